@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+'''
+FLOP rate of the CCSD(T) kernel (CCsd_t_contract without point group
+symmetry) relative to the DGEMM peak of the machine.  The blocked kernel is
+used for small nocc (c-tile > 0 in the output), the per-triple kernel
+otherwise.
+
+Random amplitudes and integrals are used.  One diagonal block of the virtual
+index a (the last ABLK virtual orbitals, paired with all c <= b <= a) is
+contracted, which is the same work unit as in cc.ccsd_t.kernel.  The FLOP
+count includes the 12 contractions of the 6 permutations of (a,b,c)
+
+        6 * 2 * nocc**3 * nvir  +  6 * 2 * nocc**4     per triple
+
+The peak is the rate of a large square DGEMM in the same process.  Memory
+requirement is about 8*(nvir*nocc)**2 bytes for t2, e.g. 1.8 GB for
+nocc=50, nvir=300 and 29 GB for nocc=100, nvir=600.
+
+Usage:
+        python ccsd_t_blocked.py [nocc nvir] ...
+'''
+
+import sys
+import time
+import ctypes
+import numpy
+from pyscf import lib
+from pyscf.cc import _ccsd
+
+SIZES = ((8, 200), (12, 300), (50, 300), (100, 600))
+ABLK = 4
+
+def dgemm_peak(n=2000):
+    a = numpy.random.random((n,n))
+    b = numpy.random.random((n,n))
+    lib.dot(a, b)
+    t0 = time.time()
+    lib.dot(a, b)
+    return 2.*n**3 / (time.time() - t0)
+
+def bench(nocc, nvir):
+    nmo = nocc + nvir
+    t1T = numpy.random.random((nvir,nocc)) - .5
+    t2T = numpy.random.random((nvir,nvir,nocc,nocc)) - .5
+    vooo = numpy.random.random((nvir,nocc,nocc,nocc)) - .5
+    fvo = numpy.random.random((nvir,nocc)) - .5
+    mo_energy = numpy.hstack((numpy.arange(nocc)*.1-3, numpy.arange(nvir)*.1+1))
+    a0, a1 = nvir - ABLK, nvir
+    cache_row_a = numpy.random.random((a1-a0,a1,nocc,nmo)) - .5
+    cache_col_a = numpy.random.random((a0,a1-a0,nocc,nmo)) - .5
+    orbsym = numpy.zeros(nmo, dtype=numpy.int32)
+    ir_loc = numpy.zeros(9, dtype=numpy.int32)
+    et = numpy.zeros(1)
+
+    t0 = time.time()
+    _ccsd.libcc.CCsd_t_contract(et.ctypes.data_as(ctypes.c_void_p),
+        mo_energy.ctypes.data_as(ctypes.c_void_p),
+        t1T.ctypes.data_as(ctypes.c_void_p),
+        t2T.ctypes.data_as(ctypes.c_void_p),
+        vooo.ctypes.data_as(ctypes.c_void_p),
+        fvo.ctypes.data_as(ctypes.c_void_p),
+        ctypes.c_int(nocc), ctypes.c_int(nvir),
+        ctypes.c_int(a0), ctypes.c_int(a1), ctypes.c_int(a0), ctypes.c_int(a1),
+        ctypes.c_int(1), ir_loc.ctypes.data_as(ctypes.c_void_p),
+        ir_loc.ctypes.data_as(ctypes.c_void_p),
+        ir_loc.ctypes.data_as(ctypes.c_void_p),
+        orbsym.ctypes.data_as(ctypes.c_void_p),
+        cache_row_a.ctypes.data_as(ctypes.c_void_p),
+        cache_col_a.ctypes.data_as(ctypes.c_void_p),
+        cache_row_a.ctypes.data_as(ctypes.c_void_p),
+        cache_col_a.ctypes.data_as(ctypes.c_void_p))
+    t = time.time() - t0
+
+    ntriples = sum(b+1 for a in range(a0, a1) for b in range(a0, a+1))
+    flops = ntriples * 12. * (nocc**3*nvir + nocc**4)
+    return ntriples, t, flops / t
+
+if __name__ == '__main__':
+    if len(sys.argv) > 2:
+        args = [int(x) for x in sys.argv[1:]]
+        sizes = list(zip(args[0::2], args[1::2]))
+    else:
+        sizes = SIZES
+    numpy.random.seed(1)
+    peak = dgemm_peak()
+    print('threads %d, DGEMM peak %.2f GFLOP/s' % (lib.num_threads(), peak*1e-9))
+    print(' nocc  nvir  c-tile  triples  time(s)  GFLOP/s  %peak')
+    for nocc, nvir in sizes:
+        ctile = _ccsd.libcc.CCsd_t_ctile(ctypes.c_int(nocc))
+        ntriples, t, rate = bench(nocc, nvir)
+        print('%5d %5d %7d %8d %8.2f %8.2f %6.1f' %
+              (nocc, nvir, ctile, ntriples, t, rate*1e-9, rate/peak*100))
@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+'''
+Timings of the permutation kernels of the CCSD(T) triples (lib/cc/ccsd_t.c)
+
+        _ccsd_t_add_permuted    w += x.transpose(perm) for the 6 permutations
+        _ccsd_t_permute_sum     4*v + v.transpose(1,2,0) + v.transpose(2,0,1)
+                                - 2*(v.transpose(2,1,0) + v.transpose(0,2,1)
+                                     + v.transpose(1,0,2))
+        _ccsd_t_zpermute_sum    the complex version of _ccsd_t_permute_sum
+
+against the gather/scatter through an index table of size nocc**3, which is
+how the permutations were applied previously.  Each kernel is called NCALL
+times for one [nocc,nocc,nocc] block.
+
+Usage:
+        python ccsd_t_permute.py [nocc] ...
+'''
+
+import sys
+import time
+import ctypes
+import numpy
+from pyscf.cc import _ccsd
+
+SIZES = (20, 40, 60, 80)
+NCALL = 20
+PERMS = ((0,1,2), (0,2,1), (1,0,2), (1,2,0), (2,0,1), (2,1,0))
+
+def timing(fn):
+    fn()
+    t0 = time.time()
+    for i in range(NCALL):
+        fn()
+    return (time.time() - t0) / NCALL
+
+def bench(n):
+    nnn = n**3
+    idx = numpy.arange(nnn).reshape(n,n,n)
+    # w.ravel()[tables[p]] += x.ravel() is _ccsd_t_add_permuted(w, x, n, p)
+    tables = [idx.transpose(p).ravel() for p in PERMS]
+    ptab = [idx.transpose(p).ravel() for p in ((1,2,0), (2,0,1), (2,1,0),
+                                                (0,2,1), (1,0,2))]
+    c_n = ctypes.c_int(n)
+    res = []
+
+    w = numpy.random.random(nnn)
+    x = numpy.random.random(nnn)
+    def add_c():
+        for p in range(6):
+            _ccsd.libcc._ccsd_t_add_permuted(w.ctypes.data_as(ctypes.c_void_p),
+                                             x.ctypes.data_as(ctypes.c_void_p),
+                                             c_n, ctypes.c_int(p))
+    def add_ref():
+        for p in range(6):
+            w[tables[p]] += x
+    res.append((timing(add_c), timing(add_ref)))
+
+    for dtype in (numpy.double, numpy.complex128):
+        v = numpy.random.random(nnn).astype(dtype)
+        out = numpy.empty_like(v)
+        if dtype == numpy.double:
+            drv = _ccsd.libcc._ccsd_t_permute_sum
+        else:
+            drv = _ccsd.libcc._ccsd_t_zpermute_sum
+        def sum_c():
+            drv(out.ctypes.data_as(ctypes.c_void_p),
+                v.ctypes.data_as(ctypes.c_void_p), c_n,
+                ctypes.c_double(4), ctypes.c_double(1), ctypes.c_double(-2))
+        def sum_ref():
+            ref = v * 4
+            ref += v[ptab[0]] + v[ptab[1]]
+            ref -= 2 * (v[ptab[2]] + v[ptab[3]] + v[ptab[4]])
+            return ref
+        sum_c()
+        assert abs(out - sum_ref()).max() < 1e-12
+        res.append((timing(sum_c), timing(sum_ref)))
+    return res
+
+if __name__ == '__main__':
+    if len(sys.argv) > 1:
+        sizes = [int(x) for x in sys.argv[1:]]
+    else:
+        sizes = SIZES
+    numpy.random.seed(1)
+    print('time per call (ms), tiled kernel / index table')
+    print(' nocc   add_permuted        permute_sum         zpermute_sum')
+    for n in sizes:
+        res = bench(n)
+        print('%5d' % n + ''.join('  %8.3f /%8.3f' % (t1*1e3, t2*1e3)
+                                  for t1, t2 in res))
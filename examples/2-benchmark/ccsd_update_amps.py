@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+'''
+Wall time and peak memory of one CCSD iteration (ccsd.update_amps) with
+incore integrals.
+
+Random MO integrals with the 8-fold permutation symmetry are used, so the
+timings do not depend on a molecule.  The peak memory is the high water mark
+of the numpy arrays allocated during update_amps (tracemalloc), on top of the
+amplitudes and integrals.  It is measured in a separate call of update_amps
+so that the tracing does not affect the wall time.  The temporary arrays of the tensor contractions
+(lib.contract) are the main part of it.
+
+Usage:
+        python ccsd_update_amps.py [nocc nvir] ...
+'''
+
+import sys
+import time
+import tracemalloc
+import numpy
+from pyscf import lib
+from pyscf import gto, scf, ao2mo
+from pyscf.cc import ccsd
+
+SIZES = ((10, 60), (15, 90), (20, 120))
+
+def make_eris(nocc, nvir):
+    nmo = nocc + nvir
+    eri = numpy.random.random((nmo*(nmo+1)//2,)*2) - .5
+    eri = ao2mo.restore(1, eri + eri.T, nmo) * .01
+    eris = ccsd._ChemistsERIs()
+    eris.nocc = nocc
+    mo_energy = numpy.hstack((numpy.arange(nocc)*.1-3, numpy.arange(nvir)*.1+1))
+    fock = (numpy.random.random((nmo,nmo)) - .5) * .01
+    eris.fock = fock + fock.T + numpy.diag(mo_energy)
+    eris.mo_energy = mo_energy
+    eris.oooo = eri[:nocc,:nocc,:nocc,:nocc].copy()
+    eris.ovoo = eri[:nocc,nocc:,:nocc,:nocc].copy()
+    eris.ovvo = eri[:nocc,nocc:,nocc:,:nocc].copy()
+    eris.ovov = eri[:nocc,nocc:,:nocc,nocc:].copy()
+    eris.oovv = eri[:nocc,:nocc,nocc:,nocc:].copy()
+    ovvv = eri[:nocc,nocc:,nocc:,nocc:].copy()
+    eris.ovvv = lib.pack_tril(ovvv.reshape(-1,nvir,nvir)).reshape(nocc,nvir,-1)
+    eris.vvvv = ao2mo.restore(4, eri[nocc:,nocc:,nocc:,nocc:], nvir)
+    return eris
+
+def bench(nocc, nvir):
+    nmo = nocc + nvir
+    mol = gto.Mole()
+    mol.verbose = 0
+    mf = scf.RHF(mol)
+    mf.mo_coeff = numpy.eye(nmo)
+    mf.mo_occ = numpy.zeros(nmo)
+    mf.mo_occ[:nocc] = 2
+    mycc = ccsd.CCSD(mf)
+    mycc.incore_complete = True
+    mycc.max_memory = 4000
+    eris = make_eris(nocc, nvir)
+    t1 = (numpy.random.random((nocc,nvir)) - .5) * .01
+    t2 = (numpy.random.random((nocc,nocc,nvir,nvir)) - .5) * .01
+    t2 = t2 + t2.transpose(1,0,3,2)
+
+    # Warm up, then time without tracemalloc which slows down the allocations
+    mycc.update_amps(t1, t2, eris)
+    t0 = time.time()
+    mycc.update_amps(t1, t2, eris)
+    t = time.time() - t0
+
+    tracemalloc.start()
+    mycc.update_amps(t1, t2, eris)
+    peak = tracemalloc.get_traced_memory()[1]
+    tracemalloc.stop()
+    return t, peak
+
+if __name__ == '__main__':
+    if len(sys.argv) > 2:
+        args = [int(x) for x in sys.argv[1:]]
+        sizes = list(zip(args[0::2], args[1::2]))
+    else:
+        sizes = SIZES
+    numpy.random.seed(1)
+    print('threads %d' % lib.num_threads())
+    print(' nocc  nvir  time(s)  peak(MB)  peak/t2')
+    for nocc, nvir in sizes:
+        t, peak = bench(nocc, nvir)
+        t2size = nocc**2*nvir**2 * 8
+        print('%5d %5d %8.3f %9.1f %8.2f' %
+              (nocc, nvir, t, peak/1e6, float(peak)/t2size))
@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+'''
+Wall time of local DF-MP2 (mp.lmp2) for hydrogen chains of growing length.
+
+The chains are H_n with the bond length 1.8 Bohr in the 6-31G basis.  The
+number of strong pairs per occupied orbital should approach a constant.  The
+setup steps (PAOs, DF half transformation, domain overlaps) work with the
+full AO and auxiliary basis.  They scale as O(N^3), so the time per occupied
+orbital still grows with the chain; mp.lmp2 is not a linear scaling
+implementation.  Set verbose to 5 to print the time of every step.
+'''
+
+import time
+from pyscf import gto, scf
+from pyscf.mp import lmp2
+
+NATOMS = (10, 20, 40, 80)
+
+def bench(natm):
+    mol = gto.M(atom=[['H', (0, 0, i*1.8)] for i in range(natm)],
+                basis='6-31g', unit='bohr', verbose=0)
+    mf = scf.RHF(mol).density_fit().run()
+    pt = lmp2.LMP2(mf)
+    t0 = time.time()
+    pt.kernel()
+    return time.time() - t0, len(pt.pairs)
+
+if __name__ == '__main__':
+    print(' natm  nocc  pairs  pairs/nocc  time(s)  time/nocc(s)')
+    for natm in NATOMS:
+        t, npair = bench(natm)
+        nocc = natm // 2
+        print('%5d %5d %6d %11.2f %8.2f %13.3f' %
+              (natm, nocc, npair, float(npair)/nocc, t, t/nocc))
@@ -0,0 +1,84 @@
+#!/usr/bin/env python
+'''
+Throughput of the multigrid collocation (rho = \sum_ij D_ij phi_i phi_j) and
+integration (V_ij = \sum_r v phi_i phi_j) kernels of libdft for each (li,lj).
+
+The shells are diffuse so that each primitive pair covers the entire mesh.
+Flops are counted with the operation count of the kernels for a pair of
+angular momentum L = li + lj (l1 = L + 1):
+    orthorhombic cell:      2 * (l1^3 nz + l1^2 ny nz + l1 nx ny nz)
+    non-orthorhombic cell:  2 * (l1 (l1+1) (l1+2) / 6 + 1) nx ny nz
+'''
+
+import time
+import numpy
+from pyscf.pbc import gto
+from pyscf.pbc.df import fft_multi_grids
+
+LMAX = 3
+MESH = [40,40,40]
+EXP = .3
+NSET = 2
+NREPEAT = 3
+
+def make_cell(a, li, lj):
+    return gto.M(a=a, atom='He 1. 1. 1.', mesh=MESH, verbose=0,
+                 basis={'He': [[li, [EXP, 1.]], [lj, [EXP, 1.]]]})
+
+def kernel_flops(cell, topl):
+    l1 = topl + 1
+    nx, ny, nz = cell.mesh
+    a = cell.lattice_vectors()
+    if numpy.allclose(a, numpy.diag(a.diagonal())):
+        return 2. * (l1**3*nz + l1**2*ny*nz + l1*nx*ny*nz)
+    else:
+        return 2. * (l1*(l1+1)*(l1+2)//6 + 1) * nx*ny*nz
+
+def bench(cell, li, lj):
+    mydf = fft_multi_grids.MultiGridFFTDF(cell)
+    meshes = numpy.asarray([cell.mesh], dtype=numpy.int32)
+    ke_cutoffs = numpy.asarray([1e9])
+    ngrids = numpy.prod(cell.mesh)
+    nao = cell.nao_nr(cart=True)
+    nfi = (li+1)*(li+2)//2
+
+    # Only the (li,lj) block of the density matrix is non-zero.  The
+    # (li,li) and (lj,lj) pairs are screened by the zero density matrix.
+    dm = numpy.zeros((NSET,nao,nao))
+    dm[:,nfi:,:nfi] = numpy.random.random((NSET,nao-nfi,nfi))
+    dm = dm + dm.transpose(0,2,1)
+    rho = numpy.zeros((NSET,ngrids))
+    t0 = time.time()
+    for i in range(NREPEAT):
+        npairs = fft_multi_grids._native_drv(
+            fft_multi_grids.libdft.NUMINT_rho_multigrid, mydf, rho, dm, NSET,
+            meshes, ke_cutoffs)
+    t_rho = (time.time() - t0) / NREPEAT
+    # Three shell pairs (li,li), (lj,li), (lj,lj) have the same number of images
+    npairs = npairs[0] // 3
+    flop_rho = kernel_flops(cell, li+lj) * npairs * NSET
+
+    v = numpy.random.random((NSET,ngrids))
+    mat = numpy.zeros((NSET,nao,nao))
+    t0 = time.time()
+    for i in range(NREPEAT):
+        fft_multi_grids._native_drv(
+            fft_multi_grids.libdft.NUMINT_vmat_multigrid, mydf, mat, v, NSET,
+            meshes, ke_cutoffs)
+    t_vmat = (time.time() - t0) / NREPEAT
+    flop_vmat = (kernel_flops(cell, li*2) + kernel_flops(cell, li+lj) +
+                 kernel_flops(cell, lj*2)) * npairs * NSET
+    return npairs, t_rho, flop_rho*1e-9/t_rho, t_vmat, flop_vmat*1e-9/t_vmat
+
+if __name__ == '__main__':
+    lattices = (('orthorhombic', numpy.eye(3)*6.),
+                ('non-orthorhombic', [[6., 0., 0.], [1.2, 5.7, 0.], [-.8, .9, 6.1]]))
+    for name, a in lattices:
+        print('%s cell, mesh %s, %d sets' % (name, MESH, NSET))
+        print(' li lj  pairs   rho(s)  GFLOP/s  vmat(s)  GFLOP/s')
+        for li in range(LMAX+1):
+            for lj in range(li+1):
+                cell = make_cell(a, li, lj)
+                npairs, t_rho, f_rho, t_vmat, f_vmat = bench(cell, li, lj)
+                print('%3d %2d %6d %8.4f %8.2f %8.4f %8.2f' %
+                      (li, lj, npairs, t_rho, f_rho, t_vmat, f_vmat))
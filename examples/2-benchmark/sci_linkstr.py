@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+'''
+Build time of the selected-CI link tables (cre_des and des) as the number
+of determinant strings grows.
+
+The strings are randomly selected from the occupation patterns of NELEC
+electrons in NORB orbitals.  The address of every string generated by the
+single and double excitations is looked up in the hash table of the string
+set.  The cost per string should stay constant when the string set grows.
+'''
+
+import time
+import numpy
+from pyscf.fci import selected_ci
+
+NORB = 40
+NELEC = 6
+NSTRS = (1000, 4000, 16000, 64000, 256000)
+
+def random_strings(nstrs, norb, nelec):
+    strs = set()
+    while len(strs) < nstrs:
+        occ = numpy.random.permutation(norb)[:nelec]
+        strs.add(int(numpy.sum(numpy.left_shift(1, occ, dtype=numpy.int64))))
+    return numpy.asarray(sorted(strs), dtype=numpy.int64)
+
+def bench(strs):
+    t0 = time.time()
+    selected_ci.cre_des_linkstr(strs, NORB, NELEC)
+    t_cre_des = time.time() - t0
+
+    t0 = time.time()
+    selected_ci.gen_des_linkstr(strs, NORB, NELEC)
+    t_des = time.time() - t0
+    return t_cre_des, t_des
+
+if __name__ == '__main__':
+    numpy.random.seed(1)
+    print('norb %d, nelec %d' % (NORB, NELEC))
+    print('  nstrs  cre_des(s)  us/str      des(s)  us/str')
+    for nstrs in NSTRS:
+        strs = random_strings(nstrs, NORB, NELEC)
+        t_cre_des, t_des = bench(strs)
+        print('%7d %11.4f %7.2f %11.4f %7.2f' %
+              (nstrs, t_cre_des, t_cre_des/nstrs*1e6,
+               t_des, t_des/nstrs*1e6))
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+
+'''
+(T) correction computed by several MPI processes.  mpi4py is required.  Every
+process runs the same script
+
+        mpirun -np 4 python 16-mpi_ccsd_t.py
+
+HF and CCSD are computed on every process.  The triples are divided into
+blocks which are distributed over the processes.
+'''
+
+from mpi4py import MPI
+from pyscf import gto, scf, cc
+from pyscf.cc import mpi_ccsd_t
+
+comm = MPI.COMM_WORLD
+
+mol = gto.M(atom='''
+O    0.    0.      0.
+H    0.    -0.757  0.587
+H    0.    0.757   0.587''',
+            basis='ccpvdz',
+            verbose=4 if comm.rank == 0 else 0)
+
+mf = scf.RHF(mol).run()
+mycc = cc.CCSD(mf).run()
+#
+# Cost-balanced static partition of the blocks
+#
+et = mpi_ccsd_t.kernel(mycc, mycc.ao2mo())
+#
+# Rank 0 hands out the blocks on request
+#
+et = mpi_ccsd_t.kernel(mycc, mycc.ao2mo(), dynamic=True)
+
+mf = scf.UHF(mol).run()
+mycc = cc.UCCSD(mf).run()
+et = mpi_ccsd_t.kernel(mycc, mycc.ao2mo())
+if comm.rank == 0:
+    print('UCCSD(T) correction', et)
@@ -84,6 +84,8 @@ def kernel(mycc, eris=None, t1=None, t2=None, max_cycle=50, tol=1e-8,
         if abs(eccsd-eold) < tol and normt < tolnormt:
             conv = True
             break
+    if adiis is not None:
+        adiis.flush()
     log.timer('CCSD', *cput0)
     return conv, eccsd, t1, t2
 
@@ -172,7 +174,7 @@ def update_amps(mycc, t1, t2, eris):
 
         tmp  = lib.einsum('ic,kjbc->ibkj', t1, eris_oovv)
         tmp += lib.einsum('bjkc,ic->jbki', eris_voov, t1)
-        t2new[:,:,p0:p1] -= lib.einsum('ka,jbki->jiba', t1, tmp)
+        lib.contract('ka,jbki->jiba', t1, tmp, -1, 1, out=t2new[:,:,p0:p1])
         eris_oovv = tmp = None
 
         fov[:,p0:p1] += numpy.einsum('kc,aikc->ia', t1, eris_voov) * 2
@@ -182,16 +184,18 @@ def update_amps(mycc, t1, t2, eris):
         tau += t2[:,:,p0:p1]
         theta  = tau.transpose(1,0,2,3) * 2
         theta -= tau
-        fvv -= lib.einsum('cjia,cjib->ab', theta.transpose(2,1,0,3), eris_voov)
-        foo += lib.einsum('aikb,kjab->ij', eris_voov, theta)
+        lib.contract('cjia,cjib->ab', theta.transpose(2,1,0,3), eris_voov,
+                     -1, 1, out=fvv)
+        lib.contract('aikb,kjab->ij', eris_voov, theta, 1, 1, out=foo)
         tau = theta = None
 
         tau = t2[:,:,p0:p1] + numpy.einsum('ia,jb->ijab', t1[:,p0:p1], t1)
-        woooo += lib.einsum('ijab,aklb->ijkl', tau, eris_voov)
+        lib.contract('ijab,aklb->ijkl', tau, eris_voov, 1, 1, out=woooo)
         tau = None
 
         def update_wVooV(q0, q1, tau):
-            wVooV[:] += lib.einsum('bkic,jkca->bija', eris_voov[:,:,:,q0:q1], tau)
+            lib.contract('bkic,jkca->bija', eris_voov[:,:,:,q0:q1], tau,
+                         1, 1, out=wVooV)
         with lib.call_in_background(update_wVooV) as update_wVooV:
             for q0, q1 in lib.prange(0, nvir, blksize):
                 tau  = t2[:,:,q0:q1] * .5
@@ -217,7 +221,8 @@ def update_amps(mycc, t1, t2, eris):
         eris_VOov += eris_voov
         eris_voov = None
         def update_wVOov(q0, q1, tau):
-            wVOov[:,:,:,q0:q1] += .5 * lib.einsum('aikc,kcjb->aijb', eris_VOov, tau)
+            lib.contract('aikc,kcjb->aijb', eris_VOov, tau, .5, 1,
+                         out=wVOov[:,:,:,q0:q1])
         with lib.call_in_background(update_wVOov) as update_wVOov:
             for q0, q1 in lib.prange(0, nvir, blksize):
                 tau  = t2[:,:,q0:q1].transpose(1,3,0,2) * 2
@@ -227,7 +232,8 @@ def update_amps(mycc, t1, t2, eris):
                 update_wVOov(q0, q1, tau)
                 tau = None
         def update_t2(q0, q1, theta):
-            t2new[:,:,q0:q1] += lib.einsum('kica,ckjb->ijab', theta, wVOov)
+            lib.contract('kica,ckjb->ijab', theta, wVOov, 1, 1,
+                         out=t2new[:,:,q0:q1])
         with lib.call_in_background(update_t2) as update_t2:
             for q0, q1 in lib.prange(0, nvir, blksize):
                 theta  = t2[:,:,p0:p1,q0:q1] * 2
@@ -242,17 +248,17 @@ def update_amps(mycc, t1, t2, eris):
     for p0, p1 in lib.prange(0, nvir, blksize):
         theta = t2[:,:,p0:p1].transpose(1,0,2,3) * 2 - t2[:,:,p0:p1]
         t1new += numpy.einsum('jb,ijba->ia', fov[:,p0:p1], theta)
-        t1new -= lib.einsum('jbki,kjba->ia', eris.ovoo[:,p0:p1], theta)
+        lib.contract('jbki,kjba->ia', eris.ovoo[:,p0:p1], theta, -1, 1, out=t1new)
 
         tau = numpy.einsum('ia,jb->ijab', t1[:,p0:p1], t1)
         tau += t2[:,:,p0:p1]
-        t2new[:,:,p0:p1] += .5 * lib.einsum('ijkl,klab->ijab', woooo, tau)
+        lib.contract('ijkl,klab->ijab', woooo, tau, .5, 1, out=t2new[:,:,p0:p1])
         theta = tau = None
 
     ft_ij = foo + numpy.einsum('ja,ia->ij', .5*t1, fov)
     ft_ab = fvv - numpy.einsum('ia,ib->ab', .5*t1, fov)
-    t2new += lib.einsum('ijac,bc->ijab', t2, ft_ab)
-    t2new -= lib.einsum('ki,kjab->ijab', ft_ij, t2)
+    lib.contract('ijac,bc->ijab', t2, ft_ab, 1, 1, out=t2new)
+    lib.contract('ki,kjab->ijab', ft_ij, t2, -1, 1, out=t2new)
 
     mo_e = fock.diagonal()
     eia = mo_e[:nocc,None] - mo_e[None,nocc:]
@@ -316,7 +322,7 @@ def _add_ovvv_(mycc, t1, t2, eris, fvv, t1new, t2new, fswap):
                 for i in range(nocc):
                     tau = t2[i,:,p0:p1] + numpy.einsum('a,jb->jab', t1[i,p0:p1], t1)
                     tmp = lib.einsum('jcd,cdbk->jbk', tau, vvvo)
-                    t2new[i] -= lib.einsum('ka,jbk->jab', t1, tmp)
+                    lib.contract('ka,jbk->jab', t1, tmp, -1, 1, out=t2new[i])
                     tau = tmp = None
                 eris_vvvo = None
 
@@ -324,7 +330,7 @@ def _add_ovvv_(mycc, t1, t2, eris, fvv, t1new, t2new, fswap):
 
             theta = t2[:,:,p0:p1].transpose(1,2,0,3) * 2
             theta -= t2[:,:,p0:p1].transpose(0,2,1,3)
-            t1new += lib.einsum('icjb,cjba->ia', theta, eris_vovv)
+            lib.contract('icjb,cjba->ia', theta, eris_vovv, 1, 1, out=t1new)
             theta = None
             time1 = log.timer_debug1('vovv [%d:%d]'%(p0, p1), *time1)
 
@@ -342,6 +348,9 @@ def _add_ovvv_(mycc, t1, t2, eris, fvv, t1new, t2new, fswap):
 def _add_vvvv(mycc, t1, t2, eris, out=None, with_ovvv=None, t2sym=None):
     '''t2sym: whether t2 has the symmetry t2[ijab]==t2[jiba] or
     t2[ijab]==-t2[jiab] or t2[ijab]==-t2[jiba]
+
+    If t1 is None, t2 can be a block of amplitudes (nvec,nocc,nocc,nvir,nvir).
+    The integrals are read once and contracted with all amplitudes.
     '''
     #TODO: Guess the symmetry of t2 amplitudes
     #if t2sym is None:
@@ -356,7 +365,8 @@ def _add_vvvv(mycc, t1, t2, eris, out=None, with_ovvv=None, t2sym=None):
 
     if t2sym in ('jiba', '-jiba', '-jiab'):
         Ht2tril = _add_vvvv_tril(mycc, t1, t2, eris, with_ovvv=with_ovvv)
-        nocc, nvir = t2.shape[1:3]
+        nocc, nvir = t2.shape[-3:-1]
+        Ht2tril = Ht2tril.reshape(t2.shape[:-4]+(-1,nvir,nvir))
         Ht2 = _unpack_t2_tril(Ht2tril, nocc, nvir, out, t2sym)
     else:
         Ht2 = _add_vvvv_full(mycc, t1, t2, eris, out, with_ovvv)
@@ -371,10 +381,12 @@ def _add_vvvv_tril(mycc, t1, t2, eris, out=None, with_ovvv=None):
     log = logger.Logger(mycc.stdout, mycc.verbose)
     if with_ovvv is None:
         with_ovvv = mycc.direct
-    nocc, nvir = t2.shape[1:3]
+    nocc, nvir = t2.shape[-3:-1]
     nocc2 = nocc*(nocc+1)//2
     if t1 is None:
-        tau = t2[numpy.tril_indices(nocc)]
+        otril = numpy.tril_indices(nocc)
+        tau = t2[...,otril[0],otril[1],:,:].reshape(-1,nvir,nvir)
+        nocc2 = tau.shape[0]
     else:
         tau = numpy.empty((nocc2,nvir,nvir), dtype=t2.dtype)
         p1 = 0
@@ -433,15 +445,15 @@ def _add_vvvv_full(mycc, t1, t2, eris, out=None, with_ovvv=False):
         mo = getattr(eris, 'mo_coeff', None)
         if mo is None:  # If eris does not have the attribute mo_coeff
             mo = _mo_without_core(mycc, mycc.mo_coeff)
-        nocc, nvir = t2.shape[1:3]
+        nocc, nvir = t2.shape[-3:-1]
         nao, nmo = mo.shape
         aos = numpy.asarray(mo[:,nocc:].T, order='F')
-        tau = _ao2mo.nr_e2(tau.reshape(nocc**2,nvir,nvir), aos, (0,nao,0,nao), 's1', 's1')
-        tau = tau.reshape(nocc,nocc,nao,nao)
+        tau = _ao2mo.nr_e2(tau.reshape(-1,nvir,nvir), aos, (0,nao,0,nao), 's1', 's1')
+        tau = tau.reshape(t2.shape[:-2]+(nao,nao))
         time0 = log.timer_debug1('vvvv-tau mo2ao', *time0)
 
         buf = eris._contract_vvvv_t2(mycc, tau, mycc.direct, out, log)
-        buf = buf.reshape(nocc**2,nao,nao)
+        buf = buf.reshape(-1,nao,nao)
         Ht2 = _ao2mo.nr_e2(buf, mo.conj(), (nocc,nmo,nocc,nmo), 's1', 's1')
     else:
         assert(not with_ovvv)
@@ -509,44 +521,36 @@ def _contract_s4vvvv_t2(mycc, mol, vvvv, t2, out=None, verbose=None):
         intor = mol._add_suffix('int2e')
         ao2mopt = _ao2mo.AO2MOpt(mol, intor, 'CVHFnr_schwarz_cond',
                                  'CVHFsetnr_direct_scf')
-        blksize = max(BLKMIN, numpy.sqrt(max_memory*.9e6/8/nvirb**2/2.5))
-        blksize = int(min((nvira+3)/4, blksize))
-        sh_ranges = ao2mo.outcore.balance_partition(ao_loc, blksize)
-        blksize = max(x[2] for x in sh_ranges)
-        eribuf = numpy.empty((blksize,blksize,nvirb,nvirb))
-        loadbuf = numpy.empty((blksize,blksize,nvirb,nvirb))
-        fint = gto.moleintor.getints4c
-
-        for ip, (ish0, ish1, ni) in enumerate(sh_ranges):
-            for jsh0, jsh1, nj in sh_ranges[:ip]:
-                eri = fint(intor, mol._atm, mol._bas, mol._env,
-                           shls_slice=(ish0,ish1,jsh0,jsh1), aosym='s2kl',
-                           ao_loc=ao_loc, cintopt=ao2mopt._cintopt, out=eribuf)
-                i0, i1 = ao_loc[ish0], ao_loc[ish1]
-                j0, j1 = ao_loc[jsh0], ao_loc[jsh1]
-                tmp = numpy.ndarray((i1-i0,nvirb,j1-j0,nvirb), buffer=loadbuf)
-                _ccsd.libcc.CCload_eri(tmp.ctypes.data_as(ctypes.c_void_p),
-                                       eri.ctypes.data_as(ctypes.c_void_p),
-                                       (ctypes.c_int*4)(i0, i1, j0, j1),
-                                       ctypes.c_int(nvirb))
-                contract_blk_(tmp, i0, i1, j0, j1)
-                time0 = log.timer_debug1('AO-vvvv [%d:%d,%d:%d]' %
-                                         (ish0,ish1,jsh0,jsh1), *time0)
-
-            eri = fint(intor, mol._atm, mol._bas, mol._env,
-                       shls_slice=(ish0,ish1,ish0,ish1), aosym='s4',
-                       ao_loc=ao_loc, cintopt=ao2mopt._cintopt, out=eribuf)
-            i0, i1 = ao_loc[ish0], ao_loc[ish1]
-            eri = lib.unpack_tril(eri, axis=0)
-            tmp = numpy.ndarray((i1-i0,nvirb,i1-i0,nvirb), buffer=loadbuf)
-            _ccsd.libcc.CCload_eri(tmp.ctypes.data_as(ctypes.c_void_p),
-                                   eri.ctypes.data_as(ctypes.c_void_p),
-                                   (ctypes.c_int*4)(i0, i1, i0, i1),
-                                   ctypes.c_int(nvirb))
-            eri = None
-            contract_blk_(tmp, i0, i1, i0, i1)
-            time0 = log.timer_debug1('AO-vvvv [%d:%d,%d:%d]' %
-                                     (ish0,ish1,ish0,ish1), *time0)
+        # Each thread holds the integrals (ac|bd) for one shell of a, blksize
+        # AOs of c and all bd, and the partial sums Ht2[:,a] and Ht2[:,c].
+        # A batch of c has at least one shell.  If even that does not fit in
+        # max_memory, fewer threads are used.
+        dmax = max(ao_loc[1:] - ao_loc[:-1])
+        nthreads = lib.num_threads()
+        unit = dmax*nvirb**2 + nocc2*nvirb
+        fixed = nocc2*dmax*nvirb + dmax**4
+        blksize = (max_memory*.9e6/8/nthreads - fixed) / unit
+        if blksize < dmax:
+            blksize = dmax
+            nthreads = max(1, int(max_memory*.9e6/8/(fixed+dmax*unit)))
+            nthreads = min(nthreads, lib.num_threads())
+            if (fixed+dmax*unit)*8e-6 > max_memory:
+                log.warn('Not enough memory for AO-direct vvvv contraction. '
+                         '%.0f MB is required', (fixed+dmax*unit)*8e-6)
+        blksize = int(min(nvira, blksize))
+        log.debug1('AO-vvvv blksize %d  nthreads %d', blksize, nthreads)
+        x2 = numpy.asarray(x2, order='C')
+        with lib.with_omp_threads(nthreads):
+            _ccsd.libcc.CCvvvv_ao_direct(
+                Ht2.ctypes.data_as(ctypes.c_void_p),
+                x2.ctypes.data_as(ctypes.c_void_p),
+                ctypes.c_int(nocc2), ctypes.c_int(blksize),
+                getattr(_ao2mo.libao2mo, intor), ao2mopt._this, ao2mopt._cintopt,
+                ao_loc.ctypes.data_as(ctypes.c_void_p),
+                mol._atm.ctypes.data_as(ctypes.c_void_p), ctypes.c_int(mol.natm),
+                mol._bas.ctypes.data_as(ctypes.c_void_p), ctypes.c_int(mol.nbas),
+                mol._env.ctypes.data_as(ctypes.c_void_p))
+        time0 = log.timer_debug1('AO-vvvv', *time0)
 
     else:
         nvir_pair = nvirb * (nvirb+1) // 2
@@ -608,18 +612,19 @@ def _contract_s1vvvv_t2(mycc, mol, vvvv, t2, out=None, verbose=None):
     return Ht2.reshape(t2.shape)
 
 def _unpack_t2_tril(t2tril, nocc, nvir, out=None, t2sym='jiba'):
-    t2 = numpy.ndarray((nocc,nocc,nvir,nvir), dtype=t2tril.dtype, buffer=out)
+    t2 = numpy.ndarray(t2tril.shape[:-3]+(nocc,nocc,nvir,nvir),
+                       dtype=t2tril.dtype, buffer=out)
     idx,idy = numpy.tril_indices(nocc)
     if t2sym == 'jiba':
-        t2[idy,idx] = t2tril.transpose(0,2,1)
-        t2[idx,idy] = t2tril
+        t2[...,idy,idx,:,:] = t2tril.swapaxes(-1,-2)
+        t2[...,idx,idy,:,:] = t2tril
     elif t2sym == '-jiba':
-        t2[idy,idx] = -t2tril.transpose(0,2,1)
-        t2[idx,idy] = t2tril
+        t2[...,idy,idx,:,:] = -t2tril.swapaxes(-1,-2)
+        t2[...,idx,idy,:,:] = t2tril
     elif t2sym == '-jiab':
-        t2[idy,idx] =-t2tril
-        t2[idx,idy] = t2tril
-        t2[numpy.diag_indices(nocc)] = 0
+        t2[...,idy,idx,:,:] =-t2tril
+        t2[...,idx,idy,:,:] = t2tril
+        t2[...,numpy.arange(nocc),numpy.arange(nocc),:,:] = 0
     return t2
 
 def _unpack_4fold(c2vec, nocc, nvir, anti_symm=True):
@@ -705,6 +710,7 @@ def restore_from_diis_(mycc, diis_file, inplace=True):
     and error vector will be reused in the CCSD calculation.
     '''
     adiis = lib.diis.DIIS(mycc, mycc.diis_file, incore=mycc.incore_complete)
+    adiis.space = mycc.diis_space
     adiis.restore(diis_file, inplace=inplace)
 
     ccvec = adiis.extrapolate()
@@ -72,6 +72,8 @@ def kernel(mycc, eris=None, t1=None, t2=None, l1=None, l2=None,
         if normt < tol:
             conv = True
             break
+    if adiis is not None:
+        adiis.flush()
     return conv, l1, l2
 
 
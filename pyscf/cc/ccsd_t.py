@@ -32,7 +32,17 @@ from pyscf.cc import _ccsd
 # t3 as ijkabc
 
 # JCP, 94, 442.  Error in Eq (1), should be [ia] >= [jb] >= [kc]
-def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
+def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE,
+           task_scheduler=None):
+    '''CCSD(T) correction
+
+    Kwargs:
+        task_scheduler : callable
+            task_scheduler(tasks, costs) returns the (a0,a1,b0,b1) blocks to
+            be computed by this process and task_scheduler.allreduce(et_sum)
+            sums the energies of all processes (see cc.mpi_ccsd_t).  By
+            default, all blocks are computed.
+    '''
     cpu1 = cpu0 = (time.clock(), time.time())
     log = logger.new_logger(mycc, verbose)
     if t1 is None: t1 = mycc.t1
@@ -98,31 +108,25 @@ def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
     # The rest 20% memory for cache b
     mem_now = lib.current_memory()[0]
     max_memory = max(0, mycc.max_memory - mem_now)
-    bufsize = (max_memory*.5e6/8-nocc**3*3*lib.num_threads())/(nocc*nmo)  #*.5 for async_io
+    ctile = _ccsd.libcc.CCsd_t_ctile(ctypes.c_int(nocc))
+    if nirrep == 1 and dtype != numpy.complex and ctile > 0:
+        # work space of the blocked kernel for a tile of c
+        thread_buf = nocc**3*(ctile*8+3) + ctile*nocc*2*nmo + nocc*2*nvir
+    else:
+        thread_buf = nocc**3*3
+    bufsize = (max_memory*.5e6/8-thread_buf*lib.num_threads())/(nocc*nmo)  #*.5 for async_io
     bufsize *= .5  #*.5 upper triangular part is loaded
     bufsize *= .8  #*.8 for [a0:a1]/[b0:b1] partition
     bufsize = max(8, bufsize)
     log.debug('max_memory %d MB (%d MB in use)', max_memory, mem_now)
-    with lib.call_in_background(contract, sync=not mycc.async_io) as async_contract:
-        for a0, a1 in reversed(list(lib.prange_tril(0, nvir, bufsize))):
-            cache_row_a = numpy.asarray(eris_vvop[a0:a1,:a1], order='C')
-            if a0 == 0:
-                cache_col_a = cache_row_a
-            else:
-                cache_col_a = numpy.asarray(eris_vvop[:a0,a0:a1], order='C')
-            async_contract(a0, a1, a0, a1, (cache_row_a,cache_col_a,
-                                            cache_row_a,cache_col_a))
-
-            for b0, b1 in lib.prange_tril(0, a0, bufsize/8):
-                cache_row_b = numpy.asarray(eris_vvop[b0:b1,:b1], order='C')
-                if b0 == 0:
-                    cache_col_b = cache_row_b
-                else:
-                    cache_col_b = numpy.asarray(eris_vvop[:b0,b0:b1], order='C')
-                async_contract(a0, a1, b0, b1, (cache_row_a,cache_col_a,
-                                                cache_row_b,cache_col_b))
+    tasks = _tril_tasks(nvir, bufsize)
+    if task_scheduler is not None:
+        tasks = task_scheduler(tasks, [_task_cost(*x) for x in tasks])
+    _contract_tril_tasks(contract, eris_vvop, tasks, mycc.async_io)
 
     t2 = restore_t2_inplace(t2T)
+    if task_scheduler is not None:
+        et_sum = task_scheduler.allreduce(et_sum)
     et_sum *= 2
     if abs(et_sum[0].imag) > 1e-4:
         logger.warn(mycc, 'Non-zero imaginary part of CCSD(T) energy was found %s',
@@ -132,6 +136,45 @@ def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
     log.note('CCSD(T) correction = %.15g', et)
     return et
 
+def _tril_tasks(nvir, bufsize):
+    '''Blocks (a0,a1,b0,b1) of the triples c <= b <= a'''
+    tasks = []
+    for a0, a1 in reversed(list(lib.prange_tril(0, nvir, bufsize))):
+        tasks.append((a0, a1, a0, a1))
+        for b0, b1 in lib.prange_tril(0, a0, bufsize/8):
+            tasks.append((a0, a1, b0, b1))
+    return tasks
+
+def _task_cost(a0, a1, b0, b1):
+    '''Number of the triples c <= b <= a in the block (a0,a1,b0,b1)'''
+    if a0 == b0:
+        return sum((b+1)*(a1-b) for b in range(a0, a1))
+    else:
+        return (a1-a0) * (b1-b0) * (b0+b1+1) // 2
+
+def _load_tril_cache(eris_vvop, a0, a1):
+    cache_row = numpy.asarray(eris_vvop[a0:a1,:a1], order='C')
+    if a0 == 0:
+        cache_col = cache_row
+    else:
+        cache_col = numpy.asarray(eris_vvop[:a0,a0:a1], order='C')
+    return cache_row, cache_col
+
+def _contract_tril_tasks(contract, eris_vvop, tasks, async_io=True):
+    '''Call contract(a0, a1, b0, b1, cache) for the blocks in tasks.  The
+    cache of block a is reused by the consecutive tasks of the same a0:a1.'''
+    with lib.call_in_background(contract, sync=not async_io) as async_contract:
+        a_block = None
+        for a0, a1, b0, b1 in tasks:
+            if a_block != (a0, a1):
+                a_block = (a0, a1)
+                cache_a = _load_tril_cache(eris_vvop, a0, a1)
+            if b0 == a0:
+                cache_b = cache_a
+            else:
+                cache_b = _load_tril_cache(eris_vvop, b0, b1)
+            async_contract(a0, a1, b0, b1, cache_a + cache_b)
+
 def _sort_eri(mycc, eris, nocc, nvir, vvop, log):
     cpu1 = (time.clock(), time.time())
     mol = mycc.mol
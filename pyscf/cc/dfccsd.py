@@ -47,66 +47,51 @@ class RCCSD(ccsd.CCSD):
 def _contract_vvvv_t2(mycc, mol, vvL, t2, out=None, verbose=None):
     '''Ht2 = numpy.einsum('ijcd,acdb->ijab', t2, vvvv)
 
-    Args:
-        vvvv : None or integral object
-            if vvvv is None, contract t2 to AO-integrals using AO-direct algorithm
+    The integrals (ac|bd) are not stored.  Tiles of (ac|bd) are assembled
+    from the 3-index tensor vvL = (L|bd) and contracted with t2 immediately
+    in CCvvvv_df_contract.  vvL is read from disk once for each block of a.
     '''
-    _dgemm = lib.numpy_helper._dgemm
     time0 = time.clock(), time.time()
     log = logger.new_logger(mol, verbose)
 
     naux = vvL.shape[-1]
     nvira, nvirb = t2.shape[-2:]
-    x2 = t2.reshape(-1,nvira,nvirb)
+    x2 = numpy.asarray(t2.reshape(-1,nvira,nvirb), order='C')
     nocc2 = x2.shape[0]
-    nvir2 = nvira * nvirb
     Ht2 = numpy.ndarray(x2.shape, buffer=out)
     Ht2[:] = 0
 
     max_memory = max(MEMORYMIN, mycc.max_memory - lib.current_memory()[0])
-    def contract_blk_(eri, i0, i1, j0, j1):
-        ic = i1 - i0
-        jc = j1 - j0
-        #:Ht2[:,j0:j1] += numpy.einsum('xef,efab->xab', x2[:,i0:i1], eri)
-        _dgemm('N', 'N', nocc2, jc*nvirb, ic*nvirb,
-               x2.reshape(-1,nvir2), eri.reshape(-1,jc*nvirb),
-               Ht2.reshape(-1,nvir2), 1, 1, i0*nvirb, 0, j0*nvirb)
-
-        if i0 > j0:
-            #:Ht2[:,i0:i1] += numpy.einsum('xef,abef->xab', x2[:,j0:j1], eri)
-            _dgemm('N', 'T', nocc2, ic*nvirb, jc*nvirb,
-                   x2.reshape(-1,nvir2), eri.reshape(-1,jc*nvirb),
-                   Ht2.reshape(-1,nvir2), 1, 1, j0*nvirb, 0, i0*nvirb)
-
-#TODO: check if vvL can be entirely loaded into memory
-    nvir_pair = nvirb * (nvirb+1) // 2
-    dmax = numpy.sqrt(max_memory*.7e6/8/nvirb**2/2)
-    dmax = int(min((nvira+3)//4, max(ccsd.BLKMIN, dmax)))
-    vvblk = (max_memory*1e6/8 - dmax**2*(nvirb**2*1.5+naux))/naux
-    vvblk = int(min((nvira+3)//4, max(ccsd.BLKMIN, vvblk/naux)))
-    eribuf = numpy.empty((dmax,dmax,nvir_pair))
-    loadbuf = numpy.empty((dmax,dmax,nvirb,nvirb))
+    bblk = max_memory*.2e6/8/(nvirb*naux)
+    bblk = int(min(nvirb, max(ccsd.BLKMIN, bblk)))
+    dmax = min(max_memory*.3e6/8/(nvira*naux),
+               numpy.sqrt(max_memory*.3e6/8/(bblk*nvirb)))
+    dmax = int(min(nvira, max(ccsd.BLKMIN, dmax)))
+    log.debug1('max_memory %d MB,  vvvv blocks: a %d  b %d',
+               max_memory, dmax, bblk)
     tril2sq = lib.square_mat_in_trilu_indices(nvira)
 
     for i0, i1 in lib.prange(0, nvira, dmax):
         off0 = i0*(i0+1)//2
         off1 = i1*(i1+1)//2
         vvL0 = _cp(vvL[off0:off1])
-        for j0, j1 in lib.prange(0, i1, dmax):
-            ijL = vvL0[tril2sq[i0:i1,j0:j1] - off0].reshape(-1,naux)
-            eri = numpy.ndarray(((i1-i0)*(j1-j0),nvir_pair), buffer=eribuf)
-            for p0, p1 in lib.prange(0, nvir_pair, vvblk):
-                vvL1 = _cp(vvL[p0:p1])
-                eri[:,p0:p1] = lib.ddot(ijL, vvL1.T)
-                vvL1 = None
-
-            tmp = numpy.ndarray((i1-i0,nvirb,j1-j0,nvirb), buffer=loadbuf)
-            _ccsd.libcc.CCload_eri(tmp.ctypes.data_as(ctypes.c_void_p),
-                                   eri.ctypes.data_as(ctypes.c_void_p),
-                                   (ctypes.c_int*4)(i0, i1, j0, j1),
-                                   ctypes.c_int(nvirb))
-            contract_blk_(tmp, i0, i1, j0, j1)
-            time0 = log.timer_debug1('vvvv [%d:%d,%d:%d]'%(i0,i1,j0,j1), *time0)
+        for b0, b1 in lib.prange(0, nvirb, bblk):
+            bdL = _cp(vvL[b0*(b0+1)//2:b1*(b1+1)//2])
+            for j0, j1 in lib.prange(0, i1, dmax):
+                ijL = vvL0[tril2sq[i0:i1,j0:j1] - off0].reshape(-1,naux)
+                _ccsd.libcc.CCvvvv_df_contract(
+                    Ht2.ctypes.data_as(ctypes.c_void_p),
+                    x2.ctypes.data_as(ctypes.c_void_p),
+                    ijL.ctypes.data_as(ctypes.c_void_p),
+                    bdL.ctypes.data_as(ctypes.c_void_p),
+                    ctypes.c_int(nocc2), ctypes.c_int(nvirb),
+                    ctypes.c_int(naux),
+                    ctypes.c_int(i0), ctypes.c_int(i1),
+                    ctypes.c_int(j0), ctypes.c_int(j1),
+                    ctypes.c_int(b0), ctypes.c_int(b1))
+            bdL = None
+        vvL0 = None
+        time0 = log.timer_debug1('vvvv [%d:%d]'%(i0,i1), *time0)
     return Ht2.reshape(t2.shape)
 
 
@@ -171,19 +156,72 @@ def _make_df_eris(cc, mo_coeff=None):
     eris.oovv[:] = lib.unpack_tril(oovv_tril).reshape(nocc,nocc,nvir,nvir)
     oovv_tril = Loo = None
 
-    Lov = Lov.reshape(naux,nocc,nvir)
-    vblk = max(nocc, int((max_memory*.15e6/8)/(nocc*nvir_pair)))
-    vvblk = min(nvir_pair, max(4, int((max_memory*.8e6/8)/(vblk*nocc+naux))))
-    eris.ovvv = eris.feri.create_dataset('ovvv', (nocc,nvir,nvir_pair), 'f8',
-                                         chunks=(nocc,1,vvblk))
-    for q0, q1 in lib.prange(0, nvir_pair, vvblk):
-        vvL = _cp(eris.vvL[q0:q1])
-        for p0, p1 in lib.prange(0, nvir, vblk):
-            tmpLov = _cp(Lov[:,:,p0:p1]).reshape(naux,-1)
-            eris.ovvv[:,p0:p1,q0:q1] = lib.ddot(tmpLov.T, vvL.T).reshape(nocc,p1-p0,q1-q0)
-        vvL = None
+    # ovvv is not stored.  Its blocks are computed from (L|ov) and (L|vv) when
+    # they are accessed.
+    eris.ovL = eris.feri.create_dataset('ovL', (nocc,nvir,naux), 'f8')
+    eris.ovL[:] = Lov.T.reshape(nocc,nvir,naux)
+    eris.ovvv = _DFovvv(eris.ovL, eris.vvL, cc.max_memory)
     return eris
 
+class _DFovvv(object):
+    '''ovvv[i,a,bc] = (ia|bc) in the lower triangular storage of bc.  The
+    requested block is computed from the 3-index tensors ovL and vvL.  It can
+    be sliced like the ovvv dataset of ccsd._ChemistsERIs, e.g. ovvv[:,p0:p1].
+    Integer (including negative) indices and slices of step 1 are supported.
+
+    Nothing is cached.  Every access computes the block with a GEMM of
+    o*v*(v*(v+1)/2)*naux for the full block and reads vvL from disk again.
+    ccsd._add_ovvv_ loops over ovvv in each CCSD iteration, so this cost is
+    paid once per iteration.
+    '''
+    def __init__(self, ovL, vvL, max_memory=MEMORYMIN):
+        self.ovL = ovL
+        self.vvL = vvL
+        self.max_memory = max_memory
+        nocc, nvir, naux = ovL.shape
+        self.shape = (nocc, nvir, vvL.shape[0])
+        self.dtype = numpy.dtype(numpy.double)
+
+    def __getitem__(self, slices):
+        if not isinstance(slices, tuple):
+            slices = (slices,)
+        if len(slices) > 3:
+            raise IndexError('too many indices for ovvv')
+        slices = slices + (slice(None),) * (3 - len(slices))
+        s0, s1, s2 = [_as_slice(s, n) for s, n in zip(slices, self.shape)]
+        ovL = _cp(self.ovL[s0,s1])
+        nocc, nvir, naux = ovL.shape
+        q0, q1 = s2.start, s2.stop
+        out = numpy.empty((nocc*nvir,q1-q0))
+        max_memory = max(MEMORYMIN, self.max_memory - lib.current_memory()[0])
+        blksize = int(max(ccsd.BLKMIN, max_memory*.3e6/8/naux))
+        for p0, p1 in lib.prange(q0, q1, blksize):
+            out[:,p0-q0:p1-q0] = lib.ddot(ovL.reshape(-1,naux),
+                                          _cp(self.vvL[p0:p1]).T)
+        out = out.reshape(nocc,nvir,q1-q0)
+        # Drop the axes which are indexed by integers
+        return out[tuple(slice(None) if isinstance(s, slice) else 0
+                         for s in slices)]
+
+    def __array__(self, dtype=None):
+        return self[:]
+
+def _as_slice(s, n):
+    '''Convert an index of an axis of length n to slice(start, stop) with
+    0 <= start <= stop <= n'''
+    if isinstance(s, slice):
+        start, stop, step = s.indices(n)
+        if step != 1:
+            raise IndexError('ovvv does not support slices with step %s' % s.step)
+        return slice(start, max(start, stop))
+    else:
+        i = int(s)
+        if i < 0:
+            i += n
+        if not 0 <= i < n:
+            raise IndexError('index %s is out of bounds for axis with size %d' % (s, n))
+        return slice(i, i+1)
+
 def _cp(a):
     return numpy.array(a, copy=False, order='C')
 
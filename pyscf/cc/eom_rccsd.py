@@ -867,19 +867,32 @@ def vector_to_amplitudes_triplet(vector, nmo, nocc):
     return t1, (t2aa, t2ab)
 
 def eeccsd_matvec_singlet(eom, vector, imds=None):
+    '''EOM-EE-CCSD singlet sigma vector.
+
+    vector can be one trial vector or a block of trial vectors (nvec,size).
+    For a block, the integrals (vvvv, ovvv, ovov) and the intermediates saved
+    on disk are read once and contracted with all vectors together.
+    '''
     if imds is None: imds = eom.make_imds()
+    vector = np.asarray(vector)
+    if vector.ndim == 1:
+        return eeccsd_matvec_singlet(eom, vector[None], imds)[0]
+
     nocc = eom.nocc
     nmo = eom.nmo
     nvir = nmo - nocc
 
-    r1, r2 = vector_to_amplitudes_singlet(vector, nmo, nocc)
+    r1, r2 = zip(*[vector_to_amplitudes_singlet(v, nmo, nocc) for v in vector])
+    r1 = np.asarray(r1)
+    r2 = np.asarray(r2)
     t1, t2, eris = imds.t1, imds.t2, imds.eris
     nocc, nvir = t1.shape
+    nvec = len(vector)
 
-    rho = r2*2 - r2.transpose(0,1,3,2)
-    Hr1  = lib.einsum('ae,ie->ia', imds.Fvv, r1)
-    Hr1 -= lib.einsum('mi,ma->ia', imds.Foo, r1)
-    Hr1 += np.einsum('me,imae->ia',imds.Fov, rho)
+    rho = r2*2 - r2.transpose(0,1,2,4,3)
+    Hr1  = lib.einsum('ae,kie->kia', imds.Fvv, r1)
+    Hr1 -= lib.einsum('mi,kma->kia', imds.Foo, r1)
+    Hr1 += lib.einsum('me,kimae->kia',imds.Fov, rho)
 
     #:eris_vvvv = ao2mo.restore(1,np.asarray(eris.vvvv), t1.shape[1])
     #:Hr2 += lib.einsum('ijef,aebf->ijab', tau2, eris_vvvv) * .5
@@ -887,64 +900,66 @@ def eeccsd_matvec_singlet(eom, vector, imds=None):
     Hr2 = eom._cc._add_vvvv(None, tau2, eris, with_ovvv=False, t2sym='jiba')
     Hr2 *= .5
 
-    Hr2 += lib.einsum('mnij,mnab->ijab', imds.woOoO, r2) * .5
-    Hr2 += lib.einsum('be,ijae->ijab', imds.Fvv   , r2)
-    Hr2 -= lib.einsum('mj,imab->ijab', imds.Foo   , r2)
+    Hr2 += lib.einsum('mnij,kmnab->kijab', imds.woOoO, r2) * .5
+    Hr2 += lib.einsum('be,kijae->kijab', imds.Fvv   , r2)
+    Hr2 -= lib.einsum('mj,kimab->kijab', imds.Foo   , r2)
 
     mem_now = lib.current_memory()[0]
     max_memory = max(0, lib.param.MAX_MEMORY - mem_now)
-    blksize = min(nocc, max(ccsd.BLKMIN, int(max_memory*1e6/8/(nvir**3*3))))
+    blksize = min(nocc, max(ccsd.BLKMIN, int(max_memory*1e6/8/(nvir**3*3+nvec*nocc**2*nvir*2))))
+    tmp1 = np.zeros((nvec,nvir,nvir), dtype=r1.dtype)
     for p0,p1 in lib.prange(0, nocc, blksize):
         ovvv = eris.get_ovvv(slice(p0,p1))  # ovvv = eris.ovvv[p0:p1]
-        Hr1 += lib.einsum('mfae,imef->ia', ovvv, rho[:,p0:p1])
-        tmp = lib.einsum('meaf,ijef->maij', ovvv, tau2)
-        Hr2 -= lib.einsum('ma,mbij->ijab', t1[p0:p1], tmp)
-        tmp  = lib.einsum('meaf,me->af', ovvv, r1[p0:p1]) * 2
-        tmp -= lib.einsum('mfae,me->af', ovvv, r1[p0:p1])
-        Hr2 += lib.einsum('af,ijfb->ijab', tmp, t2)
+        Hr1 += lib.einsum('mfae,kimef->kia', ovvv, rho[:,:,p0:p1])
+        tmp = lib.einsum('meaf,kijef->kmaij', ovvv, tau2)
+        Hr2 -= lib.einsum('ma,kmbij->kijab', t1[p0:p1], tmp)
+        tmp1 += lib.einsum('meaf,kme->kaf', ovvv, r1[:,p0:p1]) * 2
+        tmp1 -= lib.einsum('mfae,kme->kaf', ovvv, r1[:,p0:p1])
         ovvv = tmp = None
-    Hr2 -= lib.einsum('mbij,ma->ijab', imds.woVoO, r1)
-
-    Hr1-= lib.einsum('mnie,mnae->ia', imds.woOoV, rho)
-    tmp = lib.einsum('nmie,me->ni', imds.woOoV, r1) * 2
-    tmp-= lib.einsum('mnie,me->ni', imds.woOoV, r1)
-    Hr2 -= lib.einsum('ni,njab->ijab', tmp, t2)
+    Hr2 += lib.einsum('kaf,ijfb->kijab', tmp1, t2)
+    Hr2 -= lib.einsum('mbij,kma->kijab', imds.woVoO, r1)
+    tmp1 = None
+
+    Hr1-= lib.einsum('mnie,kmnae->kia', imds.woOoV, rho)
+    tmp = lib.einsum('nmie,kme->kni', imds.woOoV, r1) * 2
+    tmp-= lib.einsum('mnie,kme->kni', imds.woOoV, r1)
+    Hr2 -= lib.einsum('kni,njab->kijab', tmp, t2)
     tmp = None
     for p0, p1 in lib.prange(0, nvir, nocc):
-        Hr2 += lib.einsum('ejab,ie->ijab', np.asarray(imds.wvOvV[p0:p1]), r1[:,p0:p1])
+        Hr2 += lib.einsum('ejab,kie->kijab', np.asarray(imds.wvOvV[p0:p1]), r1[:,:,p0:p1])
 
     oVVo = np.asarray(imds.woVVo)
-    tmp = lib.einsum('mbej,imea->jiab', oVVo, r2)
+    tmp = lib.einsum('mbej,kimea->kjiab', oVVo, r2)
     Hr2 += tmp
-    Hr2 += tmp.transpose(0,1,3,2) * .5
+    Hr2 += tmp.transpose(0,1,2,4,3) * .5
     oVvO = np.asarray(imds.woVvO) + oVVo * .5
     oVVo = tmp = None
-    Hr1 += np.einsum('maei,me->ia', oVvO, r1) * 2
-    Hr2 += lib.einsum('mbej,imae->ijab', oVvO, rho)
+    Hr1 += lib.einsum('maei,kme->kia', oVvO, r1) * 2
+    Hr2 += lib.einsum('mbej,kimae->kijab', oVvO, rho)
     oVvO = None
 
     eris_ovov = np.asarray(eris.ovov)
-    tau2 = _make_tau(r2, r1, t1, fac=2)
-    tmp = lib.einsum('menf,ijef->mnij', eris_ovov, tau2)
+    tmp = lib.einsum('menf,kijef->kmnij', eris_ovov, tau2)
     tau2 = None
     tau = _make_tau(t2, t1, t1)
-    Hr2 += lib.einsum('mnij,mnab->ijab', tmp, tau) * .5
+    Hr2 += lib.einsum('kmnij,mnab->kijab', tmp, tau) * .5
     tau = tmp = None
 
-    tmp = lib.einsum('nemf,imef->ni', eris_ovov, rho)
-    Hr1 -= lib.einsum('na,ni->ia', t1, tmp)
-    Hr2 -= lib.einsum('mj,miab->ijba', tmp, t2)
+    tmp = lib.einsum('nemf,kimef->kni', eris_ovov, rho)
+    Hr1 -= lib.einsum('na,kni->kia', t1, tmp)
+    Hr2 -= lib.einsum('kmj,miab->kijba', tmp, t2)
     tmp = None
 
-    tmp  = np.einsum('mfne,mf->en', eris_ovov, r1) * 2
-    tmp -= np.einsum('menf,mf->en', eris_ovov, r1)
-    tmp  = np.einsum('en,nb->eb', tmp, t1)
-    tmp += lib.einsum('menf,mnbf->eb', eris_ovov, rho)
-    Hr2 -= lib.einsum('eb,ijea->jiab', tmp, t2)
+    tmp  = lib.einsum('mfne,kmf->ken', eris_ovov, r1) * 2
+    tmp -= lib.einsum('menf,kmf->ken', eris_ovov, r1)
+    tmp  = lib.einsum('ken,nb->keb', tmp, t1)
+    tmp += lib.einsum('menf,kmnbf->keb', eris_ovov, rho)
+    Hr2 -= lib.einsum('keb,ijea->kjiab', tmp, t2)
     tmp = eris_ovov = rho = None
 
-    Hr2 = Hr2 + Hr2.transpose(1,0,3,2)
-    vector = amplitudes_to_vector_ee(Hr1, Hr2)
+    Hr2 = Hr2 + Hr2.transpose(0,2,1,4,3)
+    vector = np.asarray([amplitudes_to_vector_ee(Hr1[k], Hr2[k])
+                         for k in range(nvec)])
     return vector
 
 def eeccsd_matvec_triplet(eom, vector, imds=None):
@@ -1322,7 +1337,7 @@ class EOMEESinglet(EOMEE):
     def gen_matvec(self, imds=None, diag=None, **kwargs):
         if imds is None: imds = self.make_imds()
         if diag is None: diag = self.get_diag(imds)[0]
-        matvec = lambda xs: [self.matvec(x, imds) for x in xs]
+        matvec = lambda xs: _block_matvec(self, xs, imds)
         return matvec, diag
 
     def vector_to_amplitudes(self, vector, nmo=None, nocc=None):
@@ -1622,9 +1637,25 @@ class _IMDS:
         log.timer('EOM-CCSD EE intermediates', *cput0)
         return self
 
+def _block_matvec(eom, xs, imds, copies=20):
+    '''Sigma vectors of all trial vectors of one Davidson iteration.  The
+    trial vectors are passed to eom.matvec in blocks, as many as the memory
+    allows.  copies is the number of temporary arrays of the size of a trial
+    vector that eom.matvec creates for each vector in the block.
+    '''
+    mem_now = lib.current_memory()[0]
+    max_memory = max(0, eom.max_memory - mem_now)
+    blksize = int(max_memory*.8e6/8/(eom.vector_size()*copies))
+    blksize = min(len(xs), max(1, blksize))
+    hxs = []
+    for p0, p1 in lib.prange(0, len(xs), blksize):
+        hxs.extend(eom.matvec(np.asarray(xs[p0:p1]), imds))
+    return hxs
+
 def _make_tau(t2, t1, r1, fac=1, out=None):
-    tau = np.einsum('ia,jb->ijab', t1, r1)
-    tau = tau + tau.transpose(1,0,3,2)
+    # t2 and t1 can be blocks of amplitudes with a leading dimension
+    tau = np.einsum('...ia,jb->...ijab', t1, r1)
+    tau = tau + tau.swapaxes(-4,-3).swapaxes(-2,-1)
     tau *= fac * .5
     tau += t2
     return tau
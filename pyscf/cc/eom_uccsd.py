@@ -310,16 +310,38 @@ def spin2spatial_eomsf(rx, orbspin):
 # Note: Last line in Eq. (10) is superfluous.
 # See, e.g. Gwaltney, Nooijen, and Barlett, Chem. Phys. Lett. 248, 189 (1996)
 def eomee_ccsd_matvec(eom, vector, imds=None):
+    '''EOM-EE-UCCSD (spin-conserving) sigma vector.
+
+    vector can be one trial vector or a block of trial vectors (nvec,size).
+    For a block, the integrals (vvvv, ovvv, ovov) are read once and
+    contracted with all vectors together.
+    '''
     if imds is None: imds = eom.make_imds()
+    vector = np.asarray(vector)
+    if vector.ndim == 1:
+        return eomee_ccsd_matvec(eom, vector[None], imds)[0]
 
     t1, t2, eris = imds.t1, imds.t2, imds.eris
     t1a, t1b = t1
     t2aa, t2ab, t2bb = t2
     nocca, noccb, nvira, nvirb = t2ab.shape
     nmoa, nmob = nocca+nvira, noccb+nvirb
-    r1, r2 = vector_to_amplitudes_ee(vector, (nmoa,nmob), (nocca,noccb))
-    r1a, r1b = r1
-    r2aa, r2ab, r2bb = r2
+    nvec = len(vector)
+    r1a, r1b, r2aa, r2ab, r2bb = [], [], [], [], []
+    for v in vector:
+        r1, r2 = vector_to_amplitudes_ee(v, (nmoa,nmob), (nocca,noccb))
+        r1a.append(r1[0])
+        r1b.append(r1[1])
+        r2aa.append(r2[0])
+        r2ab.append(r2[1])
+        r2bb.append(r2[2])
+    r1a = np.asarray(r1a)
+    r1b = np.asarray(r1b)
+    r2aa = np.asarray(r2aa)
+    r2ab = np.asarray(r2ab)
+    r2bb = np.asarray(r2bb)
+    r1 = (r1a, r1b)
+    r2 = (r2aa, r2ab, r2bb)
 
     #:eris_vvvv = ao2mo.restore(1, np.asarray(eris.vvvv), nvirb)
     #:eris_VVVV = ao2mo.restore(1, np.asarray(eris.VVVV), nvirb)
@@ -333,26 +355,26 @@ def eomee_ccsd_matvec(eom, vector, imds=None):
     Hr2bb *= .5
     tau2aa = tau2ab = tau2bb = None
 
-    Hr1a  = lib.einsum('ae,ie->ia', imds.Fvva, r1a)
-    Hr1a -= lib.einsum('mi,ma->ia', imds.Fooa, r1a)
-    Hr1a += np.einsum('me,imae->ia',imds.Fova, r2aa)
-    Hr1a += np.einsum('ME,iMaE->ia',imds.Fovb, r2ab)
-    Hr1b  = lib.einsum('ae,ie->ia', imds.Fvvb, r1b)
-    Hr1b -= lib.einsum('mi,ma->ia', imds.Foob, r1b)
-    Hr1b += np.einsum('me,imae->ia',imds.Fovb, r2bb)
-    Hr1b += np.einsum('me,mIeA->IA',imds.Fova, r2ab)
-
-    Hr2aa += lib.einsum('mnij,mnab->ijab', imds.woooo, r2aa) * .25
-    Hr2bb += lib.einsum('mnij,mnab->ijab', imds.wOOOO, r2bb) * .25
-    Hr2ab += lib.einsum('mNiJ,mNaB->iJaB', imds.woOoO, r2ab)
-    Hr2aa += lib.einsum('be,ijae->ijab', imds.Fvva, r2aa)
-    Hr2bb += lib.einsum('be,ijae->ijab', imds.Fvvb, r2bb)
-    Hr2ab += lib.einsum('BE,iJaE->iJaB', imds.Fvvb, r2ab)
-    Hr2ab += lib.einsum('be,iJeA->iJbA', imds.Fvva, r2ab)
-    Hr2aa -= lib.einsum('mj,imab->ijab', imds.Fooa, r2aa)
-    Hr2bb -= lib.einsum('mj,imab->ijab', imds.Foob, r2bb)
-    Hr2ab -= lib.einsum('MJ,iMaB->iJaB', imds.Foob, r2ab)
-    Hr2ab -= lib.einsum('mj,mIaB->jIaB', imds.Fooa, r2ab)
+    Hr1a  = lib.einsum('ae,kie->kia', imds.Fvva, r1a)
+    Hr1a -= lib.einsum('mi,kma->kia', imds.Fooa, r1a)
+    Hr1a += lib.einsum('me,kimae->kia',imds.Fova, r2aa)
+    Hr1a += lib.einsum('ME,kiMaE->kia',imds.Fovb, r2ab)
+    Hr1b  = lib.einsum('ae,kie->kia', imds.Fvvb, r1b)
+    Hr1b -= lib.einsum('mi,kma->kia', imds.Foob, r1b)
+    Hr1b += lib.einsum('me,kimae->kia',imds.Fovb, r2bb)
+    Hr1b += lib.einsum('me,kmIeA->kIA',imds.Fova, r2ab)
+
+    Hr2aa += lib.einsum('mnij,kmnab->kijab', imds.woooo, r2aa) * .25
+    Hr2bb += lib.einsum('mnij,kmnab->kijab', imds.wOOOO, r2bb) * .25
+    Hr2ab += lib.einsum('mNiJ,kmNaB->kiJaB', imds.woOoO, r2ab)
+    Hr2aa += lib.einsum('be,kijae->kijab', imds.Fvva, r2aa)
+    Hr2bb += lib.einsum('be,kijae->kijab', imds.Fvvb, r2bb)
+    Hr2ab += lib.einsum('BE,kiJaE->kiJaB', imds.Fvvb, r2ab)
+    Hr2ab += lib.einsum('be,kiJeA->kiJbA', imds.Fvva, r2ab)
+    Hr2aa -= lib.einsum('mj,kimab->kijab', imds.Fooa, r2aa)
+    Hr2bb -= lib.einsum('mj,kimab->kijab', imds.Foob, r2bb)
+    Hr2ab -= lib.einsum('MJ,kiMaB->kiJaB', imds.Foob, r2ab)
+    Hr2ab -= lib.einsum('mj,kmIaB->kjIaB', imds.Fooa, r2ab)
 
     #:tau2aa, tau2ab, tau2bb = uccsd.make_tau(r2, r1, t1, 2)
     #:eris_ovvv = lib.unpack_tril(np.asarray(eris.ovvv).reshape(nocca*nvira,-1)).reshape(nocca,nvira,nvira,nvira)
@@ -383,16 +405,16 @@ def eomee_ccsd_matvec(eom, vector, imds=None):
     tau2aa = uccsd.make_tau_aa(r2aa, r1a, t1a, 2)
     mem_now = lib.current_memory()[0]
     max_memory = max(0, eom.max_memory - mem_now)
-    tmpa = np.zeros((nvira,nvira))
-    tmpb = np.zeros((nvirb,nvirb))
+    tmpa = np.zeros((nvec,nvira,nvira))
+    tmpb = np.zeros((nvec,nvirb,nvirb))
     blksize = min(nocca, max(ccsd.BLKMIN, int(max_memory*1e6/8/(nvira**3*3))))
     for p0, p1 in lib.prange(0, nocca, blksize):
         ovvv = eris.get_ovvv(slice(p0,p1))  # ovvv = eris.ovvv[p0:p1]
-        Hr1a += lib.einsum('mfae,imef->ia', ovvv, r2aa[:,p0:p1])
-        tmpaa = lib.einsum('meaf,ijef->maij', ovvv, tau2aa)
-        Hr2aa+= lib.einsum('mb,maij->ijab', t1a[p0:p1], tmpaa)
-        tmpa+= lib.einsum('mfae,me->af', ovvv, r1a[p0:p1])
-        tmpa-= lib.einsum('meaf,me->af', ovvv, r1a[p0:p1])
+        Hr1a += lib.einsum('mfae,kimef->kia', ovvv, r2aa[:,:,p0:p1])
+        tmpaa = lib.einsum('meaf,kijef->kmaij', ovvv, tau2aa)
+        Hr2aa+= lib.einsum('mb,kmaij->kijab', t1a[p0:p1], tmpaa)
+        tmpa+= lib.einsum('mfae,kme->kaf', ovvv, r1a[:,p0:p1])
+        tmpa-= lib.einsum('meaf,kme->kaf', ovvv, r1a[:,p0:p1])
         ovvv = tmpaa = None
     tau2aa = None
 
@@ -400,11 +422,11 @@ def eomee_ccsd_matvec(eom, vector, imds=None):
     blksize = min(noccb, max(ccsd.BLKMIN, int(max_memory*1e6/8/(nvirb**3*3))))
     for p0, p1 in lib.prange(0, noccb, blksize):
         OVVV = eris.get_OVVV(slice(p0,p1))  # OVVV = eris.OVVV[p0:p1]
-        Hr1b += lib.einsum('mfae,imef->ia', OVVV, r2bb[:,p0:p1])
-        tmpbb = lib.einsum('meaf,ijef->maij', OVVV, tau2bb)
-        Hr2bb+= lib.einsum('mb,maij->ijab', t1b[p0:p1], tmpbb)
-        tmpb+= lib.einsum('mfae,me->af', OVVV, r1b[p0:p1])
-        tmpb-= lib.einsum('meaf,me->af', OVVV, r1b[p0:p1])
+        Hr1b += lib.einsum('mfae,kimef->kia', OVVV, r2bb[:,:,p0:p1])
+        tmpbb = lib.einsum('meaf,kijef->kmaij', OVVV, tau2bb)
+        Hr2bb+= lib.einsum('mb,kmaij->kijab', t1b[p0:p1], tmpbb)
+        tmpb+= lib.einsum('mfae,kme->kaf', OVVV, r1b[:,p0:p1])
+        tmpb-= lib.einsum('meaf,kme->kaf', OVVV, r1b[:,p0:p1])
         OVVV = tmpbb = None
     tau2bb = None
 
@@ -412,124 +434,126 @@ def eomee_ccsd_matvec(eom, vector, imds=None):
     blksize = min(nocca, max(ccsd.BLKMIN, int(max_memory*1e6/8/(nvira*nvirb**2*3))))
     for p0, p1 in lib.prange(0, nocca, blksize):
         ovVV = eris.get_ovVV(slice(p0,p1))  # ovVV = eris.ovVV[p0:p1]
-        Hr1b += lib.einsum('mfAE,mIfE->IA', ovVV, r2ab[p0:p1])
-        tmpab = lib.einsum('meAF,iJeF->mAiJ', ovVV, tau2ab)
-        Hr2ab-= lib.einsum('mb,mAiJ->iJbA', t1a[p0:p1], tmpab)
-        tmpb-= lib.einsum('meAF,me->AF', ovVV, r1a[p0:p1])
+        Hr1b += lib.einsum('mfAE,kmIfE->kIA', ovVV, r2ab[:,p0:p1])
+        tmpab = lib.einsum('meAF,kiJeF->kmAiJ', ovVV, tau2ab)
+        Hr2ab-= lib.einsum('mb,kmAiJ->kiJbA', t1a[p0:p1], tmpab)
+        tmpb-= lib.einsum('meAF,kme->kAF', ovVV, r1a[:,p0:p1])
         ovVV = tmpab = None
 
     blksize = min(noccb, max(ccsd.BLKMIN, int(max_memory*1e6/8/(nvirb*nvira**2*3))))
     for p0, p1 in lib.prange(0, noccb, blksize):
         OVvv = eris.get_OVvv(slice(p0,p1))  # OVvv = eris.OVvv[p0:p1]
-        Hr1a += lib.einsum('MFae,iMeF->ia', OVvv, r2ab[:,p0:p1])
-        tmpba = lib.einsum('MEaf,iJfE->MaiJ', OVvv, tau2ab)
-        Hr2ab-= lib.einsum('MB,MaiJ->iJaB', t1b[p0:p1], tmpba)
-        tmpa-= lib.einsum('MEaf,ME->af', OVvv, r1b[p0:p1])
+        Hr1a += lib.einsum('MFae,kiMeF->kia', OVvv, r2ab[:,:,p0:p1])
+        tmpba = lib.einsum('MEaf,kiJfE->kMaiJ', OVvv, tau2ab)
+        Hr2ab-= lib.einsum('MB,kMaiJ->kiJaB', t1b[p0:p1], tmpba)
+        tmpa-= lib.einsum('MEaf,kME->kaf', OVvv, r1b[:,p0:p1])
         OVvv = tmpba = None
     tau2ab = None
 
-    Hr2aa-= lib.einsum('af,ijfb->ijab', tmpa, t2aa)
-    Hr2bb-= lib.einsum('af,ijfb->ijab', tmpb, t2bb)
-    Hr2ab-= lib.einsum('af,iJfB->iJaB', tmpa, t2ab)
-    Hr2ab-= lib.einsum('AF,iJbF->iJbA', tmpb, t2ab)
+    Hr2aa-= lib.einsum('kaf,ijfb->kijab', tmpa, t2aa)
+    Hr2bb-= lib.einsum('kaf,ijfb->kijab', tmpb, t2bb)
+    Hr2ab-= lib.einsum('kaf,iJfB->kiJaB', tmpa, t2ab)
+    Hr2ab-= lib.einsum('kAF,iJbF->kiJbA', tmpb, t2ab)
 
     eris_ovov = np.asarray(eris.ovov)
     eris_OVOV = np.asarray(eris.OVOV)
     eris_ovOV = np.asarray(eris.ovOV)
     tau2aa = uccsd.make_tau_aa(r2aa, r1a, t1a, 2)
     tauaa = uccsd.make_tau_aa(t2aa, t1a, t1a)
-    tmpaa = lib.einsum('menf,ijef->mnij', eris_ovov, tau2aa)
-    Hr2aa += lib.einsum('mnij,mnab->ijab', tmpaa, tauaa) * 0.25
+    tmpaa = lib.einsum('menf,kijef->kmnij', eris_ovov, tau2aa)
+    Hr2aa += lib.einsum('kmnij,mnab->kijab', tmpaa, tauaa) * 0.25
     tau2aa = tauaa = None
 
     tau2bb = uccsd.make_tau_aa(r2bb, r1b, t1b, 2)
     taubb = uccsd.make_tau_aa(t2bb, t1b, t1b)
-    tmpbb = lib.einsum('menf,ijef->mnij', eris_OVOV, tau2bb)
-    Hr2bb += lib.einsum('mnij,mnab->ijab', tmpbb, taubb) * 0.25
+    tmpbb = lib.einsum('menf,kijef->kmnij', eris_OVOV, tau2bb)
+    Hr2bb += lib.einsum('kmnij,mnab->kijab', tmpbb, taubb) * 0.25
     tau2bb = taubb = None
 
     tau2ab = uccsd.make_tau_ab(r2ab, r1 , t1 , 2)
     tauab = uccsd.make_tau_ab(t2ab, t1 , t1)
-    tmpab = lib.einsum('meNF,iJeF->mNiJ', eris_ovOV, tau2ab)
-    Hr2ab += lib.einsum('mNiJ,mNaB->iJaB', tmpab, tauab)
+    tmpab = lib.einsum('meNF,kiJeF->kmNiJ', eris_ovOV, tau2ab)
+    Hr2ab += lib.einsum('kmNiJ,mNaB->kiJaB', tmpab, tauab)
     tau2ab = tauab = None
 
-    tmpa = lib.einsum('menf,imef->ni', eris_ovov, r2aa)
-    tmpa-= lib.einsum('neMF,iMeF->ni', eris_ovOV, r2ab)
-    tmpb = lib.einsum('menf,imef->ni', eris_OVOV, r2bb)
-    tmpb-= lib.einsum('mfNE,mIfE->NI', eris_ovOV, r2ab)
-    Hr1a += lib.einsum('na,ni->ia', t1a, tmpa)
-    Hr1b += lib.einsum('na,ni->ia', t1b, tmpb)
-    Hr2aa+= lib.einsum('mj,imab->ijab', tmpa, t2aa)
-    Hr2bb+= lib.einsum('mj,imab->ijab', tmpb, t2bb)
-    Hr2ab+= lib.einsum('MJ,iMaB->iJaB', tmpb, t2ab)
-    Hr2ab+= lib.einsum('mj,mIaB->jIaB', tmpa, t2ab)
-
-    tmp1a = np.einsum('menf,mf->en', eris_ovov, r1a)
-    tmp1a-= np.einsum('mfne,mf->en', eris_ovov, r1a)
-    tmp1a-= np.einsum('neMF,MF->en', eris_ovOV, r1b)
-    tmp1b = np.einsum('menf,mf->en', eris_OVOV, r1b)
-    tmp1b-= np.einsum('mfne,mf->en', eris_OVOV, r1b)
-    tmp1b-= np.einsum('mfNE,mf->EN', eris_ovOV, r1a)
-    tmpa = np.einsum('en,nb->eb', tmp1a, t1a)
-    tmpa+= lib.einsum('menf,mnfb->eb', eris_ovov, r2aa)
-    tmpa-= lib.einsum('meNF,mNbF->eb', eris_ovOV, r2ab)
-    tmpb = np.einsum('en,nb->eb', tmp1b, t1b)
-    tmpb+= lib.einsum('menf,mnfb->eb', eris_OVOV, r2bb)
-    tmpb-= lib.einsum('nfME,nMfB->EB', eris_ovOV, r2ab)
-    Hr2aa+= lib.einsum('eb,ijae->ijab', tmpa, t2aa)
-    Hr2bb+= lib.einsum('eb,ijae->ijab', tmpb, t2bb)
-    Hr2ab+= lib.einsum('EB,iJaE->iJaB', tmpb, t2ab)
-    Hr2ab+= lib.einsum('eb,iJeA->iJbA', tmpa, t2ab)
-    eirs_ovov = eris_ovOV = eris_OVOV = None
-
-    Hr2aa-= lib.einsum('mbij,ma->ijab', imds.wovoo, r1a)
-    Hr2bb-= lib.einsum('mbij,ma->ijab', imds.wOVOO, r1b)
-    Hr2ab-= lib.einsum('mBiJ,ma->iJaB', imds.woVoO, r1a)
-    Hr2ab-= lib.einsum('MbJi,MA->iJbA', imds.wOvOo, r1b)
-
-    Hr1a-= 0.5*lib.einsum('mnie,mnae->ia', imds.wooov, r2aa)
-    Hr1a-=     lib.einsum('mNiE,mNaE->ia', imds.woOoV, r2ab)
-    Hr1b-= 0.5*lib.einsum('mnie,mnae->ia', imds.wOOOV, r2bb)
-    Hr1b-=     lib.einsum('MnIe,nMeA->IA', imds.wOoOv, r2ab)
-    tmpa = lib.einsum('mnie,me->ni', imds.wooov, r1a)
-    tmpa-= lib.einsum('nMiE,ME->ni', imds.woOoV, r1b)
-    tmpb = lib.einsum('mnie,me->ni', imds.wOOOV, r1b)
-    tmpb-= lib.einsum('NmIe,me->NI', imds.wOoOv, r1a)
-    Hr2aa+= lib.einsum('ni,njab->ijab', tmpa, t2aa)
-    Hr2bb+= lib.einsum('ni,njab->ijab', tmpb, t2bb)
-    Hr2ab+= lib.einsum('ni,nJaB->iJaB', tmpa, t2ab)
-    Hr2ab+= lib.einsum('NI,jNaB->jIaB', tmpb, t2ab)
+    tmpa = lib.einsum('menf,kimef->kni', eris_ovov, r2aa)
+    tmpa-= lib.einsum('neMF,kiMeF->kni', eris_ovOV, r2ab)
+    tmpb = lib.einsum('menf,kimef->kni', eris_OVOV, r2bb)
+    tmpb-= lib.einsum('mfNE,kmIfE->kNI', eris_ovOV, r2ab)
+    Hr1a += lib.einsum('na,kni->kia', t1a, tmpa)
+    Hr1b += lib.einsum('na,kni->kia', t1b, tmpb)
+    Hr2aa+= lib.einsum('kmj,imab->kijab', tmpa, t2aa)
+    Hr2bb+= lib.einsum('kmj,imab->kijab', tmpb, t2bb)
+    Hr2ab+= lib.einsum('kMJ,iMaB->kiJaB', tmpb, t2ab)
+    Hr2ab+= lib.einsum('kmj,mIaB->kjIaB', tmpa, t2ab)
+
+    tmp1a = lib.einsum('menf,kmf->ken', eris_ovov, r1a)
+    tmp1a-= lib.einsum('mfne,kmf->ken', eris_ovov, r1a)
+    tmp1a-= lib.einsum('neMF,kMF->ken', eris_ovOV, r1b)
+    tmp1b = lib.einsum('menf,kmf->ken', eris_OVOV, r1b)
+    tmp1b-= lib.einsum('mfne,kmf->ken', eris_OVOV, r1b)
+    tmp1b-= lib.einsum('mfNE,kmf->kEN', eris_ovOV, r1a)
+    tmpa = lib.einsum('ken,nb->keb', tmp1a, t1a)
+    tmpa+= lib.einsum('menf,kmnfb->keb', eris_ovov, r2aa)
+    tmpa-= lib.einsum('meNF,kmNbF->keb', eris_ovOV, r2ab)
+    tmpb = lib.einsum('ken,nb->keb', tmp1b, t1b)
+    tmpb+= lib.einsum('menf,kmnfb->keb', eris_OVOV, r2bb)
+    tmpb-= lib.einsum('nfME,knMfB->kEB', eris_ovOV, r2ab)
+    Hr2aa+= lib.einsum('keb,ijae->kijab', tmpa, t2aa)
+    Hr2bb+= lib.einsum('keb,ijae->kijab', tmpb, t2bb)
+    Hr2ab+= lib.einsum('kEB,iJaE->kiJaB', tmpb, t2ab)
+    Hr2ab+= lib.einsum('keb,iJeA->kiJbA', tmpa, t2ab)
+    eris_ovov = eris_ovOV = eris_OVOV = None
+
+    Hr2aa-= lib.einsum('mbij,kma->kijab', imds.wovoo, r1a)
+    Hr2bb-= lib.einsum('mbij,kma->kijab', imds.wOVOO, r1b)
+    Hr2ab-= lib.einsum('mBiJ,kma->kiJaB', imds.woVoO, r1a)
+    Hr2ab-= lib.einsum('MbJi,kMA->kiJbA', imds.wOvOo, r1b)
+
+    Hr1a-= 0.5*lib.einsum('mnie,kmnae->kia', imds.wooov, r2aa)
+    Hr1a-=     lib.einsum('mNiE,kmNaE->kia', imds.woOoV, r2ab)
+    Hr1b-= 0.5*lib.einsum('mnie,kmnae->kia', imds.wOOOV, r2bb)
+    Hr1b-=     lib.einsum('MnIe,knMeA->kIA', imds.wOoOv, r2ab)
+    tmpa = lib.einsum('mnie,kme->kni', imds.wooov, r1a)
+    tmpa-= lib.einsum('nMiE,kME->kni', imds.woOoV, r1b)
+    tmpb = lib.einsum('mnie,kme->kni', imds.wOOOV, r1b)
+    tmpb-= lib.einsum('NmIe,kme->kNI', imds.wOoOv, r1a)
+    Hr2aa+= lib.einsum('kni,njab->kijab', tmpa, t2aa)
+    Hr2bb+= lib.einsum('kni,njab->kijab', tmpb, t2bb)
+    Hr2ab+= lib.einsum('kni,nJaB->kiJaB', tmpa, t2ab)
+    Hr2ab+= lib.einsum('kNI,jNaB->kjIaB', tmpb, t2ab)
     for p0, p1 in lib.prange(0, nvira, nocca):
-        Hr2aa+= lib.einsum('ejab,ie->ijab', imds.wvovv[p0:p1], r1a[:,p0:p1])
-        Hr2ab+= lib.einsum('eJaB,ie->iJaB', imds.wvOvV[p0:p1], r1a[:,p0:p1])
+        Hr2aa+= lib.einsum('ejab,kie->kijab', imds.wvovv[p0:p1], r1a[:,:,p0:p1])
+        Hr2ab+= lib.einsum('eJaB,kie->kiJaB', imds.wvOvV[p0:p1], r1a[:,:,p0:p1])
     for p0, p1 in lib.prange(0, nvirb, noccb):
-        Hr2bb+= lib.einsum('ejab,ie->ijab', imds.wVOVV[p0:p1], r1b[:,p0:p1])
-        Hr2ab+= lib.einsum('EjBa,IE->jIaB', imds.wVoVv[p0:p1], r1b[:,p0:p1])
-
-    Hr1a += np.einsum('maei,me->ia',imds.wovvo,r1a)
-    Hr1a += np.einsum('MaEi,ME->ia',imds.wOvVo,r1b)
-    Hr1b += np.einsum('maei,me->ia',imds.wOVVO,r1b)
-    Hr1b += np.einsum('mAeI,me->IA',imds.woVvO,r1a)
-    Hr2aa+= lib.einsum('mbej,imae->ijab', imds.wovvo, r2aa) * 2
-    Hr2aa+= lib.einsum('MbEj,iMaE->ijab', imds.wOvVo, r2ab) * 2
-    Hr2bb+= lib.einsum('mbej,imae->ijab', imds.wOVVO, r2bb) * 2
-    Hr2bb+= lib.einsum('mBeJ,mIeA->IJAB', imds.woVvO, r2ab) * 2
-    Hr2ab+= lib.einsum('mBeJ,imae->iJaB', imds.woVvO, r2aa)
-    Hr2ab+= lib.einsum('MBEJ,iMaE->iJaB', imds.wOVVO, r2ab)
-    Hr2ab+= lib.einsum('mBEj,mIaE->jIaB', imds.woVVo, r2ab)
-    Hr2ab+= lib.einsum('mbej,mIeA->jIbA', imds.wovvo, r2ab)
-    Hr2ab+= lib.einsum('MbEj,IMAE->jIbA', imds.wOvVo, r2bb)
-    Hr2ab+= lib.einsum('MbeJ,iMeA->iJbA', imds.wOvvO, r2ab)
+        Hr2bb+= lib.einsum('ejab,kie->kijab', imds.wVOVV[p0:p1], r1b[:,:,p0:p1])
+        Hr2ab+= lib.einsum('EjBa,kIE->kjIaB', imds.wVoVv[p0:p1], r1b[:,:,p0:p1])
+
+    Hr1a += lib.einsum('maei,kme->kia',imds.wovvo,r1a)
+    Hr1a += lib.einsum('MaEi,kME->kia',imds.wOvVo,r1b)
+    Hr1b += lib.einsum('maei,kme->kia',imds.wOVVO,r1b)
+    Hr1b += lib.einsum('mAeI,kme->kIA',imds.woVvO,r1a)
+    Hr2aa+= lib.einsum('mbej,kimae->kijab', imds.wovvo, r2aa) * 2
+    Hr2aa+= lib.einsum('MbEj,kiMaE->kijab', imds.wOvVo, r2ab) * 2
+    Hr2bb+= lib.einsum('mbej,kimae->kijab', imds.wOVVO, r2bb) * 2
+    Hr2bb+= lib.einsum('mBeJ,kmIeA->kIJAB', imds.woVvO, r2ab) * 2
+    Hr2ab+= lib.einsum('mBeJ,kimae->kiJaB', imds.woVvO, r2aa)
+    Hr2ab+= lib.einsum('MBEJ,kiMaE->kiJaB', imds.wOVVO, r2ab)
+    Hr2ab+= lib.einsum('mBEj,kmIaE->kjIaB', imds.woVVo, r2ab)
+    Hr2ab+= lib.einsum('mbej,kmIeA->kjIbA', imds.wovvo, r2ab)
+    Hr2ab+= lib.einsum('MbEj,kIMAE->kjIbA', imds.wOvVo, r2bb)
+    Hr2ab+= lib.einsum('MbeJ,kiMeA->kiJbA', imds.wOvvO, r2ab)
 
     Hr2aa *= .5
     Hr2bb *= .5
-    Hr2aa = Hr2aa - Hr2aa.transpose(0,1,3,2)
-    Hr2aa = Hr2aa - Hr2aa.transpose(1,0,2,3)
-    Hr2bb = Hr2bb - Hr2bb.transpose(0,1,3,2)
-    Hr2bb = Hr2bb - Hr2bb.transpose(1,0,2,3)
-
-    vector = amplitudes_to_vector_ee((Hr1a,Hr1b), (Hr2aa,Hr2ab,Hr2bb))
+    Hr2aa = Hr2aa - Hr2aa.transpose(0,1,2,4,3)
+    Hr2aa = Hr2aa - Hr2aa.transpose(0,2,1,3,4)
+    Hr2bb = Hr2bb - Hr2bb.transpose(0,1,2,4,3)
+    Hr2bb = Hr2bb - Hr2bb.transpose(0,2,1,3,4)
+
+    vector = np.asarray([amplitudes_to_vector_ee((Hr1a[k],Hr1b[k]),
+                                                 (Hr2aa[k],Hr2ab[k],Hr2bb[k]))
+                         for k in range(nvec)])
     return vector
 
 def eomsf_ccsd_matvec(eom, vector, imds=None):
@@ -1027,7 +1051,7 @@ class EOMEESpinKeep(EOMEE):
     def gen_matvec(self, imds=None, diag=None, **kwargs):
         if imds is None: imds = self.make_imds()
         if diag is None: diag = self.get_diag(imds)[0]
-        matvec = lambda xs: [self.matvec(x, imds) for x in xs]
+        matvec = lambda xs: eom_rccsd._block_matvec(self, xs, imds)
         return matvec, diag
 
     def vector_to_amplitudes(self, vector, nmo=None, nocc=None):
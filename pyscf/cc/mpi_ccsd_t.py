@@ -0,0 +1,199 @@
+#!/usr/bin/env python
+# Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+'''
+MPI parallel CCSD(T) and UCCSD(T) for molecules
+
+The (a0:a1,b0:b1) blocks of the virtual indices of the triples are the tasks.
+Every rank holds the CCSD amplitudes and transforms the integrals (the vvop
+tensors in ccsd_t._sort_eri).  Each rank loads the cache blocks of its own
+tasks only.  The tasks are assigned
+
+* statically (default): the blocks are sorted by the number of triples and
+  assigned greedily to the least loaded rank.  No communication is needed.
+* dynamically: rank 0 hands out the blocks, the most expensive ones first,
+  upon the requests of the ranks.  Rank 0 computes blocks as well.  The
+  blocks of the same a0:a1 are handed out consecutively (see cost_order).
+
+The partial energies are summed with MPI allreduce.  All ranks should run the
+same script, e.g.
+
+    mpirun -np 4 python h2o_ccsd_t.py
+
+    mf = scf.RHF(mol).run()
+    mycc = cc.CCSD(mf).run()
+    et = mpi_ccsd_t.kernel(mycc, mycc.ao2mo())
+
+Without MPI, the schedulers can be called with the rank and the number of
+ranks explicitly, e.g. the sum of
+
+    ccsd_t.kernel(mycc, eris, task_scheduler=StaticScheduler(rank, 4))
+
+over rank = 0 .. 3 is the CCSD(T) correction.
+'''
+
+import threading
+import numpy
+from pyscf.lib import logger
+
+
+def static_partition(costs, nproc):
+    '''Greedy cost-balanced partition of the tasks.  Returns the task indices
+    of each process in ascending order.'''
+    costs = numpy.asarray(costs, dtype=float)
+    order = numpy.argsort(-costs, kind='mergesort')
+    load = numpy.zeros(nproc)
+    tasks = [[] for i in range(nproc)]
+    for i in order:
+        p = numpy.argmin(load)
+        tasks[p].append(i)
+        load[p] += costs[i]
+    return [sorted(x) for x in tasks]
+
+def cost_order(tasks, costs):
+    '''The task indices, most expensive first.  The tasks of the same a block
+    (a0,a1) stay consecutive to share the cache of a.  The a blocks are
+    ordered by their total cost, then the tasks of each block by their own
+    cost.'''
+    block_cost = {}
+    first = {}
+    for i, (task, cost) in enumerate(zip(tasks, costs)):
+        key = tuple(task[:2])
+        block_cost[key] = block_cost.get(key, 0) + cost
+        first.setdefault(key, i)
+    def sort_key(i):
+        key = tuple(tasks[i][:2])
+        return (-block_cost[key], first[key], -costs[i])
+    return sorted(range(len(tasks)), key=sort_key)
+
+class StaticScheduler(object):
+    '''Cost-balanced static assignment of the tasks.
+
+    Args:
+        rank, nproc : int
+            The ID of this process and the number of processes.
+        comm : MPI communicator
+            To sum up the energy.  If not given, allreduce returns the partial
+            energy of this process.
+    '''
+    def __init__(self, rank, nproc, comm=None):
+        self.rank = rank
+        self.nproc = nproc
+        self.comm = comm
+
+    def __call__(self, tasks, costs):
+        idx = static_partition(costs, self.nproc)[self.rank]
+        return [tasks[i] for i in idx]
+
+    def allreduce(self, et_sum):
+        if self.comm is None or self.nproc == 1:
+            return et_sum
+        return self.comm.allreduce(et_sum)
+
+class DynamicScheduler(object):
+    '''Rank 0 distributes the tasks on request.  A thread on rank 0 serves
+    the requests while the main thread of rank 0 computes tasks.  MPI needs
+    to be initialized with at least MPI_THREAD_SERIALIZED (mpi4py requests
+    MPI_THREAD_MULTIPLE by default).
+    '''
+    def __init__(self, comm):
+        self.comm = comm
+        self._round = 0
+
+    def __call__(self, tasks, costs):
+        comm = self.comm
+        # Each call has its own tag so that the requests of a fast rank for
+        # the next task list are not served by the previous one.
+        self._round += 1
+        tag = self._round
+        tasks = [tasks[i] for i in cost_order(tasks, costs)]
+        ntasks = len(tasks)
+        if comm.Get_size() == 1:
+            for task in tasks:
+                yield task
+            return
+
+        if comm.Get_rank() == 0:
+            from mpi4py import MPI
+            lock = threading.Lock()
+            counter = [0]
+            def next_task():
+                with lock:
+                    i = counter[0]
+                    counter[0] += 1
+                if i < ntasks:
+                    return i
+                else:
+                    return -1
+
+            def serve():
+                nfinished = 0
+                status = MPI.Status()
+                while nfinished < comm.Get_size() - 1:
+                    comm.recv(source=MPI.ANY_SOURCE, tag=tag, status=status)
+                    i = next_task()
+                    comm.send(i, dest=status.Get_source(), tag=tag)
+                    if i < 0:
+                        nfinished += 1
+            server = threading.Thread(target=serve)
+            server.start()
+            i = next_task()
+            while i >= 0:
+                yield tasks[i]
+                i = next_task()
+            server.join()
+        else:
+            while True:
+                comm.send(None, dest=0, tag=tag)
+                i = comm.recv(source=0, tag=tag)
+                if i < 0:
+                    break
+                yield tasks[i]
+
+    def allreduce(self, et_sum):
+        if self.comm.Get_size() == 1:
+            return et_sum
+        return self.comm.allreduce(et_sum)
+
+def kernel(mycc, eris, t1=None, t2=None, verbose=None, comm=None,
+           dynamic=False):
+    '''(T) correction of RCCSD or UCCSD computed on all ranks of comm.
+
+    Kwargs:
+        comm : MPI communicator
+            Default is MPI.COMM_WORLD
+        dynamic : bool
+            Whether to assign the tasks dynamically.
+    '''
+    from pyscf.cc import ccsd_t, uccsd_t, uccsd
+    if comm is None:
+        from mpi4py import MPI
+        comm = MPI.COMM_WORLD
+    rank = comm.Get_rank()
+    if verbose is None:
+        verbose = mycc.verbose
+    if rank > 0:
+        verbose = logger.QUIET
+
+    if dynamic:
+        scheduler = DynamicScheduler(comm)
+    else:
+        scheduler = StaticScheduler(rank, comm.Get_size(), comm)
+
+    if isinstance(mycc, uccsd.UCCSD):
+        return uccsd_t.kernel(mycc, eris, t1, t2, verbose, scheduler)
+    else:
+        return ccsd_t.kernel(mycc, eris, t1, t2, verbose, scheduler)
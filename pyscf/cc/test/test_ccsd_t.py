@@ -20,6 +20,7 @@ from functools import reduce
 from pyscf import gto, scf, lib, symm
 from pyscf import cc
 from pyscf.cc import ccsd_t
+from pyscf.cc import mpi_ccsd_t
 from pyscf.cc import gccsd, gccsd_t
 
 mol = gto.Mole()
@@ -76,6 +77,12 @@ class KnownValues(unittest.TestCase):
         e = ccsd_t.kernel(mycc, eris, t1, t2)
         self.assertAlmostEqual(e, -45.96028705175308, 9)
 
+        # three processes, each computes a part of the blocks
+        e = [ccsd_t.kernel(mycc, eris, t1, t2,
+                           task_scheduler=mpi_ccsd_t.StaticScheduler(rank, 3))
+             for rank in range(3)]
+        self.assertAlmostEqual(sum(e), -45.96028705175308, 9)
+
     def test_ccsd_t_symm(self):
         e3a = ccsd_t.kernel(mcc, mcc.ao2mo())
         self.assertAlmostEqual(e3a, -0.003060022611584471, 9)
@@ -136,6 +143,56 @@ class KnownValues(unittest.TestCase):
         self.assertAlmostEqual(abs(ref_vooo-vooo).sum(), 0, 9)
         self.assertAlmostEqual(abs(ref_t2T-t2T).sum(), 0, 9)
 
+    def test_dynamic_scheduler_order(self):
+        class comm:
+            Get_rank = staticmethod(lambda: 0)
+            Get_size = staticmethod(lambda: 1)
+        tasks = ccsd_t._tril_tasks(40, 120)
+        costs = [ccsd_t._task_cost(*x) for x in tasks]
+        tasks1 = list(mpi_ccsd_t.DynamicScheduler(comm)(tasks, costs))
+        self.assertEqual(sorted(tasks1), sorted(tasks))
+        # Most expensive a block first, its tasks in a row
+        a_blocks = [x[:2] for i, x in enumerate(tasks1)
+                    if i == 0 or x[:2] != tasks1[i-1][:2]]
+        self.assertEqual(len(a_blocks), len(set(a_blocks)))
+        block_costs = [sum(c for x, c in zip(tasks, costs) if x[:2] == blk)
+                       for blk in a_blocks]
+        self.assertEqual(block_costs, sorted(block_costs, reverse=True))
+        self.assertTrue(block_costs[0] > block_costs[-1])
+
+    def test_permute_kernels(self):
+        import ctypes
+        from pyscf.cc import _ccsd
+        n = 11
+        numpy.random.seed(2)
+        perms = ((0,1,2), (0,2,1), (1,0,2), (2,0,1), (1,2,0), (2,1,0))
+        w = numpy.random.random((n,n,n))
+        x = numpy.random.random((n,n,n))
+        for p, perm in enumerate(perms):
+            ref = w.copy()
+            ref += x.transpose(perm)
+            _ccsd.libcc._ccsd_t_add_permuted(w.ctypes.data_as(ctypes.c_void_p),
+                                             x.ctypes.data_as(ctypes.c_void_p),
+                                             ctypes.c_int(n), ctypes.c_int(p))
+            self.assertAlmostEqual(abs(w-ref).max(), 0, 12)
+
+        v = numpy.random.random((n,n,n)) + numpy.random.random((n,n,n))*1j
+        ref = (4 * v + v.transpose(1,2,0) + v.transpose(2,0,1)
+               - 2 * (v.transpose(2,1,0) + v.transpose(0,2,1) + v.transpose(1,0,2)))
+        out = numpy.empty_like(v)
+        _ccsd.libcc._ccsd_t_zpermute_sum(out.ctypes.data_as(ctypes.c_void_p),
+                                         v.ctypes.data_as(ctypes.c_void_p),
+                                         ctypes.c_int(n), ctypes.c_double(4),
+                                         ctypes.c_double(1), ctypes.c_double(-2))
+        self.assertAlmostEqual(abs(out-ref).max(), 0, 12)
+        v = v.real.copy()
+        out = numpy.empty_like(v)
+        _ccsd.libcc._ccsd_t_permute_sum(out.ctypes.data_as(ctypes.c_void_p),
+                                        v.ctypes.data_as(ctypes.c_void_p),
+                                        ctypes.c_int(n), ctypes.c_double(4),
+                                        ctypes.c_double(1), ctypes.c_double(-2))
+        self.assertAlmostEqual(abs(out-ref.real).max(), 0, 12)
+
     def test_ccsd_t_complex(self):
         mol = gto.M()
         numpy.random.seed(12)
@@ -85,6 +85,21 @@ class KnownValues(unittest.TestCase):
         self.assertAlmostEqual(lib.finger(numpy.array(eris.ovvv)), 59.418747028576142, 12)
         self.assertAlmostEqual(lib.finger(numpy.array(eris.vvvv)), 43.562457227975969, 12)
 
+    def test_df_vvvv_ovvv(self):
+        vvL = numpy.asarray(eris1.vvL)
+        Lvv = lib.unpack_tril(vvL.T)
+        vvvv = lib.einsum('Lac,Lbd->acbd', Lvv, Lvv)
+        ref = lib.einsum('ijcd,acbd->ijab', mycc1.t2, vvvv)
+        Ht2 = dfccsd._contract_vvvv_t2(mycc1, mol, eris1.vvL, mycc1.t2)
+        self.assertAlmostEqual(abs(Ht2-ref).max(), 0, 12)
+
+        ovvv = lib.einsum('iaL,pL->iap', numpy.asarray(eris1.ovL), vvL)
+        self.assertAlmostEqual(abs(eris1.ovvv[:,2:5]-ovvv[:,2:5]).max(), 0, 12)
+        self.assertAlmostEqual(abs(eris1.ovvv[-1]-ovvv[-1]).max(), 0, 12)
+        self.assertAlmostEqual(abs(eris1.ovvv[1,-2,3:-1]-ovvv[1,-2,3:-1]).max(), 0, 12)
+        self.assertRaises(IndexError, eris1.ovvv.__getitem__, (slice(None), slice(0,4,2)))
+        self.assertAlmostEqual(abs(eris1.get_ovvv(slice(1,3))-eris1.get_ovvv()[1:3]).max(), 0, 12)
+
 
     def test_df_ipccsd(self):
         e,v = mycc.ipccsd(nroots=1)
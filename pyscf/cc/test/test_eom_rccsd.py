@@ -62,6 +62,43 @@ def make_mycc1():
     mycc1.t2 = r2*1e-5
     return mf1, mycc1, eris1
 
+def make_random_rccsd():
+    '''CCSD amplitudes and integrals of random numbers'''
+    numpy.random.seed(1)
+    nocc, nvir = 4, 7
+    nmo = nocc + nvir
+    eri = numpy.random.random((nmo,nmo,nmo,nmo)) - .5
+    eri = eri + eri.transpose(1,0,2,3)
+    eri = eri + eri.transpose(0,1,3,2)
+    eri = eri + eri.transpose(2,3,0,1)
+    eri *= .05
+    mol1 = gto.M(verbose=0)
+    mol1.nelectron = nocc * 2
+    mf2 = scf.RHF(mol1)
+    mf2.mo_coeff = numpy.eye(nmo)
+    mf2.mo_occ = numpy.zeros(nmo)
+    mf2.mo_occ[:nocc] = 2
+    mf2.mo_energy = numpy.arange(nmo) * .5
+    mycc2 = ccsd.CCSD(mf2)
+    eris2 = ccsd._ChemistsERIs()
+    eris2.mol = mol1
+    eris2.nocc = nocc
+    eris2.mo_coeff = mf2.mo_coeff
+    f = numpy.random.random((nmo,nmo)) * .05
+    eris2.fock = f + f.T + numpy.diag(mf2.mo_energy)
+    o, v = slice(0,nocc), slice(nocc,nmo)
+    eris2.oooo = eri[o,o,o,o].copy()
+    eris2.ovoo = eri[o,v,o,o].copy()
+    eris2.ovov = eri[o,v,o,v].copy()
+    eris2.oovv = eri[o,o,v,v].copy()
+    eris2.ovvo = eri[o,v,v,o].copy()
+    eris2.ovvv = lib.pack_tril(eri[o,v,v,v].reshape(-1,nvir,nvir)).reshape(nocc,nvir,-1)
+    eris2.vvvv = ao2mo.restore(4, eri[v,v,v,v].copy(), nvir)
+    mycc2.t1 = numpy.random.random((nocc,nvir)) * .1
+    t2 = numpy.random.random((nocc,nocc,nvir,nvir)) * .1
+    mycc2.t2 = t2 + t2.transpose(1,0,3,2)
+    return mycc2, eris2
+
 mf1, mycc1, eris1 = make_mycc1()
 no, nv = mycc1.t1.shape
 
@@ -255,6 +292,24 @@ class KnownValues(unittest.TestCase):
         self.assertAlmostEqual(lib.finger(r1), -112883.3791497977, 8)
         self.assertAlmostEqual(lib.finger(r2), -268199.3475813322, 8)
 
+    def test_eomee_ccsd_matvec_singlet_block(self):
+        mycc2, eris2 = make_random_rccsd()
+        myeom = eom_rccsd.EOMEESinglet(mycc2)
+        imds = myeom.make_imds(eris2)
+        numpy.random.seed(11)
+        vecs = numpy.random.random((3,myeom.vector_size())) - .9
+        # Fingerprints of the single-vector eeccsd_matvec_singlet before it
+        # was vectorized over a block of vectors
+        ref = [-28.827733271152553, -3.8352511623110406, 3.952603514639586]
+        vec1 = myeom.matvec(vecs, imds)
+        for k in range(3):
+            self.assertAlmostEqual(lib.finger(vec1[k]), ref[k], 9)
+        self.assertAlmostEqual(lib.finger(myeom.matvec(vecs[1], imds)), ref[1], 9)
+        matvec, diag = myeom.gen_matvec(imds)
+        vec1 = matvec(list(vecs))
+        for k in range(3):
+            self.assertAlmostEqual(lib.finger(vec1[k]), ref[k], 9)
+
     def test_eomee_ccsd_matvec_triplet(self):
         numpy.random.seed(10)
         r1 = numpy.random.random((no,nv)) - .9
@@ -84,6 +84,82 @@ def tearDownModule():
     global mol, mf, mol1, mf0, mf1, gmf, ucc, ucc0, ucc1, eris1
     del mol, mf, mol1, mf0, mf1, gmf, ucc, ucc0, ucc1, eris1
 
+def make_random_uccsd():
+    '''UCCSD amplitudes and integrals of random numbers'''
+    numpy.random.seed(2)
+    nocca, noccb, nmo = 4, 3, 10
+    nvira, nvirb = nmo - nocca, nmo - noccb
+    def sym8(x):
+        x = x + x.transpose(1,0,2,3)
+        x = x + x.transpose(0,1,3,2)
+        return x + x.transpose(2,3,0,1)
+    eri_aa = sym8(numpy.random.random((nmo,)*4) - .5) * .05
+    eri_bb = sym8(numpy.random.random((nmo,)*4) - .5) * .05
+    eri_ab = numpy.random.random((nmo,)*4) - .5
+    eri_ab = eri_ab + eri_ab.transpose(1,0,2,3)
+    eri_ab = (eri_ab + eri_ab.transpose(0,1,3,2)) * .05
+    eri_ba = eri_ab.transpose(2,3,0,1)
+    mol1 = gto.M(verbose=0)
+    mol1.nelectron = nocca + noccb
+    mol1.spin = nocca - noccb
+    mf2 = scf.UHF(mol1)
+    mf2.mo_coeff = (numpy.eye(nmo),) * 2
+    mf2.mo_occ = numpy.zeros((2,nmo))
+    mf2.mo_occ[0,:nocca] = 1
+    mf2.mo_occ[1,:noccb] = 1
+    mf2.mo_energy = (numpy.arange(nmo)*.5, numpy.arange(nmo)*.5+.1)
+    ucc2 = uccsd.UCCSD(mf2)
+    eris2 = uccsd._ChemistsERIs()
+    eris2.mol = mol1
+    eris2.nocc = (nocca, noccb)
+    eris2.mo_coeff = mf2.mo_coeff
+    def make_fock(e):
+        f = numpy.random.random((nmo,nmo)) * .05
+        return f + f.T + numpy.diag(e)
+    eris2.focka = make_fock(mf2.mo_energy[0])
+    eris2.fockb = make_fock(mf2.mo_energy[1])
+    eris2.fock = (eris2.focka, eris2.fockb)
+    oa, va = slice(0,nocca), slice(nocca,nmo)
+    ob, vb = slice(0,noccb), slice(noccb,nmo)
+    eris2.oooo = eri_aa[oa,oa,oa,oa].copy()
+    eris2.ovoo = eri_aa[oa,va,oa,oa].copy()
+    eris2.ovov = eri_aa[oa,va,oa,va].copy()
+    eris2.oovv = eri_aa[oa,oa,va,va].copy()
+    eris2.ovvo = eri_aa[oa,va,va,oa].copy()
+    eris2.ovvv = lib.pack_tril(eri_aa[oa,va,va,va].reshape(-1,nvira,nvira)).reshape(nocca,nvira,-1)
+    eris2.vvvv = ao2mo.restore(4, eri_aa[va,va,va,va].copy(), nvira)
+    eris2.OOOO = eri_bb[ob,ob,ob,ob].copy()
+    eris2.OVOO = eri_bb[ob,vb,ob,ob].copy()
+    eris2.OVOV = eri_bb[ob,vb,ob,vb].copy()
+    eris2.OOVV = eri_bb[ob,ob,vb,vb].copy()
+    eris2.OVVO = eri_bb[ob,vb,vb,ob].copy()
+    eris2.OVVV = lib.pack_tril(eri_bb[ob,vb,vb,vb].reshape(-1,nvirb,nvirb)).reshape(noccb,nvirb,-1)
+    eris2.VVVV = ao2mo.restore(4, eri_bb[vb,vb,vb,vb].copy(), nvirb)
+    eris2.ooOO = eri_ab[oa,oa,ob,ob].copy()
+    eris2.ovOO = eri_ab[oa,va,ob,ob].copy()
+    eris2.ovOV = eri_ab[oa,va,ob,vb].copy()
+    eris2.ooVV = eri_ab[oa,oa,vb,vb].copy()
+    eris2.ovVO = eri_ab[oa,va,vb,ob].copy()
+    eris2.ovVV = lib.pack_tril(eri_ab[oa,va,vb,vb].reshape(-1,nvirb,nvirb)).reshape(nocca,nvira,-1)
+    vvVV = eri_ab[va,va,vb,vb].reshape(nvira**2,nvirb**2)
+    idxa = numpy.tril_indices(nvira)
+    idxb = numpy.tril_indices(nvirb)
+    eris2.vvVV = lib.take_2d(vvVV, idxa[0]*nvira+idxa[1], idxb[0]*nvirb+idxb[1])
+    eris2.OVoo = eri_ba[ob,vb,oa,oa].copy()
+    eris2.OOvv = eri_ba[ob,ob,va,va].copy()
+    eris2.OVvo = eri_ba[ob,vb,va,oa].copy()
+    eris2.OVvv = lib.pack_tril(eri_ba[ob,vb,va,va].reshape(-1,nvira,nvira)).reshape(noccb,nvirb,-1)
+    def antisym(t):
+        t = t - t.transpose(1,0,2,3)
+        return t - t.transpose(0,1,3,2)
+    ucc2.t1 = (numpy.random.random((nocca,nvira)) * .1,
+               numpy.random.random((noccb,nvirb)) * .1)
+    ucc2.t2 = (antisym(numpy.random.random((nocca,nocca,nvira,nvira)) * .1),
+               numpy.random.random((nocca,noccb,nvira,nvirb)) * .1,
+               antisym(numpy.random.random((noccb,noccb,nvirb,nvirb)) * .1))
+    return ucc2, eris2
+
+
 class KnownValues(unittest.TestCase):
     def test_ipccsd(self):
         eom = ucc.eomip_method()
@@ -214,6 +290,24 @@ class KnownValues(unittest.TestCase):
         self.assertAlmostEqual(float(abs(gr2-gcc1.spatial2spin(r2)).max()), 0, 9)
         self.assertAlmostEqual(lib.finger(vec1), 49.499911123484523, 9)
 
+    def test_ucc_eomee_ccsd_matvec_block(self):
+        ucc2, eris2 = make_random_uccsd()
+        uee2 = eom_uccsd.EOMEESpinKeep(ucc2)
+        imds = uee2.make_imds(eris2)
+        numpy.random.seed(11)
+        vecs = numpy.random.random((3,uee2.vector_size())) - .9
+        # Fingerprints of the single-vector eomee_ccsd_matvec before it was
+        # vectorized over a block of vectors
+        ref = [-34.12047187492122, 1.7783295372785304, -48.42100395454454]
+        vec1 = uee2.matvec(vecs, imds)
+        for k in range(3):
+            self.assertAlmostEqual(lib.finger(vec1[k]), ref[k], 9)
+        self.assertAlmostEqual(lib.finger(uee2.matvec(vecs[1], imds)), ref[1], 9)
+        matvec, diag = uee2.gen_matvec(imds)
+        vec1 = matvec(list(vecs))
+        for k in range(3):
+            self.assertAlmostEqual(lib.finger(vec1[k]), ref[k], 9)
+
     def test_ucc_eomee_ccsd_diag(self):  # FIXME: compare to EOMEE-GCCSD diag
         vec1, vec2 = eom_uccsd.EOMEE(ucc1).get_diag()
         self.assertAlmostEqual(lib.finger(vec1), 62.767648620751018, 9)
@@ -21,6 +21,7 @@ from functools import reduce
 from pyscf import gto, scf, lib, symm
 from pyscf import cc
 from pyscf.cc import uccsd_t
+from pyscf.cc import mpi_ccsd_t
 from pyscf.cc import gccsd, gccsd_t
 
 mol = gto.Mole()
@@ -80,6 +81,11 @@ class KnownValues(unittest.TestCase):
         e3a = uccsd_t.kernel(mycc, eris, [t1a,t1b], [t2aa, t2ab, t2bb])
         self.assertAlmostEqual(e3a, 15.582860941071505, 8)
 
+        e3a = [uccsd_t.kernel(mycc, eris, [t1a,t1b], [t2aa, t2ab, t2bb],
+                              task_scheduler=mpi_ccsd_t.StaticScheduler(rank, 3))
+               for rank in range(3)]
+        self.assertAlmostEqual(sum(e3a), 15.582860941071505, 8)
+
         e3a = mcc.ccsd_t()
         self.assertAlmostEqual(e3a, -0.0009857042572475674, 11)
 
@@ -458,8 +458,10 @@ def _add_vvvv(mycc, t1, t2, eris, out=None, with_ovvv=False, t2sym=None):
         t2aa, t2ab, t2bb = t2
     else:
         t2aa, t2ab, t2bb = make_tau(t2, t1, t1)
-    nocca, nvira = t2aa.shape[1:3]
-    noccb, nvirb = t2bb.shape[1:3]
+    # If t1 is None, t2 can be a block of amplitudes with an extra leading
+    # dimension.  The integrals are contracted with all of them in one pass.
+    nocca, nvira = t2aa.shape[-3:-1]
+    noccb, nvirb = t2bb.shape[-3:-1]
 
     if mycc.direct:
         assert(t2sym is None)
@@ -475,18 +477,23 @@ def _add_vvvv(mycc, t1, t2, eris, out=None, with_ovvv=False, t2sym=None):
         otrila = np.tril_indices(nocca,-1)
         otrilb = np.tril_indices(noccb,-1)
         if nocca > 1:
-            tauaa = lib.einsum('xab,pa->xpb', t2aa[otrila], mo_a[:,nocca:])
+            tauaa = t2aa[...,otrila[0],otrila[1],:,:].reshape(-1,nvira,nvira)
+            tauaa = lib.einsum('xab,pa->xpb', tauaa, mo_a[:,nocca:])
             tauaa = lib.einsum('xab,pb->xap', tauaa, mo_a[:,nocca:])
         else:
             tauaa = np.zeros((0,nao,nao))
         if noccb > 1:
-            taubb = lib.einsum('xab,pa->xpb', t2bb[otrilb], mo_b[:,noccb:])
+            taubb = t2bb[...,otrilb[0],otrilb[1],:,:].reshape(-1,nvirb,nvirb)
+            taubb = lib.einsum('xab,pa->xpb', taubb, mo_b[:,noccb:])
             taubb = lib.einsum('xab,pb->xap', taubb, mo_b[:,noccb:])
         else:
             taubb = np.zeros((0,nao,nao))
-        tauab = lib.einsum('ijab,pa->ijpb', t2ab, mo_a[:,nocca:])
+        tauab = t2ab.reshape(-1,noccb,nvira,nvirb)
+        tauab = lib.einsum('ijab,pa->ijpb', tauab, mo_a[:,nocca:])
         tauab = lib.einsum('ijab,pb->ijap', tauab, mo_b[:,noccb:])
-        tau = np.vstack((tauaa, taubb, tauab.reshape(nocca*noccb,nao,nao)))
+        naa = tauaa.shape[0]
+        nbb = taubb.shape[0]
+        tau = np.vstack((tauaa, taubb, tauab.reshape(-1,nao,nao)))
         tauaa = taubb = tauab = None
         time0 = log.timer_debug1('vvvv-tau', *time0)
 
@@ -495,33 +502,35 @@ def _add_vvvv(mycc, t1, t2, eris, out=None, with_ovvv=False, t2sym=None):
         mo = np.asarray(np.hstack((mo_a[:,nocca:], mo_b[:,noccb:])), order='F')
         u2aa = np.zeros_like(t2aa)
         if nocca > 1:
-            u2tril = buf[:otrila[0].size]
+            u2tril = buf[:naa]
             u2tril = _ao2mo.nr_e2(u2tril.reshape(-1,nao**2), mo.conj(),
                                   (0,nvira,0,nvira), 's1', 's1')
-            u2tril = u2tril.reshape(otrila[0].size,nvira,nvira)
-            u2aa[otrila[1],otrila[0]] = u2tril.transpose(0,2,1)
-            u2aa[otrila] = u2tril
+            u2tril = u2tril.reshape(t2aa.shape[:-4]+(-1,nvira,nvira))
+            u2aa[...,otrila[1],otrila[0],:,:] = u2tril.swapaxes(-1,-2)
+            u2aa[...,otrila[0],otrila[1],:,:] = u2tril
 
         u2bb = np.zeros_like(t2bb)
         if noccb > 1:
-            u2tril = buf[otrila[0].size:otrila[0].size+otrilb[0].size]
+            u2tril = buf[naa:naa+nbb]
             u2tril = _ao2mo.nr_e2(u2tril.reshape(-1,nao**2), mo.conj(),
                                   (nvira,nvira+nvirb,nvira,nvira+nvirb), 's1', 's1')
-            u2tril = u2tril.reshape(otrilb[0].size,nvirb,nvirb)
-            u2bb[otrilb[1],otrilb[0]] = u2tril.transpose(0,2,1)
-            u2bb[otrilb] = u2tril
+            u2tril = u2tril.reshape(t2bb.shape[:-4]+(-1,nvirb,nvirb))
+            u2bb[...,otrilb[1],otrilb[0],:,:] = u2tril.swapaxes(-1,-2)
+            u2bb[...,otrilb[0],otrilb[1],:,:] = u2tril
 
-        u2ab = _ao2mo.nr_e2(buf[-nocca*noccb:].reshape(nocca*noccb,nao**2), mo,
+        u2ab = _ao2mo.nr_e2(buf[naa+nbb:].reshape(-1,nao**2), mo,
                             (0,nvira,nvira,nvira+nvirb), 's1', 's1')
         u2ab = u2ab.reshape(t2ab.shape)
 
     else:
         assert(not with_ovvv)
         if t2sym is None:
-            tmp = eris._contract_vvvv_t2(mycc, t2aa[np.tril_indices(nocca)],
+            otrila = np.tril_indices(nocca)
+            otrilb = np.tril_indices(noccb)
+            tmp = eris._contract_vvvv_t2(mycc, t2aa[...,otrila[0],otrila[1],:,:],
                                          mycc.direct, None)
             u2aa = ccsd._unpack_t2_tril(tmp, nocca, nvira, None, 'jiba')
-            tmp = eris._contract_VVVV_t2(mycc, t2bb[np.tril_indices(noccb)],
+            tmp = eris._contract_VVVV_t2(mycc, t2bb[...,otrilb[0],otrilb[1],:,:],
                                          mycc.direct, None)
             u2bb = ccsd._unpack_t2_tril(tmp, noccb, nvirb, None, 'jiba')
             u2ab = eris._contract_vvVV_t2(mycc, t2ab, mycc.direct, None)
@@ -1035,9 +1044,10 @@ def make_tau(t2, t1, r1, fac=1, out=None):
     return tau1aa, tau1ab, tau1bb
 
 def make_tau_aa(t2aa, t1a, r1a, fac=1, out=None):
-    tau1aa = np.einsum('ia,jb->ijab', t1a, r1a)
-    tau1aa-= np.einsum('ia,jb->jiab', t1a, r1a)
-    tau1aa = tau1aa - tau1aa.transpose(0,1,3,2)
+    # t2 and t1 can be blocks of amplitudes with a leading dimension
+    tau1aa = np.einsum('...ia,jb->...ijab', t1a, r1a)
+    tau1aa-= np.einsum('...ia,jb->...jiab', t1a, r1a)
+    tau1aa = tau1aa - tau1aa.swapaxes(-1,-2)
     tau1aa *= fac * .5
     tau1aa += t2aa
     return tau1aa
@@ -1045,8 +1055,8 @@ def make_tau_aa(t2aa, t1a, r1a, fac=1, out=None):
 def make_tau_ab(t2ab, t1, r1, fac=1, out=None):
     t1a, t1b = t1
     r1a, r1b = r1
-    tau1ab = np.einsum('ia,jb->ijab', t1a, r1b)
-    tau1ab+= np.einsum('ia,jb->ijab', r1a, t1b)
+    tau1ab = np.einsum('...ia,jb->...ijab', t1a, r1b)
+    tau1ab+= np.einsum('ia,...jb->...ijab', r1a, t1b)
     tau1ab *= fac * .5
     tau1ab += t2ab
     return tau1ab
@@ -22,12 +22,22 @@ UCCSD(T)
 
 import time
 import ctypes
+import functools
 import numpy
 from pyscf import lib
 from pyscf.lib import logger
 from pyscf.cc import _ccsd
+from pyscf.cc import ccsd_t
 
-def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
+def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE,
+           task_scheduler=None):
+    '''UCCSD(T) correction
+
+    Kwargs:
+        task_scheduler : callable
+            Distributes the (a0,a1,b0,b1) blocks over processes, see
+            ccsd_t.kernel and cc.mpi_ccsd_t.
+    '''
     cpu1 = cpu0 = (time.clock(), time.time())
     log = logger.new_logger(mycc, verbose)
     if t1 is None: t1 = mycc.t1
@@ -68,24 +78,11 @@ def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
     log.debug('max_memory %d MB (%d MB in use)', max_memory, mem_now)
     orbsym = numpy.zeros(nocca, dtype=int)
     contract = _gen_contract_aaa(t1aT, t2aaT, eris_vooo, eris.focka, orbsym, log)
-    with lib.call_in_background(contract, sync=not mycc.async_io) as ctr:
-        for a0, a1 in reversed(list(lib.prange_tril(0, nvira, bufsize))):
-            cache_row_a = numpy.asarray(eris_vvop[a0:a1,:a1], order='C')
-            if a0 == 0:
-                cache_col_a = cache_row_a
-            else:
-                cache_col_a = numpy.asarray(eris_vvop[:a0,a0:a1], order='C')
-            ctr(et_sum, a0, a1, a0, a1, (cache_row_a,cache_col_a,
-                                         cache_row_a,cache_col_a))
-
-            for b0, b1 in lib.prange_tril(0, a0, bufsize/8):
-                cache_row_b = numpy.asarray(eris_vvop[b0:b1,:b1], order='C')
-                if b0 == 0:
-                    cache_col_b = cache_row_b
-                else:
-                    cache_col_b = numpy.asarray(eris_vvop[:b0,b0:b1], order='C')
-                ctr(et_sum, a0, a1, b0, b1, (cache_row_a,cache_col_a,
-                                             cache_row_b,cache_col_b))
+    tasks = ccsd_t._tril_tasks(nvira, bufsize)
+    if task_scheduler is not None:
+        tasks = task_scheduler(tasks, [ccsd_t._task_cost(*x) for x in tasks])
+    ccsd_t._contract_tril_tasks(functools.partial(contract, et_sum), eris_vvop,
+                                tasks, mycc.async_io)
     cpu1 = log.timer_debug1('contract_aaa', *cpu1)
 
     # bbb
@@ -93,24 +90,11 @@ def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
     log.debug('max_memory %d MB (%d MB in use)', max_memory, mem_now)
     orbsym = numpy.zeros(noccb, dtype=int)
     contract = _gen_contract_aaa(t1bT, t2bbT, eris_VOOO, eris.fockb, orbsym, log)
-    with lib.call_in_background(contract, sync=not mycc.async_io) as ctr:
-        for a0, a1 in reversed(list(lib.prange_tril(0, nvirb, bufsize))):
-            cache_row_a = numpy.asarray(eris_VVOP[a0:a1,:a1], order='C')
-            if a0 == 0:
-                cache_col_a = cache_row_a
-            else:
-                cache_col_a = numpy.asarray(eris_VVOP[:a0,a0:a1], order='C')
-            ctr(et_sum, a0, a1, a0, a1, (cache_row_a,cache_col_a,
-                                         cache_row_a,cache_col_a))
-
-            for b0, b1 in lib.prange_tril(0, a0, bufsize/8):
-                cache_row_b = numpy.asarray(eris_VVOP[b0:b1,:b1], order='C')
-                if b0 == 0:
-                    cache_col_b = cache_row_b
-                else:
-                    cache_col_b = numpy.asarray(eris_VVOP[:b0,b0:b1], order='C')
-                ctr(et_sum, a0, a1, b0, b1, (cache_row_a,cache_col_a,
-                                             cache_row_b,cache_col_b))
+    tasks = ccsd_t._tril_tasks(nvirb, bufsize)
+    if task_scheduler is not None:
+        tasks = task_scheduler(tasks, [ccsd_t._task_cost(*x) for x in tasks])
+    ccsd_t._contract_tril_tasks(functools.partial(contract, et_sum), eris_VVOP,
+                                tasks, mycc.async_io)
     cpu1 = log.timer_debug1('contract_bbb', *cpu1)
 
     # Cache t2abT in t2ab to reduce memory footprint
@@ -123,15 +107,11 @@ def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
     fock = (eris.focka, eris.fockb)
     vooo = (eris_vooo, eris_vOoO, eris_VoOo)
     contract = _gen_contract_baa(ts, vooo, fock, orbsym, log)
-    with lib.call_in_background(contract, sync=not mycc.async_io) as ctr:
-        for a0, a1 in lib.prange(0, nvirb, int(bufsize/nvira+1)):
-            cache_row_a = numpy.asarray(eris_VvOp[a0:a1,:], order='C')
-            cache_col_a = numpy.asarray(eris_vVoP[:,a0:a1], order='C')
-            for b0, b1 in lib.prange_tril(0, nvira, bufsize/6/2):
-                cache_row_b = numpy.asarray(eris_vvop[b0:b1,:b1], order='C')
-                cache_col_b = numpy.asarray(eris_vvop[:b0,b0:b1], order='C')
-                ctr(et_sum, a0, a1, b0, b1, (cache_row_a,cache_col_a,
-                                             cache_row_b,cache_col_b))
+    tasks = _baa_tasks(nvirb, nvira, bufsize)
+    if task_scheduler is not None:
+        tasks = task_scheduler(tasks, [_baa_task_cost(*x) for x in tasks])
+    _contract_baa_tasks(functools.partial(contract, et_sum),
+                        (eris_VvOp, eris_vVoP, eris_vvop), tasks, mycc.async_io)
     cpu1 = log.timer_debug1('contract_baa', *cpu1)
 
     t2baT = numpy.ndarray((nvirb,nvira,noccb,nocca), buffer=t2abT,
@@ -142,20 +122,18 @@ def kernel(mycc, eris, t1=None, t2=None, verbose=logger.NOTE):
     fock = (eris.fockb, eris.focka)
     vooo = (eris_VOOO, eris_VoOo, eris_vOoO)
     contract = _gen_contract_baa(ts, vooo, fock, orbsym, log)
-    for a0, a1 in lib.prange(0, nvira, int(bufsize/nvirb+1)):
-        with lib.call_in_background(contract, sync=not mycc.async_io) as ctr:
-            cache_row_a = numpy.asarray(eris_vVoP[a0:a1,:], order='C')
-            cache_col_a = numpy.asarray(eris_VvOp[:,a0:a1], order='C')
-            for b0, b1 in lib.prange_tril(0, nvirb, bufsize/6/2):
-                cache_row_b = numpy.asarray(eris_VVOP[b0:b1,:b1], order='C')
-                cache_col_b = numpy.asarray(eris_VVOP[:b0,b0:b1], order='C')
-                ctr(et_sum, a0, a1, b0, b1, (cache_row_a,cache_col_a,
-                                             cache_row_b,cache_col_b))
+    tasks = _baa_tasks(nvira, nvirb, bufsize)
+    if task_scheduler is not None:
+        tasks = task_scheduler(tasks, [_baa_task_cost(*x) for x in tasks])
+    _contract_baa_tasks(functools.partial(contract, et_sum),
+                        (eris_vVoP, eris_VvOp, eris_VVOP), tasks, mycc.async_io)
     cpu1 = log.timer_debug1('contract_abb', *cpu1)
 
     # Restore t2ab
     lib.transpose(t2baT.transpose(1,0,3,2).copy().reshape(nvira*nvirb,nocca*noccb),
                   out=t2ab)
+    if task_scheduler is not None:
+        et_sum = task_scheduler.allreduce(et_sum)
     et_sum *= .25
     if abs(et_sum[0].imag) > 1e-4:
         logger.warn(mycc, 'Non-zero imaginary part of UCCSD(T) energy was found %s',
@@ -253,6 +231,31 @@ def _gen_contract_baa(ts, vooo, fock, orbsym, log):
         cpu2[:] = log.timer_debug1('contract %d:%d,%d:%d'%(a0,a1,b0,b1), *cpu2)
     return contract
 
+def _baa_tasks(nvira, nvirb, bufsize):
+    '''Blocks (a0,a1,b0,b1) of the triples (a,b,c), c <= b, a of the other spin'''
+    tasks = []
+    for a0, a1 in lib.prange(0, nvira, int(bufsize/nvirb+1)):
+        for b0, b1 in lib.prange_tril(0, nvirb, bufsize/6/2):
+            tasks.append((a0, a1, b0, b1))
+    return tasks
+
+def _baa_task_cost(a0, a1, b0, b1):
+    return (a1-a0) * (b1-b0) * (b0+b1+1) // 2
+
+def _contract_baa_tasks(contract, eris, tasks, async_io=True):
+    eris_VvOp, eris_vVoP, eris_vvop = eris
+    with lib.call_in_background(contract, sync=not async_io) as ctr:
+        a_block = None
+        for a0, a1, b0, b1 in tasks:
+            if a_block != (a0, a1):
+                a_block = (a0, a1)
+                cache_row_a = numpy.asarray(eris_VvOp[a0:a1,:], order='C')
+                cache_col_a = numpy.asarray(eris_vVoP[:,a0:a1], order='C')
+            cache_row_b = numpy.asarray(eris_vvop[b0:b1,:b1], order='C')
+            cache_col_b = numpy.asarray(eris_vvop[:b0,b0:b1], order='C')
+            ctr(a0, a1, b0, b1, (cache_row_a,cache_col_a,
+                                 cache_row_b,cache_col_b))
+
 def _sort_eri(mycc, eris, h5tmp, log):
     cpu1 = (time.clock(), time.time())
     nocca = eris.nocca
@@ -39,6 +39,7 @@ _itrf.LIBXC_hybrid_coeff.argtypes = [ctypes.c_int]
 _itrf.LIBXC_hybrid_coeff.restype = ctypes.c_double
 _itrf.LIBXC_nlc_coeff.argtypes = [ctypes.c_int,ctypes.POINTER(ctypes.c_double)]
 _itrf.LIBXC_rsh_coeff.argtypes = [ctypes.c_int,ctypes.POINTER(ctypes.c_double)]
+_itrf.LIBXC_evaluator_nvar.restype = ctypes.c_int
 
 # xc_code from libxc
 #cat lib/deps/include/xc_funcs.h  | awk '{printf("'\''%s'\'' %3i",$2,$3); for(i=4;i<NF;i++) {printf(" %s",$i)}; printf("\n")}'  | sed "s|/\*|# |g" | awk '{printf("%-30s : %4i\,",$1,$2); for(i=4;i<NF;i++) {printf(" %s",$i)}; printf("\n")}'
@@ -1035,6 +1036,35 @@ def eval_xc(xc_code, rho, spin=0, relativity=0, deriv=1, verbose=None):
     return _eval_xc(fn_facs, rho, spin, relativity, deriv, verbose)
 
 
+class _XCEvaluator(object):
+    '''Handle of the libxc functionals of one XC code.  The functionals are
+    initialized once and the evaluator (including its thread-local scratch
+    buffers) is reused for every grid block of an SCF calculation.
+    '''
+    def __init__(self, fn_ids, facs, nspin):
+        self._this = ctypes.c_void_p()
+        n = len(fn_ids)
+        _itrf.LIBXC_init_evaluator(ctypes.byref(self._this), ctypes.c_int(n),
+                                   (ctypes.c_int*n)(*fn_ids),
+                                   (ctypes.c_double*n)(*facs),
+                                   ctypes.c_int(nspin))
+        self.nvar = _itrf.LIBXC_evaluator_nvar(self._this)
+
+    def __del__(self):
+        _itrf.LIBXC_del_evaluator(ctypes.byref(self._this))
+
+# Evaluators of the recently used XC codes
+_EVALUATOR_CACHE = {}
+_EVALUATOR_CACHE_SIZE = 8
+def _get_evaluator(fn_ids, facs, nspin):
+    key = (tuple(fn_ids), tuple(facs), nspin)
+    if key not in _EVALUATOR_CACHE:
+        if len(_EVALUATOR_CACHE) >= _EVALUATOR_CACHE_SIZE:
+            _EVALUATOR_CACHE.clear()
+        _EVALUATOR_CACHE[key] = _XCEvaluator(fn_ids, facs, nspin)
+    return _EVALUATOR_CACHE[key]
+
+
 SINGULAR_IDS = set((131,  # LYP functions
                     402, 404, 411, 416, 419,   # hybrid LYP functions
                     74 , 75 , 226, 227))       # M11L and MN12L functional
@@ -1087,14 +1117,12 @@ def _eval_xc(fn_facs, rho, spin=0, relativity=0, deriv=1, verbose=None):
     else:
         outbuf = numpy.empty((outlen,ngrids))
 
-    n = len(fn_ids)
-    _itrf.LIBXC_eval_xc(ctypes.c_int(n),
-                        (ctypes.c_int*n)(*fn_ids), (ctypes.c_double*n)(*facs),
-                        ctypes.c_int(nspin),
-                        ctypes.c_int(deriv), ctypes.c_int(rho_u.shape[1]),
-                        rho_u.ctypes.data_as(ctypes.c_void_p),
-                        rho_d.ctypes.data_as(ctypes.c_void_p),
-                        outbuf.ctypes.data_as(ctypes.c_void_p))
+    xcobj = _get_evaluator(fn_ids, facs, nspin)
+    _itrf.LIBXC_eval_xc_batch(xcobj._this, ctypes.c_int(deriv),
+                              ctypes.c_int(rho_u.shape[1]),
+                              rho_u.ctypes.data_as(ctypes.c_void_p),
+                              rho_d.ctypes.data_as(ctypes.c_void_p),
+                              outbuf.ctypes.data_as(ctypes.c_void_p))
     if outbuf.shape[1] != ngrids:
         out = numpy.zeros((outlen,ngrids))
         out[:,non0idx] = outbuf
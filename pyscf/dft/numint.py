@@ -43,6 +43,12 @@ OCCDROP = getattr(__config__, 'dft_numint_OCCDROP', 1e-12)
 # If the number of AOs in the system is less than this value, all tensors are
 # treated as dense quantities and contracted by dgemm directly.
 SWITCH_SIZE = getattr(__config__, 'dft_numint_SWITCH_SIZE', 800)
+# XC functional is not evaluated on the blocks of grids (BLKSIZE grids per
+# block) on which the density is everywhere smaller than this value.  It can
+# be set per NumInt object (attribute small_rho_block_cutoff).  If it is
+# positive, RKS/UKS also drops these blocks from the grids when the grids are
+# first built (see dft.rks.prune_small_rho_grids_).
+SMALL_RHO_BLOCK_CUTOFF = getattr(__config__, 'dft_numint_SMALL_RHO_BLOCK_CUTOFF', 0)
 
 def eval_ao(mol, coords, deriv=0, shls_slice=None,
             non0tab=None, out=None, verbose=None):
@@ -577,6 +583,87 @@ def _dot_ao_dm(mol, ao, dm, non0tab, shls_slice, ao_loc, out=None):
        pnon0tab, pshls_slice, pao_loc)
     return vm
 
+def _screen_rho_blocks(rho, cutoff):
+    '''Find the blocks of grids (BLKSIZE grids per block) on which the
+    density is not negligible.
+
+    Returns:
+        rho_bound, the upper bound of the density of each block, and
+        keep, a boolean mask of the blocks of which the bound is not smaller
+        than cutoff
+    '''
+    if isinstance(rho, (tuple, list)):  # (rho_a, rho_b)
+        den = rho[0][0] + rho[1][0] if rho[0].ndim == 2 else rho[0] + rho[1]
+    else:
+        den = rho[0] if rho.ndim == 2 else rho
+    den = numpy.asarray(den, order='C')
+    ngrids = den.size
+    nblk = (ngrids+BLKSIZE-1) // BLKSIZE
+    keep = numpy.empty(nblk, dtype=numpy.int8)
+    rho_bound = numpy.empty(nblk)
+    libdft.VXCscreen_rho_blocks(keep.ctypes.data_as(ctypes.c_void_p),
+                                rho_bound.ctypes.data_as(ctypes.c_void_p),
+                                den.ctypes.data_as(ctypes.c_void_p),
+                                ctypes.c_double(cutoff), ctypes.c_int(ngrids))
+    return rho_bound, keep.astype(bool)
+
+def _skip_small_rho(rho, non0tab, cutoff):
+    '''Screen the blocks of grids on which the density is smaller than
+    cutoff.  The AO values are not copied.  The screened blocks are removed
+    from non0tab, which lets _dot_ao_ao skip them for large basis sets, and
+    the functional is only evaluated on the remaining grids (see
+    _eval_xc_on_grids).
+
+    Returns:
+        None if the density is negligible on all grids.  Otherwise idx, the
+        indices of the remaining grids (None if no block is screened), and
+        non0tab without the screened blocks.
+    '''
+    if cutoff <= 0:
+        return None, non0tab
+    keep = _screen_rho_blocks(rho, cutoff)[1]
+    if keep.all():
+        return None, non0tab
+    elif not keep.any():
+        return None
+
+    if isinstance(rho, (tuple, list)):
+        ngrids = rho[0].shape[-1]
+    else:
+        ngrids = rho.shape[-1]
+    idx = numpy.where(numpy.repeat(keep, BLKSIZE)[:ngrids])[0]
+    if non0tab is not None:
+        non0tab = numpy.array(non0tab[:keep.size], order='C')
+        non0tab[~keep] = 0
+    return idx, non0tab
+
+def _eval_xc_on_grids(ni, xc_code, rho, spin, relativity, verbose, idx):
+    '''exc and vxc of ni.eval_xc on the grids idx (all grids if idx is
+    None).  They are zero on the other grids.
+    '''
+    if idx is None:
+        return ni.eval_xc(xc_code, rho, spin, relativity, 1, verbose)[:2]
+
+    if spin == 0:
+        ngrids = rho.shape[-1]
+        rho = numpy.asarray(rho[...,idx], order='C')
+    else:
+        ngrids = rho[0].shape[-1]
+        rho = (numpy.asarray(rho[0][...,idx], order='C'),
+               numpy.asarray(rho[1][...,idx], order='C'))
+    exc, vxc = ni.eval_xc(xc_code, rho, spin, relativity, 1, verbose)[:2]
+    exc1 = numpy.zeros(ngrids)
+    exc1[idx] = exc
+    vxc1 = []
+    for v in vxc:
+        if v is None:
+            vxc1.append(None)
+        else:
+            v1 = numpy.zeros((ngrids,) + v.shape[1:])
+            v1[idx] = v
+            vxc1.append(v1)
+    return exc1, vxc1
+
 def nr_vxc(mol, grids, xc_code, dms, spin=0, relativity=0, hermi=0,
            max_memory=2000, verbose=None):
     '''
@@ -674,6 +761,7 @@ def nr_rks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
     excsum = numpy.zeros(nset)
     vmat = numpy.zeros((nset,nao,nao))
     aow = None
+    rho_cutoff = getattr(ni, 'small_rho_block_cutoff', SMALL_RHO_BLOCK_CUTOFF)
     if xctype == 'LDA':
         ao_deriv = 0
         for ao, mask, weight, coords \
@@ -681,14 +769,19 @@ def nr_rks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
             aow = numpy.ndarray(ao.shape, order='F', buffer=aow)
             for idm in range(nset):
                 rho = make_rho(idm, ao, mask, 'LDA')
-                exc, vxc = ni.eval_xc(xc_code, rho, 0, relativity, 1, verbose)[:2]
+                screened = _skip_small_rho(rho, mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                exc, vxc = _eval_xc_on_grids(ni, xc_code, rho, 0, relativity,
+                                             verbose, idx)
                 vrho = vxc[0]
                 den = rho * weight
                 nelec[idm] += den.sum()
                 excsum[idm] += numpy.dot(den, exc)
                 # *.5 because vmat + vmat.T
                 aow = numpy.einsum('pi,p->pi', ao, .5*weight*vrho, out=aow)
-                vmat[idm] += _dot_ao_ao(mol, ao, aow, mask, shls_slice, ao_loc)
+                vmat[idm] += _dot_ao_ao(mol, ao, aow, mask1, shls_slice, ao_loc)
                 rho = exc = vxc = vrho = None
     elif xctype == 'GGA':
         ao_deriv = 1
@@ -698,14 +791,19 @@ def nr_rks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
             aow = numpy.ndarray(ao[0].shape, order='F', buffer=aow)
             for idm in range(nset):
                 rho = make_rho(idm, ao, mask, 'GGA')
-                exc, vxc = ni.eval_xc(xc_code, rho, 0, relativity, 1, verbose)[:2]
+                screened = _skip_small_rho(rho, mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                exc, vxc = _eval_xc_on_grids(ni, xc_code, rho, 0, relativity,
+                                             verbose, idx)
                 den = rho[0] * weight
                 nelec[idm] += den.sum()
                 excsum[idm] += numpy.dot(den, exc)
 # ref eval_mat function
                 wv = _rks_gga_wv0(rho, vxc, weight)
                 aow = numpy.einsum('npi,np->pi', ao, wv, out=aow)
-                vmat[idm] += _dot_ao_ao(mol, ao[0], aow, mask, shls_slice, ao_loc)
+                vmat[idm] += _dot_ao_ao(mol, ao[0], aow, mask1, shls_slice, ao_loc)
                 rho = exc = vxc = wv = None
     elif xctype == 'NLC':
         nlc_pars = ni.nlc_coeff(xc_code[:-6])
@@ -759,7 +857,12 @@ def nr_rks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
             aow = numpy.ndarray(ao[0].shape, order='F', buffer=aow)
             for idm in range(nset):
                 rho = make_rho(idm, ao, mask, 'MGGA')
-                exc, vxc = ni.eval_xc(xc_code, rho, 0, relativity, 1, verbose)[:2]
+                screened = _skip_small_rho(rho, mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                exc, vxc = _eval_xc_on_grids(ni, xc_code, rho, 0, relativity,
+                                             verbose, idx)
                 vrho, vsigma, vlapl, vtau = vxc[:4]
                 den = rho[0] * weight
                 nelec[idm] += den.sum()
@@ -767,14 +870,14 @@ def nr_rks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
 
                 wv = _rks_gga_wv0(rho, vxc, weight)
                 aow = numpy.einsum('npi,np->pi', ao[:4], wv, out=aow)
-                vmat[idm] += _dot_ao_ao(mol, ao[0], aow, mask, shls_slice, ao_loc)
+                vmat[idm] += _dot_ao_ao(mol, ao[0], aow, mask1, shls_slice, ao_loc)
 
 # FIXME: .5 * .5   First 0.5 for v+v.T symmetrization.
 # Second 0.5 is due to the Libxc convention tau = 1/2 \nabla\phi\dot\nabla\phi
                 wv = (.5 * .5 * weight * vtau).reshape(-1,1)
-                vmat[idm] += _dot_ao_ao(mol, ao[1], wv*ao[1], mask, shls_slice, ao_loc)
-                vmat[idm] += _dot_ao_ao(mol, ao[2], wv*ao[2], mask, shls_slice, ao_loc)
-                vmat[idm] += _dot_ao_ao(mol, ao[3], wv*ao[3], mask, shls_slice, ao_loc)
+                vmat[idm] += _dot_ao_ao(mol, ao[1], wv*ao[1], mask1, shls_slice, ao_loc)
+                vmat[idm] += _dot_ao_ao(mol, ao[2], wv*ao[2], mask1, shls_slice, ao_loc)
+                vmat[idm] += _dot_ao_ao(mol, ao[3], wv*ao[3], mask1, shls_slice, ao_loc)
 
                 rho = exc = vxc = vrho = vsigma = wv = None
 
@@ -845,6 +948,7 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
     excsum = numpy.zeros(nset)
     vmat = numpy.zeros((2,nset,nao,nao))
     aow = None
+    rho_cutoff = getattr(ni, 'small_rho_block_cutoff', SMALL_RHO_BLOCK_CUTOFF)
     if xctype == 'LDA':
         ao_deriv = 0
         for ao, mask, weight, coords \
@@ -853,8 +957,12 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
             for idm in range(nset):
                 rho_a = make_rhoa(idm, ao, mask, xctype)
                 rho_b = make_rhob(idm, ao, mask, xctype)
-                exc, vxc = ni.eval_xc(xc_code, (rho_a, rho_b),
-                                      1, relativity, 1, verbose)[:2]
+                screened = _skip_small_rho((rho_a, rho_b), mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                exc, vxc = _eval_xc_on_grids(ni, xc_code, (rho_a, rho_b), 1,
+                                             relativity, verbose, idx)
                 vrho = vxc[0]
                 den = rho_a * weight
                 nelec[0,idm] += den.sum()
@@ -865,9 +973,9 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
 
                 # *.5 due to +c.c. in the end
                 aow = numpy.einsum('pi,p->pi', ao, .5*weight*vrho[:,0], out=aow)
-                vmat[0,idm] += _dot_ao_ao(mol, ao, aow, mask, shls_slice, ao_loc)
+                vmat[0,idm] += _dot_ao_ao(mol, ao, aow, mask1, shls_slice, ao_loc)
                 aow = numpy.einsum('pi,p->pi', ao, .5*weight*vrho[:,1], out=aow)
-                vmat[1,idm] += _dot_ao_ao(mol, ao, aow, mask, shls_slice, ao_loc)
+                vmat[1,idm] += _dot_ao_ao(mol, ao, aow, mask1, shls_slice, ao_loc)
                 rho_a = rho_b = exc = vxc = vrho = None
     elif xctype == 'GGA':
         ao_deriv = 1
@@ -878,8 +986,12 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
             for idm in range(nset):
                 rho_a = make_rhoa(idm, ao, mask, xctype)
                 rho_b = make_rhob(idm, ao, mask, xctype)
-                exc, vxc = ni.eval_xc(xc_code, (rho_a, rho_b),
-                                      1, relativity, 1, verbose)[:2]
+                screened = _skip_small_rho((rho_a, rho_b), mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                exc, vxc = _eval_xc_on_grids(ni, xc_code, (rho_a, rho_b), 1,
+                                             relativity, verbose, idx)
                 den = rho_a[0]*weight
                 nelec[0,idm] += den.sum()
                 excsum[idm] += numpy.dot(den, exc)
@@ -889,9 +1001,9 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
 
                 wva, wvb = _uks_gga_wv0((rho_a,rho_b), vxc, weight)
                 aow = numpy.einsum('npi,np->pi', ao, wva, out=aow)
-                vmat[0,idm] += _dot_ao_ao(mol, ao[0], aow, mask, shls_slice, ao_loc)
+                vmat[0,idm] += _dot_ao_ao(mol, ao[0], aow, mask1, shls_slice, ao_loc)
                 aow = numpy.einsum('npi,np->pi', ao, wvb, out=aow)
-                vmat[1,idm] += _dot_ao_ao(mol, ao[0], aow, mask, shls_slice, ao_loc)
+                vmat[1,idm] += _dot_ao_ao(mol, ao[0], aow, mask1, shls_slice, ao_loc)
                 rho_a = rho_b = exc = vxc = wva = wvb = None
     elif xctype == 'MGGA':
         if (any(x in xc_code.upper() for x in ('CC06', 'CS', 'BR89', 'MK00'))):
@@ -904,8 +1016,12 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
             for idm in range(nset):
                 rho_a = make_rhoa(idm, ao, mask, xctype)
                 rho_b = make_rhob(idm, ao, mask, xctype)
-                exc, vxc = ni.eval_xc(xc_code, (rho_a, rho_b),
-                                      1, relativity, 1, verbose)[:2]
+                screened = _skip_small_rho((rho_a, rho_b), mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                exc, vxc = _eval_xc_on_grids(ni, xc_code, (rho_a, rho_b), 1,
+                                             relativity, verbose, idx)
                 vrho, vsigma, vlapl, vtau = vxc[:4]
                 den = rho_a[0]*weight
                 nelec[0,idm] += den.sum()
@@ -916,20 +1032,20 @@ def nr_uks(ni, mol, grids, xc_code, dms, relativity=0, hermi=0,
 
                 wva, wvb = _uks_gga_wv0((rho_a,rho_b), vxc, weight)
                 aow = numpy.einsum('npi,np->pi', ao[:4], wva, out=aow)
-                vmat[0,idm] += _dot_ao_ao(mol, ao[0], aow, mask, shls_slice, ao_loc)
+                vmat[0,idm] += _dot_ao_ao(mol, ao[0], aow, mask1, shls_slice, ao_loc)
                 aow = numpy.einsum('npi,np->pi', ao[:4], wvb, out=aow)
-                vmat[1,idm] += _dot_ao_ao(mol, ao[0], aow, mask, shls_slice, ao_loc)
+                vmat[1,idm] += _dot_ao_ao(mol, ao[0], aow, mask1, shls_slice, ao_loc)
 
 # FIXME: .5 * .5   First 0.5 for v+v.T symmetrization.
 # Second 0.5 is due to the Libxc convention tau = 1/2 \nabla\phi\dot\nabla\phi
                 wv = (.25 * weight * vtau[:,0]).reshape(-1,1)
-                vmat[0,idm] += _dot_ao_ao(mol, ao[1], wv*ao[1], mask, shls_slice, ao_loc)
-                vmat[0,idm] += _dot_ao_ao(mol, ao[2], wv*ao[2], mask, shls_slice, ao_loc)
-                vmat[0,idm] += _dot_ao_ao(mol, ao[3], wv*ao[3], mask, shls_slice, ao_loc)
+                vmat[0,idm] += _dot_ao_ao(mol, ao[1], wv*ao[1], mask1, shls_slice, ao_loc)
+                vmat[0,idm] += _dot_ao_ao(mol, ao[2], wv*ao[2], mask1, shls_slice, ao_loc)
+                vmat[0,idm] += _dot_ao_ao(mol, ao[3], wv*ao[3], mask1, shls_slice, ao_loc)
                 wv = (.25 * weight * vtau[:,1]).reshape(-1,1)
-                vmat[1,idm] += _dot_ao_ao(mol, ao[1], wv*ao[1], mask, shls_slice, ao_loc)
-                vmat[1,idm] += _dot_ao_ao(mol, ao[2], wv*ao[2], mask, shls_slice, ao_loc)
-                vmat[1,idm] += _dot_ao_ao(mol, ao[3], wv*ao[3], mask, shls_slice, ao_loc)
+                vmat[1,idm] += _dot_ao_ao(mol, ao[1], wv*ao[1], mask1, shls_slice, ao_loc)
+                vmat[1,idm] += _dot_ao_ao(mol, ao[2], wv*ao[2], mask1, shls_slice, ao_loc)
+                vmat[1,idm] += _dot_ao_ao(mol, ao[3], wv*ao[3], mask1, shls_slice, ao_loc)
                 rho_a = rho_b = exc = vxc = vrho = vsigma = wva = wvb = None
 
     for i in range(nset):
@@ -188,8 +188,18 @@ def prune_small_rho_grids_(ks, mol, dm, grids):
     rho = ks._numint.get_rho(mol, dm, grids, ks.max_memory)
     n = numpy.dot(rho, grids.weights)
     if abs(n-mol.nelectron) < NELEC_ERROR_TOL*n:
+        block_cutoff = getattr(ks._numint, 'small_rho_block_cutoff',
+                               numint.SMALL_RHO_BLOCK_CUTOFF)
+        if block_cutoff > 0:
+            # Also drop the blocks of grids which nr_rks would skip, so
+            # that the following SCF iterations and the gradients do not
+            # generate AO values on them
+            keep = numint._screen_rho_blocks(rho, block_cutoff)[1]
+            keep = numpy.repeat(keep, numint.BLKSIZE)[:rho.size]
+        else:
+            keep = True
         rho *= grids.weights
-        idx = abs(rho) > ks.small_rho_cutoff / grids.weights.size
+        idx = (abs(rho) > ks.small_rho_cutoff / grids.weights.size) & keep
         logger.debug(ks, 'Drop grids %d',
                      grids.weights.size - numpy.count_nonzero(idx))
         grids.coords  = numpy.asarray(grids.coords [idx], order='C')
@@ -247,6 +247,23 @@ class KnownValues(unittest.TestCase):
         self.assertRaises(NotImplementedError, dft.libxc.test_deriv_order, 'pbe0', 3, True)
         self.assertRaises(KeyError, dft.libxc.test_deriv_order, 'OL2', 3, True)
 
+    def test_eval_xc_evaluator(self):
+        rho1 = rho[:,:1000]
+        ref = dft.libxc.eval_xc('b88,lyp', (rho1*.5, rho1*.3), spin=1, deriv=2)
+        dft.libxc._EVALUATOR_CACHE.clear()
+        e1 = dft.libxc.eval_xc('b88,lyp', (rho1*.5, rho1*.3), spin=1, deriv=2)
+        e2 = dft.libxc.eval_xc('b88,lyp', (rho1*.5, rho1*.3), spin=1, deriv=2)
+        self.assertEqual(len(dft.libxc._EVALUATOR_CACHE), 1)
+        self.assertAlmostEqual(abs(e1[0] - ref[0]).max(), 0, 12)
+        self.assertAlmostEqual(abs(e2[0] - ref[0]).max(), 0, 12)
+        for i in range(3):
+            self.assertAlmostEqual(abs(e1[2][i] - ref[2][i]).max(), 0, 12)
+
+        # grids of different blocks evaluated independently
+        e3 = dft.libxc.eval_xc('b88,lyp', (rho1[:,:333]*.5, rho1[:,:333]*.3),
+                               spin=1, deriv=2)
+        self.assertAlmostEqual(abs(e3[1][1] - ref[1][1][:333]).max(), 0, 12)
+
     def test_xc_type(self):
         self.assertEqual(dft.libxc.xc_type(416), 'GGA')
         self.assertEqual(dft.libxc.xc_type('hf'), 'HF')
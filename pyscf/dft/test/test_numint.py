@@ -14,6 +14,7 @@
 # limitations under the License.
 
 import unittest
+import copy
 import numpy
 from pyscf import gto
 from pyscf import dft
@@ -209,6 +210,37 @@ class KnownValues(unittest.TestCase):
         v = mf._numint.nr_vxc(mol, mf.grids, '', dms, spin=0, hermi=0)[2]
         self.assertAlmostEqual(abs(v).max(), 0, 9)
 
+    def test_rks_vxc_skip_small_rho(self):
+        dm = dft.RKS(h4).get_init_guess(key='minao')
+        ni = dft.numint.NumInt()
+        ni.small_rho_block_cutoff = 0
+        n0, e0, v0 = ni.nr_vxc(h4, mf_h4.grids, 'b88,lyp', dm)
+        ni.small_rho_block_cutoff = 1e-10
+        n1, e1, v1 = ni.nr_vxc(h4, mf_h4.grids, 'b88,lyp', dm)
+        self.assertAlmostEqual(n1, n0, 7)
+        self.assertAlmostEqual(e1, e0, 7)
+        self.assertAlmostEqual(abs(v1-v0).max(), 0, 7)
+
+        n1, e1, v1 = ni.nr_vxc(h4, mf_h4.grids, 'b88,lyp', (dm*.5,dm*.5), spin=1)
+        self.assertAlmostEqual(e1, e0, 7)
+        self.assertAlmostEqual(abs(v1[0]-v0).max(), 0, 7)
+
+        rho = ni.get_rho(h4, dm, mf_h4.grids)
+        rho_bound, keep = dft.numint._screen_rho_blocks(rho, 1e-10)
+        self.assertEqual(rho_bound.size, (rho.size+127)//128)
+        self.assertTrue(0 < numpy.count_nonzero(keep) < keep.size)
+
+        # The screened blocks are dropped from the grids of RKS
+        ks = dft.RKS(h4)
+        grids0 = dft.rks.prune_small_rho_grids_(ks, h4, dm, copy.copy(mf_h4.grids))
+        ks._numint.small_rho_block_cutoff = 1e-10
+        grids1 = dft.rks.prune_small_rho_grids_(ks, h4, dm, copy.copy(mf_h4.grids))
+        self.assertTrue(grids1.weights.size < grids0.weights.size)
+        n0, e0, v0 = ni.nr_vxc(h4, grids0, 'b88,lyp', dm)
+        n1, e1, v1 = ni.nr_vxc(h4, grids1, 'b88,lyp', dm)
+        self.assertAlmostEqual(e1, e0, 7)
+        self.assertAlmostEqual(abs(v1-v0).max(), 0, 7)
+
     def test_uks_vxc(self):
         numpy.random.seed(10)
         nao = h2o.nao_nr()
@@ -82,6 +82,14 @@ def contract_2e(eri, fcivec, norb, nelec, link_index=None):
     link_index = _unpack(norb, nelec, link_index)
     na, nlink = link_index.shape[:2]
     assert(fcivec.size == na**2)
+    if fcivec.dtype == numpy.float32:
+        # Single precision vectors are contracted with the spin1 kernel.  The
+        # result is symmetrized to remove the rounding errors which break
+        # the singlet symmetry.
+        ci1 = direct_spin1.contract_2e(eri, fcivec.reshape(na,na), norb, nelec,
+                                       (link_index,link_index))
+        ci1 = (ci1 + ci1.T) * .5
+        return ci1.reshape(fcivec.shape)
     ci1 = numpy.empty((na,na))
 
     libfci.FCIcontract_2e_spin0(eri.ctypes.data_as(ctypes.c_void_p),
@@ -223,6 +231,7 @@ def kernel_ms0(fci, h1e, eri, norb, nelec, ci0=None, link_index=None,
     if nroots is None: nroots = fci.nroots
     if davidson_only is None: davidson_only = fci.davidson_only
     if pspace_size is None: pspace_size = fci.pspace_size
+    follow_state = kwargs.pop('follow_state', True)
 
     assert(fci.spin is None or fci.spin == 0)
 
@@ -309,10 +318,15 @@ def kernel_ms0(fci, h1e, eri, norb, nelec, ci0=None, link_index=None,
     tol_residual = getattr(fci, 'conv_tol_residual', None)
 
     with lib.with_omp_threads(fci.threads):
+        if direct_spin1._mixed_precision_enabled(fci, FCISolver):
+            ci0 = direct_spin1._eig_single_precision(
+                fci, hop, ci0, precond, tol, lindep, max_cycle, max_space,
+                nroots, max_memory, verbose, follow_state, **kwargs)
         #e, c = lib.davidson(hop, ci0, precond, tol=fci.conv_tol, lindep=fci.lindep)
         e, c = fci.eig(hop, ci0, precond, tol=tol, lindep=lindep,
                        max_cycle=max_cycle, max_space=max_space, nroots=nroots,
-                       max_memory=max_memory, verbose=verbose, follow_state=True,
+                       max_memory=max_memory, verbose=verbose,
+                       follow_state=follow_state,
                        tol_residual=tol_residual, **kwargs)
     if nroots > 1:
         return e+ecore, [_check_(ci.reshape(na,na)) for ci in c]
@@ -39,6 +39,7 @@ direct_nosym        No            No             No**               Yes
 '''
 
 import sys
+import time
 import ctypes
 import numpy
 import scipy.linalg
@@ -53,6 +54,10 @@ from pyscf import __config__
 
 libfci = lib.load_library('libfci')
 
+# The linear dependency threshold of the single precision Davidson iterations
+SINGLE_PRECISION_LINDEP = getattr(__config__, 'fci_direct_spin1_single_precision_lindep', 1e-8)
+DOT_BLKSIZE = 65536
+
 def contract_1e(f1e, fcivec, norb, nelec, link_index=None):
     '''Contract the 1-electron Hamiltonian with a FCI vector to get a new FCI
     vector.
@@ -106,6 +111,9 @@ def contract_2e(eri, fcivec, norb, nelec, link_index=None):
         eri_{pq,rs} = (pq|rs) - (.5/Nelec) [\sum_q (pq|qs) + \sum_p (pq|rp)]
 
     See also :func:`direct_spin1.absorb_h1e`
+
+    If fcivec is a single precision (float32) array, the contraction is
+    computed in single precision and a float32 array is returned.
     '''
     fcivec = numpy.asarray(fcivec, order='C')
     eri = ao2mo.restore(4, eri, norb)
@@ -115,6 +123,18 @@ def contract_2e(eri, fcivec, norb, nelec, link_index=None):
     assert(fcivec.size == na*nb)
     ci1 = numpy.empty_like(fcivec)
 
+    if fcivec.dtype == numpy.float32:
+        eri = numpy.asarray(eri, dtype=numpy.float32, order='C')
+        libfci.FCIcontract_2e_spin1_f32(eri.ctypes.data_as(ctypes.c_void_p),
+                                        fcivec.ctypes.data_as(ctypes.c_void_p),
+                                        ci1.ctypes.data_as(ctypes.c_void_p),
+                                        ctypes.c_int(norb),
+                                        ctypes.c_int(na), ctypes.c_int(nb),
+                                        ctypes.c_int(nlinka), ctypes.c_int(nlinkb),
+                                        link_indexa.ctypes.data_as(ctypes.c_void_p),
+                                        link_indexb.ctypes.data_as(ctypes.c_void_p))
+        return ci1
+
     libfci.FCIcontract_2e_spin1(eri.ctypes.data_as(ctypes.c_void_p),
                                 fcivec.ctypes.data_as(ctypes.c_void_p),
                                 ci1.ctypes.data_as(ctypes.c_void_p),
@@ -428,13 +448,15 @@ def kernel_ms1(fci, h1e, eri, norb, nelec, ci0=None, link_index=None,
     if nroots is None: nroots = fci.nroots
     if davidson_only is None: davidson_only = fci.davidson_only
     if pspace_size is None: pspace_size = fci.pspace_size
+    follow_state = kwargs.pop('follow_state', True)
 
     nelec = _unpack_nelec(nelec, fci.spin)
     link_indexa, link_indexb = _unpack(norb, nelec, link_index)
     na = link_indexa.shape[0]
     nb = link_indexb.shape[0]
     hdiag = fci.make_hdiag(h1e, eri, norb, nelec)
-    nroots = min(hdiag.size, nroots)
+    # hdiag may hold only the local rows if the CI vectors are distributed
+    nroots = min(na*nb, nroots)
 
     try:
         addr, h0 = fci.pspace(h1e, eri, norb, nelec, hdiag, max(pspace_size,nroots))
@@ -479,7 +501,9 @@ def kernel_ms1(fci, h1e, eri, norb, nelec, ci0=None, link_index=None,
                     x0.append(x)
                 return x0
     else:
-        if isinstance(ci0, numpy.ndarray) and ci0.size == na*nb:
+        # hdiag and the CI vectors may hold only part of the rows (alpha
+        # strings) if they are distributed over processes
+        if isinstance(ci0, numpy.ndarray) and ci0.size == hdiag.size:
             ci0 = [ci0.ravel()]
         else:
             ci0 = [x.ravel() for x in ci0]
@@ -493,15 +517,82 @@ def kernel_ms1(fci, h1e, eri, norb, nelec, ci0=None, link_index=None,
     tol_residual = getattr(fci, 'conv_tol_residual', None)
 
     with lib.with_omp_threads(fci.threads):
+        if _mixed_precision_enabled(fci, FCISolver):
+            ci0 = _eig_single_precision(fci, hop, ci0, precond, tol, lindep,
+                                        max_cycle, max_space, nroots,
+                                        max_memory, verbose, follow_state,
+                                        **kwargs)
         #e, c = lib.davidson(hop, ci0, precond, tol=fci.conv_tol, lindep=fci.lindep)
         e, c = fci.eig(hop, ci0, precond, tol=tol, lindep=lindep,
                        max_cycle=max_cycle, max_space=max_space, nroots=nroots,
-                       max_memory=max_memory, verbose=verbose, follow_state=True,
+                       max_memory=max_memory, verbose=verbose,
+                       follow_state=follow_state,
                        tol_residual=tol_residual, **kwargs)
     if nroots > 1:
-        return e+ecore, [ci.reshape(na,nb) for ci in c]
+        return e+ecore, [ci.reshape(-1,nb) for ci in c]
     else:
-        return e+ecore, c.reshape(na,nb)
+        return e+ecore, c.reshape(-1,nb)
+
+def _mixed_precision_enabled(fci, solver_class):
+    '''Whether to run the single precision Davidson iterations.  The option
+    fci.mixed_precision is only honored if the sigma vector and the
+    eigensolver of fci are those of solver_class, which provides the float32
+    contract_2e kernel.  Solvers which override contract_2e or eig (e.g. the
+    point group symmetry solvers, the MPI solver) use double precision.
+    '''
+    if not getattr(fci, 'mixed_precision', False):
+        return False
+    for key in ('contract_2e', 'eig'):
+        f32_method = getattr(solver_class, key)
+        f32_method = getattr(f32_method, '__func__', f32_method)
+        if getattr(getattr(fci, key), '__func__', None) is not f32_method:
+            logger.warn(fci, 'mixed_precision is not supported by %s.%s. '
+                        'Double precision Davidson is used.',
+                        fci.__class__.__module__, fci.__class__.__name__)
+            return False
+    return True
+
+def _eig_single_precision(fci, hop, ci0, precond, tol, lindep, max_cycle,
+                          max_space, nroots, max_memory, verbose,
+                          follow_state=True, **kwargs):
+    '''Davidson iterations with single precision CI vectors and sigma vectors.
+    The subspace Hamiltonian and the orthogonalization coefficients are
+    computed in double precision.  The iterations stop when the energy
+    change is smaller than fci.mixed_precision_tol.  The returned vectors
+    (double precision) are the initial guess of the double precision
+    iterations which refine the solution to the requested tolerance.
+    '''
+    log = logger.new_logger(fci, verbose)
+    cput0 = (time.clock(), time.time())
+    if callable(ci0):
+        ci0 = ci0()
+    if isinstance(ci0, numpy.ndarray) and ci0.ndim == 1:
+        ci0 = [ci0]
+    ci0 = [numpy.asarray(x, dtype=numpy.float32) for x in ci0]
+
+    def precond32(r, e0, x0, *args):
+        return numpy.asarray(precond(r, e0, x0, *args), dtype=numpy.float32)
+
+    e, c = fci.eig(hop, ci0, precond32, tol=max(tol, fci.mixed_precision_tol),
+                   lindep=max(lindep, SINGLE_PRECISION_LINDEP),
+                   max_cycle=max_cycle, max_space=max_space, nroots=nroots,
+                   max_memory=max_memory, verbose=verbose,
+                   follow_state=follow_state, dot=_dot_f64, **kwargs)
+    log.timer('single precision Davidson', *cput0)
+    log.debug('Single precision FCI energy %s', e)
+    if nroots == 1:
+        c = [c]
+    return [numpy.asarray(x, dtype=numpy.double) for x in c]
+
+def _dot_f64(x, y):
+    '''Inner product of two vectors accumulated in double precision'''
+    if x.dtype == numpy.double and y.dtype == numpy.double:
+        return numpy.dot(x, y)
+    s = 0
+    for p0, p1 in lib.prange(0, x.size, DOT_BLKSIZE):
+        s += numpy.dot(numpy.asarray(x[p0:p1], dtype=numpy.double),
+                       numpy.asarray(y[p0:p1], dtype=numpy.double))
+    return s
 
 def make_pspace_precond(hdiag, pspaceig, pspaceci, addr, level_shift=0):
     # precondition with pspace Hamiltonian, CPL, 169, 463
@@ -569,6 +660,20 @@ class FCISolver(lib.StreamObject):
         wfnsym : str or int
             Symmetry of wavefunction.  It is used only in direct_spin1_symm
             and direct_spin0_symm solver.
+        mixed_precision : bool
+            Whether to start the Davidson iterations with single precision
+            CI vectors.  The CI vectors, the sigma vectors and the 2e
+            Hamiltonian are stored in float32 until the energy is converged
+            to mixed_precision_tol.  Then the solution is refined with double
+            precision to conv_tol.  The final energy agrees with the double
+            precision solver within conv_tol.  It is available in the
+            direct_spin1 and direct_spin0 solvers.  The solvers which override
+            contract_2e (point group symmetry, MPI) ignore this option.
+            Default is False.
+        mixed_precision_tol : float
+            Energy convergence tolerance of the single precision iterations.
+            Single precision sigma vectors have a relative error around 1e-7.
+            Default is 1e-6.
 
     Saved results
 
@@ -610,6 +715,10 @@ class FCISolver(lib.StreamObject):
     pspace_size = getattr(__config__, 'fci_direct_spin1_FCI_pspace_size', 400)
     threads = getattr(__config__, 'fci_direct_spin1_FCI_threads', None)
     lessio = getattr(__config__, 'fci_direct_spin1_FCI_lessio', False)
+    mixed_precision = getattr(__config__, 'fci_direct_spin1_FCI_mixed_precision', False)
+    mixed_precision_tol = getattr(__config__, 'fci_direct_spin1_FCI_mixed_precision_tol', 1e-6)
+    # Use lib.davidson1_native (preallocated, possibly memory-mapped subspace)
+    native_davidson = getattr(__config__, 'fci_direct_spin1_FCI_native_davidson', False)
 
     def __init__(self, mol=None):
         if mol is None:
@@ -636,7 +745,8 @@ class FCISolver(lib.StreamObject):
 
         keys = set(('max_cycle', 'max_space', 'conv_tol', 'lindep',
                     'level_shift', 'davidson_only', 'pspace_size', 'threads',
-                    'lessio'))
+                    'lessio', 'mixed_precision', 'mixed_precision_tol',
+                    'native_davidson'))
         self._keys = set(self.__dict__.keys()).union(keys)
 
     @property
@@ -664,6 +774,9 @@ class FCISolver(lib.StreamObject):
         log.info('nroots = %d', self.nroots)
         log.info('pspace_size = %d', self.pspace_size)
         log.info('spin = %s', self.spin)
+        if self.mixed_precision:
+            log.info('mixed precision Davidson, single precision conv_tol = %g',
+                     self.mixed_precision_tol)
         return self
 
     @lib.with_doc(absorb_h1e.__doc__)
@@ -691,9 +804,14 @@ class FCISolver(lib.StreamObject):
             self.converged = True
             return scipy.linalg.eigh(op)
 
-        self.converged, e, ci = \
-                lib.davidson1(lambda xs: [op(x) for x in xs],
-                              x0, precond, lessio=self.lessio, **kwargs)
+        if self.native_davidson and 'dot' not in kwargs:
+            self.converged, e, ci = \
+                    lib.davidson1_native(lambda xs: [op(x) for x in xs],
+                                         x0, precond, **kwargs)
+        else:
+            self.converged, e, ci = \
+                    lib.davidson1(lambda xs: [op(x) for x in xs],
+                                  x0, precond, lessio=self.lessio, **kwargs)
         if kwargs['nroots'] == 1:
             self.converged = self.converged[0]
             e = e[0]
@@ -0,0 +1,247 @@
+#!/usr/bin/env python
+# Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+'''
+FCI solver with the CI vector distributed over MPI processes
+
+The rows of the CI vector (alpha strings) are partitioned over processes.
+Each process holds the rows ci[a0:a1] given by :func:`alpha_segments`.  In
+the contraction, the columns of the CI vector are processed block by block.
+For each block of beta strings, the column panel of the entire CI vector is
+gathered on every process (MPI_Allgatherv).  Each process computes the
+sigma vector of its own rows only (the alpha-excitations are gathered from
+the panel), so no reduction of the sigma vector is needed.  The memory
+footprint of each process is the local rows of the Davidson vectors plus
+one column panel of size na*STRB_BLKSIZE.
+
+The communicator is mpi4py.MPI.COMM_WORLD by default.  Any object which
+provides Get_rank, Get_size, Allgatherv and allreduce with the mpi4py
+semantics can be used in place of it.
+
+Usage::
+
+    mpirun -n 4 python input.py
+
+    from pyscf.fci import direct_spin1_mpi
+    cis = direct_spin1_mpi.FCISolver(mol)
+    e, ci_local = cis.kernel(h1e, eri, norb, nelec)
+    ci = direct_spin1_mpi.gather_civec(ci_local, norb, nelec, cis.comm)
+'''
+
+import ctypes
+import numpy
+from pyscf import lib
+from pyscf import ao2mo
+from pyscf.fci import cistring
+from pyscf.fci import direct_spin1
+from pyscf.fci.direct_spin1 import _unpack_nelec, _unpack
+from pyscf import __config__
+
+libfci = lib.load_library('libfci')
+
+# The size of the beta-string block.  The column panel is na*STRB_BLKSIZE
+# doubles
+STRB_BLKSIZE = getattr(__config__, 'fci_direct_spin1_mpi_STRB_BLKSIZE', 112)
+
+def _default_comm():
+    from mpi4py import MPI
+    return MPI.COMM_WORLD
+
+def alpha_segments(na, comm):
+    '''The alpha strings seg[rank]:seg[rank+1] are held by process rank'''
+    size = comm.Get_size()
+    return numpy.asarray([na*i//size for i in range(size+1)])
+
+def _compress_link(link_index):
+    nstr, nlink = link_index.shape[:2]
+    # _LinkTrilT takes 8 bytes
+    clink = numpy.empty((nstr,nlink), dtype=numpy.int64)
+    link_index = numpy.asarray(link_index, dtype=numpy.int32, order='C')
+    libfci.FCIcompress_link_tril(clink.ctypes.data_as(ctypes.c_void_p),
+                                 link_index.ctypes.data_as(ctypes.c_void_p),
+                                 ctypes.c_int(nstr), ctypes.c_int(nlink))
+    return clink
+
+def contract_2e(eri, fcivec, norb, nelec, link_index=None, comm=None):
+    '''Distributed version of :func:`direct_spin1.contract_2e`.  fcivec and
+    the returned vector are the local rows of the CI vectors.  It should be
+    called by all processes of comm.
+    '''
+    if comm is None: comm = _default_comm()
+    eri = numpy.asarray(ao2mo.restore(4, eri, norb), order='C')
+    link_indexa, link_indexb = _unpack(norb, nelec, link_index)
+    na, nlinka = link_indexa.shape[:2]
+    nb, nlinkb = link_indexb.shape[:2]
+    seg = alpha_segments(na, comm)
+    rank = comm.Get_rank()
+    a0, a1 = seg[rank], seg[rank+1]
+    fcivec = numpy.asarray(fcivec, order='C').reshape(a1-a0,nb)
+    ci1 = numpy.zeros_like(fcivec)
+    clinka = _compress_link(link_indexa)
+    clinkb = _compress_link(link_indexb)
+    counts = numpy.diff(seg)
+
+    buf = numpy.empty((na+a1-a0)*min(nb,STRB_BLKSIZE))
+    for b0, b1 in lib.prange(0, nb, STRB_BLKSIZE):
+        blen = b1 - b0
+        ci0pan = numpy.ndarray((na,blen), buffer=buf)
+        ci0loc = numpy.ndarray((a1-a0,blen), buffer=buf, offset=na*blen*8)
+        ci0loc[:] = fcivec[:,b0:b1]
+        comm.Allgatherv(ci0loc, [ci0pan, counts*blen])
+        libfci.FCIcontract_2e_spin1_rows(eri.ctypes.data_as(ctypes.c_void_p),
+                                         ci0pan.ctypes.data_as(ctypes.c_void_p),
+                                         fcivec.ctypes.data_as(ctypes.c_void_p),
+                                         ci1.ctypes.data_as(ctypes.c_void_p),
+                                         ctypes.c_int(norb),
+                                         ctypes.c_int(na), ctypes.c_int(nb),
+                                         ctypes.c_int(nlinka), ctypes.c_int(nlinkb),
+                                         ctypes.c_int(a0), ctypes.c_int(a1),
+                                         ctypes.c_int(b0), ctypes.c_int(b1),
+                                         clinka.ctypes.data_as(ctypes.c_void_p),
+                                         clinkb.ctypes.data_as(ctypes.c_void_p))
+    return ci1
+
+def make_hdiag(h1e, eri, norb, nelec, comm=None):
+    '''The local rows of the diagonal Hamiltonian'''
+    if comm is None: comm = _default_comm()
+    neleca, nelecb = _unpack_nelec(nelec)
+    h1e = numpy.asarray(h1e, order='C')
+    eri = ao2mo.restore(1, eri, norb)
+    occslsta = occslstb = cistring._gen_occslst(range(norb), neleca)
+    if neleca != nelecb:
+        occslstb = cistring._gen_occslst(range(norb), nelecb)
+    na = len(occslsta)
+    nb = len(occslstb)
+    seg = alpha_segments(na, comm)
+    rank = comm.Get_rank()
+    a0, a1 = seg[rank], seg[rank+1]
+    occslsta = numpy.asarray(occslsta[a0:a1], order='C')
+
+    hdiag = numpy.empty((a1-a0)*nb)
+    jdiag = numpy.asarray(numpy.einsum('iijj->ij',eri), order='C')
+    kdiag = numpy.asarray(numpy.einsum('ijji->ij',eri), order='C')
+    c_h1e = h1e.ctypes.data_as(ctypes.c_void_p)
+    c_jdiag = jdiag.ctypes.data_as(ctypes.c_void_p)
+    c_kdiag = kdiag.ctypes.data_as(ctypes.c_void_p)
+    libfci.FCImake_hdiag_uhf(hdiag.ctypes.data_as(ctypes.c_void_p),
+                             c_h1e, c_h1e, c_jdiag, c_jdiag, c_jdiag, c_kdiag, c_kdiag,
+                             ctypes.c_int(norb),
+                             ctypes.c_int(a1-a0), ctypes.c_int(nb),
+                             ctypes.c_int(neleca), ctypes.c_int(nelecb),
+                             occslsta.ctypes.data_as(ctypes.c_void_p),
+                             occslstb.ctypes.data_as(ctypes.c_void_p))
+    return hdiag
+
+def get_init_guess(norb, nelec, nroots, hdiag, comm=None):
+    '''The local rows of the lowest nroots determinants'''
+    if comm is None: comm = _default_comm()
+    neleca, nelecb = _unpack_nelec(nelec)
+    na = cistring.num_strings(norb, neleca)
+    nb = cistring.num_strings(norb, nelecb)
+    seg = alpha_segments(na, comm)
+    rank = comm.Get_rank()
+    offset = seg[rank] * nb
+
+    # The nroots lowest diagonal elements of each process, then the lowest
+    # ones of all processes
+    nroots = min(nroots, na*nb)
+    idx = numpy.argsort(hdiag)[:nroots]
+    cands = comm.allreduce([(hdiag[i], i+offset) for i in idx])
+    addrs = [addr for e, addr in sorted(cands)[:nroots]]
+
+    ci0 = []
+    for addr in addrs:
+        x = numpy.zeros(hdiag.size)
+        if offset <= addr < offset + hdiag.size:
+            x[addr-offset] = 1
+        ci0.append(x)
+
+    # Add noise
+    if offset == 0 and hdiag.size > 0:
+        ci0[0][0] += 1e-5
+    if offset + hdiag.size == na*nb and hdiag.size > 0:
+        ci0[0][-1] -= 1e-5
+    return ci0
+
+def gather_civec(fcivec, norb, nelec, comm=None):
+    '''Collect the local rows of the CI vector to the full CI vector on every
+    process'''
+    if comm is None: comm = _default_comm()
+    neleca, nelecb = _unpack_nelec(nelec)
+    na = cistring.num_strings(norb, neleca)
+    nb = cistring.num_strings(norb, nelecb)
+    counts = numpy.diff(alpha_segments(na, comm)) * nb
+    ci = numpy.empty((na,nb))
+    comm.Allgatherv(numpy.asarray(fcivec, order='C'), [ci, counts])
+    return ci
+
+def scatter_civec(fcivec, norb, nelec, comm=None):
+    '''The local rows of the full CI vector fcivec'''
+    if comm is None: comm = _default_comm()
+    fcivec = numpy.asarray(fcivec)
+    na = fcivec.shape[0]
+    seg = alpha_segments(na, comm)
+    rank = comm.Get_rank()
+    return numpy.array(fcivec[seg[rank]:seg[rank+1]], copy=True)
+
+
+class FCISolver(direct_spin1.FCISolver):
+    '''Full CI solver with the CI vectors distributed over processes.  The
+    CI vectors (ci0 and the solutions) are the local rows ci[a0:a1] of
+    each process.  The pspace preconditioner is not available.
+
+    Attributes:
+        comm :
+            MPI communicator.  Default is mpi4py.MPI.COMM_WORLD
+    '''
+    def __init__(self, mol=None, comm=None):
+        direct_spin1.FCISolver.__init__(self, mol)
+        if comm is None:
+            comm = _default_comm()
+        self.comm = comm
+        self._keys = self._keys.union(['comm'])
+
+    def make_hdiag(self, h1e, eri, norb, nelec):
+        return make_hdiag(h1e, eri, norb, nelec, self.comm)
+
+    def pspace(self, h1e, eri, norb, nelec, hdiag=None, np=400):
+        raise NotImplementedError('pspace for distributed CI vectors')
+
+    def contract_1e(self, f1e, fcivec, norb, nelec, link_index=None, **kwargs):
+        raise NotImplementedError
+
+    def contract_2e(self, eri, fcivec, norb, nelec, link_index=None, **kwargs):
+        return contract_2e(eri, fcivec, norb, nelec, link_index, self.comm)
+
+    def eig(self, op, x0=None, precond=None, **kwargs):
+        if isinstance(op, numpy.ndarray):
+            return direct_spin1.FCISolver.eig(self, op, x0, precond, **kwargs)
+        comm = self.comm
+        def dot(x, y):
+            return comm.allreduce(numpy.dot(x, y))
+        kwargs['dot'] = dot
+        return direct_spin1.FCISolver.eig(self, op, x0, precond, **kwargs)
+
+    def get_init_guess(self, norb, nelec, nroots, hdiag):
+        return get_init_guess(norb, nelec, nroots, hdiag, self.comm)
+
+    def gather_civec(self, fcivec, norb=None, nelec=None):
+        if norb is None: norb = self.norb
+        if nelec is None: nelec = self.nelec
+        nelec = _unpack_nelec(nelec, self.spin)
+        return gather_civec(fcivec, norb, nelec, self.comm)
+
+FCI = FCISolver
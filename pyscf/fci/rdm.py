@@ -26,6 +26,7 @@ Different conventions are used in the high order density matrices:
 
 import ctypes
 import numpy
+import h5py
 from pyscf import lib
 from pyscf.fci import cistring
 
@@ -310,6 +311,130 @@ def _complete_dm4_(dm3, dm4):
                     tmp = chain(tmp, l, i, j, k)
     return dm4
 
+def make_dm34_slice(cibra, ciket, norb, nelec, p0, p1, with_dm4=True,
+                    link_index=None):
+    r'''Slices dm3[p0:p1] and dm4[p0:p1] of the spin traced 3 and 4-particle
+    density matrices, in the same order as the output of make_dm1234
+    (before reorder_dm1234)
+
+        3pdm[p,q,r,s,t,u] = :math:`\langle p^\dagger q r^\dagger s t^\dagger u\rangle`
+        4pdm[p,q,r,s,t,u,v,w] = :math:`\langle p^\dagger q r^\dagger s t^\dagger u v^\dagger w\rangle`
+
+    The returned dm4 is None if with_dm4 is False.
+    '''
+    cibra = numpy.asarray(cibra, order='C')
+    ciket = numpy.asarray(ciket, order='C')
+    if link_index is None:
+        neleca, nelecb = _unpack_nelec(nelec)
+        link_indexa = cistring.gen_linkstr_index(range(norb), neleca)
+        link_indexb = cistring.gen_linkstr_index(range(norb), nelecb)
+    else:
+        link_indexa, link_indexb = link_index
+    na,nlinka = link_indexa.shape[:2]
+    nb,nlinkb = link_indexb.shape[:2]
+    assert(cibra.size == na*nb)
+    assert(ciket.size == na*nb)
+    rdm3 = numpy.empty((p1-p0,)+(norb,)*5)
+    if with_dm4:
+        rdm4 = numpy.empty((p1-p0,)+(norb,)*7)
+        ptr4 = rdm4.ctypes.data_as(ctypes.c_void_p)
+    else:
+        rdm4 = ptr4 = None
+    librdm.FCIrdm34_slice_drv(rdm3.ctypes.data_as(ctypes.c_void_p), ptr4,
+                              cibra.ctypes.data_as(ctypes.c_void_p),
+                              ciket.ctypes.data_as(ctypes.c_void_p),
+                              ctypes.c_int(norb),
+                              ctypes.c_int(na), ctypes.c_int(nb),
+                              ctypes.c_int(nlinka), ctypes.c_int(nlinkb),
+                              link_indexa.ctypes.data_as(ctypes.c_void_p),
+                              link_indexb.ctypes.data_as(ctypes.c_void_p),
+                              ctypes.c_int(p0), ctypes.c_int(p1))
+    if with_dm4:
+        rdm4 = _complete_dm4_slice_(rdm3, rdm4)
+    return rdm3, rdm4
+
+def _complete_dm4_slice_(dm3, dm4):
+# FCIrdm34_slice_drv assumed symmetry r >= t >= v for the slices of 4-pdm
+# <p^+ q r^+ s t^+ u v^+ w>.  Permuting E^r_s E^t_u E^v_w does not involve the
+# leading index p, the slice is completed with the same slice of the 3-pdm.
+    def transpose12(ijkl, i, j, k, l):
+        ikjl = ijkl.transpose(0,2,1,3)
+        ikjl[:,:,k] -= dm3[i,:,j,:,l,:]
+        ikjl[:,j,:] += dm3[i,:,k,:,l,:]
+        dm4[i,:,k,:,j,:,l,:] = ikjl
+        return ikjl
+    def transpose23(ijkl, i, j, k, l):
+        ijlk = ijkl.transpose(0,1,3,2)
+        ijlk[:,:,:,l] -= dm3[i,:,j,:,k,:]
+        ijlk[:,:,k,:] += dm3[i,:,j,:,l,:]
+        dm4[i,:,j,:,l,:,k,:] = ijlk
+        return ijlk
+
+# jkl -> jlk -> ljk -> lkj -> klj -> kjl
+    nslice, norb = dm3.shape[:2]
+    for i in range(nslice):
+        for j in range(norb):
+            for k in range(j+1):
+                for l in range(k+1):
+                    tmp = transpose23(dm4[i,:,j,:,k,:,l,:].copy(), i, j, k, l)
+                    tmp = transpose12(tmp, i, j, l, k)
+                    tmp = transpose23(tmp, i, l, j, k)
+                    tmp = transpose12(tmp, i, l, k, j)
+                    tmp = transpose23(tmp, i, k, l, j)
+    return dm4
+
+def make_dm1234_outcore(cibra, ciket, norb, nelec, dm4file, dataname='dm4',
+                        max_memory=lib.param.MAX_MEMORY, reorder=True):
+    r'''Spin traced 1, 2, 3-particle density matrices in memory and the
+    4-particle density matrix written to dm4file[dataname].
+
+    The 4-pdm is generated slice by slice dm4[p0:p1] and is never held in
+    memory as a whole.  The size of the slices is determined by max_memory
+    (in MB).  dm4file can be a file name or an h5py File/Group object.
+
+    With reorder=True, the density matrices are transformed to the normal
+    density matrices as reorder_dm1234 does.  Otherwise they are in the
+    order of make_dm1234.
+
+    Returns:
+        dm1, dm2, dm3
+    '''
+    neleca, nelecb = _unpack_nelec(nelec)
+    link_index = (cistring.gen_linkstr_index(range(norb), neleca),
+                  cistring.gen_linkstr_index(range(norb), nelecb))
+    dm1, dm2, dm3 = make_dm123('FCI3pdm_kern_sf', cibra, ciket, norb, nelec)
+    if reorder:
+        dm1, dm2, dm3 = reorder_dm123(dm1, dm2, dm3)
+
+    if isinstance(dm4file, str):
+        feri = h5py.File(dm4file, 'a')
+    else:
+        feri = dm4file
+    if dataname in feri:
+        del(feri[dataname])
+    h5d = feri.create_dataset(dataname, (norb,)*8, 'f8',
+                              chunks=(1,1)+(norb,)*6)
+
+# per orbital p: the slice dm4[p] and the transposed intermediates of
+# fci_4pdm.c;  the other intermediates do not depend on the slice size
+    nbuf = 96
+    mem_now = lib.current_memory()[0]
+    mem_fixed = (nbuf*2*norb**4 + nbuf*norb**2) * 8e-6
+    mem_per_p = (norb**7 + nbuf*norb**3) * 8e-6
+    blksize = int((max_memory - mem_now - mem_fixed) / mem_per_p)
+    blksize = max(1, min(norb, blksize))
+    for p0, p1 in lib.prange(0, norb, blksize):
+        dm4 = make_dm34_slice(cibra, ciket, norb, nelec, p0, p1,
+                              link_index=link_index)[1]
+        if reorder:
+            _reorder_dm4_slice_(dm1[:,p0:p1], dm2[p0:p1], dm3[p0:p1], dm4)
+        h5d[p0:p1] = dm4
+        dm4 = None
+
+    if isinstance(dm4file, str):
+        feri.close()
+    return dm1, dm2, dm3
+
 def reorder_dm12(rdm1, rdm2, inplace=True):
     return reorder_rdm(rdm1, rdm2, inplace)
 
@@ -335,7 +460,15 @@ def reorder_dm1234(rdm1, rdm2, rdm3, rdm4, inplace=True):
     rdm1, rdm2, rdm3 = reorder_dm123(rdm1, rdm2, rdm3, inplace)
     if not inplace:
         rdm4 = rdm4.copy()
-    norb = rdm1.shape[0]
+    _reorder_dm4_slice_(rdm1, rdm2, rdm3, rdm4)
+    return rdm1, rdm2, rdm3, rdm4
+
+# The corrections of reorder_dm1234 for the slice rdm4[p0:p1].  rdm1, rdm2,
+# rdm3 are the reordered density matrices restricted to the same p0:p1 on the
+# index which pairs with the first index of rdm4, i.e. rdm1[:,p0:p1],
+# rdm2[p0:p1] and rdm3[p0:p1].
+def _reorder_dm4_slice_(rdm1, rdm2, rdm3, rdm4):
+    norb = rdm4.shape[1]
     for q in range(norb):
         rdm4[:,q,:,:,:,:,q,:] -= rdm3.transpose(0,2,3,4,5,1)
         rdm4[:,:,:,q,:,:,q,:] -= rdm3.transpose(0,1,2,4,5,3)
@@ -353,7 +486,7 @@ def reorder_dm1234(rdm1, rdm2, rdm3, rdm4, inplace=True):
             rdm4[:,q,q,s,s,:,:,:] -= rdm2
             for u in range(norb):
                 rdm4[:,q,q,s,s,u,u,:] -= rdm1.T
-    return rdm1, rdm2, rdm3, rdm4
+    return rdm4
 
 def _unpack_nelec(nelec, spin=None):
     if spin is None:
@@ -15,7 +15,9 @@
 
 from functools import reduce
 import unittest
+import tempfile
 import numpy
+import h5py
 from pyscf import gto
 from pyscf import scf
 from pyscf import ao2mo
@@ -56,6 +58,20 @@ class KnownValues(unittest.TestCase):
         dm3 = fci.rdm.make_dm123('FCI3pdm_kern_sf', ci1, ci1, norb, (5,3))[2]
         self.assertTrue(numpy.allclose(dm3ref, dm3))
 
+    def test_rdm3_sparse_ci(self):
+        # most CI blocks are zero and skipped by the RDM drivers
+        ci1 = numpy.zeros((na,na))
+        ci1[:2,:2] = ci0[:2,:2]
+        dm3ref = make_dm3_o0(ci1, norb, nelec)
+        dm1, dm2, dm3 = fci.rdm.make_dm123('FCI3pdm_kern_sf', ci1, ci1, norb, nelec)
+        self.assertTrue(numpy.allclose(dm3ref, dm3))
+        dm2 = fci.direct_spin1.make_rdm12(ci1, norb, nelec, reorder=False)[1]
+        self.assertTrue(numpy.allclose(dm2, numpy.einsum('mmijkl->ijkl',dm3)/nelec))
+
+        dm4ref = make_dm4_o0(ci1, norb, nelec)
+        dm4 = fci.rdm.make_dm1234('FCI4pdm_kern_sf', ci1, ci1, norb, nelec)[3]
+        self.assertTrue(numpy.allclose(dm4ref, dm4))
+
     def test_dm4(self):
         dm4ref = make_dm4_o0(ci0, norb, nelec)
         dm4 = fci.rdm.make_dm1234('FCI4pdm_kern_sf', ci0, ci0, norb, nelec)[3]
@@ -81,6 +97,27 @@ class KnownValues(unittest.TestCase):
         self.assertTrue(numpy.allclose(dm3a, numpy.einsum('mnijppkl->mnijkl',dm4b)/5))
         self.assertTrue(numpy.allclose(dm3a, numpy.einsum('mnijklpp->mnijkl',dm4b)/5))
 
+    def test_dm1234_outcore(self):
+        numpy.random.seed(3)
+        na = fci.cistring.num_strings(norb, 5)
+        nb = fci.cistring.num_strings(norb, 3)
+        ci1 = numpy.random.random((na,nb))
+        ci2 = numpy.random.random((na,nb))
+        dm1, dm2, dm3, dm4 = fci.rdm.make_dm1234('FCI4pdm_kern_sf', ci1, ci2, norb, (5,3))
+        dm3s, dm4s = fci.rdm.make_dm34_slice(ci1, ci2, norb, (5,3), 2, 5)
+        self.assertTrue(numpy.allclose(dm3[2:5], dm3s))
+        self.assertTrue(numpy.allclose(dm4[2:5], dm4s))
+
+        dm1, dm2, dm3, dm4 = fci.rdm.reorder_dm1234(dm1, dm2, dm3, dm4)
+        ftmp = tempfile.NamedTemporaryFile()
+        dm1a, dm2a, dm3a = fci.rdm.make_dm1234_outcore(ci1, ci2, norb, (5,3),
+                                                       ftmp.name, max_memory=1)
+        with h5py.File(ftmp.name, 'r') as f:
+            self.assertTrue(numpy.allclose(dm4, f['dm4'][:]))
+        self.assertTrue(numpy.allclose(dm1, dm1a))
+        self.assertTrue(numpy.allclose(dm2, dm2a))
+        self.assertTrue(numpy.allclose(dm3, dm3a))
+
     def test_tdm2(self):
         dm1 = numpy.einsum('ij,ijkl->lk', ci0, _trans1(ci0, norb, nelec))
         self.assertTrue(numpy.allclose(rdm1, dm1))
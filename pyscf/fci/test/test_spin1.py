@@ -80,6 +80,19 @@ class KnownValues(unittest.TestCase):
         e, c = fci.direct_spin1.kernel(h1e, g2e, norb, neleci)
         self.assertAlmostEqual(e, -8.7498253981782, 8)
 
+    def test_mixed_precision(self):
+        ci1ref = fci.direct_spin1.contract_2e(g2e, ci2, norb, neleci)
+        ci1 = fci.direct_spin1.contract_2e(g2e, ci2.astype(numpy.float32), norb, neleci)
+        self.assertEqual(ci1.dtype, numpy.float32)
+        self.assertAlmostEqual(abs(ci1-ci1ref).max(), 0, 4)
+
+        cis = fci.direct_spin1.FCI()
+        cis.mixed_precision = True
+        cis.davidson_only = True
+        e, c = cis.kernel(h1e, g2e, norb, neleci, nroots=2)
+        self.assertAlmostEqual(e[0], -8.7498253981782, 8)
+        self.assertEqual(c[0].dtype, numpy.double)
+
     def test_hdiag(self):
         hdiagref = fci.direct_spin0.make_hdiag(h1e, g2e, norb, mol.nelectron)
         hdiag = fci.direct_spin1.make_hdiag(h1e, g2e, norb, nelec)
@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+# Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+#
+# The tests can be executed with multiple processes
+#       mpirun -n 3 python test_spin1_mpi.py
+#
+
+import unittest
+import numpy
+from pyscf import fci
+from pyscf.fci import direct_spin1_mpi
+try:
+    from mpi4py import MPI
+    comm = MPI.COMM_WORLD
+except ImportError:
+    comm = None
+
+norb = 8
+nelec = (4, 3)
+numpy.random.seed(1)
+h1e = numpy.random.random((norb,norb))
+h1e = h1e + h1e.T
+g2e = numpy.random.random((norb,norb,norb,norb)) * .5
+g2e = g2e + g2e.transpose(1,0,2,3)
+g2e = g2e + g2e.transpose(0,1,3,2)
+g2e = g2e + g2e.transpose(2,3,0,1)
+na = fci.cistring.num_strings(norb, nelec[0])
+nb = fci.cistring.num_strings(norb, nelec[1])
+ci0 = numpy.random.random((na,nb))
+
+@unittest.skipIf(comm is None, 'mpi4py not found')
+class KnownValues(unittest.TestCase):
+    def test_contract(self):
+        h2e = fci.direct_spin1.absorb_h1e(h1e, g2e, norb, nelec, .5)
+        ref = fci.direct_spin1.contract_2e(h2e, ci0, norb, nelec)
+        c0 = direct_spin1_mpi.scatter_civec(ci0, norb, nelec, comm)
+        ci1 = direct_spin1_mpi.contract_2e(h2e, c0, norb, nelec, comm=comm)
+        ci1 = direct_spin1_mpi.gather_civec(ci1, norb, nelec, comm)
+        self.assertAlmostEqual(abs(ci1-ref).max(), 0, 9)
+
+        ref = fci.direct_spin1.make_hdiag(h1e, g2e, norb, nelec)
+        hdiag = direct_spin1_mpi.make_hdiag(h1e, g2e, norb, nelec, comm)
+        hdiag = direct_spin1_mpi.gather_civec(hdiag, norb, nelec, comm)
+        self.assertAlmostEqual(abs(hdiag.ravel()-ref).max(), 0, 9)
+
+    def test_kernel(self):
+        eref, cref = fci.direct_spin1.FCI().kernel(h1e, g2e, norb, nelec, nroots=2)
+        cis = direct_spin1_mpi.FCI(comm=comm)
+        e, c = cis.kernel(h1e, g2e, norb, nelec, nroots=2)
+        self.assertAlmostEqual(abs(e-eref).max(), 0, 8)
+        c0 = cis.gather_civec(c[0])
+        self.assertAlmostEqual(abs(numpy.dot(c0.ravel(), cref[0].ravel())), 1, 8)
+
+class _FakeComm(object):
+    '''One process of a communicator of the given size, in serial'''
+    def __init__(self, rank, size):
+        self.rank = rank
+        self.size = size
+    def Get_rank(self):
+        return self.rank
+    def Get_size(self):
+        return self.size
+
+class _EigCalled(Exception):
+    pass
+
+class _RecordNroots(direct_spin1_mpi.FCISolver):
+    '''Stops the kernel at eig and records the number of roots'''
+    def eig(self, op, x0=None, precond=None, **kwargs):
+        self.nroots_used.append(kwargs['nroots'])
+        raise _EigCalled
+
+class KnownValuesSerial(unittest.TestCase):
+    def test_nroots_local_rows(self):
+        # 6 alpha strings over 4 processes.  Process 0 holds 1*4 rows, fewer
+        # than nroots.  All processes should solve the same number of roots,
+        # otherwise the collective calls in eig do not match.
+        norb = 4
+        nelec = (2, 1)
+        h1e = numpy.random.random((norb,norb))
+        h1e = h1e + h1e.T
+        eri = numpy.random.random((norb,)*4)
+        for rank in range(4):
+            cis = _RecordNroots(comm=_FakeComm(rank, 4))
+            cis.nroots_used = nroots_used = []
+            self.assertRaises(_EigCalled, cis.kernel, h1e, eri, norb, nelec,
+                              nroots=5)
+            self.assertEqual(nroots_used, [5])
+            self.assertRaises(_EigCalled, cis.kernel, h1e, eri, norb, nelec,
+                              nroots=30)
+            self.assertEqual(nroots_used, [5, 24])
+
+
+if __name__ == "__main__":
+    print("Full Tests for distributed FCI")
+    unittest.main()
@@ -68,6 +68,30 @@ class KnownValues(unittest.TestCase):
         e = fci.direct_spin1_symm.energy(h1e, g2e, c, norb, nelec)
         self.assertAlmostEqual(e, -84.200905534209554, 8)
 
+    def test_mixed_precision(self):
+        # mixed_precision is not available for the symmetry adapted sigma
+        # vector.  It should fall back to double precision.
+        norb = 6
+        nelec = (3, 3)
+        orbsym = numpy.array([0,1,0,1,0,1])
+        numpy.random.seed(12)
+        h1 = numpy.random.random((norb,norb))
+        h1 = h1 + h1.T
+        h1[orbsym[:,None] != orbsym] = 0
+        eri = numpy.random.random((norb,)*4)
+        eri = eri + eri.transpose(1,0,2,3)
+        eri = eri + eri.transpose(0,1,3,2)
+        eri = eri + eri.transpose(2,3,0,1)
+        sym = orbsym[:,None,None,None] ^ orbsym[:,None,None] ^ orbsym[:,None] ^ orbsym
+        eri[sym != 0] = 0
+        solver = fci.direct_spin1_symm.FCI()
+        solver.davidson_only = True
+        eref, cref = solver.kernel(h1, eri, norb, nelec, orbsym=orbsym)
+        solver.mixed_precision = True
+        e, c = solver.kernel(h1, eri, norb, nelec, orbsym=orbsym)
+        self.assertAlmostEqual(e, eref, 9)
+        self.assertEqual(c.dtype, numpy.double)
+
     def test_fci_spin_square_nroots(self):
         mol = gto.M(
             verbose = 0,
@@ -58,13 +58,15 @@ def grad_elec(mf_grad, mo_energy=None, mo_coeff=None, mo_occ=None, atmlst=None):
 # nabla was applied on bra in vhf, *2 for the contributions of nabla|ket>
         de[k] += numpy.einsum('xij,ij->x', vhf[:,p0:p1], dm0[p0:p1]) * 2
         de[k] -= numpy.einsum('xij,ij->x', s1[:,p0:p1], dme0[p0:p1]) * 2
-        if mf_grad.grid_response: # Only effective in DFT gradients
+        # Only effective in DFT gradients.  exc1_grid holds the grids response
+        # or the XC contributions accumulated on atoms
+        if getattr(vhf, 'exc1_grid', None) is not None:
             de[k] += vhf.exc1_grid[ia]
     if log.verbose >= logger.DEBUG:
         log.debug('gradients of electronic part')
         _write(log, mol, de, atmlst)
-        if mf_grad.grid_response:
-            log.debug('grids response contributions')
+        if getattr(vhf, 'exc1_grid', None) is not None:
+            log.debug('XC contributions on atoms')
             _write(log, mol, vhf.exc1_grid[atmlst], atmlst)
             log.debug1('sum(de) %s', vhf.exc1_grid.sum(axis=0))
     return de
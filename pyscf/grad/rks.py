@@ -20,6 +20,7 @@
 
 import time
 import copy
+import ctypes
 import numpy
 import scipy.linalg
 from pyscf import gto
@@ -29,6 +30,7 @@ from pyscf.grad import rhf as rhf_grad
 from pyscf.dft import numint, radi, gen_grid
 from pyscf import __config__
 
+libdft = lib.load_library('libdft')
 
 def get_veff(ks_grad, mol=None, dm=None):
     '''Coulomb + XC functional
@@ -53,7 +55,20 @@ def get_veff(ks_grad, mol=None, dm=None):
 
     mem_now = lib.current_memory()[0]
     max_memory = max(2000, ks_grad.max_memory*.9-mem_now)
-    if ks_grad.grid_response:
+    if (getattr(ks_grad, 'native_xc', False) and numpy.ndim(dm) == 2 and
+        ni._xc_type(mf.xc) in ('LDA', 'GGA')):
+        # The XC contributions are accumulated on atoms (exc1_grid) without
+        # building the XC potential matrices
+        if ks_grad.grid_response:
+            exc = get_vxc_grad_full_response(ni, mol, grids, mf.xc, dm,
+                                             max_memory=max_memory,
+                                             verbose=ks_grad.verbose)
+        else:
+            exc = get_vxc_grad(ni, mol, grids, mf.xc, dm,
+                               max_memory=max_memory, verbose=ks_grad.verbose)
+        nao = mol.nao_nr()
+        vxc = numpy.zeros((3,nao,nao))
+    elif ks_grad.grid_response:
         exc, vxc = get_vxc_full_response(ni, mol, grids, mf.xc, dm,
                                          max_memory=max_memory,
                                          verbose=ks_grad.verbose)
@@ -85,16 +100,23 @@ def get_vxc(ni, mol, grids, xc_code, dms, relativity=0, hermi=1,
     ao_loc = mol.ao_loc_nr()
 
     vmat = numpy.zeros((nset,3,nao,nao))
+    rho_cutoff = getattr(ni, 'small_rho_block_cutoff',
+                         numint.SMALL_RHO_BLOCK_CUTOFF)
     if xctype == 'LDA':
         ao_deriv = 1
         for ao, mask, weight, coords \
                 in ni.block_loop(mol, grids, nao, ao_deriv, max_memory):
             for idm in range(nset):
                 rho = make_rho(idm, ao[0], mask, 'LDA')
-                vxc = ni.eval_xc(xc_code, rho, 0, relativity, 1, verbose)[1]
+                screened = numint._skip_small_rho(rho, mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                vxc = numint._eval_xc_on_grids(ni, xc_code, rho, 0, relativity,
+                                               verbose, idx)[1]
                 vrho = vxc[0]
                 aow = numpy.einsum('pi,p->pi', ao[0], weight*vrho)
-                _d1_dot_(vmat[idm], mol, ao[1:4], aow, mask, ao_loc, True)
+                _d1_dot_(vmat[idm], mol, ao[1:4], aow, mask1, ao_loc, True)
                 rho = vxc = vrho = aow = None
     elif xctype == 'GGA':
         ao_deriv = 2
@@ -102,9 +124,14 @@ def get_vxc(ni, mol, grids, xc_code, dms, relativity=0, hermi=1,
                 in ni.block_loop(mol, grids, nao, ao_deriv, max_memory):
             for idm in range(nset):
                 rho = make_rho(idm, ao[:4], mask, 'GGA')
-                vxc = ni.eval_xc(xc_code, rho, 0, relativity, 1, verbose)[1]
+                screened = numint._skip_small_rho(rho, mask, rho_cutoff)
+                if screened is None:
+                    continue
+                idx, mask1 = screened
+                vxc = numint._eval_xc_on_grids(ni, xc_code, rho, 0, relativity,
+                                               verbose, idx)[1]
                 wv = numint._rks_gga_wv0(rho, vxc, weight)
-                _gga_grad_sum_(vmat[idm], mol, ao, wv, mask, ao_loc)
+                _gga_grad_sum_(vmat[idm], mol, ao, wv, mask1, ao_loc)
                 rho = vxc = vrho = vsigma = wv = None
     elif xctype == 'NLC':
         raise NotImplementedError('NLC')
@@ -212,6 +239,178 @@ def get_vxc_full_response(ni, mol, grids, xc_code, dms, relativity=0, hermi=1,
     return excsum, -vmat
 
 
+def get_vxc_grad(ni, mol, grids, xc_code, dm, relativity=0, hermi=1,
+                 max_memory=2000, verbose=None):
+    '''XC contributions to the nuclear gradients, accumulated on atoms.  The
+    AO derivatives of each block of grids are contracted with the density
+    matrix and the XC potential in C (VXCnr_grad_xc).
+
+    Returns:
+        de : (natm,3) ndarray
+    '''
+    xctype = ni._xc_type(xc_code)
+    make_rho, nset, nao = ni._gen_rho_evaluator(mol, dm, hermi)
+    dm = numpy.asarray(dm, order='C')
+    rho_cutoff = getattr(ni, 'small_rho_block_cutoff',
+                         numint.SMALL_RHO_BLOCK_CUTOFF)
+
+    de = numpy.zeros((mol.natm,3))
+    if xctype == 'LDA':
+        ao_deriv = 1
+    elif xctype == 'GGA':
+        ao_deriv = 2
+    else:
+        raise NotImplementedError(xctype)
+    for ao, mask, weight, coords \
+            in ni.block_loop(mol, grids, nao, ao_deriv, max_memory):
+        if xctype == 'LDA':
+            rho = make_rho(0, ao[0], mask, 'LDA')
+        else:
+            rho = make_rho(0, ao[:4], mask, 'GGA')
+        screened = numint._skip_small_rho(rho, mask, rho_cutoff)
+        if screened is None:
+            continue
+        idx, mask1 = screened
+        vxc = numint._eval_xc_on_grids(ni, xc_code, rho, 0, relativity,
+                                       verbose, idx)[1]
+        if xctype == 'LDA':
+            wv = (weight * vxc[0]).reshape(1,-1)
+        else:
+            wv = numint._rks_gga_wv0(rho, vxc, weight)
+        _grad_xc_(de, mol, ao, wv, dm, mask1)
+        rho = vxc = wv = None
+    return de
+
+def get_vxc_grad_full_response(ni, mol, grids, xc_code, dm, relativity=0,
+                               hermi=1, max_memory=2000, verbose=None):
+    '''XC contributions to the nuclear gradients including the response of
+    the grids coordinates and the grids weights.
+
+    Returns:
+        de : (natm,3) ndarray
+    '''
+    xctype = ni._xc_type(xc_code)
+    make_rho, nset, nao = ni._gen_rho_evaluator(mol, dm, hermi)
+    dm = numpy.asarray(dm, order='C')
+
+    de = numpy.zeros((mol.natm,3))
+    if xctype == 'LDA':
+        ao_deriv = 1
+    elif xctype == 'GGA':
+        ao_deriv = 2
+    else:
+        raise NotImplementedError(xctype)
+    for atm_id, coords, weight, vol in _grids_response_cc_native(grids):
+        mask = gen_grid.make_mask(mol, coords)
+        ao = ni.eval_ao(mol, coords, deriv=ao_deriv, non0tab=mask)
+        if xctype == 'LDA':
+            rho = make_rho(0, ao[0], mask, 'LDA')
+            rho0 = rho
+        else:
+            rho = make_rho(0, ao[:4], mask, 'GGA')
+            rho0 = rho[0]
+        exc, vxc = ni.eval_xc(xc_code, rho, 0, relativity, 1, verbose)[:2]
+        if xctype == 'LDA':
+            wv = (weight * vxc[0]).reshape(1,-1)
+        else:
+            wv = numint._rks_gga_wv0(rho, vxc, weight)
+
+        de1 = numpy.zeros((mol.natm,3))
+        _grad_xc_(de1, mol, ao, wv, dm, mask)
+        de += de1
+        # response of grids coordinates
+        de[atm_id] -= de1.sum(axis=0)
+        # response of weights
+        _grids_weight_response_(de, grids, atm_id, coords, vol, exc*rho0)
+        rho = rho0 = vxc = wv = exc = None
+    return de
+
+def _grad_xc_(de, mol, ao, wv, dm, non0tab):
+    nwv, ngrids = wv.shape
+    nao = dm.shape[0]
+    ncomp = 4 if nwv == 1 else 10
+    # VXCnr_grad_xc takes the layout ao[comp,nao,ngrids] of eval_ao
+    ao = numpy.asarray(ao[:ncomp].transpose(0,2,1), order='C')
+    wv = numpy.asarray(wv, order='C')
+    # VXCnr_grad_xc computes \sum_k aow[k,p] dm[i,k] with the transposed dm
+    dmT = numpy.asarray(dm.T, order='C')
+    if non0tab is None:
+        pnon0tab = lib.c_null_ptr()
+    else:
+        pnon0tab = non0tab.ctypes.data_as(ctypes.c_void_p)
+    libdft.VXCnr_grad_xc(de.ctypes.data_as(ctypes.c_void_p),
+                         ao.ctypes.data_as(ctypes.c_void_p),
+                         wv.ctypes.data_as(ctypes.c_void_p),
+                         dmT.ctypes.data_as(ctypes.c_void_p),
+                         ctypes.c_int(nwv), ctypes.c_int(nao),
+                         ctypes.c_int(ngrids), ctypes.c_int(mol.natm),
+                         ctypes.c_int(mol.nbas), pnon0tab,
+                         (ctypes.c_int*2)(0, mol.nbas),
+                         mol.ao_loc_nr().ctypes.data_as(ctypes.c_void_p),
+                         mol._bas.ctypes.data_as(ctypes.c_void_p))
+    return de
+
+def _grids_radii_table(grids):
+    mol = grids.mol
+    if grids.radii_adjust in (radi.treutler_atomic_radii_adjust,
+                              radi.becke_atomic_radii_adjust):
+        fadjust = grids.radii_adjust(mol, grids.atomic_radii)
+        return numpy.asarray([fadjust(i, j, 0)
+                              for i in range(mol.natm)
+                              for j in range(mol.natm)])
+    else:
+        return None
+
+def _grids_response_cc_native(grids):
+    '''Similar to grids_response_cc.  The weight derivatives are not
+    generated.  They are contracted by _grids_weight_response_ in C.
+    '''
+    mol = grids.mol
+    atom_grids_tab = grids.gen_atomic_grids(mol, grids.atom_grid,
+                                            grids.radi_method,
+                                            grids.level, grids.prune)
+    atm_coords = numpy.asarray(mol.atom_coords() , order='C')
+    radii_table = _grids_radii_table(grids)
+    if radii_table is None:
+        p_radii_table = lib.c_null_ptr()
+    else:
+        p_radii_table = radii_table.ctypes.data_as(ctypes.c_void_p)
+
+    for ia in range(mol.natm):
+        coords, vol = atom_grids_tab[mol.atom_symbol(ia)]
+        coords = coords + atm_coords[ia]
+        ngrids = coords.shape[0]
+        pbecke = numpy.empty((mol.natm,ngrids))
+        libdft.VXCgen_grid(pbecke.ctypes.data_as(ctypes.c_void_p),
+                           numpy.asarray(coords, order='F').ctypes.data_as(ctypes.c_void_p),
+                           atm_coords.ctypes.data_as(ctypes.c_void_p),
+                           p_radii_table,
+                           ctypes.c_int(mol.natm), ctypes.c_int(ngrids))
+        weight = vol * pbecke[ia] / pbecke.sum(axis=0)
+        yield ia, coords, weight, vol
+
+def _grids_weight_response_(de, grids, atm_id, coords, vol, erho):
+    '''de[n,x] += \sum_r erho[r] dw[r]/dR_{n,x} for the grids of atom atm_id'''
+    mol = grids.mol
+    atm_coords = numpy.asarray(mol.atom_coords() , order='C')
+    radii_table = _grids_radii_table(grids)
+    if radii_table is None:
+        p_radii_table = lib.c_null_ptr()
+    else:
+        p_radii_table = radii_table.ctypes.data_as(ctypes.c_void_p)
+    coords = numpy.asarray(coords, order='F')
+    vol = numpy.asarray(vol, order='C')
+    erho = numpy.asarray(erho, order='C')
+    libdft.VXCgrid_response(de.ctypes.data_as(ctypes.c_void_p),
+                            erho.ctypes.data_as(ctypes.c_void_p),
+                            coords.ctypes.data_as(ctypes.c_void_p),
+                            vol.ctypes.data_as(ctypes.c_void_p),
+                            atm_coords.ctypes.data_as(ctypes.c_void_p),
+                            p_radii_table, ctypes.c_int(atm_id),
+                            ctypes.c_int(mol.natm), ctypes.c_int(coords.shape[0]))
+    return de
+
+
 # JCP, 98, 5612
 def grids_response_cc(grids):
     mol = grids.mol
@@ -330,15 +529,18 @@ class Gradients(rhf_grad.Gradients):
 # This parameter has no effects for HF gradients. Add this attribute so that
 # the kernel function can be reused in the DFT gradients code.
     grid_response = getattr(__config__, 'grad_rks_Gradients_grid_response', False)
+    # Accumulate the XC contributions on atoms in C (get_vxc_grad) for LDA and GGA
+    native_xc = getattr(__config__, 'grad_rks_Gradients_native_xc', False)
 
     def __init__(self, mf):
         rhf_grad.Gradients.__init__(self, mf)
         self.grids = None
-        self._keys = self._keys.union(['grid_response', 'grids'])
+        self._keys = self._keys.union(['grid_response', 'grids', 'native_xc'])
 
     def dump_flags(self):
         rhf_grad.Gradients.dump_flags(self)
         logger.info(self, 'grid_response = %s', self.grid_response)
+        logger.info(self, 'native_xc = %s', self.native_xc)
         #if callable(self.base.grids.prune):
         #    logger.info(self, 'Grid pruning %s may affect DFT gradients accuracy.'
         #                'Call mf.grids.run(prune=False) to mute grid pruning',
@@ -383,6 +383,48 @@ class KnownValues(unittest.TestCase):
 #FIXME: exc1_full is quite different to the finite difference results, why?
         self.assertAlmostEqual(dexc_t, exc1_full[2], 2)
 
+    def test_native_xc(self):
+        g_ref = mf.nuc_grad_method().set(native_xc=False).kernel()
+        g = mf.nuc_grad_method().set(native_xc=True).kernel()
+        self.assertAlmostEqual(abs(g-g_ref).max(), 0, 9)
+
+        g_ref = mf.nuc_grad_method().set(native_xc=False, grid_response=True).kernel()
+        g = mf.nuc_grad_method().set(native_xc=True, grid_response=True).kernel()
+        self.assertAlmostEqual(abs(g-g_ref).max(), 0, 9)
+
+        mf1 = dft.RKS(mol).set(xc='b3lyp', conv_tol=1e-12).run()
+        g_ref = mf1.nuc_grad_method().set(native_xc=False).kernel()
+        g = mf1.nuc_grad_method().set(native_xc=True).kernel()
+        self.assertAlmostEqual(abs(g-g_ref).max(), 0, 9)
+
+        mf1.grids.radii_adjust = radi.becke_atomic_radii_adjust
+        g_ref = mf1.nuc_grad_method().set(native_xc=False, grid_response=True).kernel()
+        g = mf1.nuc_grad_method().set(native_xc=True, grid_response=True).kernel()
+        self.assertAlmostEqual(abs(g-g_ref).max(), 0, 9)
+
+    def test_grad_xc_kernel(self):
+        numpy.random.seed(1)
+        nao = mol.nao_nr()
+        ngrids = 300
+        ao = numpy.random.random((10,ngrids,nao)) - .5
+        wv = numpy.random.random((4,ngrids))
+        dm = numpy.random.random((nao,nao))
+        dm = dm + dm.T
+        ao_loc = mol.ao_loc_nr()
+        aoslices = mol.aoslice_by_atom()
+        for nwv in (1, 4):
+            de = numpy.zeros((mol.natm,3))
+            rks._grad_xc_(de, mol, ao, wv[:nwv], dm, None)
+            vmat = numpy.zeros((3,nao,nao))
+            if nwv == 1:
+                aow = numpy.einsum('pi,p->pi', ao[0], wv[0])
+                rks._d1_dot_(vmat, mol, ao[1:4], aow, None, ao_loc, True)
+            else:
+                rks._gga_grad_sum_(vmat, mol, ao, wv, None, ao_loc)
+            ref = [numpy.einsum('xij,ij->x', vmat[:,p0:p1], dm[p0:p1]) * -2
+                   for p0, p1 in aoslices[:,2:]]
+            self.assertAlmostEqual(abs(de - ref).max(), 0, 9)
+
     def test_range_separated(self):
         mol = gto.M(atom="H; H 1 1.", basis='ccpvdz', verbose=0)
         mf = dft.RKS(mol)
@@ -210,13 +210,13 @@ def cre_des_sign(p, q, string):
         for i in range(nset-pg, nset-qg-1):
             n1 += bin(string[i]).count('1')
         n1 += bin(string[-1-pg] & numpy.uint64((1<<pb) - 1)).count('1')
-        n1 += string[-1-qg] >> numpy.uint64(qb+1)
+        n1 += bin(string[-1-qg] >> numpy.uint64(qb+1)).count('1')
     elif pg < qg:
         n1 = 0
         for i in range(nset-qg, nset-pg-1):
             n1 += bin(string[i]).count('1')
         n1 += bin(string[-1-qg] & numpy.uint64((1<<qb) - 1)).count('1')
-        n1 += string[-1-pg] >> numpy.uint64(pb+1)
+        n1 += bin(string[-1-pg] >> numpy.uint64(pb+1)).count('1')
     else:
         if p > q:
             mask = numpy.uint64((1 << pb) - (1 << (qb+1)))
@@ -309,57 +309,44 @@ def toggle_bit(s, place):
 
 def select_strs_ctypes(myci, civec, h1, eri, jk, eri_sorted, jk_sorted, norb, nelec):
     strs = civec._strs
-    ndet = strs.shape[0]
     ndet, nset = strs.shape
-    nset = nset // 2
     neleca, nelecb = nelec
 
-    h1 = numpy.asarray(h1, order='C')  
+    h1 = numpy.asarray(h1, order='C')
     eri = numpy.asarray(eri, order='C')
     jk = numpy.asarray(jk, order='C')
-    civec = numpy.asarray(civec, order='C')
+    civec = numpy.asarray(abs(civec), order='C')
     strs = numpy.asarray(strs, order='C')
     eri_sorted = numpy.asarray(eri_sorted, order='C')
     jk_sorted = numpy.asarray(jk_sorted, order='C')
 
-    str_add = numpy.empty((0,strs.shape[1]), dtype=numpy.uint64)
-
-    batch_size = max(1, 8 * 4 * neleca * nelecb * (norb-neleca) * (norb-nelecb))
-    ndet_batch = int(myci.max_memory * 1024**2) // batch_size
-    nbatches = ndet // ndet_batch + 1
-
-    for i in range(nbatches):
-        ndet_start = ndet_batch * i
-        ndet_finish = min(ndet_batch * (i + 1), ndet)
-        ndet_select_max = 4 * neleca * nelecb * (norb-neleca) * (norb-nelecb) * ndet_batch
-
-        str_add_batch = numpy.empty((ndet_select_max, strs.shape[1]), dtype=numpy.uint64)
-        n_str_add_batch = numpy.array([str_add_batch.shape[0]])
-
-        str_add_batch = numpy.asarray(str_add_batch, order='C')
-
-        libhci.select_strs(h1.ctypes.data_as(ctypes.c_void_p), 
-                           eri.ctypes.data_as(ctypes.c_void_p), 
-                           jk.ctypes.data_as(ctypes.c_void_p), 
-                           eri_sorted.ctypes.data_as(ctypes.c_void_p), 
-                           jk_sorted.ctypes.data_as(ctypes.c_void_p), 
-                           ctypes.c_int(norb), 
-                           ctypes.c_int(neleca), 
-                           ctypes.c_int(nelecb), 
-                           strs.ctypes.data_as(ctypes.c_void_p), 
-                           civec.ctypes.data_as(ctypes.c_void_p), 
-                           ctypes.c_ulonglong(ndet_start), 
-                           ctypes.c_ulonglong(ndet_finish), 
-                           ctypes.c_double(myci.select_cutoff),
-                           str_add_batch.ctypes.data_as(ctypes.c_void_p),
-                           n_str_add_batch.ctypes.data_as(ctypes.c_void_p))
-
-        n_str_add_batch = n_str_add_batch[0]
-        str_add_batch = str_add_batch[:n_str_add_batch]
-        str_add = numpy.vstack((str_add, str_add_batch))
-
-    str_add = numpy.asarray(str_add)
-    return str_add
+    # The selected strings are unique.  If the buffer is not large enough,
+    # the selection is redone with the buffer size returned by select_strs_uniq
+    nsingles = neleca * (norb-neleca) + nelecb * (norb-nelecb)
+    max_str_add = int(myci.max_memory * 1e6) // (strs.itemsize * nset)
+    n_str_add = max(1, min(max_str_add, ndet * nsingles * 4))
+    while True:
+        str_add = numpy.empty((n_str_add,nset), dtype=numpy.uint64)
+        n_str_add_ = numpy.array([n_str_add], dtype=numpy.uint64)
+        libhci.select_strs_uniq(h1.ctypes.data_as(ctypes.c_void_p),
+                                eri.ctypes.data_as(ctypes.c_void_p),
+                                jk.ctypes.data_as(ctypes.c_void_p),
+                                eri_sorted.ctypes.data_as(ctypes.c_void_p),
+                                jk_sorted.ctypes.data_as(ctypes.c_void_p),
+                                ctypes.c_int(norb),
+                                ctypes.c_int(neleca),
+                                ctypes.c_int(nelecb),
+                                strs.ctypes.data_as(ctypes.c_void_p),
+                                civec.ctypes.data_as(ctypes.c_void_p),
+                                ctypes.c_ulonglong(ndet),
+                                ctypes.c_double(myci.select_cutoff),
+                                str_add.ctypes.data_as(ctypes.c_void_p),
+                                n_str_add_.ctypes.data_as(ctypes.c_void_p))
+        if n_str_add_[0] <= n_str_add:
+            break
+        n_str_add = int(n_str_add_[0])
+
+    return str_add[:n_str_add_[0]]
 
 def enlarge_space(myci, civec, h1, eri, jk, eri_sorted, jk_sorted, norb, nelec):
     if not isinstance(civec, (tuple, list)):
@@ -376,12 +363,13 @@ def enlarge_space(myci, civec, h1, eri, jk, eri_sorted, jk_sorted, norb, nelec):
     strs = strs[cidx]
 
     ci_coeff = [as_SCIvector(c[cidx], strs) for c in civec]
- 
-    strs_new = strs.copy()
 
-    for p in range(nroots):
-        str_add = select_strs_ctypes(myci, ci_coeff[p], h1, eri, jk, eri_sorted, jk_sorted, norb, nelec)
-        strs_new = numpy.vstack((strs, str_add))
+    # Select with max_root |C_I| to get the union of the strings of all roots
+    cmax = abs(ci_coeff[0])
+    for p in range(1,nroots):
+        cmax = numpy.maximum(cmax, abs(ci_coeff[p]))
+    str_add = select_strs_ctypes(myci, as_SCIvector(cmax, strs), h1, eri, jk, eri_sorted, jk_sorted, norb, nelec)
+    strs_new = numpy.vstack((strs, str_add))
 
     # Add strings together and remove duplicate strings
     tmp = numpy.ascontiguousarray(strs_new).view(numpy.dtype((numpy.void, strs_new.dtype.itemsize * strs_new.shape[1])))
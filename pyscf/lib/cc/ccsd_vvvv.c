@@ -0,0 +1,347 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * AO-direct particle-particle ladder of CCSD
+ *
+ *      Ht2[x,a,b] += sum_{cd} x2[x,c,d] (ac|bd)
+ *
+ * x2 is the t2 amplitudes with the virtual indices transformed to AO.  The
+ * AO integrals (ac|bd) are generated for one shell of a and a group of
+ * shells of c at a time, for all bd.  Nothing of size nao^4 is held.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "cint.h"
+#include "vhf/cvhf.h"
+#include "vhf/fblas.h"
+#include "np_helper/np_helper.h"
+
+int GTOmax_shell_dim(int *ao_loc, int *shls_slice, int ncenter);
+int GTOmax_cache_size(int (*intor)(), int *shls_slice, int ncenter,
+                      int *atm, int natm, int *bas, int nbas, double *env);
+
+/*
+ * Split the shells into groups of consecutive shells.  Each group has at
+ * most blksize AOs, or one shell if the shell is larger than blksize.
+ */
+static int shell_groups(int *groups, int *ao_loc, int nbas, int blksize)
+{
+        int sh, sh0 = 0;
+        int ngroups = 0;
+        groups[0] = 0;
+        for (sh = 1; sh <= nbas; sh++) {
+                if (sh == nbas || ao_loc[sh+1] - ao_loc[sh0] > blksize) {
+                        groups[++ngroups] = sh;
+                        sh0 = sh;
+                }
+        }
+        return ngroups;
+}
+
+/*
+ * eri[a,c,b,d] = (ac|bd) for a in shell ish, c in shells [csh0:csh1] and all
+ * b, d.  Integrals which are screened out by the Schwarz inequality are 0.
+ * Returns 0 if all shell quartets are screened out.
+ */
+static int fill_ac(double *eri, double *buf, int (*intor)(),
+                   int ish, int csh0, int csh1,
+                   CVHFOpt *vhfopt, CINTOpt *cintopt, int *ao_loc,
+                   int *atm, int natm, int *bas, int nbas, double *env)
+{
+        const int nao = ao_loc[nbas];
+        const size_t nao2 = (size_t)nao * nao;
+        const int da = ao_loc[ish+1] - ao_loc[ish];
+        const int c0 = ao_loc[csh0];
+        const int nc = ao_loc[csh1] - c0;
+        int (*fprescreen)();
+        if (vhfopt != NULL) {
+                fprescreen = vhfopt->fprescreen;
+        } else {
+                fprescreen = CVHFnoscreen;
+        }
+
+        int csh, ksh, lsh, a, c, k, l, dc, dk, dl, k0, l0, dack;
+        int shls[4];
+        int nonzero = 0;
+        double *pbuf, *peri;
+        double *cache;
+
+        memset(eri, 0, sizeof(double) * da*nc*nao2);
+        shls[0] = ish;
+        for (csh = csh0; csh < csh1; csh++) {
+                shls[1] = csh;
+                dc = ao_loc[csh+1] - ao_loc[csh];
+                for (ksh = 0; ksh < nbas; ksh++) {
+                for (lsh = 0; lsh <= ksh; lsh++) {
+                        shls[2] = ksh;
+                        shls[3] = lsh;
+                        dk = ao_loc[ksh+1] - ao_loc[ksh];
+                        dl = ao_loc[lsh+1] - ao_loc[lsh];
+                        dack = da * dc * dk;
+                        cache = buf + dack * dl;
+                        if (!((*fprescreen)(shls, vhfopt, atm, bas, env) &&
+                              (*intor)(buf, NULL, shls, atm, natm, bas, nbas,
+                                       env, cintopt, cache))) {
+                                continue;
+                        }
+                        nonzero = 1;
+                        k0 = ao_loc[ksh];
+                        l0 = ao_loc[lsh];
+                        for (a = 0; a < da; a++) {
+                        for (c = 0; c < dc; c++) {
+                                peri = eri + (a*nc+ao_loc[csh]-c0+c) * nao2;
+                                for (k = 0; k < dk; k++) {
+                                for (l = 0; l < dl; l++) {
+                                        pbuf = buf + a + da*c + da*dc*k + dack*l;
+                                        peri[(k0+k)*nao+l0+l] = *pbuf;
+                                        peri[(l0+l)*nao+k0+k] = *pbuf;
+                                } }
+                        } }
+                } }
+        }
+        return nonzero;
+}
+
+/*
+ * Contract the integrals eri[a,c,b,d] = (ac|bd) of fill_ac to x2
+ *      ha[x,a,b] += sum_{cd} x2[x,c,d] (ac|bd)
+ * and if hc is not NULL
+ *      hc[x,c,b] += sum_{ad} x2[x,a,d] (ac|bd)
+ *
+ * ha: (nocc2,da,nao), hc: (nocc2,nc,nao)
+ */
+static void contract_ac(double *ha, double *hc, double *eri, double *x2,
+                        int nocc2, int nao, int a0, int da, int c0, int nc)
+{
+        const char TRANS_N = 'N';
+        const double D1 = 1;
+        const size_t nao2 = (size_t)nao * nao;
+        const int ldx = nao * nao;
+        const int lda = da * nao;
+        const int ldc = nc * nao;
+        const int nk = nc * nao;
+        int a, c;
+        double *peri;
+        for (a = 0; a < da; a++) {
+                // (ac|bd) = (ac|db): eri[a] is also the [(c,d),b] matrix
+                dgemm_(&TRANS_N, &TRANS_N, &nao, &nocc2, &nk,
+                       &D1, eri+a*nc*nao2, &nao, x2+c0*nao, &ldx,
+                       &D1, ha+a*nao, &lda);
+        }
+        if (hc == NULL) {
+                return;
+        }
+        for (a = 0; a < da; a++) {
+        for (c = 0; c < nc; c++) {
+                peri = eri + (a*nc+c) * nao2;
+                dgemm_(&TRANS_N, &TRANS_N, &nao, &nocc2, &nao,
+                       &D1, peri, &nao, x2+(a0+a)*nao, &ldx,
+                       &D1, hc+c*nao, &ldc);
+        } }
+}
+
+/*
+ * Ht2[x,a0:a0+na,:] += h[x,:na,:]
+ */
+static void add_rows(double *Ht2, double *h, int nocc2, int nao,
+                     int a0, int na)
+{
+        const size_t nao2 = (size_t)nao * nao;
+        const size_t nrow = (size_t)na * nao;
+        size_t x, i;
+        double *pHt2, *ph;
+        for (x = 0; x < nocc2; x++) {
+                pHt2 = Ht2 + x * nao2 + a0 * nao;
+                ph = h + x * nrow;
+                for (i = 0; i < nrow; i++) {
+                        pHt2[i] += ph[i];
+                }
+        }
+}
+
+/*
+ * Ht2[x,a,b] += sum_{cd} x2[x,c,d] (ac|bd)
+ *
+ * Ht2, x2: (nocc2,nao,nao)
+ * blksize: max number of AOs of c in one batch.  Each thread holds
+ *      (max shell dim) * blksize * nao^2 integrals and
+ *      nocc2 * (max shell dim + blksize) * nao partial sums of Ht2.
+ *
+ * The shells of a are distributed over threads.  Only the integrals of the
+ * shells c <= a are evaluated.  Each block (ac|bd) is contracted to both
+ * Ht2[:,a] and, using (ac|bd) = (ca|bd), Ht2[:,c].  The contributions are
+ * accumulated in the per-thread buffers ha and hc and added to Ht2 in a
+ * critical section.  The symmetry between b and d is used in the integral
+ * evaluation.
+ */
+void CCvvvv_ao_direct(double *Ht2, double *x2, int nocc2, int blksize,
+                      int (*intor)(), CVHFOpt *vhfopt, CINTOpt *cintopt,
+                      int *ao_loc, int *atm, int natm,
+                      int *bas, int nbas, double *env)
+{
+        const int nao = ao_loc[nbas];
+        const size_t nao2 = (size_t)nao * nao;
+        int shls_slice[] = {0, nbas};
+        const int dmax = GTOmax_shell_dim(ao_loc, shls_slice, 1);
+        const int cache_size = GTOmax_cache_size(intor, shls_slice, 1,
+                                                 atm, natm, bas, nbas, env);
+        int *groups = malloc(sizeof(int) * (nbas+1));
+        const int ngroups = shell_groups(groups, ao_loc, nbas, blksize);
+        int ncmax = 0;
+        int i;
+        for (i = 0; i < ngroups; i++) {
+                ncmax = MAX(ncmax, ao_loc[groups[i+1]] - ao_loc[groups[i]]);
+        }
+
+#pragma omp parallel \
+        shared(Ht2, x2, nocc2, intor, vhfopt, cintopt, ao_loc, atm, natm, \
+               bas, nbas, env, groups, ncmax)
+{
+        int ish, ig, a0, da, csh0, csh1, c0, nc;
+        double *eri = malloc(sizeof(double) * (dmax*ncmax*nao2 +
+                                               dmax*dmax*dmax*dmax + cache_size));
+        double *buf = eri + dmax*ncmax*nao2;
+        double *ha = malloc(sizeof(double) * nocc2*(dmax+ncmax)*nao);
+        double *hc = ha + nocc2*dmax*nao;
+#pragma omp for schedule(dynamic)
+        for (ish = nbas-1; ish >= 0; ish--) {
+                a0 = ao_loc[ish];
+                da = ao_loc[ish+1] - a0;
+                memset(ha, 0, sizeof(double) * nocc2*da*nao);
+                for (ig = 0; ig < ngroups && groups[ig] < ish; ig++) {
+                        csh0 = groups[ig];
+                        csh1 = MIN(groups[ig+1], ish);
+                        if (!fill_ac(eri, buf, intor, ish, csh0, csh1,
+                                     vhfopt, cintopt, ao_loc,
+                                     atm, natm, bas, nbas, env)) {
+                                continue;
+                        }
+                        c0 = ao_loc[csh0];
+                        nc = ao_loc[csh1] - c0;
+                        memset(hc, 0, sizeof(double) * nocc2*nc*nao);
+                        contract_ac(ha, hc, eri, x2, nocc2, nao, a0, da, c0, nc);
+#pragma omp critical
+                        add_rows(Ht2, hc, nocc2, nao, c0, nc);
+                }
+                // c in the same shell as a: (ac|bd) and (ca|bd) are both in
+                // the block and both update Ht2[:,a]
+                if (fill_ac(eri, buf, intor, ish, ish, ish+1,
+                            vhfopt, cintopt, ao_loc,
+                            atm, natm, bas, nbas, env)) {
+                        contract_ac(ha, NULL, eri, x2, nocc2, nao, a0, da, a0, da);
+                }
+#pragma omp critical
+                add_rows(Ht2, ha, nocc2, nao, a0, da);
+        }
+        free(eri);
+        free(ha);
+}
+        free(groups);
+}
+
+/*
+ * ta[p-b0,q] = (ij|pq) for b0 <= p < b1, q <= p, and 0 for q > p.  The
+ * diagonal (ij|pp) is scaled by 1/2 since it is used twice in
+ * CCvvvv_df_contract.
+ */
+static void unpack_bd(double *ta, double *eri, int b0, int b1)
+{
+        const size_t off0 = (size_t)b0 * (b0 + 1) / 2;
+        int p, q;
+        double *pta, *peri;
+        for (p = b0; p < b1; p++) {
+                pta = ta + (size_t)(p-b0) * b1;
+                peri = eri + (size_t)p * (p + 1) / 2 - off0;
+                for (q = 0; q < p; q++) {
+                        pta[q] = peri[q];
+                }
+                pta[p] = peri[p] * .5;
+                for (q = p + 1; q < b1; q++) {
+                        pta[q] = 0;
+                }
+        }
+}
+
+/*
+ * Ht2[x,j,d] += sum_{ib} x2[x,i,b] (ij|bd)
+ * for the tile (ij|bd) of i in [i0:i1], j in [j0:j1], max(b,d) in [b0:b1]
+ *
+ * Ht2, x2: (nocc2,nvir,nvir)
+ * ijL: (L|ij) of the tile, (i1-i0,j1-j0,naux)
+ * bdL: (L|bd), the rows of the lower triangular pairs b*(b+1)/2+d for b in
+ *      [b0:b1], (npair,naux)
+ *
+ * The tile of (ij|bd) is assembled from the 3-index tensors and contracted
+ * to t2 immediately.  If i0 != j0, (ij|bd) = (ji|bd) is used to update
+ * Ht2[:,i0:i1] as well.  The threads own the rows Ht2[:,j] (or Ht2[:,i]).
+ */
+void CCvvvv_df_contract(double *Ht2, double *x2, double *ijL, double *bdL,
+                        int nocc2, int nvir, int naux,
+                        int i0, int i1, int j0, int j1, int b0, int b1)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D0 = 0;
+        const double D1 = 1;
+        const int ni = i1 - i0;
+        const int nj = j1 - j0;
+        const int nij = ni * nj;
+        const int npair = b1*(b1+1)/2 - b0*(b0+1)/2;
+        double *eri = malloc(sizeof(double) * nij * npair);
+        dgemm_(&TRANS_T, &TRANS_N, &npair, &nij, &naux,
+               &D1, bdL, &naux, ijL, &naux, &D0, eri, &npair);
+
+#pragma omp parallel \
+        shared(Ht2, x2, nocc2, nvir, i0, j0, b0, b1, eri)
+{
+        const int nvir2 = nvir * nvir;
+        const int db = b1 - b0;
+        int i, j;
+        double *ta = malloc(sizeof(double) * db * b1);
+#pragma omp for schedule(dynamic)
+        for (j = 0; j < nj; j++) {
+                for (i = 0; i < ni; i++) {
+                        unpack_bd(ta, eri+(size_t)(i*nj+j)*npair, b0, b1);
+                        // Ht2[x,j,q] += sum_p x2[x,i,p] ta[p,q]
+                        dgemm_(&TRANS_N, &TRANS_N, &b1, &nocc2, &db,
+                               &D1, ta, &b1, x2+(i0+i)*nvir+b0, &nvir2,
+                               &D1, Ht2+(j0+j)*nvir, &nvir2);
+                        // Ht2[x,j,p] += sum_q x2[x,i,q] ta[p,q]
+                        dgemm_(&TRANS_T, &TRANS_N, &db, &nocc2, &b1,
+                               &D1, ta, &b1, x2+(i0+i)*nvir, &nvir2,
+                               &D1, Ht2+(j0+j)*nvir+b0, &nvir2);
+                }
+        }
+
+        if (i0 != j0) {
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < ni; i++) {
+                for (j = 0; j < nj; j++) {
+                        unpack_bd(ta, eri+(size_t)(i*nj+j)*npair, b0, b1);
+                        dgemm_(&TRANS_N, &TRANS_N, &b1, &nocc2, &db,
+                               &D1, ta, &b1, x2+(j0+j)*nvir+b0, &nvir2,
+                               &D1, Ht2+(i0+i)*nvir, &nvir2);
+                        dgemm_(&TRANS_T, &TRANS_N, &db, &nocc2, &b1,
+                               &D1, ta, &b1, x2+(j0+j)*nvir, &nvir2,
+                               &D1, Ht2+(i0+i)*nvir+b0, &nvir2);
+                }
+        }
+        }
+        free(ta);
+}
+        free(eri);
+}
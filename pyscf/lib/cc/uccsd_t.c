@@ -37,7 +37,13 @@ size_t _ccsd_t_gen_jobs(CacheJob *jobs, int nocc, int nvir,
                         void *cache_row_a, void *cache_col_a,
                         void *cache_row_b, void *cache_col_b, size_t stride);
 
-void _make_permute_indices(int *idx, int n);
+void _ccsd_t_perm_strides(int *s, int n, int perm);
+void _ccsd_t_add_permuted(double *w, double *x, int n, int perm);
+void _ccsd_t_permute_sum(double *out, double *v, int n,
+                         double f0, double f1, double f2);
+void _ccsd_t_zadd_permuted(double complex *w, double complex *x, int n, int perm);
+void _ccsd_t_zpermute_sum(double complex *out, double complex *v, int n,
+                          double f0, double f1, double f2);
 
 double _ccsd_t_zget_energy(double complex *w, double complex *v,
                            double *mo_energy, int nocc,
@@ -49,20 +55,12 @@ double _ccsd_t_zget_energy(double complex *w, double complex *v,
  */
 static void add_and_permute(double *out, double *w, double *v, int n)
 {
-        int nn = n * n;
-        int nnn = nn * n;
-        int i, j, k;
-
+        int nnn = n * n * n;
+        int i;
         for (i = 0; i < nnn; i++) {
                 v[i] += w[i];
         }
-
-        for (i = 0; i < n; i++) {
-        for (j = 0; j < n; j++) {
-        for (k = 0; k < n; k++) {
-                out[i*nn+j*n+k] = v[i*nn+j*n+k] + v[j*nn+k*n+i] + v[k*nn+i*n+j]
-                                - v[k*nn+j*n+i] - v[i*nn+k*n+j] - v[j*nn+i*n+k];
-        } } }
+        _ccsd_t_permute_sum(out, v, n, 1, 1, -1);
 }
 
 /*
@@ -77,7 +75,7 @@ static void add_and_permute(double *out, double *w, double *v, int n)
 static void get_wv(double *w, double *v, double *cache,
                    double *fvohalf, double *vooo,
                    double *vv_op, double *t1T, double *t2T,
-                   int nocc, int nvir, int a, int b, int c, int *idx)
+                   int nocc, int nvir, int a, int b, int c, int perm)
 {
         const double D0 = 0;
         const double D1 = 1;
@@ -98,14 +96,16 @@ static void get_wv(double *w, double *v, double *cache,
                &DN1, t2T+b*nvoo+c*noo, &nocc, vooo+a*nooo, &noo,
                &D1, cache, &nocc);
 
+        _ccsd_t_add_permuted(w, cache, nocc, perm);
+
         pt2T = t2T + a * nvoo + b * noo;
         for (n = 0, i = 0; i < nocc; i++) {
         for (j = 0; j < nocc; j++) {
         for (k = 0; k < nocc; k++, n++) {
-                w[idx[n]] += cache[n];
-                v[idx[n]] +=(vv_op[i*nmo+j] * t1T[c*nocc+k]
-                           + pt2T[i*nocc+j] * fvohalf[c*nocc+k]);
+                cache[n] = vv_op[i*nmo+j] * t1T[c*nocc+k]
+                         + pt2T[i*nocc+j] * fvohalf[c*nocc+k];
         } } }
+        _ccsd_t_add_permuted(v, cache, nocc, perm);
 }
 
 static void sym_wv(double *w, double *v, double *cache,
@@ -113,7 +113,7 @@ static void sym_wv(double *w, double *v, double *cache,
                    double *vv_op, double *t1T, double *t2T,
                    int nocc, int nvir, int a, int b, int c, int nirrep,
                    int *o_ir_loc, int *v_ir_loc, int *oo_ir_loc, int *orbsym,
-                   int *idx)
+                   int perm)
 {
         const double D0 = 0;
         const double D1 = 1;
@@ -128,11 +128,14 @@ static void sym_wv(double *w, double *v, double *cache,
         int ab_irrep = a_irrep ^ b_irrep;
         int bc_irrep = c_irrep ^ b_irrep;
         int i, j, k, n;
+        int s[3];
         int fr, f0, f1, df, mr, m0, m1, dm, mk0;
         int ir, i0, i1, di, kr, k0, k1, dk, jr;
         int ijr, ij0, ij1, dij, jkr, jk0, jk1, djk;
         double *pt2T;
 
+        _ccsd_t_perm_strides(s, nocc, perm);
+
 /* symmetry adapted
  * w = numpy.einsum('if,fjk->ijk', ov, t2T[c]) */
         pt2T = t2T + c * nvoo;
@@ -160,7 +163,7 @@ static void sym_wv(double *w, double *v, double *cache,
                 kr = jkr ^ jr;
                 for (j = o_ir_loc[jr]; j < o_ir_loc[jr+1]; j++) {
                 for (k = o_ir_loc[kr]; k < o_ir_loc[kr+1]; k++, n++) {
-                        w[idx[i*noo+j*nocc+k]] -= cache[n];
+                        w[i*s[0]+j*s[1]+k*s[2]] -= cache[n];
                 } }
         } }
                                 }
@@ -197,7 +200,7 @@ static void sym_wv(double *w, double *v, double *cache,
                 for (i = o_ir_loc[ir]; i < o_ir_loc[ir+1]; i++) {
                 for (j = o_ir_loc[jr]; j < o_ir_loc[jr+1]; j++) {
                 for (k = o_ir_loc[kr]; k < o_ir_loc[kr+1]; k++, n++) {
-                        w[idx[i*noo+j*nocc+k]] -= cache[n];
+                        w[i*s[0]+j*s[1]+k*s[2]] -= cache[n];
                 } }
         } }
                                 }
@@ -210,25 +213,19 @@ static void sym_wv(double *w, double *v, double *cache,
         for (n = 0, i = 0; i < nocc; i++) {
         for (j = 0; j < nocc; j++) {
         for (k = 0; k < nocc; k++, n++) {
-                v[idx[n]] +=(vv_op[i*nmo+j] * t1T[c*nocc+k]
-                           + pt2T[i*nocc+j] * fvohalf[c*nocc+k]);
+                cache[n] = vv_op[i*nmo+j] * t1T[c*nocc+k]
+                         + pt2T[i*nocc+j] * fvohalf[c*nocc+k];
         } } }
+        _ccsd_t_add_permuted(v, cache, nocc, perm);
 }
 
 static double contract6_aaa(int nocc, int nvir, int a, int b, int c,
                             double *mo_energy, double *t1T, double *t2T,
                             int nirrep, int *o_ir_loc, int *v_ir_loc,
                             int *oo_ir_loc, int *orbsym, double *fvo,
-                            double *vooo, double *cache1, void **cache,
-                            int *permute_idx)
+                            double *vooo, double *cache1, void **cache)
 {
         int nooo = nocc * nocc * nocc;
-        int *idx0 = permute_idx;
-        int *idx1 = idx0 + nooo;
-        int *idx2 = idx1 + nooo;
-        int *idx3 = idx2 + nooo;
-        int *idx4 = idx3 + nooo;
-        int *idx5 = idx4 + nooo;
         double *v0 = cache1;
         double *w0 = v0 + nooo;
         double *z0 = w0 + nooo;
@@ -241,25 +238,25 @@ static double contract6_aaa(int nocc, int nvir, int a, int b, int c,
         }
 
         if (nirrep == 1) {
-                get_wv(w0, v0, wtmp, fvo, vooo, cache[0], t1T, t2T, nocc, nvir, a, b, c, idx0);
-                get_wv(w0, v0, wtmp, fvo, vooo, cache[1], t1T, t2T, nocc, nvir, a, c, b, idx1);
-                get_wv(w0, v0, wtmp, fvo, vooo, cache[2], t1T, t2T, nocc, nvir, b, a, c, idx2);
-                get_wv(w0, v0, wtmp, fvo, vooo, cache[3], t1T, t2T, nocc, nvir, b, c, a, idx3);
-                get_wv(w0, v0, wtmp, fvo, vooo, cache[4], t1T, t2T, nocc, nvir, c, a, b, idx4);
-                get_wv(w0, v0, wtmp, fvo, vooo, cache[5], t1T, t2T, nocc, nvir, c, b, a, idx5);
+                get_wv(w0, v0, wtmp, fvo, vooo, cache[0], t1T, t2T, nocc, nvir, a, b, c, 0);
+                get_wv(w0, v0, wtmp, fvo, vooo, cache[1], t1T, t2T, nocc, nvir, a, c, b, 1);
+                get_wv(w0, v0, wtmp, fvo, vooo, cache[2], t1T, t2T, nocc, nvir, b, a, c, 2);
+                get_wv(w0, v0, wtmp, fvo, vooo, cache[3], t1T, t2T, nocc, nvir, b, c, a, 3);
+                get_wv(w0, v0, wtmp, fvo, vooo, cache[4], t1T, t2T, nocc, nvir, c, a, b, 4);
+                get_wv(w0, v0, wtmp, fvo, vooo, cache[5], t1T, t2T, nocc, nvir, c, b, a, 5);
         } else {
                 sym_wv(w0, v0, wtmp, fvo, vooo, cache[0], t1T, t2T, nocc, nvir, a, b, c,
-                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, idx0);
+                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, 0);
                 sym_wv(w0, v0, wtmp, fvo, vooo, cache[1], t1T, t2T, nocc, nvir, a, c, b,
-                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, idx1);
+                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, 1);
                 sym_wv(w0, v0, wtmp, fvo, vooo, cache[2], t1T, t2T, nocc, nvir, b, a, c,
-                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, idx2);
+                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, 2);
                 sym_wv(w0, v0, wtmp, fvo, vooo, cache[3], t1T, t2T, nocc, nvir, b, c, a,
-                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, idx3);
+                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, 3);
                 sym_wv(w0, v0, wtmp, fvo, vooo, cache[4], t1T, t2T, nocc, nvir, c, a, b,
-                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, idx4);
+                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, 4);
                 sym_wv(w0, v0, wtmp, fvo, vooo, cache[5], t1T, t2T, nocc, nvir, c, b, a,
-                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, idx5);
+                       nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym, 5);
         }
         add_and_permute(z0, w0, v0, nocc);
 
@@ -295,13 +292,10 @@ void CCuccsd_t_aaa(double complex *e_tot,
                 fvohalf[i] = fvo[i] * .5;
         }
 
-        int *permute_idx = malloc(sizeof(int) * nocc*nocc*nocc * 6);
-        _make_permute_indices(permute_idx, nocc);
 
 #pragma omp parallel default(none) \
         shared(njobs, nocc, nvir, mo_energy, t1T, t2T, nirrep, o_ir_loc, \
-               v_ir_loc, oo_ir_loc, orbsym, vooo, fvohalf, jobs, e_tot, \
-               permute_idx)
+               v_ir_loc, oo_ir_loc, orbsym, vooo, fvohalf, jobs, e_tot)
 {
         int a, b, c;
         size_t k;
@@ -314,14 +308,12 @@ void CCuccsd_t_aaa(double complex *e_tot,
                 c = jobs[k].c;
                 e += contract6_aaa(nocc, nvir, a, b, c, mo_energy, t1T, t2T,
                                    nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym,
-                                   fvohalf, vooo, cache1, jobs[k].cache,
-                                   permute_idx);
+                                   fvohalf, vooo, cache1, jobs[k].cache);
         }
         free(cache1);
 #pragma omp critical
         *e_tot += e;
 }
-        free(permute_idx);
 }
 
 
@@ -569,26 +561,18 @@ void CCuccsd_t_baa(double complex *e_tot,
 static void zadd_and_permute(double complex *out, double complex *w,
                              double complex *v, int n)
 {
-        int nn = n * n;
-        int nnn = nn * n;
-        int i, j, k;
-
+        int nnn = n * n * n;
+        int i;
         for (i = 0; i < nnn; i++) {
                 v[i] += w[i];
         }
-
-        for (i = 0; i < n; i++) {
-        for (j = 0; j < n; j++) {
-        for (k = 0; k < n; k++) {
-                out[i*nn+j*n+k] = v[i*nn+j*n+k] + v[j*nn+k*n+i] + v[k*nn+i*n+j]
-                                - v[k*nn+j*n+i] - v[i*nn+k*n+j] - v[j*nn+i*n+k];
-        } } }
+        _ccsd_t_zpermute_sum(out, v, n, 1, 1, -1);
 }
 
 static void zget_wv(double complex *w, double complex *v, double complex *cache,
                     double complex *fvohalf, double complex *vooo,
                     double complex *vv_op, double complex *t1T, double complex *t2T,
-                    int nocc, int nvir, int a, int b, int c, int *idx)
+                    int nocc, int nvir, int a, int b, int c, int perm)
 {
         const double complex D0 = 0;
         const double complex D1 = 1;
@@ -609,14 +593,16 @@ static void zget_wv(double complex *w, double complex *v, double complex *cache,
                &DN1, t2T+b*nvoo+c*noo, &nocc, vooo+a*nooo, &noo,
                &D1, cache, &nocc);
 
+        _ccsd_t_zadd_permuted(w, cache, nocc, perm);
+
         pt2T = t2T + a * nvoo + b * noo;
         for (n = 0, i = 0; i < nocc; i++) {
         for (j = 0; j < nocc; j++) {
         for (k = 0; k < nocc; k++, n++) {
-                w[idx[n]] += cache[n];
-                v[idx[n]] +=(vv_op[i*nmo+j] * t1T[c*nocc+k]
-                           + pt2T[i*nocc+j] * fvohalf[c*nocc+k]);
+                cache[n] = vv_op[i*nmo+j] * t1T[c*nocc+k]
+                         + pt2T[i*nocc+j] * fvohalf[c*nocc+k];
         } } }
+        _ccsd_t_zadd_permuted(v, cache, nocc, perm);
 }
 
 static double complex
@@ -624,16 +610,9 @@ zcontract6_aaa(int nocc, int nvir, int a, int b, int c,
                double *mo_energy, double complex *t1T, double complex *t2T,
                int nirrep, int *o_ir_loc, int *v_ir_loc,
                int *oo_ir_loc, int *orbsym, double complex *fvo,
-               double complex *vooo, double complex *cache1, void **cache,
-               int *permute_idx)
+               double complex *vooo, double complex *cache1, void **cache)
 {
         int nooo = nocc * nocc * nocc;
-        int *idx0 = permute_idx;
-        int *idx1 = idx0 + nooo;
-        int *idx2 = idx1 + nooo;
-        int *idx3 = idx2 + nooo;
-        int *idx4 = idx3 + nooo;
-        int *idx5 = idx4 + nooo;
         double complex *v0 = cache1;
         double complex *w0 = v0 + nooo;
         double complex *z0 = w0 + nooo;
@@ -645,12 +624,12 @@ zcontract6_aaa(int nocc, int nvir, int a, int b, int c,
                 v0[i] = 0;
         }
 
-        zget_wv(w0, v0, wtmp, fvo, vooo, cache[0], t1T, t2T, nocc, nvir, a, b, c, idx0);
-        zget_wv(w0, v0, wtmp, fvo, vooo, cache[1], t1T, t2T, nocc, nvir, a, c, b, idx1);
-        zget_wv(w0, v0, wtmp, fvo, vooo, cache[2], t1T, t2T, nocc, nvir, b, a, c, idx2);
-        zget_wv(w0, v0, wtmp, fvo, vooo, cache[3], t1T, t2T, nocc, nvir, b, c, a, idx3);
-        zget_wv(w0, v0, wtmp, fvo, vooo, cache[4], t1T, t2T, nocc, nvir, c, a, b, idx4);
-        zget_wv(w0, v0, wtmp, fvo, vooo, cache[5], t1T, t2T, nocc, nvir, c, b, a, idx5);
+        zget_wv(w0, v0, wtmp, fvo, vooo, cache[0], t1T, t2T, nocc, nvir, a, b, c, 0);
+        zget_wv(w0, v0, wtmp, fvo, vooo, cache[1], t1T, t2T, nocc, nvir, a, c, b, 1);
+        zget_wv(w0, v0, wtmp, fvo, vooo, cache[2], t1T, t2T, nocc, nvir, b, a, c, 2);
+        zget_wv(w0, v0, wtmp, fvo, vooo, cache[3], t1T, t2T, nocc, nvir, b, c, a, 3);
+        zget_wv(w0, v0, wtmp, fvo, vooo, cache[4], t1T, t2T, nocc, nvir, c, a, b, 4);
+        zget_wv(w0, v0, wtmp, fvo, vooo, cache[5], t1T, t2T, nocc, nvir, c, b, a, 5);
         zadd_and_permute(z0, w0, v0, nocc);
 
         double complex et;
@@ -686,13 +665,10 @@ void CCuccsd_t_zaaa(double complex *e_tot,
                 fvohalf[i] = fvo[i] * .5;
         }
 
-        int *permute_idx = malloc(sizeof(int) * nocc*nocc*nocc * 6);
-        _make_permute_indices(permute_idx, nocc);
 
 #pragma omp parallel default(none) \
         shared(njobs, nocc, nvir, mo_energy, t1T, t2T, nirrep, o_ir_loc, \
-               v_ir_loc, oo_ir_loc, orbsym, vooo, fvohalf, jobs, e_tot, \
-               permute_idx)
+               v_ir_loc, oo_ir_loc, orbsym, vooo, fvohalf, jobs, e_tot)
 {
         int a, b, c;
         size_t k;
@@ -706,14 +682,12 @@ void CCuccsd_t_zaaa(double complex *e_tot,
                 c = jobs[k].c;
                 e += zcontract6_aaa(nocc, nvir, a, b, c, mo_energy, t1T, t2T,
                                     nirrep, o_ir_loc, v_ir_loc, oo_ir_loc, orbsym,
-                                    fvohalf, vooo, cache1, jobs[k].cache,
-                                    permute_idx);
+                                    fvohalf, vooo, cache1, jobs[k].cache);
         }
         free(cache1);
 #pragma omp critical
         *e_tot += e;
 }
-        free(permute_idx);
 }
 
 
@@ -158,3 +158,169 @@ void VXCgen_grid(double *out, double *coords, double *atm_coords,
         free(atom_dist);
 }
 
+
+/*
+ * Derivatives of the Becke partition weights (JCP, 98, 5612) of the grids
+ * which belong to atom atm_id, contracted with the energy density
+ *      de[n,x] += \sum_r erho[r] d(w[r])/dR_n,x
+ * w[r] = vol[r] P_atm_id(r) / \sum_a P_a(r) is the weight of the grid r.
+ * radii_table (or NULL) is the radii adjustment a[i,j] as in VXCgen_grid.
+ */
+void VXCgrid_response(double *de, double *erho, double *coords, double *vol,
+                      double *atm_coords, double *radii_table,
+                      int atm_id, int natm, int ngrids)
+{
+        const size_t Ngrids = ngrids;
+        int i, j;
+        double dx, dy, dz;
+        double *atom_dist = malloc(sizeof(double) * natm*natm);
+        for (i = 0; i < natm; i++) {
+                for (j = 0; j < i; j++) {
+                        dx = atm_coords[i*3+0] - atm_coords[j*3+0];
+                        dy = atm_coords[i*3+1] - atm_coords[j*3+1];
+                        dz = atm_coords[i*3+2] - atm_coords[j*3+2];
+                        atom_dist[i*natm+j] = 1 / sqrt(dx*dx + dy*dy + dz*dz);
+                        atom_dist[j*natm+i] = atom_dist[i*natm+j];
+                }
+        }
+
+#pragma omp parallel \
+        shared(de, erho, coords, vol, atm_coords, atom_dist, radii_table, \
+               atm_id, natm) \
+        private(i, j, dx, dy, dz)
+{
+        double *grid_dist = malloc(sizeof(double) * natm*GRIDS_BLOCK);
+        double *unit_vec = malloc(sizeof(double) * natm*3*GRIDS_BLOCK);
+        double *pbecke = malloc(sizeof(double) * natm*GRIDS_BLOCK);
+        double *dpa = malloc(sizeof(double) * natm*3*GRIDS_BLOCK);
+        double *dpsum = malloc(sizeof(double) * natm*3*GRIDS_BLOCK);
+        double *de_priv = calloc(natm*3, sizeof(double));
+        double g0[GRIDS_BLOCK];
+        double pt_ij[GRIDS_BLOCK];
+        double pt_ji[GRIDS_BLOCK];
+        size_t ig0, n, ngs;
+        int x;
+        double fac, rfac, p0, p1, p2, p3, t, s_ij, s_ji, du_ij, du_ji, du, r3;
+        double z, w;
+        double *pb_i, *pb_j, *d_i, *d_j, *u_i, *u_j;
+#pragma omp for nowait schedule(static)
+        for (ig0 = 0; ig0 < Ngrids; ig0 += GRIDS_BLOCK) {
+                ngs = MIN(Ngrids-ig0, GRIDS_BLOCK);
+                for (i = 0; i < natm; i++) {
+                for (n = 0; n < ngs; n++) {
+                        dx = atm_coords[i*3+0] - coords[0*Ngrids+ig0+n];
+                        dy = atm_coords[i*3+1] - coords[1*Ngrids+ig0+n];
+                        dz = atm_coords[i*3+2] - coords[2*Ngrids+ig0+n];
+                        fac = sqrt(dx*dx + dy*dy + dz*dz) + 1e-200;
+                        grid_dist[i*GRIDS_BLOCK+n] = fac;
+                        unit_vec[(i*3+0)*GRIDS_BLOCK+n] = dx / fac;
+                        unit_vec[(i*3+1)*GRIDS_BLOCK+n] = dy / fac;
+                        unit_vec[(i*3+2)*GRIDS_BLOCK+n] = dz / fac;
+                        pbecke[i*GRIDS_BLOCK+n] = 1;
+                } }
+
+                // Becke partition of all atoms
+                for (i = 0; i < natm; i++) {
+                for (j = 0; j < i; j++) {
+                        fac = atom_dist[i*natm+j];
+                        rfac = (radii_table == NULL) ? 0 : radii_table[i*natm+j];
+                        for (n = 0; n < ngs; n++) {
+                                p0 = (grid_dist[i*GRIDS_BLOCK+n] -
+                                      grid_dist[j*GRIDS_BLOCK+n]) * fac;
+                                p0 += rfac * (1 - p0*p0);
+                                p1 = (3 - p0*p0) * p0 * .5;
+                                p2 = (3 - p1*p1) * p1 * .5;
+                                p3 = (3 - p2*p2) * p2 * .5;
+                                pbecke[i*GRIDS_BLOCK+n] *= .5 * (1 - p3 + 1e-200);
+                                pbecke[j*GRIDS_BLOCK+n] *= .5 * (1 + p3 + 1e-200);
+                        }
+                } }
+
+                // dpa[n] = d P_atm_id / dR_n
+                // dpsum[n] = \sum_a d P_a / dR_n
+                for (n = 0; n < natm*3*GRIDS_BLOCK; n++) {
+                        dpa[n] = 0;
+                        dpsum[n] = 0;
+                }
+                for (i = 0; i < natm; i++) {
+                for (j = 0; j < i; j++) {
+                        fac = atom_dist[i*natm+j];
+                        rfac = (radii_table == NULL) ? 0 : radii_table[i*natm+j];
+                        pb_i = pbecke + i * GRIDS_BLOCK;
+                        pb_j = pbecke + j * GRIDS_BLOCK;
+                        d_i = grid_dist + i * GRIDS_BLOCK;
+                        d_j = grid_dist + j * GRIDS_BLOCK;
+                        for (n = 0; n < ngs; n++) {
+                                g0[n] = (d_i[n] - d_j[n]) * fac;
+                                p0 = g0[n] + rfac * (1 - g0[n]*g0[n]);
+                                p1 = (3 - p0*p0) * p0 * .5;
+                                p2 = (3 - p1*p1) * p1 * .5;
+                                p3 = (3 - p2*p2) * p2 * .5;
+                                t = 27./16 * (1-p2*p2) * (1-p1*p1) * (1-p0*p0)
+                                  * (1 - 2*rfac*g0[n]);
+                                s_ij = .5 * (1 - p3 + 1e-200);
+                                s_ji = .5 * (1 + p3 + 1e-200);
+                                // the derivatives of P_i and P_j, scaled by
+                                // the final partitions
+                                pt_ij[n] =-t / s_ij * pb_i[n];
+                                pt_ji[n] = t / s_ji * pb_j[n];
+                        }
+                        for (x = 0; x < 3; x++) {
+                                u_i = unit_vec + (i*3+x) * GRIDS_BLOCK;
+                                u_j = unit_vec + (j*3+x) * GRIDS_BLOCK;
+                                r3 = (atm_coords[i*3+x] - atm_coords[j*3+x]) * fac*fac*fac;
+                                for (n = 0; n < ngs; n++) {
+                                        // d u_ij / dR_i and d u_ji / dR_j
+                                        du_ij = fac * u_i[n] - r3 * (d_i[n] - d_j[n]);
+                                        du_ji = fac * u_j[n] - r3 * (d_i[n] - d_j[n]);
+                                        du = (i == atm_id) ? du_ji : du_ij;
+                                        dpsum[(i*3+x)*GRIDS_BLOCK+n] += (pt_ij[n] + pt_ji[n]) * du;
+                                        if (i == atm_id) {
+                                                dpa[(i*3+x)*GRIDS_BLOCK+n] += pt_ij[n] * du;
+                                        } else if (j == atm_id) {
+                                                dpa[(i*3+x)*GRIDS_BLOCK+n] += pt_ji[n] * du;
+                                        }
+                                        du = (j == atm_id) ? du_ij : du_ji;
+                                        dpsum[(j*3+x)*GRIDS_BLOCK+n] -= (pt_ij[n] + pt_ji[n]) * du;
+                                        if (i == atm_id) {
+                                                dpa[(j*3+x)*GRIDS_BLOCK+n] -= pt_ij[n] * du;
+                                        } else if (j == atm_id) {
+                                                dpa[(j*3+x)*GRIDS_BLOCK+n] -= pt_ji[n] * du;
+                                        }
+                                        if (i != atm_id && j != atm_id) {
+                                                du = (u_i[n] - u_j[n]) * fac;
+                                                dpsum[(atm_id*3+x)*GRIDS_BLOCK+n] -= (pt_ij[n] + pt_ji[n]) * du;
+                                        }
+                                }
+                        }
+                } }
+
+                for (n = 0; n < ngs; n++) {
+                        z = 0;
+                        for (i = 0; i < natm; i++) {
+                                z += pbecke[i*GRIDS_BLOCK+n];
+                        }
+                        z = 1 / z;
+                        w = erho[ig0+n] * vol[ig0+n] * z;
+                        fac = pbecke[atm_id*GRIDS_BLOCK+n] * z;
+                        for (i = 0; i < natm*3; i++) {
+                                de_priv[i] += w * (dpa[i*GRIDS_BLOCK+n] -
+                                                   fac * dpsum[i*GRIDS_BLOCK+n]);
+                        }
+                }
+        }
+#pragma omp critical
+        {
+                for (i = 0; i < natm*3; i++) {
+                        de[i] += de_priv[i];
+                }
+        }
+        free(de_priv);
+        free(dpsum);
+        free(dpa);
+        free(pbecke);
+        free(unit_vec);
+        free(grid_dist);
+}
+        free(atom_dist);
+}
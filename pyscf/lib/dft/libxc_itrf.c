@@ -25,6 +25,8 @@
 #include <string.h>
 #include <assert.h>
 #include <xc.h>
+#include "config.h"
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
 #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
 
 /* Extracted from comments of libxc:gga.c
@@ -71,19 +73,99 @@
     v3sigma(10)     = (uu_uu_uu, uu_uu_ud, uu_uu_dd, uu_ud_ud, uu_ud_dd, uu_dd_dd, ud_ud_ud, ud_ud_dd, ud_dd_dd, dd_dd_dd)
 
  */
+#define XC_BLKSIZE      128
+// scratch (in doubles per grid) of each thread: packed rho(2) sigma(3)
+// lapl(2) tau(2) and the functional outputs ex(1) vxc(9) fxc(48) kxc(35)
+#define XC_BUFSIZE      102
+
+typedef struct {
+        int nfn;
+        int spin;
+        int nvar;
+        int family;  // the family which decides the packed input variables
+        int nthreads;
+        xc_func_type *funcs;
+        double *fac;
+        double **bufs;  // thread-local scratch, XC_BLKSIZE*XC_BUFSIZE each
+} LIBXCEvaluator;
+
 /*
  * rho_u/rho_d = (den,grad_x,grad_y,grad_z,laplacian,tau)
  * In spin restricted case (spin == 1), rho_u is assumed to be the
  * spin-free quantities, rho_d is not used.
+ *
+ * Pack the density of np grids, starting from grid p0 of the input rho_u
+ * and rho_d (leading dimension ngrids), in the layout required by libxc.
+ * The packed variables are shared by all functionals of one evaluator.
+ */
+static void _pack_rho(int family, int spin, int np, size_t ngrids,
+                      double *rho_u, double *rho_d, double *buf,
+                      double **prho, double **psigma,
+                      double **plapl, double **ptau)
+{
+        int i;
+        double *rho = buf;
+        double *sigma = rho + np * 2;
+        double *lapl = sigma + np * 3;
+        double *tau = lapl + np * 2;
+        double *gxu = rho_u + ngrids;
+        double *gyu = rho_u + ngrids * 2;
+        double *gzu = rho_u + ngrids * 3;
+        double *gxd = rho_d + ngrids;
+        double *gyd = rho_d + ngrids * 2;
+        double *gzd = rho_d + ngrids * 3;
+
+        if (spin == XC_POLARIZED) {
+                for (i = 0; i < np; i++) {
+                        rho[i*2+0] = rho_u[i];
+                        rho[i*2+1] = rho_d[i];
+                }
+        } else {
+                rho = rho_u;
+        }
+
+        switch (family) {
+        case XC_FAMILY_MGGA:
+        case XC_FAMILY_HYB_MGGA:
+                if (spin == XC_POLARIZED) {
+                        for (i = 0; i < np; i++) {
+                                lapl[i*2+0] = rho_u[ngrids*4+i];
+                                lapl[i*2+1] = rho_d[ngrids*4+i];
+                                tau[i*2+0] = rho_u[ngrids*5+i];
+                                tau[i*2+1] = rho_d[ngrids*5+i];
+                        }
+                } else {
+                        lapl = rho_u + ngrids * 4;
+                        tau  = rho_u + ngrids * 5;
+                }
+                /* fall through */
+        case XC_FAMILY_GGA:
+        case XC_FAMILY_HYB_GGA:
+                if (spin == XC_POLARIZED) {
+                        for (i = 0; i < np; i++) {
+                                sigma[i*3+0] = gxu[i]*gxu[i] + gyu[i]*gyu[i] + gzu[i]*gzu[i];
+                                sigma[i*3+1] = gxu[i]*gxd[i] + gyu[i]*gyd[i] + gzu[i]*gzd[i];
+                                sigma[i*3+2] = gxd[i]*gxd[i] + gyd[i]*gyd[i] + gzd[i]*gzd[i];
+                        }
+                } else {
+                        for (i = 0; i < np; i++) {
+                                sigma[i] = gxu[i]*gxu[i] + gyu[i]*gyu[i] + gzu[i]*gzu[i];
+                        }
+                }
+        }
+        *prho = rho;
+        *psigma = sigma;
+        *plapl = lapl;
+        *ptau = tau;
+}
+
+/*
+ * rho, sigma, lapl, tau are the variables packed by _pack_rho
  */
 static void _eval_xc(xc_func_type *func_x, int spin, int np,
-                     double *rho_u, double *rho_d,
+                     double *rho, double *sigma, double *lapl, double *tau,
                      double *ex, double *vxc, double *fxc, double *kxc)
 {
-        int i;
-        double *rho, *sigma, *lapl, *tau;
-        double *gxu, *gyu, *gzu, *gxd, *gyd, *gzd;
-        double *lapl_u, *lapl_d, *tau_u, *tau_d;
         double *vsigma = NULL;
         double *vlapl  = NULL;
         double *vtau   = NULL;
@@ -105,37 +187,11 @@ static void _eval_xc(xc_func_type *func_x, int spin, int np,
                 // ex is the energy density
                 // NOTE libxc library added ex/ec into vrho/vcrho
                 // vrho = rho d ex/d rho + ex, see work_lda.c:L73
-                if (spin == XC_POLARIZED) {
-                        rho = malloc(sizeof(double) * np*2);
-                        for (i = 0; i < np; i++) {
-                                rho[i*2+0] = rho_u[i];
-                                rho[i*2+1] = rho_d[i];
-                        }
-                        xc_lda(func_x, np, rho, ex, vxc, fxc, kxc);
-                        free(rho);
-                } else {
-                        rho = rho_u;
-                        xc_lda(func_x, np, rho, ex, vxc, fxc, kxc);
-                }
+                xc_lda(func_x, np, rho, ex, vxc, fxc, kxc);
                 break;
         case XC_FAMILY_GGA:
         case XC_FAMILY_HYB_GGA:
                 if (spin == XC_POLARIZED) {
-                        rho = malloc(sizeof(double) * np*2);
-                        sigma = malloc(sizeof(double) * np*3);
-                        gxu = rho_u + np;
-                        gyu = rho_u + np * 2;
-                        gzu = rho_u + np * 3;
-                        gxd = rho_d + np;
-                        gyd = rho_d + np * 2;
-                        gzd = rho_d + np * 3;
-                        for (i = 0; i < np; i++) {
-                                rho[i*2+0] = rho_u[i];
-                                rho[i*2+1] = rho_d[i];
-                                sigma[i*3+0] = gxu[i]*gxu[i] + gyu[i]*gyu[i] + gzu[i]*gzu[i];
-                                sigma[i*3+1] = gxu[i]*gxd[i] + gyu[i]*gyd[i] + gzu[i]*gzd[i];
-                                sigma[i*3+2] = gxd[i]*gxd[i] + gyd[i]*gyd[i] + gzd[i]*gzd[i];
-                        }
                         if (vxc != NULL) {
                                 // vrho = vxc
                                 vsigma = vxc + np * 2;
@@ -151,25 +207,7 @@ static void _eval_xc(xc_func_type *func_x, int spin, int np,
                                 v3rhosigma2 = v3rho2sigma + np * 9;
                                 v3sigma3 = v3rhosigma2 + np * 12; // np*10
                         }
-#if (XC_MAJOR_VERSION == 2 && XC_MINOR_VERSION < 2)
-                        xc_gga(func_x, np, rho, sigma, ex,
-                               vxc, vsigma, fxc, v2rhosigma, v2sigma2);
-#else
-                        xc_gga(func_x, np, rho, sigma, ex,
-                               vxc, vsigma, fxc, v2rhosigma, v2sigma2,
-                               kxc, v3rho2sigma, v3rhosigma2, v3sigma3);
-#endif
-                        free(rho);
-                        free(sigma);
                 } else {
-                        rho = rho_u;
-                        sigma = malloc(sizeof(double) * np);
-                        gxu = rho_u + np;
-                        gyu = rho_u + np * 2;
-                        gzu = rho_u + np * 3;
-                        for (i = 0; i < np; i++) {
-                                sigma[i] = gxu[i]*gxu[i] + gyu[i]*gyu[i] + gzu[i]*gzu[i];
-                        }
                         if (vxc != NULL) {
                                 vsigma = vxc + np;
                         }
@@ -182,45 +220,19 @@ static void _eval_xc(xc_func_type *func_x, int spin, int np,
                                 v3rhosigma2 = v3rho2sigma + np;
                                 v3sigma3 = v3rhosigma2 + np;
                         }
+                }
 #if (XC_MAJOR_VERSION == 2 && XC_MINOR_VERSION < 2)
-                        xc_gga(func_x, np, rho, sigma, ex,
-                               vxc, vsigma, fxc, v2rhosigma, v2sigma2);
+                xc_gga(func_x, np, rho, sigma, ex,
+                       vxc, vsigma, fxc, v2rhosigma, v2sigma2);
 #else
-                        xc_gga(func_x, np, rho, sigma, ex,
-                               vxc, vsigma, fxc, v2rhosigma, v2sigma2,
-                               kxc, v3rho2sigma, v3rhosigma2, v3sigma3);
+                xc_gga(func_x, np, rho, sigma, ex,
+                       vxc, vsigma, fxc, v2rhosigma, v2sigma2,
+                       kxc, v3rho2sigma, v3rhosigma2, v3sigma3);
 #endif
-                        free(sigma);
-                }
                 break;
         case XC_FAMILY_MGGA:
         case XC_FAMILY_HYB_MGGA:
                 if (spin == XC_POLARIZED) {
-                        rho = malloc(sizeof(double) * np*2);
-                        sigma = malloc(sizeof(double) * np*3);
-                        lapl = malloc(sizeof(double) * np*2);
-                        tau = malloc(sizeof(double) * np*2);
-                        gxu = rho_u + np;
-                        gyu = rho_u + np * 2;
-                        gzu = rho_u + np * 3;
-                        gxd = rho_d + np;
-                        gyd = rho_d + np * 2;
-                        gzd = rho_d + np * 3;
-                        lapl_u = rho_u + np * 4;
-                        tau_u  = rho_u + np * 5;
-                        lapl_d = rho_d + np * 4;
-                        tau_d  = rho_d + np * 5;
-                        for (i = 0; i < np; i++) {
-                                rho[i*2+0] = rho_u[i];
-                                rho[i*2+1] = rho_d[i];
-                                sigma[i*3+0] = gxu[i]*gxu[i] + gyu[i]*gyu[i] + gzu[i]*gzu[i];
-                                sigma[i*3+1] = gxu[i]*gxd[i] + gyu[i]*gyd[i] + gzu[i]*gzd[i];
-                                sigma[i*3+2] = gxd[i]*gxd[i] + gyd[i]*gyd[i] + gzd[i]*gzd[i];
-                                lapl[i*2+0] = lapl_u[i];
-                                lapl[i*2+1] = lapl_d[i];
-                                tau[i*2+0] = tau_u[i];
-                                tau[i*2+1] = tau_d[i];
-                        }
                         if (vxc != NULL) {
                                 // vrho = vxc
                                 vsigma = vxc + np * 2;
@@ -239,25 +251,7 @@ static void _eval_xc(xc_func_type *func_x, int spin, int np,
                                 v2sigmalapl = v2lapltau   + np * 4;
                                 v2sigmatau  = v2sigmalapl + np * 6; // np*6
                         }
-                        xc_mgga(func_x, np, rho, sigma, lapl, tau, ex,
-                                vxc, vsigma, vlapl, vtau,
-                                fxc, v2sigma2, v2lapl2, v2tau2, v2rhosigma, v2rholapl,
-                                v2rhotau, v2sigmalapl, v2sigmatau, v2lapltau);
-                        free(rho);
-                        free(sigma);
-                        free(lapl);
-                        free(tau);
                 } else {
-                        rho = rho_u;
-                        sigma = malloc(sizeof(double) * np);
-                        lapl = rho_u + np * 4;
-                        tau  = rho_u + np * 5;
-                        gxu = rho_u + np;
-                        gyu = rho_u + np * 2;
-                        gzu = rho_u + np * 3;
-                        for (i = 0; i < np; i++) {
-                                sigma[i] = gxu[i]*gxu[i] + gyu[i]*gyu[i] + gzu[i]*gzu[i];
-                        }
                         if (vxc != NULL) {
                                 vsigma = vxc + np;
                                 vlapl = vsigma + np;
@@ -274,12 +268,11 @@ static void _eval_xc(xc_func_type *func_x, int spin, int np,
                                 v2sigmalapl = v2lapltau   + np;
                                 v2sigmatau  = v2sigmalapl + np;
                         }
-                        xc_mgga(func_x, np, rho, sigma, lapl, tau, ex,
-                                vxc, vsigma, vlapl, vtau,
-                                fxc, v2sigma2, v2lapl2, v2tau2, v2rhosigma, v2rholapl,
-                                v2rhotau, v2sigmalapl, v2sigmatau, v2lapltau);
-                        free(sigma);
                 }
+                xc_mgga(func_x, np, rho, sigma, lapl, tau, ex,
+                        vxc, vsigma, vlapl, vtau,
+                        fxc, v2sigma2, v2lapl2, v2tau2, v2rhosigma, v2rholapl,
+                        v2rhotau, v2sigmalapl, v2sigmatau, v2lapltau);
                 break;
         default:
                 fprintf(stderr, "functional %d '%s' is not implmented\n",
@@ -493,20 +486,28 @@ int LIBXC_input_length(int nfn, int *fn_id, double *fac, int spin)
         return nvar;
 }
 
+/*
+ * dst[j,i] += fac * src[i,j], for dst of leading dimension ldd
+ */
 static void axpy(double *dst, double *src, double fac,
-                 int np, int ndst, int nsrc)
+                 int np, size_t ldd, int nsrc)
 {
         int i, j;
         for (j = 0; j < nsrc; j++) {
                 for (i = 0; i < np; i++) {
-                        dst[j*np+i] += fac * src[i*nsrc+j];
+                        dst[j*ldd+i] += fac * src[i*nsrc+j];
                 }
         }
 }
 
+/*
+ * Accumulate the libxc outputs of np grids to dst.  dst has the leading
+ * dimension ldd (the total number of grids) so that each block of grids
+ * can be merged in place while the libxc outputs are still in cache.
+ */
 static void merge_xc(double *dst, double *ebuf, double *vbuf,
                      double *fbuf, double *kbuf, double fac,
-                     int np, int ndst, int nvar, int spin, int type)
+                     int np, size_t ldd, int nvar, int spin, int type)
 {
         const int seg0 [] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
         // LDA             |  |
@@ -553,86 +554,205 @@ static void merge_xc(double *dst, double *ebuf, double *vbuf,
 
         int i;
         size_t offset;
-        axpy(dst, ebuf, fac, np, ndst, 1);
+        axpy(dst, ebuf, fac, np, ldd, 1);
 
         if (vbuf != NULL) {
-                offset = np;
+                offset = ldd;
                 for (i = 0; i < vsegtot; i++) {
-                        axpy(dst+offset, vbuf, fac, np, ndst, vseg[i]);
-                        offset += np * vseg[i];
+                        axpy(dst+offset, vbuf, fac, np, ldd, vseg[i]);
+                        offset += ldd * vseg[i];
                         vbuf += np * vseg[i];
                 }
         }
 
         if (fbuf != NULL) {
-                offset = np * xc_output_length(nvar, 1);
+                offset = ldd * xc_output_length(nvar, 1);
                 for (i = 0; i < fsegtot; i++) {
-                        axpy(dst+offset, fbuf, fac, np, ndst, fseg[i]);
-                        offset += np * fseg[i];
+                        axpy(dst+offset, fbuf, fac, np, ldd, fseg[i]);
+                        offset += ldd * fseg[i];
                         fbuf += np * fseg[i];
                 }
         }
 
         if (kbuf != NULL) {
-                offset = np * xc_output_length(nvar, 2);
+                offset = ldd * xc_output_length(nvar, 2);
                 for (i = 0; i < ksegtot; i++) {
-                        axpy(dst+offset, kbuf, fac, np, ndst, kseg[i]);
-                        offset += np * kseg[i];
+                        axpy(dst+offset, kbuf, fac, np, ldd, kseg[i]);
+                        offset += ldd * kseg[i];
                         kbuf += np * kseg[i];
                 }
         }
 }
 
-void LIBXC_eval_xc(int nfn, int *fn_id, double *fac,
-                   int spin, int deriv, int np,
-                   double *rho_u, double *rho_d, double *output)
+static int _family_rank(int family)
 {
-        assert(deriv <= 3);
-        int nvar = LIBXC_input_length(nfn, fn_id, fac, spin);
-        int outlen = xc_output_length(nvar, deriv);
-        memset(output, 0, sizeof(double) * np*outlen);
-
-        double *ebuf = malloc(sizeof(double) * np);
-        double *vbuf = NULL;
-        double *fbuf = NULL;
-        double *kbuf = NULL;
-        if (deriv > 0) {
-                vbuf = malloc(sizeof(double) * np*9);
-        }
-        if (deriv > 1) {
-                fbuf = malloc(sizeof(double) * np*48);
-        }
-        if (deriv > 2) {  // *220 if mgga kxc available
-                kbuf = malloc(sizeof(double) * np*35);
+        switch (family) {
+        case XC_FAMILY_GGA:
+        case XC_FAMILY_HYB_GGA:
+                return 1;
+        case XC_FAMILY_MGGA:
+        case XC_FAMILY_HYB_MGGA:
+                return 2;
+        default:
+                return 0;
         }
+}
+
+/*
+ * Initialize the functionals once.  The evaluator can be reused for any
+ * number of calls to LIBXC_eval_xc_batch.  Functionals associated with
+ * zero factors are dropped.
+ */
+void LIBXC_init_evaluator(LIBXCEvaluator **xcobj, int nfn, int *fn_id,
+                          double *fac, int spin)
+{
+        LIBXCEvaluator *xc0 = malloc(sizeof(LIBXCEvaluator));
+        xc0->funcs = malloc(sizeof(xc_func_type) * MAX(nfn, 1));
+        xc0->fac = malloc(sizeof(double) * MAX(nfn, 1));
+        xc0->spin = spin;
+        xc0->nvar = LIBXC_input_length(nfn, fn_id, fac, spin);
+        xc0->family = XC_FAMILY_LDA;
+        xc0->nthreads = 0;
+        xc0->bufs = NULL;
 
         int i;
-        xc_func_type func;
+        int n = 0;
         for (i = 0; i < nfn; i++) {
-                if (xc_func_init(&func, fn_id[i], spin) != 0) {
+                if (fac[i] < 1e-14 && fac[i] > -1e-14) {
+                        continue;
+                }
+                if (xc_func_init(xc0->funcs+n, fn_id[i], spin) != 0) {
                         fprintf(stderr, "XC functional %d not found\n",
                                 fn_id[i]);
                         exit(1);
                 }
-#if defined XC_SET_RELATIVITY
-                xc_lda_x_set_params(&func, relativity);
-#endif
-                _eval_xc(&func, spin, np, rho_u, rho_d, ebuf, vbuf, fbuf, kbuf);
-                merge_xc(output, ebuf, vbuf, fbuf, kbuf, fac[i],
-                         np, outlen, nvar, spin, func.info->family);
-                xc_func_end(&func);
+                if (_family_rank(xc0->funcs[n].info->family) >
+                    _family_rank(xc0->family)) {
+                        xc0->family = xc0->funcs[n].info->family;
+                }
+                xc0->fac[n] = fac[i];
+                n++;
+        }
+        xc0->nfn = n;
+        *xcobj = xc0;
+}
+
+void LIBXC_del_evaluator(LIBXCEvaluator **xcobj)
+{
+        LIBXCEvaluator *xc0 = *xcobj;
+        if (!xc0) {
+                return;
         }
 
-        free(ebuf);
+        int i;
+        for (i = 0; i < xc0->nfn; i++) {
+                xc_func_end(xc0->funcs+i);
+        }
+        for (i = 0; i < xc0->nthreads; i++) {
+                free(xc0->bufs[i]);
+        }
+        free(xc0->bufs);
+        free(xc0->funcs);
+        free(xc0->fac);
+        free(xc0);
+        *xcobj = NULL;
+}
+
+int LIBXC_evaluator_nvar(LIBXCEvaluator *xcobj)
+{
+        return xcobj->nvar;
+}
+
+/*
+ * Called in omp single region.  The scratch of each thread is allocated by
+ * the thread itself at its first use.
+ */
+static void _reserve_thread_buffers(LIBXCEvaluator *xcobj, int nthreads)
+{
+        if (nthreads > xcobj->nthreads) {
+                int i;
+                xcobj->bufs = realloc(xcobj->bufs, sizeof(double *) * nthreads);
+                for (i = xcobj->nthreads; i < nthreads; i++) {
+                        xcobj->bufs[i] = NULL;
+                }
+                xcobj->nthreads = nthreads;
+        }
+}
+
+/*
+ * Evaluate the functionals of xcobj on np grids.  The grids are split into
+ * blocks of XC_BLKSIZE and distributed over threads.  For each block, the
+ * density variables are packed once for all functionals, and the output of
+ * each functional is merged into output immediately.
+ */
+void LIBXC_eval_xc_batch(LIBXCEvaluator *xcobj, int deriv, int np,
+                         double *rho_u, double *rho_d, double *output)
+{
+        assert(deriv <= 3);
+        int nfn = xcobj->nfn;
+        int spin = xcobj->spin;
+        int nvar = xcobj->nvar;
+        int family = xcobj->family;
+        int outlen = xc_output_length(nvar, deriv);
+        int nblk = (np + XC_BLKSIZE - 1) / XC_BLKSIZE;
+        size_t ngrids = np;
+
+#pragma omp parallel default(none) \
+                shared(xcobj, deriv, np, rho_u, rho_d, output, nfn, spin, \
+                       nvar, family, outlen, nblk, ngrids)
+{
+        int it = omp_get_thread_num();
+#pragma omp single
+        _reserve_thread_buffers(xcobj, omp_get_num_threads());
+        if (xcobj->bufs[it] == NULL) {
+                xcobj->bufs[it] = malloc(sizeof(double) * XC_BLKSIZE*XC_BUFSIZE);
+        }
+        double *packbuf = xcobj->bufs[it];
+        double *ebuf = packbuf + XC_BLKSIZE * 9;
+        double *vbuf = NULL;
+        double *fbuf = NULL;
+        double *kbuf = NULL;
         if (deriv > 0) {
-                free(vbuf);
+                vbuf = ebuf + XC_BLKSIZE;
         }
         if (deriv > 1) {
-                free(fbuf);
+                fbuf = ebuf + XC_BLKSIZE * 10;
         }
-        if (deriv > 2) {
-                free(kbuf);
+        if (deriv > 2) {  // *220 if mgga kxc available
+                kbuf = ebuf + XC_BLKSIZE * 58;
         }
+        double *rho, *sigma, *lapl, *tau, *out;
+        int ib, i, k, p0, bgrids;
+#pragma omp for schedule(static)
+        for (ib = 0; ib < nblk; ib++) {
+                p0 = ib * XC_BLKSIZE;
+                bgrids = MIN(np - p0, XC_BLKSIZE);
+                out = output + p0;
+                for (k = 0; k < outlen; k++) {
+                        memset(out+k*ngrids, 0, sizeof(double) * bgrids);
+                }
+                _pack_rho(family, spin, bgrids, ngrids, rho_u+p0, rho_d+p0,
+                          packbuf, &rho, &sigma, &lapl, &tau);
+                for (i = 0; i < nfn; i++) {
+                        _eval_xc(xcobj->funcs+i, spin, bgrids,
+                                 rho, sigma, lapl, tau,
+                                 ebuf, vbuf, fbuf, kbuf);
+                        merge_xc(out, ebuf, vbuf, fbuf, kbuf, xcobj->fac[i],
+                                 bgrids, ngrids, nvar, spin,
+                                 xcobj->funcs[i].info->family);
+                }
+        }
+}
+}
+
+void LIBXC_eval_xc(int nfn, int *fn_id, double *fac,
+                   int spin, int deriv, int np,
+                   double *rho_u, double *rho_d, double *output)
+{
+        LIBXCEvaluator *xcobj;
+        LIBXC_init_evaluator(&xcobj, nfn, fn_id, fac, spin);
+        LIBXC_eval_xc_batch(xcobj, deriv, np, rho_u, rho_d, output);
+        LIBXC_del_evaluator(&xcobj);
 }
 
 int LIBXC_max_deriv_order(int xc_id)
@@ -18,8 +18,10 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
 #include "config.h"
+#include "cint.h"
 #include "gto/grid_ao_drv.h"
 #include "np_helper/np_helper.h"
 #include "vhf/fblas.h"
@@ -59,7 +61,7 @@ int VXCao_empty_blocks(char *empty, unsigned char *non0table, int *shls_slice,
 }
 
 static void dot_ao_dm(double *vm, double *ao, double *dm,
-                      int nao, int nocc, int ngrids, int bgrids,
+                      int nao, int nocc, int ngrids, int ldv, int bgrids,
                       unsigned char *non0table, int *shls_slice, int *ao_loc)
 {
         int nbox = (nao+BOXSIZE-1) / BOXSIZE;
@@ -81,20 +83,20 @@ static void dot_ao_dm(double *vm, double *ao, double *dm,
                                 blen = MIN(nao-b0, BOXSIZE);
                                 dgemm_(&TRANS_N, &TRANS_T, &bgrids, &nocc, &blen,
                                        &D1, ao+b0*ngrids, &ngrids, dm+b0*nocc, &nocc,
-                                       &beta, vm, &ngrids);
+                                       &beta, vm, &ldv);
                                 beta = 1.0;
                         }
                 }
                 if (beta == 0) { // all empty
                         for (i = 0; i < nocc; i++) {
                                 for (j = 0; j < bgrids; j++) {
-                                        vm[i*ngrids+j] = 0;
+                                        vm[i*ldv+j] = 0;
                                 }
                         }
                 }
         } else {
                 dgemm_(&TRANS_N, &TRANS_T, &bgrids, &nocc, &nao,
-                       &D1, ao, &ngrids, dm, &nocc, &beta, vm, &ngrids);
+                       &D1, ao, &ngrids, dm, &nocc, &beta, vm, &ldv);
         }
 }
 
@@ -115,7 +117,7 @@ void VXCdot_ao_dm(double *vm, double *ao, double *dm,
         for (ib = 0; ib < nblk; ib++) {
                 ip = ib * BLKSIZE;
                 dot_ao_dm(vm+ip, ao+ip, dm,
-                          nao, nocc, ngrids, MIN(ngrids-ip, BLKSIZE),
+                          nao, nocc, ngrids, ngrids, MIN(ngrids-ip, BLKSIZE),
                           non0table+ib*nbas, shls_slice, ao_loc);
         }
 }
@@ -196,3 +198,139 @@ void VXCdot_ao_ao(double *vv, double *ao1, double *ao2,
                 NPdsymm_triu(nao, vv, hermi);
         }
 }
+
+/*
+ * Screen the density rho[ngrids] block by block (BLKSIZE grids per block).
+ * rho_bound[ib] is the largest |rho| on block ib and keep[ib] = 0 if the
+ * bound is smaller than cutoff.  Returns the number of blocks to keep.
+ */
+int VXCscreen_rho_blocks(char *keep, double *rho_bound, double *rho,
+                         double cutoff, int ngrids)
+{
+        const int nblk = (ngrids+BLKSIZE-1) / BLKSIZE;
+        int ib, ip, ip1;
+        int nkeep = 0;
+        double bound;
+        for (ib = 0; ib < nblk; ib++) {
+                ip1 = MIN(ngrids, (ib+1)*BLKSIZE);
+                bound = 0;
+                for (ip = ib*BLKSIZE; ip < ip1; ip++) {
+                        bound = MAX(bound, fabs(rho[ip]));
+                }
+                rho_bound[ib] = bound;
+                keep[ib] = (bound >= cutoff);
+                nkeep += keep[ib];
+        }
+        return nkeep;
+}
+
+/*
+ * XC contributions to the nuclear gradients of the grids in one batch,
+ * accumulated on the atoms of the bra AOs
+ *
+ * LDA (nwv = 1):
+ *      de[atm,x] -= 2 \sum_{i in atm} \sum_p ao[1+x,i,p] (aow dm)[i,p]
+ * GGA (nwv = 4):
+ *      de[atm,x] -= 2 \sum_{i in atm} \sum_p ao[1+x,i,p] (aow dm)[i,p]
+ *                   + ao[1+x,i,p] wv[0,p] (ao[0] dm)[i,p]
+ *                   + \sum_y ao[xy,i,p] wv[1+y,p] (ao[0] dm)[i,p]
+ * where aow[i,p] = \sum_n wv[n,p] ao[n,i,p].  ao[comp,nao,ngrids] are the
+ * AO values and derivatives (up to 2nd order for GGA) in the order of
+ * eval_ao.  wv[nwv,ngrids] includes the grid weights.
+ */
+void VXCnr_grad_xc(double *de, double *ao, double *wv, double *dm,
+                   int nwv, int nao, int ngrids, int natm, int nbas,
+                   unsigned char *non0table, int *shls_slice, int *ao_loc,
+                   int *bas)
+{
+        const int nblk = (ngrids+BLKSIZE-1) / BLKSIZE;
+        const int sh0 = shls_slice[0];
+        const int sh1 = shls_slice[1];
+        const int ao_off = ao_loc[sh0];
+        const size_t Ngrids = ngrids;
+        // the indices of d/dx d/dy ... in ao for (XX,XY,XZ), (YX,YY,YZ), (ZX,ZY,ZZ)
+        const int xyz_idx[] = {4, 5, 6, 5, 7, 8, 6, 8, 9};
+
+#pragma omp parallel \
+        shared(de, ao, wv, dm, nwv, nao, ngrids, natm, nbas, non0table, \
+               shls_slice, ao_loc, bas)
+{
+        int ib, ip, bgrids, ish, atm_id, i, n, p, x;
+        unsigned char *non0;
+        double *pao, *pwv, *paow, *pc1, *pc0;
+        double s;
+        double *de_priv = calloc(natm*3, sizeof(double));
+        double *aow = malloc(sizeof(double) * nao*BLKSIZE * 3);
+        double *c1 = aow + nao * BLKSIZE;
+        double *c0 = c1 + nao * BLKSIZE;
+#pragma omp for schedule(static)
+        for (ib = 0; ib < nblk; ib++) {
+                ip = ib * BLKSIZE;
+                bgrids = MIN(ngrids-ip, BLKSIZE);
+                non0 = (non0table == NULL) ? NULL : non0table + ib * nbas;
+
+                for (i = 0; i < nao; i++) {
+                        paow = aow + i * BLKSIZE;
+                        pao = ao + i * Ngrids + ip;
+                        for (p = 0; p < bgrids; p++) {
+                                paow[p] = pao[p] * wv[ip+p];
+                        }
+                        for (n = 1; n < nwv; n++) {
+                                pao = ao + (n*nao+i) * Ngrids + ip;
+                                pwv = wv + n * Ngrids + ip;
+                                for (p = 0; p < bgrids; p++) {
+                                        paow[p] += pao[p] * pwv[p];
+                                }
+                        }
+                }
+                // c1[k,p] = \sum_i aow[i,p] dm[i,k]
+                dot_ao_dm(c1, aow, dm, nao, nao, BLKSIZE, BLKSIZE, bgrids,
+                          non0, shls_slice, ao_loc);
+                if (nwv > 1) {
+                        dot_ao_dm(c0, ao+ip, dm, nao, nao, ngrids, BLKSIZE,
+                                  bgrids, non0, shls_slice, ao_loc);
+                }
+
+                for (ish = sh0; ish < sh1; ish++) {
+                        if (non0 != NULL && !non0[ish]) {
+                                continue;
+                        }
+                        atm_id = bas(ATOM_OF, ish);
+                        for (i = ao_loc[ish]-ao_off; i < ao_loc[ish+1]-ao_off; i++) {
+                                pc1 = c1 + i * BLKSIZE;
+                                pc0 = c0 + i * BLKSIZE;
+                                for (x = 0; x < 3; x++) {
+                                        pao = ao + ((1+x)*nao+i) * Ngrids + ip;
+                                        s = 0;
+                                        if (nwv > 1) {
+                                                // wv[0] was halved for v+v.T
+                                                for (p = 0; p < bgrids; p++) {
+                                                        s += pao[p] * (pc1[p] + wv[ip+p] * pc0[p]);
+                                                }
+                                        } else {
+                                                for (p = 0; p < bgrids; p++) {
+                                                        s += pao[p] * pc1[p];
+                                                }
+                                        }
+                                        for (n = 1; n < nwv; n++) {
+                                                pao = ao + (xyz_idx[x*3+n-1]*nao+i) * Ngrids + ip;
+                                                pwv = wv + n * Ngrids + ip;
+                                                for (p = 0; p < bgrids; p++) {
+                                                        s += pao[p] * pwv[p] * pc0[p];
+                                                }
+                                        }
+                                        de_priv[atm_id*3+x] -= s * 2;
+                                }
+                        }
+                }
+        }
+#pragma omp critical
+        {
+                for (i = 0; i < natm*3; i++) {
+                        de[i] += de_priv[i];
+                }
+        }
+        free(aow);
+        free(de_priv);
+}
+}
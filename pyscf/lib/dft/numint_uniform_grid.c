@@ -1226,3 +1226,1244 @@ int NUMINT_ovlp_sph(double *out, int *dims, int *shls, int *atm, int natm,
         return (*numint_drv)(out, dims, &c2s_sph_1e, 1., log_prec,
                              dimension, a, b, mesh, weights, &envs, cache);
 }
+
+
+/*************************************************
+ *
+ * Multigrid density collocation and potential integration.
+ *
+ * Each primitive pair is assigned to the coarsest mesh level whose kinetic
+ * energy cutoff resolves the product Gaussian exp(-aij (r-Rij)^2).  The
+ * density of each level is collocated on its own mesh.  The levels are
+ * merged by the caller in reciprocal space (FFT interpolation).  The
+ * integration V_ij = \sum_r v(r) \phi_i(r) \phi_j(r) is the transpose
+ * operation, with v(r) given on each level.
+ *
+ * The density is collocated in owner-computes mode.  The x-planes of each
+ * level are split into slabs.  Each slab is a task which loops over all
+ * pairs and only writes the planes it owns, so the threads share one output
+ * density and no private copy of the mesh is needed.
+ *
+ * For orthorhombic cells, the pair products are separable along x, y, z.
+ * They are evaluated with 1D tables and contracted with dgemm over tiles of
+ * y-rows.  For non-orthorhombic cells, the Gaussian is evaluated line by
+ * line along the third lattice vector and the polynomials are evaluated in
+ * chunks of SIMDD grids.
+ *
+ *************************************************/
+
+// Size (in doubles) of the intermediates of one y-tile
+#define MG_TILESIZE     8192
+// Number of x-slabs per thread in the density collocation
+#define MG_SLABS_PER_THREAD     4
+
+typedef struct {
+        int nlevels;
+        int dimension;
+        int orth;
+        int mesh_max;
+        int *meshes;
+        double *ke_levels;
+        double log_prec;
+        double *a;      // lattice vectors, a[i*3+x]
+        double *b;      // inv(a.T), fractional coordinates f_i = b[i*3+x] r_x
+} MGGrids;
+
+// Grids of a primitive pair on its level
+typedef struct {
+        int *mesh;
+        int topl;
+        double aij;
+        double cutoff;
+        double *ri;
+        double rij[3];
+        // orthorhombic cell: 1D tables and the segments of non-zero values
+        double *xs_exp;
+        double *ys_exp;
+        double *zs_exp;
+        int segs[12];
+        int nseg[3];
+        // non-orthorhombic cell: box of (unwrapped) grid indices
+        int box[6];
+        // the x-planes [xwin[0],xwin[1]) to be evaluated
+        int xwin[2];
+        // the first x-plane of the support
+        int xfirst;
+} MGSupport;
+
+/*
+ * 1D factors (x-xi)^l exp(-aij (x-xij)^2) for l = 0..topl on the n grids of
+ * the cell edge, summed over periodic images.  Only the grids within cutoff
+ * to xij are evaluated.  They are stored in (at most two) segments
+ * [segs[0],segs[1]), [segs[2],segs[3]).  Returns the number of segments.
+ */
+static int _mg_components(double *xs_exp, int *segs, double xi, double xij,
+                          double aij, double len, int periodic, int n,
+                          int topl, double cutoff)
+{
+        double dx = len / n;
+        int ix0 = (int)floor((xij - cutoff) / dx);
+        int ix1 = (int)ceil ((xij + cutoff) / dx) + 1;
+        int nseg, i, k, l, p;
+        if (periodic) {
+                if (ix1 - ix0 >= n) {
+                        nseg = 1;
+                        segs[0] = 0;
+                        segs[1] = n;
+                } else {
+                        p = ((ix0 % n) + n) % n;
+                        segs[0] = p;
+                        if (p + ix1 - ix0 <= n) {
+                                nseg = 1;
+                                segs[1] = p + ix1 - ix0;
+                        } else {
+                                nseg = 2;
+                                segs[1] = n;
+                                segs[2] = 0;
+                                segs[3] = p + ix1 - ix0 - n;
+                        }
+                }
+        } else {
+                ix0 = MAX(ix0, 0);
+                ix1 = MIN(ix1, n);
+                if (ix0 >= ix1) {
+                        return 0;
+                }
+                nseg = 1;
+                segs[0] = ix0;
+                segs[1] = ix1;
+        }
+
+        int kc = rint(xij / dx);
+        kc = MIN(kc, ix1-1);
+        kc = MAX(kc, ix0);
+        double x0xij = kc * dx - xij;
+        double _x0x0 = -aij * x0xij * x0xij;
+        if (_x0x0 < EXPMIN) {
+                return 0;
+        }
+
+        for (k = 0; k < nseg; k++) {
+                for (l = 0; l <= topl; l++) {
+                        for (i = segs[k*2]; i < segs[k*2+1]; i++) {
+                                xs_exp[l*n+i] = 0;
+                        }
+                }
+        }
+
+        double _dxdx = -aij * dx * dx;
+        double exp_2dxdx = exp(2 * _dxdx);
+        double exp_x0dx = exp(_dxdx - 2 * aij * x0xij * dx);
+        double exp_x0x0 = exp(_x0x0);
+        double xl, xxi;
+        for (k = kc; k < ix1; k++) {
+                p = periodic ? (((k % n) + n) % n) : k;
+                xxi = k * dx - xi;
+                xl = exp_x0x0;
+                for (l = 0; l <= topl; l++) {
+                        xs_exp[l*n+p] += xl;
+                        xl *= xxi;
+                }
+                exp_x0x0 *= exp_x0dx;
+                exp_x0dx *= exp_2dxdx;
+        }
+
+        exp_x0dx = exp(_dxdx + 2 * aij * x0xij * dx);
+        exp_x0x0 = exp(_x0x0);
+        for (k = kc-1; k >= ix0; k--) {
+                exp_x0x0 *= exp_x0dx;
+                exp_x0dx *= exp_2dxdx;
+                p = periodic ? (((k % n) + n) % n) : k;
+                xxi = k * dx - xi;
+                xl = exp_x0x0;
+                for (l = 0; l <= topl; l++) {
+                        xs_exp[l*n+p] += xl;
+                        xl *= xxi;
+                }
+        }
+        return nseg;
+}
+
+/*
+ * Whether the (unwrapped) grid indices [x0,x1) hit the planes [w0,w1) of the
+ * mesh of n planes.
+ */
+static int _mg_range_overlap(int x0, int x1, int n, int w0, int w1)
+{
+        if (x1 - x0 >= n) {
+                return 1;
+        }
+        int p0 = ((x0 % n) + n) % n;
+        int p1 = p0 + x1 - x0;
+        return (p0 < w1 && p1 > w0) || (p1 > n && p1 - n > w0);
+}
+
+/*
+ * Initialize the grids of the primitive pair.  Returns 0 if the pair has no
+ * contribution on the grids or on the x-planes sup->xwin.
+ */
+static int _mg_support(MGSupport *sup, MGGrids *grids, int *mesh, int topl,
+                       double aij, double *ri, double *rij, double cutoff,
+                       double *cache)
+{
+        int dimension = grids->dimension;
+        int i;
+        sup->mesh = mesh;
+        sup->topl = topl;
+        sup->aij = aij;
+        sup->cutoff = cutoff;
+        sup->ri = ri;
+        sup->rij[0] = rij[0];
+        sup->rij[1] = rij[1];
+        sup->rij[2] = rij[2];
+
+        if (grids->orth) {
+                double *a = grids->a;
+                sup->xs_exp = cache;
+                sup->ys_exp = sup->xs_exp + (topl+1) * mesh[0];
+                sup->zs_exp = sup->ys_exp + (topl+1) * mesh[1];
+                sup->nseg[0] = _mg_components(sup->xs_exp, sup->segs, ri[0], rij[0],
+                                              aij, a[0], (dimension>=1),
+                                              mesh[0], topl, cutoff);
+                if (sup->nseg[0] == 0) {
+                        return 0;
+                }
+                sup->xfirst = sup->segs[0];
+                for (i = 0; i < sup->nseg[0]; i++) {
+                        if (sup->segs[i*2] < sup->xwin[1] &&
+                            sup->segs[i*2+1] > sup->xwin[0]) {
+                                break;
+                        }
+                }
+                if (i == sup->nseg[0]) {
+                        return 0;
+                }
+                sup->nseg[1] = _mg_components(sup->ys_exp, sup->segs+4, ri[1], rij[1],
+                                              aij, a[4], (dimension>=2),
+                                              mesh[1], topl, cutoff);
+                if (sup->nseg[1] == 0) {
+                        return 0;
+                }
+                sup->nseg[2] = _mg_components(sup->zs_exp, sup->segs+8, ri[2], rij[2],
+                                              aij, a[8], (dimension>=3),
+                                              mesh[2], topl, cutoff);
+                return sup->nseg[2];
+        }
+
+        double *b = grids->b;
+        double f, w;
+        for (i = 0; i < 3; i++) {
+                f = b[i*3+0] * rij[0] + b[i*3+1] * rij[1] + b[i*3+2] * rij[2];
+                w = cutoff * sqrt(SQUARE(b+i*3));
+                sup->box[i*2  ] = (int)floor((f - w) * mesh[i]);
+                sup->box[i*2+1] = (int)ceil ((f + w) * mesh[i]) + 1;
+                if (dimension <= i) {
+                        sup->box[i*2  ] = MAX(sup->box[i*2  ], 0);
+                        sup->box[i*2+1] = MIN(sup->box[i*2+1], mesh[i]);
+                        if (sup->box[i*2] >= sup->box[i*2+1]) {
+                                return 0;
+                        }
+                }
+        }
+        sup->xfirst = ((sup->box[0] % mesh[0]) + mesh[0]) % mesh[0];
+        return _mg_range_overlap(sup->box[0], sup->box[1], mesh[0],
+                                 sup->xwin[0], sup->xwin[1]);
+}
+
+/*
+ * rho[x,y,z] += \sum_{lx,ly,lz} coef[lx,ly,lz] xs[lx,x] ys[ly,y] zs[lz,z]
+ */
+static void _mg_orth_collocate(double *rho, double *coef, MGSupport *sup,
+                               double *cache)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D0 = 0;
+        const double D1 = 1;
+        int *mesh = sup->mesh;
+        int topl = sup->topl;
+        int l1 = topl + 1;
+        int l1l1 = l1 * l1;
+        int *xsegs = sup->segs;
+        int *ysegs = sup->segs + 4;
+        int *zsegs = sup->segs + 8;
+        double *xs_exp = sup->xs_exp;
+        double *ys_exp = sup->ys_exp;
+        double *zs_exp = sup->zs_exp;
+        int ix, iy, iz, lx, x, y, z;
+        int x0, x1, y0, y1, yt0, z0, z1, ny, nz, nyt;
+        double c;
+        double *tmp2 = cache;
+        double *tmp1 = tmp2 + l1l1 * mesh[2];
+        double *prho, *ptmp;
+
+        for (iz = 0; iz < sup->nseg[2]; iz++) {
+                z0 = zsegs[iz*2  ];
+                z1 = zsegs[iz*2+1];
+                nz = z1 - z0;
+                nyt = MAX(MG_TILESIZE / (l1 * nz), 1);
+                // tmp2[lx,ly,z] = \sum_lz coef[lx,ly,lz] zs[lz,z]
+                dgemm_(&TRANS_N, &TRANS_N, &nz, &l1l1, &l1,
+                       &D1, zs_exp+z0, mesh+2, coef, &l1,
+                       &D0, tmp2, &nz);
+                for (iy = 0; iy < sup->nseg[1]; iy++) {
+                        y0 = ysegs[iy*2  ];
+                        y1 = ysegs[iy*2+1];
+                for (yt0 = y0; yt0 < y1; yt0 += nyt) {
+                        ny = MIN(nyt, y1 - yt0);
+                        // tmp1[lx,y,z] = \sum_ly ys[ly,y] tmp2[lx,ly,z]
+                        for (lx = 0; lx <= topl; lx++) {
+                                dgemm_(&TRANS_N, &TRANS_T, &nz, &ny, &l1,
+                                       &D1, tmp2+lx*l1*nz, &nz, ys_exp+yt0, mesh+1,
+                                       &D0, tmp1+lx*ny*nz, &nz);
+                        }
+                        for (ix = 0; ix < sup->nseg[0]; ix++) {
+                                x0 = MAX(xsegs[ix*2  ], sup->xwin[0]);
+                                x1 = MIN(xsegs[ix*2+1], sup->xwin[1]);
+                                for (x = x0; x < x1; x++) {
+                                for (lx = 0; lx <= topl; lx++) {
+                                        c = xs_exp[lx*mesh[0]+x];
+                                        if (c == 0) {
+                                                continue;
+                                        }
+                                        for (y = 0; y < ny; y++) {
+                                                prho = rho + ((size_t)x*mesh[1]+yt0+y) * mesh[2] + z0;
+                                                ptmp = tmp1 + (lx*ny+y) * nz;
+                                                for (z = 0; z < nz; z++) {
+                                                        prho[z] += c * ptmp[z];
+                                                }
+                                        }
+                                } }
+                        }
+                } }
+        }
+}
+
+/*
+ * g[lx,ly,lz] = \sum_{xyz} v[x,y,z] xs[lx,x] ys[ly,y] zs[lz,z]
+ */
+static void _mg_orth_integrate(double *g, double *v, MGSupport *sup,
+                               double *cache)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D1 = 1;
+        int *mesh = sup->mesh;
+        int topl = sup->topl;
+        int l1 = topl + 1;
+        int l1l1 = l1 * l1;
+        int *xsegs = sup->segs;
+        int *ysegs = sup->segs + 4;
+        int *zsegs = sup->segs + 8;
+        double *xs_exp = sup->xs_exp;
+        double *ys_exp = sup->ys_exp;
+        double *zs_exp = sup->zs_exp;
+        int ix, iy, iz, lx, x, y, z, n;
+        int x0, x1, y0, y1, yt0, z0, z1, ny, nz, nyt;
+        double c;
+        double *tmp2 = cache;
+        double *tmp1 = tmp2 + l1l1 * mesh[2];
+        double *pv, *ptmp;
+
+        for (n = 0; n < l1l1*l1; n++) {
+                g[n] = 0;
+        }
+        for (iz = 0; iz < sup->nseg[2]; iz++) {
+                z0 = zsegs[iz*2  ];
+                z1 = zsegs[iz*2+1];
+                nz = z1 - z0;
+                nyt = MAX(MG_TILESIZE / (l1 * nz), 1);
+                for (n = 0; n < l1l1*nz; n++) {
+                        tmp2[n] = 0;
+                }
+                for (iy = 0; iy < sup->nseg[1]; iy++) {
+                        y0 = ysegs[iy*2  ];
+                        y1 = ysegs[iy*2+1];
+                for (yt0 = y0; yt0 < y1; yt0 += nyt) {
+                        ny = MIN(nyt, y1 - yt0);
+                        // tmp1[lx,y,z] = \sum_x xs[lx,x] v[x,y,z]
+                        for (n = 0; n < l1*ny*nz; n++) {
+                                tmp1[n] = 0;
+                        }
+                        for (ix = 0; ix < sup->nseg[0]; ix++) {
+                                x0 = xsegs[ix*2  ];
+                                x1 = xsegs[ix*2+1];
+                                for (x = x0; x < x1; x++) {
+                                for (lx = 0; lx <= topl; lx++) {
+                                        c = xs_exp[lx*mesh[0]+x];
+                                        if (c == 0) {
+                                                continue;
+                                        }
+                                        for (y = 0; y < ny; y++) {
+                                                pv = v + ((size_t)x*mesh[1]+yt0+y) * mesh[2] + z0;
+                                                ptmp = tmp1 + (lx*ny+y) * nz;
+                                                for (z = 0; z < nz; z++) {
+                                                        ptmp[z] += c * pv[z];
+                                                }
+                                        }
+                                } }
+                        }
+                        // tmp2[lx,ly,z] += \sum_y tmp1[lx,y,z] ys[ly,y]
+                        for (lx = 0; lx <= topl; lx++) {
+                                dgemm_(&TRANS_N, &TRANS_N, &nz, &l1, &ny,
+                                       &D1, tmp1+lx*ny*nz, &nz, ys_exp+yt0, mesh+1,
+                                       &D1, tmp2+lx*l1*nz, &nz);
+                        }
+                } }
+                // g[lx,ly,lz] += \sum_z tmp2[lx,ly,z] zs[lz,z]
+                dgemm_(&TRANS_T, &TRANS_N, &l1, &l1l1, &nz,
+                       &D1, zs_exp+z0, mesh+2, tmp2, &nz,
+                       &D1, g, &l1);
+        }
+}
+
+/*
+ * exp(-aij |r_k - rij|^2) for the grids r_k = r0 + k * dr, k = k0..k1-1,
+ * evaluated by recurrence from the grid closest to rij.  Returns 0 if all
+ * values are negligible.
+ */
+static int _mg_line_exp(double *eline, double aij, double *r0rij, double *dr,
+                        int k0, int k1)
+{
+        double rr = r0rij[0] * r0rij[0] + r0rij[1] * r0rij[1] + r0rij[2] * r0rij[2];
+        double rdr = r0rij[0] * dr[0] + r0rij[1] * dr[1] + r0rij[2] * dr[2];
+        double drdr = dr[0] * dr[0] + dr[1] * dr[1] + dr[2] * dr[2];
+        int kc = rint(-rdr / drdr);
+        int k;
+        kc = MIN(kc, k1-1);
+        kc = MAX(kc, k0);
+        double _r0r0 = -aij * (rr + 2 * kc * rdr + kc * kc * drdr);
+        if (_r0r0 < EXPMIN) {
+                return 0;
+        }
+
+        double exp_2drdr = exp(-2 * aij * drdr);
+        double exp_r0r0 = exp(_r0r0);
+        double exp_r0dr = exp(-aij * (2 * rdr + (2 * kc + 1) * drdr));
+        for (k = kc; k < k1; k++) {
+                eline[k-k0] = exp_r0r0;
+                exp_r0r0 *= exp_r0dr;
+                exp_r0dr *= exp_2drdr;
+        }
+        exp_r0r0 = exp(_r0r0);
+        exp_r0dr = exp(aij * (2 * rdr + (2 * kc - 1) * drdr));
+        for (k = kc-1; k >= k0; k--) {
+                exp_r0r0 *= exp_r0dr;
+                exp_r0dr *= exp_2drdr;
+                eline[k-k0] = exp_r0r0;
+        }
+        return 1;
+}
+
+/*
+ * Loop over the lines (along the third lattice vector) of the box of the
+ * primitive pair.  Each line is trimmed to the segment inside the sphere of
+ * radius cutoff around rij.  For each line, fline is called with the
+ * polynomial variables u = r - ri of the first grid and the Gaussian factors
+ * of the line.
+ */
+static void _mg_nonorth_lines(MGSupport *sup, MGGrids *grids, double *val,
+                              double *coef, double *data, double *cache,
+                              void (*fline)())
+{
+        int *mesh = sup->mesh;
+        int *box = sup->box;
+        double *a = grids->a;
+        double *ri = sup->ri;
+        double *rij = sup->rij;
+        double cutoff = sup->cutoff;
+        int periodic = (grids->dimension >= 3);
+        int ix, iy, iz, iz0, iz1, px, py, nz;
+        double r0[3], r0rij[3], u0[3], dr[3];
+        double rr, rdr, drdr, disc;
+        double *eline = cache;
+        cache += mesh[2] + SIMDD;
+
+        dr[0] = a[6] / mesh[2];
+        dr[1] = a[7] / mesh[2];
+        dr[2] = a[8] / mesh[2];
+        drdr = SQUARE(dr);
+        for (ix = box[0]; ix < box[1]; ix++) {
+                px = ((ix % mesh[0]) + mesh[0]) % mesh[0];
+                if (px < sup->xwin[0] || px >= sup->xwin[1]) {
+                        continue;
+                }
+        for (iy = box[2]; iy < box[3]; iy++) {
+                py = ((iy % mesh[1]) + mesh[1]) % mesh[1];
+                r0[0] = a[0] * ix / mesh[0] + a[3] * iy / mesh[1];
+                r0[1] = a[1] * ix / mesh[0] + a[4] * iy / mesh[1];
+                r0[2] = a[2] * ix / mesh[0] + a[5] * iy / mesh[1];
+                r0rij[0] = r0[0] - rij[0];
+                r0rij[1] = r0[1] - rij[1];
+                r0rij[2] = r0[2] - rij[2];
+                // |r0rij + k dr|^2 < cutoff^2
+                rr = SQUARE(r0rij);
+                rdr = r0rij[0] * dr[0] + r0rij[1] * dr[1] + r0rij[2] * dr[2];
+                disc = rdr * rdr - drdr * (rr - cutoff * cutoff);
+                if (disc < 0) {
+                        continue;
+                }
+                disc = sqrt(disc);
+                iz0 = MAX(box[4], (int)floor((-rdr - disc) / drdr));
+                iz1 = MIN(box[5], (int)ceil ((-rdr + disc) / drdr) + 1);
+        // Lines longer than the cell edge are split into pieces of mesh[2]
+        for (iz = iz0; iz < iz1; iz += mesh[2]) {
+                nz = MIN(iz1 - iz, mesh[2]);
+                r0rij[0] = r0[0] + dr[0] * iz - rij[0];
+                r0rij[1] = r0[1] + dr[1] * iz - rij[1];
+                r0rij[2] = r0[2] + dr[2] * iz - rij[2];
+                if (!_mg_line_exp(eline, sup->aij, r0rij, dr, 0, nz)) {
+                        continue;
+                }
+                u0[0] = r0[0] + dr[0] * iz - ri[0];
+                u0[1] = r0[1] + dr[1] * iz - ri[1];
+                u0[2] = r0[2] + dr[2] * iz - ri[2];
+                (*fline)(val + ((size_t)px * mesh[1] + py) * mesh[2], coef, data,
+                         sup->topl, u0, dr, eline, iz, nz, mesh[2],
+                         periodic, cache);
+        } } }
+}
+
+static void _mg_powers(double *px, double *py, double *pz, double *u0,
+                       double *dr, int k0, int topl)
+{
+        int n, l;
+        for (n = 0; n < SIMDD; n++) {
+                px[n] = 1;
+                py[n] = 1;
+                pz[n] = 1;
+                px[SIMDD+n] = u0[0] + dr[0] * (k0 + n);
+                py[SIMDD+n] = u0[1] + dr[1] * (k0 + n);
+                pz[SIMDD+n] = u0[2] + dr[2] * (k0 + n);
+        }
+        for (l = 2; l <= topl; l++) {
+                for (n = 0; n < SIMDD; n++) {
+                        px[l*SIMDD+n] = px[(l-1)*SIMDD+n] * px[SIMDD+n];
+                        py[l*SIMDD+n] = py[(l-1)*SIMDD+n] * py[SIMDD+n];
+                        pz[l*SIMDD+n] = pz[(l-1)*SIMDD+n] * pz[SIMDD+n];
+                }
+        }
+}
+
+static void _mg_line_collocate(double *rho, double *coef, double *data,
+                               int topl, double *u0, double *dr, double *eline,
+                               int z0, int nz, int nzmesh, int periodic,
+                               double *cache)
+{
+        int l1 = topl + 1;
+        int k, n, lx, ly, lz, z;
+        double px[LMAX1*SIMDD];
+        double py[LMAX1*SIMDD];
+        double pz[LMAX1*SIMDD];
+        double vy[SIMDD];
+        double vz[SIMDD];
+        double *vline = cache;
+        double *pcoef;
+
+        for (k = 0; k < nz; k += SIMDD) {
+                _mg_powers(px, py, pz, u0, dr, k, topl);
+                for (n = 0; n < SIMDD; n++) {
+                        vline[k+n] = 0;
+                }
+                for (lx = 0; lx <= topl; lx++) {
+                        for (n = 0; n < SIMDD; n++) {
+                                vy[n] = 0;
+                        }
+                        for (ly = 0; ly <= topl-lx; ly++) {
+                                pcoef = coef + (lx*l1+ly)*l1;
+                                for (n = 0; n < SIMDD; n++) {
+                                        vz[n] = 0;
+                                }
+                                for (lz = 0; lz <= topl-lx-ly; lz++) {
+                                        for (n = 0; n < SIMDD; n++) {
+                                                vz[n] += pcoef[lz] * pz[lz*SIMDD+n];
+                                        }
+                                }
+                                for (n = 0; n < SIMDD; n++) {
+                                        vy[n] += vz[n] * py[ly*SIMDD+n];
+                                }
+                        }
+                        for (n = 0; n < SIMDD; n++) {
+                                vline[k+n] += vy[n] * px[lx*SIMDD+n];
+                        }
+                }
+        }
+
+        if (periodic) {
+                z = ((z0 % nzmesh) + nzmesh) % nzmesh;
+                for (k = 0; k < nz; k++) {
+                        rho[z] += vline[k] * eline[k];
+                        z = (z + 1 == nzmesh) ? 0 : z + 1;
+                }
+        } else {
+                for (k = MAX(-z0, 0); k < MIN(nz, nzmesh-z0); k++) {
+                        rho[z0+k] += vline[k] * eline[k];
+                }
+        }
+}
+
+static void _mg_line_integrate(double *v, double *g, double *data,
+                               int topl, double *u0, double *dr, double *eline,
+                               int z0, int nz, int nzmesh, int periodic,
+                               double *cache)
+{
+        int l1 = topl + 1;
+        int k, n, lx, ly, lz, z;
+        double px[LMAX1*SIMDD];
+        double py[LMAX1*SIMDD];
+        double pz[LMAX1*SIMDD];
+        double wx[SIMDD];
+        double wy[SIMDD];
+        double *vline = cache;
+        double *pg, s;
+
+        for (k = 0; k < nz + SIMDD; k++) {
+                vline[k] = 0;
+        }
+        if (periodic) {
+                z = ((z0 % nzmesh) + nzmesh) % nzmesh;
+                for (k = 0; k < nz; k++) {
+                        vline[k] = v[z] * eline[k];
+                        z = (z + 1 == nzmesh) ? 0 : z + 1;
+                }
+        } else {
+                for (k = MAX(-z0, 0); k < MIN(nz, nzmesh-z0); k++) {
+                        vline[k] = v[z0+k] * eline[k];
+                }
+        }
+
+        for (k = 0; k < nz; k += SIMDD) {
+                _mg_powers(px, py, pz, u0, dr, k, topl);
+                for (lx = 0; lx <= topl; lx++) {
+                        for (n = 0; n < SIMDD; n++) {
+                                wx[n] = vline[k+n] * px[lx*SIMDD+n];
+                        }
+                        for (ly = 0; ly <= topl-lx; ly++) {
+                                pg = g + (lx*l1+ly)*l1;
+                                for (n = 0; n < SIMDD; n++) {
+                                        wy[n] = wx[n] * py[ly*SIMDD+n];
+                                }
+                                for (lz = 0; lz <= topl-lx-ly; lz++) {
+                                        s = 0;
+                                        for (n = 0; n < SIMDD; n++) {
+                                                s += wy[n] * pz[lz*SIMDD+n];
+                                        }
+                                        pg[lz] += s;
+                                }
+                        }
+                }
+        }
+}
+
+static void _mg_collocate(double *rho, double *coef, MGSupport *sup,
+                          MGGrids *grids, double *cache)
+{
+        if (grids->orth) {
+                _mg_orth_collocate(rho, coef, sup, cache);
+        } else {
+                _mg_nonorth_lines(sup, grids, rho, coef, NULL, cache,
+                                  &_mg_line_collocate);
+        }
+}
+
+static void _mg_integrate(double *g, double *v, MGSupport *sup,
+                          MGGrids *grids, double *cache)
+{
+        if (grids->orth) {
+                _mg_orth_integrate(g, v, sup, cache);
+        } else {
+                int l1 = sup->topl + 1;
+                int n;
+                for (n = 0; n < l1*l1*l1; n++) {
+                        g[n] = 0;
+                }
+                _mg_nonorth_lines(sup, grids, v, g, NULL, cache,
+                                  &_mg_line_integrate);
+        }
+}
+
+/*
+ * (x-xi)^i (x-xj)^j = \sum_k binom(j,k) (xi-xj)^(j-k) (x-xi)^(i+k)
+ * h[(i*(lj+1)+j)*l1 + i+k] = binom(j,k) (xi-xj)^(j-k)
+ */
+static void _mg_pair_poly1d(double *h, int li, int lj, double xixj)
+{
+        int l1 = li + lj + 1;
+        int i, j, k;
+        double binom[LMAX1*LMAX1];
+        double xpow[LMAX1];
+        for (j = 0; j <= lj; j++) {
+                binom[j*LMAX1] = 1;
+                binom[j*LMAX1+j] = 1;
+                for (k = 1; k < j; k++) {
+                        binom[j*LMAX1+k] = binom[(j-1)*LMAX1+k-1]
+                                         + binom[(j-1)*LMAX1+k];
+                }
+        }
+        xpow[0] = 1;
+        for (j = 1; j <= lj; j++) {
+                xpow[j] = xpow[j-1] * xixj;
+        }
+        for (i = 0; i < (li+1)*(lj+1)*l1; i++) {
+                h[i] = 0;
+        }
+        for (i = 0; i <= li; i++) {
+        for (j = 0; j <= lj; j++) {
+                for (k = 0; k <= j; k++) {
+                        h[(i*(lj+1)+j)*l1+i+k] = binom[j*LMAX1+k] * xpow[j-k];
+                }
+        } }
+}
+
+static void _mg_cart_powers(int *nx, int *ny, int *nz, int l)
+{
+        int lx, ly, n;
+        for (n = 0, lx = l; lx >= 0; lx--) {
+        for (ly = l - lx; ly >= 0; ly--, n++) {
+                nx[n] = lx;
+                ny[n] = ly;
+                nz[n] = l - lx - ly;
+        } }
+}
+
+/*
+ * coef[lx,ly,lz] = \sum_{ij} dm[i,j] * poly expansion of the Cartesian
+ * pair (i,j) on (x-xi)^lx (y-yi)^ly (z-zi)^lz.  Returns 0 if dm is zero
+ */
+static int _mg_pair_coef(double *coef, double *dmp, double fac,
+                         int li, int lj, double *hx, double *hy, double *hz)
+{
+        int l1 = li + lj + 1;
+        int nfi = (li+1)*(li+2)/2;
+        int nfj = (lj+1)*(lj+2)/2;
+        int inx[CART_MAX], iny[CART_MAX], inz[CART_MAX];
+        int jnx[CART_MAX], jny[CART_MAX], jnz[CART_MAX];
+        int i, j, px, py, pz;
+        int empty = 1;
+        double d, dx, dxy;
+        double *phx, *phy, *phz;
+        _mg_cart_powers(inx, iny, inz, li);
+        _mg_cart_powers(jnx, jny, jnz, lj);
+
+        for (i = 0; i < l1*l1*l1; i++) {
+                coef[i] = 0;
+        }
+        for (i = 0; i < nfi; i++) {
+        for (j = 0; j < nfj; j++) {
+                d = dmp[i*nfj+j] * fac;
+                if (d == 0) {
+                        continue;
+                }
+                empty = 0;
+                phx = hx + (inx[i]*(lj+1)+jnx[j]) * l1;
+                phy = hy + (iny[i]*(lj+1)+jny[j]) * l1;
+                phz = hz + (inz[i]*(lj+1)+jnz[j]) * l1;
+                for (px = inx[i]; px <= inx[i]+jnx[j]; px++) {
+                        dx = d * phx[px];
+                        for (py = iny[i]; py <= iny[i]+jny[j]; py++) {
+                                dxy = dx * phy[py];
+                                for (pz = inz[i]; pz <= inz[i]+jnz[j]; pz++) {
+                                        coef[(px*l1+py)*l1+pz] += dxy * phz[pz];
+                                }
+                        }
+                }
+        } }
+        return !empty;
+}
+
+/*
+ * The transpose of _mg_pair_coef
+ * vp[i,j] = fac * \sum_{lx,ly,lz} g[lx,ly,lz] * poly expansion of (i,j)
+ */
+static void _mg_pair_contract(double *vp, double *g, double fac,
+                              int li, int lj, double *hx, double *hy, double *hz)
+{
+        int l1 = li + lj + 1;
+        int nfi = (li+1)*(li+2)/2;
+        int nfj = (lj+1)*(lj+2)/2;
+        int inx[CART_MAX], iny[CART_MAX], inz[CART_MAX];
+        int jnx[CART_MAX], jny[CART_MAX], jnz[CART_MAX];
+        int i, j, px, py, pz;
+        double s, sx, sxy;
+        double *phx, *phy, *phz;
+        _mg_cart_powers(inx, iny, inz, li);
+        _mg_cart_powers(jnx, jny, jnz, lj);
+
+        for (i = 0; i < nfi; i++) {
+        for (j = 0; j < nfj; j++) {
+                phx = hx + (inx[i]*(lj+1)+jnx[j]) * l1;
+                phy = hy + (iny[i]*(lj+1)+jny[j]) * l1;
+                phz = hz + (inz[i]*(lj+1)+jnz[j]) * l1;
+                s = 0;
+                for (px = inx[i]; px <= inx[i]+jnx[j]; px++) {
+                        sx = 0;
+                        for (py = iny[i]; py <= iny[i]+jny[j]; py++) {
+                                sxy = 0;
+                                for (pz = inz[i]; pz <= inz[i]+jnz[j]; pz++) {
+                                        sxy += g[(px*l1+py)*l1+pz] * phz[pz];
+                                }
+                                sx += sxy * phy[py];
+                        }
+                        s += sx * phx[px];
+                }
+                vp[i*nfj+j] = s * fac;
+        } }
+}
+
+static size_t _mg_cache_size(MGGrids *grids, int nset, int *shls_slice,
+                             int *bas)
+{
+        int i, lmax = 0, nprim_max = 0;
+        for (i = shls_slice[0]; i < shls_slice[1]; i++) {
+                lmax = MAX(lmax, bas(ANG_OF, i));
+                nprim_max = MAX(nprim_max, bas(NPRIM_OF, i));
+        }
+        size_t l1 = lmax * 2 + 1;
+        size_t nf = (lmax+1)*(lmax+2)/2;
+        size_t mesh_max = grids->mesh_max;
+        size_t size = nf * nf * nset + l1*l1*l1 + (lmax+1)*(lmax+1)*l1*3
+                    + nprim_max * 2 + l1 * mesh_max * 3;
+        // intermediates of _mg_orth_collocate and _mg_orth_integrate
+        size += l1 * l1 * mesh_max + MAX(MG_TILESIZE, l1 * mesh_max);
+        // line buffers of the non-orthorhombic cell
+        size += mesh_max * 4 + SIMDD * 4;
+        return size;
+}
+
+static void _mg_init_grids(MGGrids *grids, int nlevels, int *meshes,
+                           double *ke_levels, double log_prec, int dimension,
+                           double *a, double *b)
+{
+        int i;
+        grids->nlevels = nlevels;
+        grids->meshes = meshes;
+        grids->ke_levels = ke_levels;
+        grids->log_prec = log_prec;
+        grids->dimension = dimension;
+        grids->a = a;
+        grids->b = b;
+        grids->orth = (a[1] == 0 && a[2] == 0 && a[3] == 0 &&
+                       a[5] == 0 && a[6] == 0 && a[7] == 0);
+        grids->mesh_max = 0;
+        for (i = 0; i < nlevels*3; i++) {
+                grids->mesh_max = MAX(grids->mesh_max, meshes[i]);
+        }
+}
+
+/*
+ * Loop over the primitive pairs of shells (ish, jsh) and the lattice images
+ * of jsh.  fprim is called for each primitive pair on its level.  Only the
+ * x-planes of slab islab (of nslab slabs) of each level are evaluated.  A
+ * pair is counted in npairs_levels by the slab of its first x-plane.
+ */
+static void _mg_shell_pair(void (*fprim)(), double *out, double *in, int nset,
+                           size_t *offsets, int *npairs_levels,
+                           int islab, int nslab,
+                           MGGrids *grids, int ish, int jsh, int *ao_loc,
+                           int ao_off, int nao, int *atm, int *bas, double *env,
+                           double *cache)
+{
+        const int li = bas(ANG_OF, ish);
+        const int lj = bas(ANG_OF, jsh);
+        const int i_prim = bas(NPRIM_OF, ish);
+        const int j_prim = bas(NPRIM_OF, jsh);
+        const int i_ctr = bas(NCTR_OF, ish);
+        const int j_ctr = bas(NCTR_OF, jsh);
+        const int topl = li + lj;
+        const int l1 = topl + 1;
+        const int lh = (li+1) * (lj+1) * l1;
+        const int nfi = (li+1)*(li+2)/2;
+        const int nfj = (lj+1)*(lj+2)/2;
+        const int nlevels = grids->nlevels;
+        const int dimension = grids->dimension;
+        const double log_prec = grids->log_prec;
+        double *ri = env + atm(PTR_COORD, bas(ATOM_OF, ish));
+        double *rj0 = env + atm(PTR_COORD, bas(ATOM_OF, jsh));
+        double *ai = env + bas(PTR_EXP, ish);
+        double *aj = env + bas(PTR_EXP, jsh);
+        double *ci = env + bas(PTR_COEFF, ish);
+        double *cj = env + bas(PTR_COEFF, jsh);
+        double *a = grids->a;
+        double *b = grids->b;
+        double fac = CINTcommon_fac_sp(li) * CINTcommon_fac_sp(lj);
+
+        double *buf = cache;
+        double *hx = buf + nfi * nfj * nset + l1*l1*l1;
+        double *hy = hx + lh;
+        double *hz = hy + lh;
+        double *log_iprim_max = hz + lh;
+        double *log_jprim_max = log_iprim_max + i_prim;
+        cache = log_jprim_max + j_prim;
+
+        MGSupport sup;
+        int ip, jp, i, lv, mx, my, mz, nx;
+        int img0[3], img1[3];
+        double aij, eij, logcc, cutoff, ke, f, w;
+        double rj[3], rij[3], ij_frac[3];
+        double rrij;
+        double log_imax = log_prec;
+        double log_jmax = log_prec;
+        double ai_min = ai[0];
+        double aj_min = aj[0];
+
+        for (ip = 0; ip < i_prim; ip++) {
+                log_iprim_max[ip] = log(max_pgto_coeff(ci, i_prim, i_ctr, ip));
+                log_imax = MAX(log_imax, log_iprim_max[ip]);
+                ai_min = MIN(ai_min, ai[ip]);
+        }
+        for (jp = 0; jp < j_prim; jp++) {
+                log_jprim_max[jp] = log(max_pgto_coeff(cj, j_prim, j_ctr, jp));
+                log_jmax = MAX(log_jmax, log_jprim_max[jp]);
+                aj_min = MIN(aj_min, aj[jp]);
+        }
+
+        // Lattice images of shell j which overlap with shell i
+        double rmax = EXPCUTOFF15 + log_imax + log_jmax;
+        rmax = sqrt(MAX(rmax, 0) * (ai_min + aj_min) / (ai_min * aj_min));
+        for (i = 0; i < 3; i++) {
+                ij_frac[i] = b[i*3+0] * (ri[0] - rj0[0])
+                           + b[i*3+1] * (ri[1] - rj0[1])
+                           + b[i*3+2] * (ri[2] - rj0[2]);
+                if (dimension > i) {
+                        w = rmax * sqrt(SQUARE(b+i*3));
+                        img0[i] = (int)ceil (ij_frac[i] - w);
+                        img1[i] = (int)floor(ij_frac[i] + w) + 1;
+                } else {
+                        img0[i] = 0;
+                        img1[i] = 1;
+                }
+        }
+
+        for (mx = img0[0]; mx < img1[0]; mx++) {
+        for (my = img0[1]; my < img1[1]; my++) {
+        for (mz = img0[2]; mz < img1[2]; mz++) {
+                for (i = 0; i < 3; i++) {
+                        rj[i] = rj0[i] + mx * a[i] + my * a[3+i] + mz * a[6+i];
+                }
+                rrij = CINTsquare_dist(ri, rj);
+                if (rrij * ai_min * aj_min / (ai_min + aj_min)
+                    > EXPCUTOFF15 + log_imax + log_jmax) {
+                        continue;
+                }
+                _mg_pair_poly1d(hx, li, lj, ri[0] - rj[0]);
+                _mg_pair_poly1d(hy, li, lj, ri[1] - rj[1]);
+                _mg_pair_poly1d(hz, li, lj, ri[2] - rj[2]);
+
+                for (jp = 0; jp < j_prim; jp++) {
+                for (ip = 0; ip < i_prim; ip++) {
+                        aij = ai[ip] + aj[jp];
+                        eij = (ai[ip] * aj[jp] / aij) * rrij;
+                        logcc = log_iprim_max[ip] + log_jprim_max[jp];
+                        if (eij-logcc > EXPCUTOFF15) {
+                                continue;
+                        }
+
+                        // Fourier components of the pair decay as exp(-G^2/(4aij)).
+                        // Pick the coarsest level whose cutoff resolves them.
+                        ke = 2 * aij * (logcc - eij - log_prec);
+                        for (lv = 0; lv < nlevels-1; lv++) {
+                                if (grids->ke_levels[lv] >= ke) {
+                                        break;
+                                }
+                        }
+                        nx = grids->meshes[lv*3];
+                        sup.xwin[0] = nx * islab / nslab;
+                        sup.xwin[1] = nx * (islab+1) / nslab;
+                        if (sup.xwin[0] == sup.xwin[1]) {
+                                continue;
+                        }
+
+                        rij[0] = (ai[ip] * ri[0] + aj[jp] * rj[0]) / aij;
+                        rij[1] = (ai[ip] * ri[1] + aj[jp] * rj[1]) / aij;
+                        rij[2] = (ai[ip] * ri[2] + aj[jp] * rj[2]) / aij;
+                        cutoff = gto_rcut(aij, topl, exp(logcc-eij), log_prec);
+                        if (!_mg_support(&sup, grids, grids->meshes+lv*3, topl,
+                                         aij, ri, rij, cutoff, cache)) {
+                                continue;
+                        }
+                        if (sup.xfirst >= sup.xwin[0] && sup.xfirst < sup.xwin[1]) {
+                                npairs_levels[lv] += 1;
+                        }
+                        f = fac * exp(-eij);
+                        (*fprim)(out, in, nset, offsets[lv], offsets[nlevels],
+                                 &sup, grids, f, li, lj, ip, jp,
+                                 ish, jsh, ao_loc, ao_off, nao, bas, env,
+                                 buf, hx, hy, hz,
+                                 cache + l1 * (sup.mesh[0]+sup.mesh[1]+sup.mesh[2]));
+                } }
+        } } }
+}
+
+static void _mg_rho_prim(double *rho, double *dm, int nset, size_t offset,
+                         size_t ngrids, MGSupport *sup, MGGrids *grids,
+                         double fac, int li, int lj, int ip, int jp,
+                         int ish, int jsh, int *ao_loc, int ao_off, int nao,
+                         int *bas, double *env, double *buf,
+                         double *hx, double *hy, double *hz, double *cache)
+{
+        const int i_prim = bas(NPRIM_OF, ish);
+        const int j_prim = bas(NPRIM_OF, jsh);
+        const int i_ctr = bas(NCTR_OF, ish);
+        const int j_ctr = bas(NCTR_OF, jsh);
+        const int nfi = (li+1)*(li+2)/2;
+        const int nfj = (lj+1)*(lj+2)/2;
+        const int i0 = ao_loc[ish] - ao_off;
+        const int j0 = ao_loc[jsh] - ao_off;
+        const size_t nao2 = (size_t)nao * nao;
+        double *ci = env + bas(PTR_COEFF, ish);
+        double *cj = env + bas(PTR_COEFF, jsh);
+        double *dmp = buf;
+        double *coef = dmp + nfi * nfj * nset;
+        double *pdm, *pdmp;
+        double cc;
+        int ic, jc, i, j, n, iset;
+
+        for (n = 0; n < nfi*nfj*nset; n++) {
+                dmp[n] = 0;
+        }
+        for (ic = 0; ic < i_ctr; ic++) {
+        for (jc = 0; jc < j_ctr; jc++) {
+                cc = ci[ic*i_prim+ip] * cj[jc*j_prim+jp];
+                if (cc == 0) {
+                        continue;
+                }
+                for (iset = 0; iset < nset; iset++) {
+                        pdm = dm + iset * nao2 + (size_t)(i0+ic*nfi) * nao + j0+jc*nfj;
+                        pdmp = dmp + iset * nfi * nfj;
+                        for (i = 0; i < nfi; i++) {
+                        for (j = 0; j < nfj; j++) {
+                                pdmp[i*nfj+j] += cc * pdm[(size_t)i*nao+j];
+                        } }
+                }
+        } }
+
+        for (iset = 0; iset < nset; iset++) {
+                if (_mg_pair_coef(coef, dmp+iset*nfi*nfj, fac,
+                                  li, lj, hx, hy, hz)) {
+                        _mg_collocate(rho+iset*ngrids+offset, coef, sup,
+                                      grids, cache);
+                }
+        }
+}
+
+static void _mg_vmat_prim(double *mat, double *v, int nset, size_t offset,
+                          size_t ngrids, MGSupport *sup, MGGrids *grids,
+                          double fac, int li, int lj, int ip, int jp,
+                          int ish, int jsh, int *ao_loc, int ao_off, int nao,
+                          int *bas, double *env, double *buf,
+                          double *hx, double *hy, double *hz, double *cache)
+{
+        const int i_prim = bas(NPRIM_OF, ish);
+        const int j_prim = bas(NPRIM_OF, jsh);
+        const int i_ctr = bas(NCTR_OF, ish);
+        const int j_ctr = bas(NCTR_OF, jsh);
+        const int nfi = (li+1)*(li+2)/2;
+        const int nfj = (lj+1)*(lj+2)/2;
+        const int i0 = ao_loc[ish] - ao_off;
+        const int j0 = ao_loc[jsh] - ao_off;
+        const size_t nao2 = (size_t)nao * nao;
+        double *ci = env + bas(PTR_COEFF, ish);
+        double *cj = env + bas(PTR_COEFF, jsh);
+        double *vp = buf;
+        double *g = vp + nfi * nfj;
+        double *pmat;
+        double cc;
+        int ic, jc, i, j, iset;
+
+        for (iset = 0; iset < nset; iset++) {
+                _mg_integrate(g, v+iset*ngrids+offset, sup, grids, cache);
+                _mg_pair_contract(vp, g, fac, li, lj, hx, hy, hz);
+                for (ic = 0; ic < i_ctr; ic++) {
+                for (jc = 0; jc < j_ctr; jc++) {
+                        cc = ci[ic*i_prim+ip] * cj[jc*j_prim+jp];
+                        if (cc == 0) {
+                                continue;
+                        }
+                        pmat = mat + iset * nao2 + (size_t)(i0+ic*nfi) * nao + j0+jc*nfj;
+                        for (i = 0; i < nfi; i++) {
+                        for (j = 0; j < nfj; j++) {
+                                pmat[(size_t)i*nao+j] += cc * vp[i*nfj+j];
+                        } }
+                } }
+        }
+}
+
+/*
+ * rho[iset,level_grids] = \sum_{ij} dm[iset,i,j] \phi_i \phi_j
+ *
+ * dm is given in the Cartesian GTO basis of the shells in shls_slice.
+ * meshes (nlevels,3) and ke_levels (nlevels) are sorted from the coarsest to
+ * the finest level.  The densities of all levels are concatenated in rho
+ * along the grids dimension.  npairs_levels counts the primitive pairs
+ * collocated on each level.  b = inv(a.T).
+ */
+void NUMINT_rho_multigrid(double *rho, double *dm, int nset, int hermi,
+                          int nlevels, int *meshes, double *ke_levels,
+                          int *npairs_levels, double log_prec, int dimension,
+                          double *a, double *b, int *shls_slice, int *ao_loc,
+                          int *atm, int natm, int *bas, int nbas, double *env)
+{
+        int sh0 = shls_slice[0];
+        int sh1 = shls_slice[1];
+        int nsh = sh1 - sh0;
+        int ao_off = ao_loc[sh0];
+        int nao = ao_loc[sh1] - ao_off;
+        size_t *offsets = malloc(sizeof(size_t) * (nlevels+1));
+        int i;
+        MGGrids grids;
+        _mg_init_grids(&grids, nlevels, meshes, ke_levels, log_prec,
+                       dimension, a, b);
+
+        offsets[0] = 0;
+        for (i = 0; i < nlevels; i++) {
+                offsets[i+1] = offsets[i] + (size_t)meshes[i*3+0] * meshes[i*3+1] * meshes[i*3+2];
+        }
+        size_t cache_size = _mg_cache_size(&grids, nset, shls_slice, bas);
+        for (i = 0; i < nlevels; i++) {
+                npairs_levels[i] = 0;
+        }
+
+        double *dm_sym = dm;
+        if (hermi != PLAIN) {
+                // dm[j,i] of the lower triangular part is folded into dm[i,j]
+                size_t nao2 = (size_t)nao * nao;
+                size_t n, j;
+                dm_sym = malloc(sizeof(double) * nao2 * nset);
+                for (n = 0; n < nset; n++) {
+                for (i = 0; i < nao; i++) {
+                for (j = 0; j < nao; j++) {
+                        dm_sym[n*nao2+i*nao+j] = dm[n*nao2+i*nao+j]
+                                               + dm[n*nao2+j*nao+i];
+                } } }
+        }
+
+        int nslab = 1;
+#pragma omp parallel default(none) \
+        shared(rho, dm, dm_sym, nset, hermi, npairs_levels, ao_loc, atm, bas, \
+               env, sh0, nsh, ao_off, nao, offsets, cache_size, \
+               grids, nlevels, nslab)
+{
+        int ish, jsh, islab, it;
+#pragma omp single
+{
+        int nx_max = 0;
+        for (it = 0; it < nlevels; it++) {
+                nx_max = MAX(nx_max, grids.meshes[it*3]);
+        }
+        nslab = MIN(omp_get_num_threads() * MG_SLABS_PER_THREAD, nx_max);
+}
+        int *npairs_priv = calloc(nlevels, sizeof(int));
+        double *cache = malloc(sizeof(double) * cache_size);
+// Each slab of x-planes is written by one task only
+#pragma omp for schedule(dynamic)
+        for (islab = 0; islab < nslab; islab++) {
+        for (ish = 0; ish < nsh; ish++) {
+                if (hermi != PLAIN) {
+                        // the diagonal block with dm, off-diagonal with dm_sym
+                        _mg_shell_pair(&_mg_rho_prim, rho, dm, nset,
+                                       offsets, npairs_priv, islab, nslab,
+                                       &grids, ish+sh0, ish+sh0, ao_loc,
+                                       ao_off, nao, atm, bas, env, cache);
+                        for (jsh = 0; jsh < ish; jsh++) {
+                                _mg_shell_pair(&_mg_rho_prim, rho, dm_sym, nset,
+                                               offsets, npairs_priv, islab, nslab,
+                                               &grids, ish+sh0, jsh+sh0, ao_loc,
+                                               ao_off, nao, atm, bas, env, cache);
+                        }
+                } else {
+                        for (jsh = 0; jsh < nsh; jsh++) {
+                                _mg_shell_pair(&_mg_rho_prim, rho, dm, nset,
+                                               offsets, npairs_priv, islab, nslab,
+                                               &grids, ish+sh0, jsh+sh0, ao_loc,
+                                               ao_off, nao, atm, bas, env, cache);
+                        }
+                }
+        } }
+        free(cache);
+#pragma omp critical
+{
+        for (it = 0; it < nlevels; it++) {
+                npairs_levels[it] += npairs_priv[it];
+        }
+}
+        free(npairs_priv);
+}
+        if (dm_sym != dm) {
+                free(dm_sym);
+        }
+        free(offsets);
+}
+
+/*
+ * mat[iset,i,j] = \sum_r v[iset,level_grids] \phi_i(r) \phi_j(r)
+ *
+ * The potential of each level is concatenated in v along the grids dimension.
+ * mat is in the Cartesian GTO basis of the shells in shls_slice.  If hermi
+ * is set, only the blocks of ish >= jsh are computed and the lower
+ * triangular part is copied to the upper triangular part.
+ */
+void NUMINT_vmat_multigrid(double *mat, double *v, int nset, int hermi,
+                           int nlevels, int *meshes, double *ke_levels,
+                           int *npairs_levels, double log_prec, int dimension,
+                           double *a, double *b, int *shls_slice, int *ao_loc,
+                           int *atm, int natm, int *bas, int nbas, double *env)
+{
+        int sh0 = shls_slice[0];
+        int sh1 = shls_slice[1];
+        int nsh = sh1 - sh0;
+        int ao_off = ao_loc[sh0];
+        int nao = ao_loc[sh1] - ao_off;
+        size_t nao2 = (size_t)nao * nao;
+        size_t *offsets = malloc(sizeof(size_t) * (nlevels+1));
+        size_t i, j, n;
+        MGGrids grids;
+        _mg_init_grids(&grids, nlevels, meshes, ke_levels, log_prec,
+                       dimension, a, b);
+
+        offsets[0] = 0;
+        for (i = 0; i < nlevels; i++) {
+                offsets[i+1] = offsets[i] + (size_t)meshes[i*3+0] * meshes[i*3+1] * meshes[i*3+2];
+                npairs_levels[i] = 0;
+        }
+        size_t cache_size = _mg_cache_size(&grids, nset, shls_slice, bas);
+        for (n = 0; n < nset*nao2; n++) {
+                mat[n] = 0;
+        }
+
+#pragma omp parallel default(none) \
+        shared(mat, v, nset, hermi, npairs_levels, ao_loc, atm, bas, env, \
+               sh0, nsh, ao_off, nao, offsets, cache_size, grids, nlevels)
+{
+        int ish, jsh, ij, it;
+        int *npairs_priv = calloc(nlevels, sizeof(int));
+        double *cache = malloc(sizeof(double) * cache_size);
+#pragma omp for schedule(dynamic)
+        for (ij = 0; ij < nsh*nsh; ij++) {
+                ish = ij / nsh;
+                jsh = ij % nsh;
+                if (hermi != PLAIN && jsh > ish) {
+                        continue;
+                }
+                _mg_shell_pair(&_mg_vmat_prim, mat, v, nset, offsets,
+                               npairs_priv, 0, 1, &grids, ish+sh0, jsh+sh0,
+                               ao_loc, ao_off, nao, atm, bas, env, cache);
+        }
+        free(cache);
+#pragma omp critical
+{
+        for (it = 0; it < nlevels; it++) {
+                npairs_levels[it] += npairs_priv[it];
+        }
+}
+        free(npairs_priv);
+}
+        if (hermi != PLAIN) {
+                for (n = 0; n < nset; n++) {
+                        for (i = 0; i < nao; i++) {
+                        for (j = i+1; j < nao; j++) {
+                                mat[n*nao2+i*nao+j] = mat[n*nao2+j*nao+i];
+                        } }
+                }
+        }
+        free(offsets);
+}
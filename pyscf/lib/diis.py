@@ -47,6 +47,14 @@ class DIIS(object):
             DIIS subspace size. The maximum number of the vectors to be stored.
         min_space
             The minimal size of subspace before DIIS extrapolation.
+        async_io : bool
+            Write the vectors smaller than INCORE_SIZE to the diis file in a
+            background thread.  It only has effects if filename is given.
+            The file is updated at the end of each :func:`update` call,
+            while the next iteration is running.  The queued vectors are
+            copies of the input, so the vectors of up to two updates are
+            held in memory in addition.  Vectors larger than INCORE_SIZE are
+            always written synchronously, block by block.  Default is False.
 
     Functions:
         update(x, xerr=None) :
@@ -101,7 +109,8 @@ class DIIS(object):
     E_6 = -1.100153764878
     '''
     def __init__(self, dev=None, filename=None,
-                 incore=getattr(__config__, 'lib_diis_DIIS_incore', False)):
+                 incore=getattr(__config__, 'lib_diis_DIIS_incore', False),
+                 async_io=getattr(__config__, 'lib_diis_DIIS_async_io', False)):
         if dev is not None:
             self.verbose = dev.verbose
             self.stdout = dev.stdout
@@ -111,6 +120,7 @@ class DIIS(object):
         self.space = 6
         self.min_space = 1
         self.incore = incore
+        self.async_io = async_io
 
 ##################################################
 # don't modify the following private variables, they are not input options
@@ -122,6 +132,9 @@ class DIIS(object):
         self._H = None
         self._xprev = None
         self._err_vec_touched = False
+        self._pending = {}  # vectors waiting to be written to _diisfile
+        self._writing = {}  # vectors being written by the background thread
+        self._writer = None
 
     def _store(self, key, value):
         incore = value.size < INCORE_SIZE or self.incore
@@ -133,13 +146,89 @@ class DIIS(object):
         if (not incore) or isinstance(self.filename, str):
             if self._diisfile is None:
                 self._diisfile = misc.H5TmpFile(self.filename, 'w')
-            if key in self._diisfile:
-                self._diisfile[key][:] = value
+            if value.size < INCORE_SIZE and self._async_enabled():
+                # Snapshot, the caller may overwrite value in the next
+                # iteration
+                self._pending[key] = numpy.array(value, copy=True)
             else:
-                self._diisfile[key] = value
+                self.flush()
+                self._dump({key: value})
+
+    def _async_enabled(self):
+        # See the comments of lib.call_in_background.  Threads are not
+        # created in the import stage.
+        return (self.async_io and h5py.version.version[:4] != '2.2.' and
+                not misc.imp.lock_held())
+
+    def _dump(self, vecs, meta=None):
+        '''Write vectors to the diis file. The DIIS metadata (bookkeeping and
+        the overlap matrix of error vectors) are written after the vectors so
+        that the metadata in the file always refer to complete vectors.
+        '''
+        fdiis = self._diisfile
+        if vecs and 'H' in fdiis:
+            # Invalidate the metadata until all vectors are updated
+            del(fdiis['H'])
+        for key, value in vecs.items():
+            if key not in fdiis:
+                fdiis.create_dataset(key, value.shape, value.dtype)
+            dat = fdiis[key]
+            # Write block by block, so that the h5py lock is released
+            # regularly when called in background
+            for p0, p1 in misc.prange(0, value.size, BLOCK_SIZE):
+                dat[p0:p1] = value[p0:p1]
+        if meta is not None:
+            for key, value in meta.items():
+                if key in fdiis:
+                    del(fdiis[key])
+                fdiis[key] = value
 # to avoid "Unable to find a valid file signature" error when reload the hdf5
 # file from a crashed claculation
-            self._diisfile.flush()
+        fdiis.flush()
+
+    def _save_state(self):
+        '''Save the vectors which were not written to the diis file and the
+        DIIS metadata. In async_io mode, the writing is executed in the
+        background. It returns immediately if the previous writing was
+        finished (double buffering).
+        '''
+        if (self._diisfile is None or self._H is None or
+            not isinstance(self.filename, str)):
+            meta = None
+        else:
+            meta = {'H': self._H.copy(),
+                    'bookkeep': numpy.array([self._head] + self._bookkeep)}
+        vecs, self._pending = self._pending, {}
+        if not vecs and meta is None:
+            return
+        elif self._async_enabled():
+            self.flush()
+            self._writing = vecs
+            self._writer = misc.ThreadWithTraceBack(target=self._dump,
+                                                    args=(vecs, meta))
+            self._writer.start()
+        else:
+            self._dump(vecs, meta)
+
+    def flush(self):
+        '''Wait until all vectors are written to the diis file'''
+        if self._writer is not None:
+            self._writer.join()
+            self._writer = None
+        self._writing = {}
+        if self._pending:
+            vecs, self._pending = self._pending, {}
+            self._dump(vecs)
+
+    def _get(self, key):
+        if key in self._buffer:
+            return self._buffer[key]
+        elif key in self._pending:
+            return self._pending[key]
+        elif key in self._writing:
+            return self._writing[key]
+        else:
+            return self._diisfile[key]
 
     def push_err_vec(self, xerr):
         self._err_vec_touched = True
@@ -167,7 +256,7 @@ class DIIS(object):
             self._xprev = x
             self._store('xprev', x)
             if 'xprev' not in self._buffer:  # not incore
-                self._xprev = self._diisfile['xprev']
+                self._xprev = self._get('xprev')
 
         else:
             if self._head >= self.space:
@@ -179,6 +268,7 @@ class DIIS(object):
             if x.size < INCORE_SIZE or self.incore:
                 self._store(ekey, x - numpy.asarray(self._xprev))
             else:  # not call _store to reduce memory footprint
+                self.flush()
                 if ekey not in self._diisfile:
                     self._diisfile.create_dataset(ekey, (x.size,), x.dtype)
                 edat = self._diisfile[ekey]
@@ -188,16 +278,10 @@ class DIIS(object):
             self._head += 1
 
     def get_err_vec(self, idx):
-        if self._buffer:
-            return self._buffer['e%d'%idx]
-        else:
-            return self._diisfile['e%d'%idx]
+        return self._get('e%d'%idx)
 
     def get_vec(self, idx):
-        if self._buffer:
-            return self._buffer['x%d'%idx]
-        else:
-            return self._diisfile['x%d'%idx]
+        return self._get('x%d'%idx)
 
     def get_num_vec(self):
         return len(self._bookkeep)
@@ -218,6 +302,7 @@ class DIIS(object):
 
         nd = self.get_num_vec()
         if nd < self.min_space:
+            self._save_state()
             return x
 
         dt = numpy.array(self.get_err_vec(self._head-1), copy=False)
@@ -241,7 +326,8 @@ class DIIS(object):
 
             self._store('xprev', xnew)
             if 'xprev' not in self._buffer:  # not incore
-                self._xprev = self._diisfile['xprev']
+                self._xprev = self._get('xprev')
+        self._save_state()
         return xnew.reshape(x.shape)
 
     def extrapolate(self, nd=None):
@@ -280,12 +366,17 @@ class DIIS(object):
         '''Read diis contents from a diis file and replace the attributes of
         current diis object if needed, then construct the vector.
         '''
-        fdiis = misc.H5TmpFile(filename)
+        self.flush()
+        if inplace:
+            # The restored file is updated in the following iterations
+            fdiis = misc.H5TmpFile(filename, 'a')
+        else:
+            fdiis = misc.H5TmpFile(filename, 'r')
         if inplace:
             self.filename = filename
             self._diisfile = fdiis
 
-        diis_keys = fdiis.keys()
+        diis_keys = [k for k in fdiis.keys() if k[0] in ('x', 'e')]
         x_keys = [k for k in diis_keys if k[0] == 'x']
         e_keys = [k for k in diis_keys if k[0] == 'e']
         # errvec may be incomplete if program is terminated when generating errvec.
@@ -304,14 +395,24 @@ class DIIS(object):
 
         else:
             for key in diis_keys:
-                self._store(key, fdiis[key].value)
+                self._store(key, numpy.asarray(fdiis[key]))
 
             if 'xprev' in diis_keys:
                 self._store('xprev', numpy.asarray(fdiis['xprev']))
-                if 'xprev' in self._buffer:  # incore
-                    self._xprev = self._buffer['xprev']
-                else:
-                    self._xprev = self._diisfile['xprev']
+                self._xprev = self._get('xprev')
+
+        # Fast restart: the overlap matrix of error vectors and the ordering of
+        # the vectors are available if the last writing was completed
+        if 'H' in fdiis and 'bookkeep' in fdiis:
+            h = numpy.asarray(fdiis['H'])
+            bookkeep = [int(i) for i in fdiis['bookkeep']]
+            if (h.shape[0] == self.space+1 and len(bookkeep) == nd+1 and
+                sorted(bookkeep[1:]) == list(range(nd))):
+                self._head = bookkeep[0]
+                self._bookkeep = bookkeep[1:]
+                self._H = h
+                self._save_state()
+                return self
 
         self._bookkeep = list(range(nd))
         self._head = nd
@@ -335,6 +436,7 @@ class DIIS(object):
         self._H = numpy.zeros((space+1,space+1), e_mat.dtype)
         self._H[0,1:] = self._H[1:,0] = 1
         self._H[1:nd+1,1:nd+1] = e_mat
+        self._save_state()
         return self
 
 
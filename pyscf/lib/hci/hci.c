@@ -24,221 +24,583 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include "config.h"
 #include "hci.h"
-//#include <omp.h>
+#include "mcscf/fci_bitstr.h"
 #include <limits.h>
 
-// Computes C' = H * C in the selected CI basis
-void contract_h_c(double *h1, double *eri, int norb, int neleca, int nelecb, uint64_t *strs, double *civec, double *hdiag, uint64_t ndet, double *ci1) {
+#define HASH_EMPTY      -1
+// Cost of a hash lookup relative to the excitation level test of a pair
+#define LOOKUP_COST     4
+
+// Open-addressing hash index of a set of bit strings.  keys[k] points to the
+// nset words of the k-th unique string.
+typedef struct {
+    int nset;
+    uint64_t mask;
+    uint64_t nkeys;
+    int64_t *slots;
+    uint64_t **keys;
+} StrIndex;
+
+// Connectivity of the determinants through their alpha and beta strings.
+// The determinant lists of each unique string and the unique strings
+// connected by a single excitation are stored in CSR format.
+typedef struct {
+    int nset;
+    uint64_t *strs;
+    StrIndex dindex;
+    StrIndex aindex;
+    StrIndex bindex;
+    uint64_t *aid;
+    uint64_t *bid;
+    uint64_t *abucket_loc;
+    uint64_t *abucket;
+    uint64_t *bbucket_loc;
+    uint64_t *bbucket;
+    uint64_t *asingles_loc;
+    uint64_t *asingles;
+    uint64_t *bsingles_loc;
+    uint64_t *bsingles;
+} HCIConnect;
+
+static uint64_t hash_str(uint64_t *str, int nset) {
+
+    size_t k;
+    uint64_t h = 0;
+
+    for (k = 0; k < nset; ++k) {
+        h = (h ^ str[k]) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+
+    return h;
+
+}
+
+// Build the index of the strings strs[p*stride:p*stride+nset]; ids[p] is the
+// index of the unique string of strs[p]
+static void str_index_build(StrIndex *index, uint64_t *strs, uint64_t nstrs, size_t stride, int nset, uint64_t *ids) {
+
+    size_t p;
+    uint64_t size = 16;
+    while (size < nstrs * 2) size *= 2;
+
+    index->nset = nset;
+    index->mask = size - 1;
+    index->nkeys = 0;
+    index->slots = malloc(sizeof(int64_t) * size);
+    index->keys = malloc(sizeof(uint64_t *) * (nstrs + 1));
+    for (p = 0; p < size; ++p) index->slots[p] = HASH_EMPTY;
+
+    for (p = 0; p < nstrs; ++p) {
+        uint64_t *str = strs + p * stride;
+        uint64_t h = hash_str(str, nset) & index->mask;
+        int64_t k;
+        while ((k = index->slots[h]) != HASH_EMPTY && !FCIbs_equal(index->keys[k], str, nset)) {
+            h = (h + 1) & index->mask;
+        }
+        if (k == HASH_EMPTY) {
+            k = index->nkeys;
+            index->slots[h] = k;
+            index->keys[k] = str;
+            index->nkeys++;
+        }
+        ids[p] = k;
+    }
+
+}
+
+static int64_t str_index_lookup(StrIndex *index, uint64_t *str) {
+
+    int nset = index->nset;
+    uint64_t h = hash_str(str, nset) & index->mask;
+    int64_t k;
+
+    while ((k = index->slots[h]) != HASH_EMPTY) {
+        if (FCIbs_equal(index->keys[k], str, nset)) return k;
+        h = (h + 1) & index->mask;
+    }
+
+    return HASH_EMPTY;
+
+}
+
+static void str_index_del(StrIndex *index) {
+
+    free(index->slots);
+    free(index->keys);
+
+}
+
+// Occupied and virtual orbitals of a string in ascending order
+static void occ_vir_list(uint64_t *string, int nset, int norb, int *occ, int *vir) {
+
+    int p;
+    int nvir = 0;
+
+    FCIbs_occ_list(string, nset, occ);
+    for (p = 0; p < norb; ++p) {
+        if (!FCIbs_test(string, nset, p)) {
+            vir[nvir] = p;
+            nvir++;
+        }
+    }
+
+}
+
+// Determinant lists of the unique strings in CSR format
+static void make_buckets(uint64_t *ids, uint64_t ndet, uint64_t nkeys, uint64_t **loc_, uint64_t **bucket_) {
+
+    size_t ip, k;
+    uint64_t *loc = calloc(nkeys + 1, sizeof(uint64_t));
+    uint64_t *bucket = malloc(sizeof(uint64_t) * (ndet + 1));
+    uint64_t *cursor = malloc(sizeof(uint64_t) * (nkeys + 1));
+
+    for (ip = 0; ip < ndet; ++ip) loc[ids[ip] + 1]++;
+    for (k = 0; k < nkeys; ++k) {
+        loc[k + 1] += loc[k];
+        cursor[k] = loc[k];
+    }
+    for (ip = 0; ip < ndet; ++ip) {
+        bucket[cursor[ids[ip]]] = ip;
+        cursor[ids[ip]]++;
+    }
+    free(cursor);
+
+    *loc_ = loc;
+    *bucket_ = bucket;
+
+}
+
+// Unique strings connected to str by a single excitation.  Their indices are
+// written to out if out is not NULL.  Returns the number of connected strings.
+static uint64_t connected_singles(StrIndex *index, uint64_t *str, int norb, int nelec, int *occ, int *vir, uint64_t *tmp, uint64_t *out) {
+
+    int nset = index->nset;
+    int i, a, k;
+    int64_t addr;
+    uint64_t n = 0;
+
+    occ_vir_list(str, nset, norb, occ, vir);
+    for (i = 0; i < nelec; ++i) {
+        for (a = 0; a < norb - nelec; ++a) {
+            for (k = 0; k < nset; ++k) tmp[k] = str[k];
+            FCIbs_flip(tmp, nset, occ[i]);
+            FCIbs_flip(tmp, nset, vir[a]);
+            addr = str_index_lookup(index, tmp);
+            if (addr != HASH_EMPTY) {
+                if (out != NULL) out[n] = addr;
+                n++;
+            }
+        }
+    }
+
+    return n;
 
-    int *ts = malloc(sizeof(int) * ndet);
+}
+
+static void make_singles(StrIndex *index, int norb, int nelec, uint64_t **loc_, uint64_t **singles_) {
+
+    uint64_t nkeys = index->nkeys;
+    int nset = index->nset;
+    uint64_t *loc = malloc(sizeof(uint64_t) * (nkeys + 1));
+    uint64_t *singles = NULL;
+    loc[0] = 0;
+
+    #pragma omp parallel default(none) shared(index, norb, nelec, nkeys, nset, loc, singles)
+    {
+
+    size_t u;
+    int *occ = malloc(sizeof(int) * (norb + 1));
+    int *vir = occ + nelec;
+    uint64_t *tmp = malloc(sizeof(uint64_t) * nset);
 
-    #pragma omp parallel default(none) shared(h1, eri, norb, neleca, nelecb, strs, civec, hdiag, ndet, ci1, ts)
+    #pragma omp for schedule(dynamic, 64)
+    for (u = 0; u < nkeys; ++u) {
+        loc[u + 1] = connected_singles(index, index->keys[u], norb, nelec, occ, vir, tmp, NULL);
+    }
+
+    #pragma omp single
     {
+    for (u = 0; u < nkeys; ++u) loc[u + 1] += loc[u];
+    singles = malloc(sizeof(uint64_t) * (loc[nkeys] + 1));
+    }
+
+    #pragma omp for schedule(dynamic, 64)
+    for (u = 0; u < nkeys; ++u) {
+        connected_singles(index, index->keys[u], norb, nelec, occ, vir, tmp, singles + loc[u]);
+    }
+
+    free(occ);
+    free(tmp);
+
+    } // end omp
+
+    *loc_ = loc;
+    *singles_ = singles;
+
+}
+
+static void hci_connect_build(HCIConnect *con, uint64_t *strs, uint64_t ndet, int norb, int neleca, int nelecb) {
 
-    size_t ip, jp, p;
     int nset = (norb + 63) / 64;
- 
-    // Calculate excitation level for prescreening
-    ts[0] = 0;
-    uint64_t *str1a = strs;
-    uint64_t *str1b = strs + nset;
-    #pragma omp for schedule(static)
-    for (ip = 1; ip < ndet; ++ip) {
-        uint64_t *stria = strs + ip * 2 * nset;
-        uint64_t *strib = strs + ip * 2 * nset + nset;
-        ts[ip] = (n_excitations(stria, str1a, nset) + n_excitations(strib, str1b, nset));
+
+    con->nset = nset;
+    con->strs = strs;
+    con->aid = malloc(sizeof(uint64_t) * (ndet + 1));
+    con->bid = malloc(sizeof(uint64_t) * (ndet + 1));
+    // The determinants are unique.  aid is used as a scratch for their ids
+    str_index_build(&con->dindex, strs, ndet, 2 * nset, 2 * nset, con->aid);
+    str_index_build(&con->aindex, strs, ndet, 2 * nset, nset, con->aid);
+    str_index_build(&con->bindex, strs + nset, ndet, 2 * nset, nset, con->bid);
+    make_buckets(con->aid, ndet, con->aindex.nkeys, &con->abucket_loc, &con->abucket);
+    make_buckets(con->bid, ndet, con->bindex.nkeys, &con->bbucket_loc, &con->bbucket);
+    make_singles(&con->aindex, norb, neleca, &con->asingles_loc, &con->asingles);
+    make_singles(&con->bindex, norb, nelecb, &con->bsingles_loc, &con->bsingles);
+
+}
+
+// Index of the determinant (stra, strb), -1 if it is not in the CI space
+static int64_t lookup_det(HCIConnect *con, uint64_t *stra, uint64_t *strb, uint64_t *key) {
+
+    int nset = con->nset;
+    int k;
+
+    for (k = 0; k < nset; ++k) {
+        key[k] = stra[k];
+        key[nset + k] = strb[k];
     }
+    int64_t addr = str_index_lookup(&con->dindex, key);
+    if (addr == HASH_EMPTY) return HASH_EMPTY;
 
-    // Loop over pairs of determinants
-    #pragma omp for schedule(static)
+    return (con->dindex.keys[addr] - con->strs) / (2 * nset);
+
+}
+
+static void hci_connect_del(HCIConnect *con) {
+
+    str_index_del(&con->dindex);
+    str_index_del(&con->aindex);
+    str_index_del(&con->bindex);
+    free(con->aid);
+    free(con->bid);
+    free(con->abucket_loc);
+    free(con->abucket);
+    free(con->bbucket_loc);
+    free(con->bbucket);
+    free(con->asingles_loc);
+    free(con->asingles);
+    free(con->bsingles_loc);
+    free(con->bsingles);
+
+}
+
+// <I|H|J> of a single excitation i->a.  occs are the occupied orbitals of the
+// excited spin, occo the occupied orbitals of the other spin in I.
+static double single_element(double *h1, double *eri, int norb, int i, int a, int *occs, int nelecs, int *occo, int neleco) {
+
+    size_t p;
+    size_t n2 = (size_t) norb * norb;
+    size_t n3 = n2 * norb;
+    double fai = h1[a * norb + i];
+
+    for (p = 0; p < nelecs; ++p) {
+        size_t k = occs[p];
+        fai += eri[k * n3 + k * n2 + a * norb + i] - eri[k * n3 + i * n2 + a * norb + k];
+    }
+    for (p = 0; p < neleco; ++p) {
+        size_t k = occo[p];
+        fai += eri[k * n3 + k * n2 + a * norb + i];
+    }
+
+    return fai;
+
+}
+
+// sign * <I|H|J> of a same-spin double excitation from stri to strj
+static double double_element(double *eri, int norb, uint64_t *stri, uint64_t *strj, int nset) {
+
+    int ijab[4];
+    size_t n2 = (size_t) norb * norb;
+    size_t n3 = n2 * norb;
+    double v, sign;
+
+    FCIbs_double_excitation(stri, strj, nset, ijab);
+    size_t i = ijab[0];
+    size_t j = ijab[1];
+    size_t a = ijab[2];
+    size_t b = ijab[3];
+    size_t ajbi = a * n3 + j * n2 + b * norb + i;
+    size_t aibj = a * n3 + i * n2 + b * norb + j;
+    if (a > j || i > b) {
+        v = eri[ajbi] - eri[aibj];
+        sign = FCIbs_cre_des_sign(b, i, stri, nset);
+        sign *= FCIbs_cre_des_sign(a, j, stri, nset);
+    }
+    else {
+        v = eri[aibj] - eri[ajbi];
+        sign = FCIbs_cre_des_sign(b, j, stri, nset);
+        sign *= FCIbs_cre_des_sign(a, i, stri, nset);
+    }
+
+    return sign * v;
+
+}
+
+// sign * <I|H|J> of a same-spin single excitation from stri to strj
+static double single_term(double *h1, double *eri, int norb, uint64_t *stri, uint64_t *strj, int nset, int *occs, int nelecs, int *occo, int neleco) {
+
+    int ia[2];
+
+    FCIbs_single_excitation(stri, strj, nset, ia);
+    double fai = single_element(h1, eri, norb, ia[0], ia[1], occs, nelecs, occo, neleco);
+    if (fabs(fai) > 1.0E-14) {
+        return FCIbs_cre_des_sign(ia[1], ia[0], stri, nset) * fai;
+    }
+
+    return 0.0;
+
+}
+
+// alpha,beta->alpha,beta contributions of determinant J to H * C (hc) and
+// S2 * C (ssc).  hc or ssc can be NULL.
+static void ab_double_term(double *eri, int norb, uint64_t *stria, uint64_t *strib, uint64_t *strja, uint64_t *strjb, int nset, double cj, double *hc, double *ssc) {
+
+    int ia[2], jb[2];
+
+    FCIbs_single_excitation(stria, strja, nset, ia);
+    FCIbs_single_excitation(strib, strjb, nset, jb);
+    size_t i = ia[0];
+    size_t a = ia[1];
+    size_t j = jb[0];
+    size_t b = jb[1];
+    double sign = FCIbs_cre_des_sign(a, i, stria, nset);
+    sign *= FCIbs_cre_des_sign(b, j, strib, nset);
+    if (hc != NULL) {
+        double v = eri[((a * norb + i) * norb + b) * norb + j];
+        if (fabs(v) > 1.0E-14) *hc += sign * v * cj;
+    }
+    // S^2
+    if (ssc != NULL && i == b && j == a) {
+        *ssc -= sign * cj;
+    }
+
+}
+
+// Sum of sign * <I|H|J> C_J over the same-spin (spin = 0 for alpha, 1 for
+// beta) double excitations J of I = (stria, strib) found in the CI space
+static double doubles_lookup(HCIConnect *con, double *eri, int norb, uint64_t *stria, uint64_t *strib, int spin, int *occ, int nocc, int *vir, int nvir, double *civec, uint64_t *strj, uint64_t *key) {
+
+    int nset = con->nset;
+    uint64_t *stri = (spin == 0) ? stria : strib;
+    int i, j, a, b, k;
+    int64_t jp;
+    double hc = 0.0;
+
+    for (i = 1; i < nocc; ++i) {
+    for (j = 0; j < i; ++j) {
+    for (a = 1; a < nvir; ++a) {
+    for (b = 0; b < a; ++b) {
+        for (k = 0; k < nset; ++k) strj[k] = stri[k];
+        FCIbs_flip(strj, nset, occ[i]);
+        FCIbs_flip(strj, nset, occ[j]);
+        FCIbs_flip(strj, nset, vir[a]);
+        FCIbs_flip(strj, nset, vir[b]);
+        if (spin == 0) jp = lookup_det(con, strj, strib, key);
+        else           jp = lookup_det(con, stria, strj, key);
+        if (jp != HASH_EMPTY) {
+            double v = double_element(eri, norb, stri, strj, nset);
+            if (fabs(v) > 1.0E-14) hc += v * civec[jp];
+        }
+    } } } }
+
+    return hc;
+
+}
+
+// ci1 += H * C and ci2 += S2 * C (ci1 or ci2 can be NULL).  For each
+// determinant I the connected determinants J are enumerated from the
+// connectivity lists:
+//   same alpha string                 -> beta singles, beta-beta doubles
+//   same beta string                  -> alpha-alpha doubles
+//   alpha string connected by singles -> alpha singles, alpha-beta doubles
+// When a determinant list is longer than the number of possible excitations
+// the excitations are generated and searched in the determinant index
+// instead.  The cost is linear in the number of determinants.  Each row of
+// ci1 and ci2 is owned by one thread.
+static void contract_connected(double *h1, double *eri, int norb, int neleca, int nelecb, uint64_t *strs, double *civec, double *hdiag, uint64_t ndet, double *ci1, double *ci2) {
+
+    int nset = (norb + 63) / 64;
+    int nvira = norb - neleca;
+    int nvirb = norb - nelecb;
+    uint64_t nadoubles = (uint64_t) neleca * (neleca - 1) / 2 * nvira * (nvira - 1) / 2;
+    uint64_t nbdoubles = (uint64_t) nelecb * (nelecb - 1) / 2 * nvirb * (nvirb - 1) / 2;
+    HCIConnect con;
+    hci_connect_build(&con, strs, ndet, norb, neleca, nelecb);
+
+    #pragma omp parallel default(none) shared(h1, eri, norb, neleca, nelecb, strs, civec, hdiag, ndet, ci1, ci2, nset, nvira, nvirb, nadoubles, nbdoubles, con)
+    {
+
+    size_t ip, jp, k, l, m;
+    int64_t jq;
+    int *occsa = malloc(sizeof(int) * (norb * 2 + 1));
+    int *vira = occsa + neleca;
+    int *occsb = vira + nvira;
+    int *virb = occsb + nelecb;
+    uint64_t *strj = malloc(sizeof(uint64_t) * nset * 3);
+    uint64_t *key = strj + nset;
+    double apb = (double) (neleca + nelecb);
+    double amb = (double) (neleca - nelecb);
+    double ss_diag = apb / 2.0 + amb * amb / 4.0;
+
+    #pragma omp for schedule(dynamic, 16)
     for (ip = 0; ip < ndet; ++ip) {
-        for (jp = 0; jp < ndet; ++jp) {
-            if (abs(ts[ip] - ts[jp]) < 3) {
-                uint64_t *stria = strs + ip * 2 * nset;
-                uint64_t *strib = strs + ip * 2 * nset + nset;
-                uint64_t *strja = strs + jp * 2 * nset;
-                uint64_t *strjb = strs + jp * 2 * nset + nset;
-                int n_excit_a = n_excitations(stria, strja, nset);
-                int n_excit_b = n_excitations(strib, strjb, nset);
-                // Diagonal term
-                if (ip == jp) {
-                    ci1[ip] += hdiag[ip] * civec[ip];
+        uint64_t *stria = strs + ip * 2 * nset;
+        uint64_t *strib = strs + ip * 2 * nset + nset;
+        uint64_t ua = con.aid[ip];
+        uint64_t ub = con.bid[ip];
+        uint64_t nbsingles = con.bsingles_loc[ub + 1] - con.bsingles_loc[ub];
+        uint64_t *bsingles = con.bsingles + con.bsingles_loc[ub];
+        uint64_t nbucket;
+        double hc = 0.0;
+        double ssc = 0.0;
+        double *phc = (ci1 != NULL) ? &hc : NULL;
+        double *pssc = (ci2 != NULL) ? &ssc : NULL;
+        occ_vir_list(stria, nset, norb, occsa, vira);
+        occ_vir_list(strib, nset, norb, occsb, virb);
+
+        // Diagonal term
+        if (ci1 != NULL) {
+            hc += hdiag[ip] * civec[ip];
+        }
+        if (ci2 != NULL) {
+            int ndocc = 0;
+            for (k = 0; k < nset; ++k) ndocc += FCIbs_popcount64(stria[k] & strib[k]);
+            ssc += (ss_diag - ndocc) * civec[ip];
+        }
+
+        if (ci1 != NULL) {
+            // beta->beta and beta,beta->beta,beta
+            nbucket = con.abucket_loc[ua + 1] - con.abucket_loc[ua];
+            if (nbucket <= LOOKUP_COST * (nbsingles + nbdoubles)) {
+                for (k = con.abucket_loc[ua]; k < con.abucket_loc[ua + 1]; ++k) {
+                    jp = con.abucket[k];
+                    if (jp == ip) continue;
+                    uint64_t *strjb = strs + jp * 2 * nset + nset;
+                    int n_excit_b = n_excitations(strib, strjb, nset);
+                    if (n_excit_b == 1) {
+                        hc += single_term(h1, eri, norb, strib, strjb, nset, occsb, nelecb, occsa, neleca) * civec[jp];
+                    }
+                    else if (n_excit_b == 2) {
+                        double v = double_element(eri, norb, strib, strjb, nset);
+                        if (fabs(v) > 1.0E-14) hc += v * civec[jp];
+                    }
                 }
-                // Single excitation
-                else if ((n_excit_a + n_excit_b) == 1) {
-                    int *ia;
-                    // alpha->alpha
-                    if (n_excit_b == 0) {
-                        ia = get_single_excitation(stria, strja, nset);
-                        int i = ia[0];
-                        int a = ia[1];
-                        double sign = compute_cre_des_sign(a, i, stria, nset);
-                        int *occsa = compute_occ_list(stria, nset, norb, neleca);
-                        int *occsb = compute_occ_list(strib, nset, norb, nelecb);
-                        double fai = h1[a * norb + i];
-                        for (p = 0; p < neleca; ++p) {
-                            int k = occsa[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            int kiak = k * norb * norb * norb + i * norb * norb + a * norb + k;
-                            fai += eri[kkai] - eri[kiak];
-                        }
-                        for (p = 0; p < nelecb; ++p) {
-                            int k = occsb[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            fai += eri[kkai];
-                        }
-                        if (fabs(fai) > 1.0E-14) ci1[ip] += sign * fai * civec[jp];
-                        free(occsa);
-                        free(occsb);
+            }
+            else {
+                for (m = 0; m < nbsingles; ++m) {
+                    uint64_t *strjb = con.bindex.keys[bsingles[m]];
+                    jq = lookup_det(&con, stria, strjb, key);
+                    if (jq != HASH_EMPTY) {
+                        hc += single_term(h1, eri, norb, strib, strjb, nset, occsb, nelecb, occsa, neleca) * civec[jq];
                     }
-                    // beta->beta
-                    else if (n_excit_a == 0) {
-                        ia = get_single_excitation(strib, strjb, nset);
-                        int i = ia[0];
-                        int a = ia[1];
-                        double sign = compute_cre_des_sign(a, i, strib, nset);
-                        int *occsa = compute_occ_list(stria, nset, norb, neleca);
-                        int *occsb = compute_occ_list(strib, nset, norb, nelecb);
-                        double fai = h1[a * norb + i];
-                        for (p = 0; p < nelecb; ++p) {
-                            int k = occsb[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            int kiak = k * norb * norb * norb + i * norb * norb + a * norb + k;
-                            fai += eri[kkai] - eri[kiak];
-                        }
-                        for (p = 0; p < neleca; ++p) {
-                            int k = occsa[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            fai += eri[kkai];
-                        }
-                        if (fabs(fai) > 1.0E-14) ci1[ip] += sign * fai * civec[jp];
-                        free(occsa);
-                        free(occsb);
+                }
+                hc += doubles_lookup(&con, eri, norb, stria, strib, 1, occsb, nelecb, virb, nvirb, civec, strj, key);
+            }
+
+            // alpha,alpha->alpha,alpha
+            nbucket = con.bbucket_loc[ub + 1] - con.bbucket_loc[ub];
+            if (nbucket <= LOOKUP_COST * nadoubles) {
+                for (k = con.bbucket_loc[ub]; k < con.bbucket_loc[ub + 1]; ++k) {
+                    jp = con.bbucket[k];
+                    if (con.aid[jp] == ua) continue;
+                    uint64_t *strja = strs + jp * 2 * nset;
+                    if (n_excitations(stria, strja, nset) == 2) {
+                        double v = double_element(eri, norb, stria, strja, nset);
+                        if (fabs(v) > 1.0E-14) hc += v * civec[jp];
                     }
-                   free(ia);
                 }
-                // Double excitation
-                else if ((n_excit_a + n_excit_b) == 2) {
-                    int i, j, a, b;
-                    // alpha,alpha->alpha,alpha
-                    if (n_excit_b == 0) {
-	                int *ijab = get_double_excitation(stria, strja, nset);
-                        i = ijab[0]; j = ijab[1]; a = ijab[2]; b = ijab[3];
-                        double v, sign;
-                        int ajbi = a * norb * norb * norb + j * norb * norb + b * norb + i;
-                        int aibj = a * norb * norb * norb + i * norb * norb + b * norb + j;
-                        if (a > j || i > b) {
-                            v = eri[ajbi] - eri[aibj];
-                            sign = compute_cre_des_sign(b, i, stria, nset);
-                            sign *= compute_cre_des_sign(a, j, stria, nset);
-                        } 
-                        else {
-                            v = eri[aibj] - eri[ajbi];
-                            sign = compute_cre_des_sign(b, j, stria, nset);
-                            sign *= compute_cre_des_sign(a, i, stria, nset);
-                        }
-                        if (fabs(v) > 1.0E-14) ci1[ip] += sign * v * civec[jp];
-                        free(ijab);
+            }
+            else {
+                hc += doubles_lookup(&con, eri, norb, stria, strib, 0, occsa, neleca, vira, nvira, civec, strj, key);
+            }
+        }
+
+        // alpha->alpha and alpha,beta->alpha,beta
+        for (l = con.asingles_loc[ua]; l < con.asingles_loc[ua + 1]; ++l) {
+            uint64_t uj = con.asingles[l];
+            uint64_t *strja = con.aindex.keys[uj];
+            nbucket = con.abucket_loc[uj + 1] - con.abucket_loc[uj];
+            if (nbucket <= LOOKUP_COST * (nbsingles + 1)) {
+                for (k = con.abucket_loc[uj]; k < con.abucket_loc[uj + 1]; ++k) {
+                    jp = con.abucket[k];
+                    uint64_t *strjb = strs + jp * 2 * nset + nset;
+                    int n_excit_b = n_excitations(strib, strjb, nset);
+                    if (n_excit_b == 0 && ci1 != NULL) {
+                        hc += single_term(h1, eri, norb, stria, strja, nset, occsa, neleca, occsb, nelecb) * civec[jp];
                     }
-                    // beta,beta->beta,beta
-                    else if (n_excit_a == 0) {
-	                int *ijab = get_double_excitation(strib, strjb, nset);
-                        i = ijab[0]; j = ijab[1]; a = ijab[2]; b = ijab[3];
-                        double v, sign;
-                        int ajbi = a * norb * norb * norb + j * norb * norb + b * norb + i;
-                        int aibj = a * norb * norb * norb + i * norb * norb + b * norb + j;
-                        if (a > j || i > b) {
-                            v = eri[ajbi] - eri[aibj];
-                            sign = compute_cre_des_sign(b, i, strib, nset);
-                            sign *= compute_cre_des_sign(a, j, strib, nset);
-                        } 
-                        else {
-                            v = eri[aibj] - eri[ajbi];
-                            sign = compute_cre_des_sign(b, j, strib, nset);
-                            sign *= compute_cre_des_sign(a, i, strib, nset);
-                        }
-                        if (fabs(v) > 1.0E-14) ci1[ip] += sign * v * civec[jp];
-                        free(ijab);
+                    else if (n_excit_b == 1) {
+                        ab_double_term(eri, norb, stria, strib, strja, strjb, nset, civec[jp], phc, pssc);
                     }
-                    // alpha,beta->alpha,beta
-                    else {
-                        int *ia = get_single_excitation(stria, strja, nset);
-                        int *jb = get_single_excitation(strib, strjb, nset);
-                        i = ia[0]; a = ia[1]; j = jb[0]; b = jb[1];
-                        double v = eri[a * norb * norb * norb + i * norb * norb + b * norb + j];
-                        double sign = compute_cre_des_sign(a, i, stria, nset);
-                        sign *= compute_cre_des_sign(b, j, strib, nset);
-                        if (fabs(v) > 1.0E-14) ci1[ip] += sign * v * civec[jp];
-                        free(ia);
-                        free(jb);
-                   }
                 }
-            } // end if over ts
-        } // end loop over jp
-    } // end loop over ip
+            }
+            else {
+                if (ci1 != NULL) {
+                    jq = lookup_det(&con, strja, strib, key);
+                    if (jq != HASH_EMPTY) {
+                        hc += single_term(h1, eri, norb, stria, strja, nset, occsa, neleca, occsb, nelecb) * civec[jq];
+                    }
+                }
+                for (m = 0; m < nbsingles; ++m) {
+                    uint64_t *strjb = con.bindex.keys[bsingles[m]];
+                    jq = lookup_det(&con, strja, strjb, key);
+                    if (jq != HASH_EMPTY) {
+                        ab_double_term(eri, norb, stria, strib, strja, strjb, nset, civec[jq], phc, pssc);
+                    }
+                }
+            }
+        }
+
+        if (ci1 != NULL) ci1[ip] += hc;
+        if (ci2 != NULL) ci2[ip] += ssc;
+    }
+
+    free(occsa);
+    free(strj);
 
     } // end omp
-  
-    free(ts);
+
+    hci_connect_del(&con);
 
 }
 
-// Compare two strings and compute excitation level
-int n_excitations(uint64_t *str1, uint64_t *str2, int nset) {
+// Computes C' = H * C in the selected CI basis
+void contract_h_c(double *h1, double *eri, int norb, int neleca, int nelecb, uint64_t *strs, double *civec, double *hdiag, uint64_t ndet, double *ci1) {
 
-    size_t p;
-    int d = 0;
+    contract_connected(h1, eri, norb, neleca, nelecb, strs, civec, hdiag, ndet, ci1, NULL);
 
-    for (p = 0; p < nset; ++p) {
-        d += popcount(str1[p] ^ str2[p]);
-    }
+}
+
+// Compare two strings and compute excitation level
+int n_excitations(uint64_t *str1, uint64_t *str2, int nset) {
 
-    return d / 2;
+    return FCIbs_n_excitations(str1, str2, nset);
 
 }
 
 // Compute number of set bits in a string
 int popcount(uint64_t x) {
 
-    const uint64_t m1  = 0x5555555555555555; //binary: 0101...
-    const uint64_t m2  = 0x3333333333333333; //binary: 00110011..
-    const uint64_t m4  = 0x0f0f0f0f0f0f0f0f; //binary:  4 zeros,  4 ones ...
-    const uint64_t m8  = 0x00ff00ff00ff00ff; //binary:  8 zeros,  8 ones ...
-    const uint64_t m16 = 0x0000ffff0000ffff; //binary: 16 zeros, 16 ones ...
-    const uint64_t m32 = 0x00000000ffffffff; //binary: 32 zeros, 32 ones
-    x = (x & m1 ) + ((x >>  1) & m1 ); //put count of each  2 bits into those  2 bits 
-    x = (x & m2 ) + ((x >>  2) & m2 ); //put count of each  4 bits into those  4 bits 
-    x = (x & m4 ) + ((x >>  4) & m4 ); //put count of each  8 bits into those  8 bits 
-    x = (x & m8 ) + ((x >>  8) & m8 ); //put count of each 16 bits into those 16 bits 
-    x = (x & m16) + ((x >> 16) & m16); //put count of each 32 bits into those 32 bits 
-    x = (x & m32) + ((x >> 32) & m32); //put count of each 64 bits into those 64 bits 
-
-    return x;
+    return FCIbs_popcount64(x);
 
 }
 
 // Compute orbital indices for a single excitation 
 int *get_single_excitation(uint64_t *str1, uint64_t *str2, int nset) {
 
-    size_t p;
     int *ia = malloc(sizeof(int) * 2);
-
-    for (p = 0; p < nset; ++p) {
-        size_t pp = nset - p - 1;
-        uint64_t str_tmp = str1[pp] ^ str2[pp];
-        uint64_t str_particle = str_tmp & str2[pp];
-        uint64_t str_hole = str_tmp & str1[pp];
-
-        if (popcount(str_particle) == 1) {
-            ia[1] = trailz(str_particle) + 64 * p;
-        }
-       
-        if (popcount(str_hole) == 1) {
-            ia[0] = trailz(str_hole) + 64 * p;
-        }
-    }
-
+    FCIbs_single_excitation(str1, str2, nset, ia);
     return ia;
 
 }
@@ -246,44 +608,8 @@ int *get_single_excitation(uint64_t *str1, uint64_t *str2, int nset) {
 // Compute orbital indices for a double excitation 
 int *get_double_excitation(uint64_t *str1, uint64_t *str2, int nset) {
 
-    size_t p;
     int *ijab = malloc(sizeof(int) * 4);
-    int particle_ind = 2;
-    int hole_ind = 0;
-
-    for (p = 0; p < nset; ++p) {
-        size_t pp = nset - p - 1;
-        uint64_t str_tmp = str1[pp] ^ str2[pp];
-        uint64_t str_particle = str_tmp & str2[pp];
-        uint64_t str_hole = str_tmp & str1[pp];
-        int n_particle = popcount(str_particle);
-        int n_hole = popcount(str_hole);
-
-        if (n_particle == 1) {
-            ijab[particle_ind] = trailz(str_particle) + 64 * p;
-            particle_ind++;
-        }
-        else if (n_particle == 2) {
-            int a = trailz(str_particle);
-            ijab[2] = a + 64 * p;
-            str_particle &= ~(1ULL << a);
-            int b = trailz(str_particle);
-            ijab[3] = b + 64 * p;
-        }
-       
-        if (n_hole == 1) {
-            ijab[hole_ind] = trailz(str_hole) + 64 * p;
-            hole_ind++;
-        }
-        else if (n_hole == 2) {
-            int i = trailz(str_hole);
-            ijab[0] = i + 64 * p;
-            str_hole &= ~(1ULL << i);
-            int j = trailz(str_hole);
-            ijab[1] = j + 64 * p;
-        }
-    }
-
+    FCIbs_double_excitation(str1, str2, nset, ijab);
     return ijab;
 
 }
@@ -291,19 +617,8 @@ int *get_double_excitation(uint64_t *str1, uint64_t *str2, int nset) {
 // Compute number of trailing zeros in a bit string
 int trailz(uint64_t v) {
 
-    int c = 64;
-
-    // Trick to unset all bits but the first one
-    v &= -(int64_t) v;
-    if (v) c--;
-    if (v & 0x00000000ffffffff) c -= 32;
-    if (v & 0x0000ffff0000ffff) c -= 16;
-    if (v & 0x00ff00ff00ff00ff) c -= 8;
-    if (v & 0x0f0f0f0f0f0f0f0f) c -= 4;
-    if (v & 0x3333333333333333) c -= 2;
-    if (v & 0x5555555555555555) c -= 1;
-
-    return c;
+    if (v == 0) return 64;
+    return FCIbs_tzcnt64(v);
 
 }
 
@@ -328,42 +643,7 @@ char *int2bin(uint64_t i) {
 // Compute sign for a pair of creation and desctruction operators
 double compute_cre_des_sign(int p, int q, uint64_t *str, int nset) {
 
-    double sign;
-    int nperm;
-    size_t i;
-
-    int pg = p / 64;
-    int qg = q / 64;
-    int pb = p % 64;
-    int qb = q % 64;
-
-    if (pg > qg) {
-        nperm = 0;
-        for (i = nset-pg; i < nset-qg-1; ++i) {
-            nperm += popcount(str[i]);
-        }
-        nperm += popcount(str[nset -1 - pg] & ((1ULL << pb) - 1));
-        nperm += str[nset -1 - qg] >> (qb + 1);
-    }
-    else if (pg < qg) {
-        nperm = 0;
-        for (i = nset-qg; i < nset-pg-1; ++i) {
-            nperm += popcount(str[i]);
-        }
-        nperm += popcount(str[nset -1 - qg] & ((1ULL << qb) - 1));
-        nperm += str[nset -1 - pg] >> (pb + 1);
-    }
-    else {
-        uint64_t mask;
-        if (p > q) mask = (1ULL << pb) - (1ULL << (qb + 1));
-        else       mask = (1ULL << qb) - (1ULL << (pb + 1));
-        nperm = popcount(str[nset -1 - pg] & mask);
-    }
-
-    if (nperm % 2) sign = -1.0;
-    else           sign = 1.0;
-
-    return sign;
+    return FCIbs_cre_des_sign(p, q, str, nset);
 
 }
 
@@ -707,6 +987,435 @@ void select_strs(double *h1, double *eri, double *jk, uint64_t *eri_sorted, uint
 
 }
 
+// Candidate determinants selected by one thread.  Open-addressing hash set of
+// keys of keylen words stored in place.
+typedef struct {
+    int keylen;
+    uint64_t mask;
+    uint64_t count;
+    uint64_t *keys;
+    char *used;
+} CandSet;
+
+static void cand_set_init(CandSet *set, int keylen, uint64_t size) {
+
+    set->keylen = keylen;
+    set->mask = size - 1;
+    set->count = 0;
+    set->keys = malloc(sizeof(uint64_t) * size * keylen);
+    set->used = calloc(size, sizeof(char));
+
+}
+
+static void cand_set_del(CandSet *set) {
+
+    free(set->keys);
+    free(set->used);
+
+}
+
+static void cand_set_add(CandSet *set, uint64_t *key);
+
+static void cand_set_grow(CandSet *set) {
+
+    size_t p;
+    CandSet old = *set;
+
+    cand_set_init(set, old.keylen, (old.mask + 1) * 2);
+    for (p = 0; p <= old.mask; ++p) {
+        if (old.used[p]) cand_set_add(set, old.keys + p * old.keylen);
+    }
+    cand_set_del(&old);
+
+}
+
+static void cand_set_add(CandSet *set, uint64_t *key) {
+
+    int keylen = set->keylen;
+    uint64_t h = hash_str(key, keylen) & set->mask;
+    int k;
+
+    while (set->used[h]) {
+        if (FCIbs_equal(set->keys + h * keylen, key, keylen)) return;
+        h = (h + 1) & set->mask;
+    }
+    for (k = 0; k < keylen; ++k) set->keys[h * keylen + k] = key[k];
+    set->used[h] = 1;
+    set->count++;
+    if (set->count * 2 > set->mask) cand_set_grow(set);
+
+}
+
+// Number of the leading elements of the sorted table with |tab| >= tol
+static uint64_t sorted_cutoff(double *tab, uint64_t *sorted, uint64_t n, double tol) {
+
+    uint64_t lo = 0;
+    uint64_t hi = n;
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (fabs(tab[sorted[mid]]) < tol) hi = mid;
+        else lo = mid + 1;
+    }
+
+    return lo;
+
+}
+
+// Add the determinants connected to (stra, strb) with |H_IJ| > tol to the
+// candidates.  Singles are screened with the Fock matrix, doubles with the
+// sorted integrals.
+static void select_from_det(double *focka, double *fockb, double *eri, double *jk, uint64_t *eri_sorted, uint64_t *jk_sorted, int norb, int neleca, int nelecb, uint64_t *stra, uint64_t *strb, double tol, uint64_t ncut_eri, uint64_t ncut_jk, int *buf, uint64_t *key, CandSet *set) {
+
+    size_t p, q, r, k, a, i;
+    size_t n2 = (size_t) norb * norb;
+    size_t n3 = n2 * norb;
+    int nset = (norb + 63) / 64;
+    uint64_t *keya = key;
+    uint64_t *keyb = key + nset;
+    int *occsa = buf;
+    int *virsa = occsa + neleca;
+    int *occsb = virsa + norb - neleca;
+    int *virsb = occsb + nelecb;
+    int *holes_a = virsb + norb - nelecb;
+    int *particles_a = holes_a + norb;
+    int *holes_b = particles_a + norb;
+    int *particles_b = holes_b + norb;
+    int n_holes_a = 0;
+    int n_holes_b = 0;
+    int n_particles_a = 0;
+    int n_particles_b = 0;
+
+    occ_vir_list(stra, nset, norb, occsa, virsa);
+    occ_vir_list(strb, nset, norb, occsb, virsb);
+    for (p = 0; p < (norb - neleca); ++p) {
+        if (virsa[p] < neleca) holes_a[n_holes_a++] = virsa[p];
+    }
+    for (p = 0; p < neleca; ++p) {
+        if (occsa[p] >= neleca) particles_a[n_particles_a++] = occsa[p];
+    }
+    for (p = 0; p < (norb - nelecb); ++p) {
+        if (virsb[p] < nelecb) holes_b[n_holes_b++] = virsb[p];
+    }
+    for (p = 0; p < nelecb; ++p) {
+        if (occsb[p] >= nelecb) particles_b[n_particles_b++] = occsb[p];
+    }
+
+    // alpha->alpha
+    for (p = 0; p < neleca; ++p) {
+        i = occsa[p];
+        for (q = 0; q < (norb - neleca); ++q) {
+            a = virsa[q];
+            double fai = focka[a * norb + i];
+            for (r = 0; r < n_particles_a; ++r) {
+                k = particles_a[r];
+                fai += jk[k * n3 + k * n2 + a * norb + i];
+            }
+            for (r = 0; r < n_holes_a; ++r) {
+                k = holes_a[r];
+                fai -= jk[k * n3 + k * n2 + a * norb + i];
+            }
+            for (r = 0; r < n_particles_b; ++r) {
+                k = particles_b[r];
+                fai += eri[k * n3 + k * n2 + a * norb + i];
+            }
+            for (r = 0; r < n_holes_b; ++r) {
+                k = holes_b[r];
+                fai -= eri[k * n3 + k * n2 + a * norb + i];
+            }
+            if (fabs(fai) > tol) {
+                for (k = 0; k < nset; ++k) {
+                    keya[k] = stra[k];
+                    keyb[k] = strb[k];
+                }
+                FCIbs_flip(keya, nset, a);
+                FCIbs_flip(keya, nset, i);
+                cand_set_add(set, key);
+            }
+        }
+    }
+
+    // beta->beta
+    for (p = 0; p < nelecb; ++p) {
+        i = occsb[p];
+        for (q = 0; q < (norb - nelecb); ++q) {
+            a = virsb[q];
+            double fai = fockb[a * norb + i];
+            for (r = 0; r < n_particles_b; ++r) {
+                k = particles_b[r];
+                fai += jk[k * n3 + k * n2 + a * norb + i];
+            }
+            for (r = 0; r < n_holes_b; ++r) {
+                k = holes_b[r];
+                fai -= jk[k * n3 + k * n2 + a * norb + i];
+            }
+            for (r = 0; r < n_particles_a; ++r) {
+                k = particles_a[r];
+                fai += eri[k * n3 + k * n2 + a * norb + i];
+            }
+            for (r = 0; r < n_holes_a; ++r) {
+                k = holes_a[r];
+                fai -= eri[k * n3 + k * n2 + a * norb + i];
+            }
+            if (fabs(fai) > tol) {
+                for (k = 0; k < nset; ++k) {
+                    keya[k] = stra[k];
+                    keyb[k] = strb[k];
+                }
+                FCIbs_flip(keyb, nset, a);
+                FCIbs_flip(keyb, nset, i);
+                cand_set_add(set, key);
+            }
+        }
+    }
+
+    // alpha,alpha->alpha,alpha and beta,beta->beta,beta.  The entries of
+    // jk_sorted beyond ncut_jk are smaller than tol.
+    for (p = 0; p < ncut_jk; ++p) {
+        size_t ih = jk_sorted[p];
+        size_t lp = ih % norb;
+        size_t kp = ih / norb % norb;
+        size_t jp = ih / n2 % norb;
+        size_t ip = ih / n3;
+        if (ip == kp || jp == lp) continue;
+        if (FCIbs_test(stra, nset, jp) && FCIbs_test(stra, nset, lp) &&
+            !FCIbs_test(stra, nset, ip) && !FCIbs_test(stra, nset, kp)) {
+            for (k = 0; k < nset; ++k) {
+                keya[k] = stra[k];
+                keyb[k] = strb[k];
+            }
+            FCIbs_flip(keya, nset, jp);
+            FCIbs_flip(keya, nset, ip);
+            FCIbs_flip(keya, nset, lp);
+            FCIbs_flip(keya, nset, kp);
+            cand_set_add(set, key);
+        }
+        if (FCIbs_test(strb, nset, jp) && FCIbs_test(strb, nset, lp) &&
+            !FCIbs_test(strb, nset, ip) && !FCIbs_test(strb, nset, kp)) {
+            for (k = 0; k < nset; ++k) {
+                keya[k] = stra[k];
+                keyb[k] = strb[k];
+            }
+            FCIbs_flip(keyb, nset, jp);
+            FCIbs_flip(keyb, nset, ip);
+            FCIbs_flip(keyb, nset, lp);
+            FCIbs_flip(keyb, nset, kp);
+            cand_set_add(set, key);
+        }
+    }
+
+    // alpha,beta->alpha,beta
+    for (p = 0; p < ncut_eri; ++p) {
+        size_t ih = eri_sorted[p];
+        size_t lp = ih % norb;
+        size_t kp = ih / norb % norb;
+        size_t jp = ih / n2 % norb;
+        size_t ip = ih / n3;
+        if (FCIbs_test(stra, nset, jp) && !FCIbs_test(stra, nset, ip) &&
+            FCIbs_test(strb, nset, lp) && !FCIbs_test(strb, nset, kp)) {
+            for (k = 0; k < nset; ++k) {
+                keya[k] = stra[k];
+                keyb[k] = strb[k];
+            }
+            FCIbs_flip(keya, nset, jp);
+            FCIbs_flip(keya, nset, ip);
+            FCIbs_flip(keyb, nset, lp);
+            FCIbs_flip(keyb, nset, kp);
+            cand_set_add(set, key);
+        }
+    }
+
+}
+
+// Sort n keys of keylen words in ascending order (the first word is the most
+// significant).  LSD radix sort on bytes.  Each pass is distributed over
+// threads in contiguous chunks; the passes in which all keys have the same
+// byte are skipped.
+static void radix_sort_keys(uint64_t *keys, uint64_t n, int keylen) {
+
+    if (n <= 1) return;
+
+    uint64_t *buf = malloc(sizeof(uint64_t) * n * keylen);
+    uint64_t *hist = malloc(sizeof(uint64_t) * MAX_THREADS * 256);
+    uint64_t *src = keys;
+    uint64_t *dst = buf;
+    uint64_t *tmp;
+    int w, shift, skip;
+
+    for (w = keylen - 1; w >= 0; --w) {
+    for (shift = 0; shift < 64; shift += 8) {
+        #pragma omp parallel default(none) shared(src, dst, n, keylen, w, shift, hist, skip)
+        {
+        int nthreads = omp_get_num_threads();
+        int tid = omp_get_thread_num();
+        uint64_t i0 = n * tid / nthreads;
+        uint64_t i1 = n * (tid + 1) / nthreads;
+        uint64_t *h = hist + tid * 256;
+        uint64_t i, d;
+        int t, k;
+
+        memset(h, 0, sizeof(uint64_t) * 256);
+        for (i = i0; i < i1; ++i) {
+            h[(src[i * keylen + w] >> shift) & 0xff]++;
+        }
+        #pragma omp barrier
+        #pragma omp single
+        {
+        uint64_t off = 0;
+        skip = 0;
+        for (d = 0; d < 256; ++d) {
+            uint64_t total = 0;
+            for (t = 0; t < nthreads; ++t) total += hist[t * 256 + d];
+            if (total == n) skip = 1;
+        }
+        for (d = 0; d < 256; ++d) {
+            for (t = 0; t < nthreads; ++t) {
+                uint64_t c = hist[t * 256 + d];
+                hist[t * 256 + d] = off;
+                off += c;
+            }
+        }
+        }
+        if (!skip) {
+            for (i = i0; i < i1; ++i) {
+                d = (src[i * keylen + w] >> shift) & 0xff;
+                uint64_t *pdst = dst + h[d] * keylen;
+                for (k = 0; k < keylen; ++k) pdst[k] = src[i * keylen + k];
+                h[d]++;
+            }
+        }
+        } // end omp
+        if (!skip) {
+            tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+    } }
+
+    if (src != keys) memcpy(keys, src, sizeof(uint64_t) * n * keylen);
+    free(buf);
+    free(hist);
+
+}
+
+// Heat-bath selection of the determinants connected to the CI space strs.
+// civec holds max_root |C_I|.  The selected determinants are unique and not
+// in strs.  They are written to strs_add in ascending order (at most
+// strs_add_size[0] of them); the total number of the selected determinants
+// is returned in strs_add_size[0].
+void select_strs_uniq(double *h1, double *eri, double *jk, uint64_t *eri_sorted, uint64_t *jk_sorted, int norb, int neleca, int nelecb, uint64_t *strs, double *civec, uint64_t ndet, double select_cutoff, uint64_t *strs_add, uint64_t *strs_add_size) {
+
+    size_t p, q, i;
+
+    uint64_t max_strs_add = strs_add_size[0];
+    int nset = (norb + 63) / 64;
+    int keylen = nset * 2;
+    uint64_t n4 = (uint64_t) norb * norb * norb * norb;
+    uint64_t counts[MAX_THREADS + 1];
+    uint64_t *cands = NULL;
+
+    // Compute Fock intermediates
+    double *focka = malloc(sizeof(double) * norb * norb);
+    double *fockb = malloc(sizeof(double) * norb * norb);
+    for (p = 0; p < norb; ++p) {
+        for (q = 0; q < norb; ++q) {
+            double vja = 0.0;
+            double vka = 0.0;
+            for (i = 0; i < neleca; ++i) {
+                size_t iipq = i * norb * norb * norb + i * norb * norb + p * norb + q;
+                size_t piiq = p * norb * norb * norb + i * norb * norb + i * norb + q;
+                vja += eri[iipq];
+                vka += eri[piiq];
+            }
+            double vjb = 0.0;
+            double vkb = 0.0;
+            for (i = 0; i < nelecb; ++i) {
+                size_t iipq = i * norb * norb * norb + i * norb * norb + p * norb + q;
+                size_t piiq = p * norb * norb * norb + i * norb * norb + i * norb + q;
+                vjb += eri[iipq];
+                vkb += eri[piiq];
+            }
+            focka[p * norb + q] = h1[p * norb + q] + vja + vjb - vka;
+            fockb[p * norb + q] = h1[p * norb + q] + vja + vjb - vkb;
+        }
+    }
+
+    StrIndex dets;
+    uint64_t *ids = malloc(sizeof(uint64_t) * (ndet + 1));
+    str_index_build(&dets, strs, ndet, keylen, keylen, ids);
+    free(ids);
+
+    #pragma omp parallel default(none) shared(h1, eri, jk, eri_sorted, jk_sorted, norb, neleca, nelecb, strs, civec, ndet, select_cutoff, nset, keylen, n4, counts, cands, focka, fockb, dets)
+    {
+
+    int tid = omp_get_thread_num();
+    int nthreads = omp_get_num_threads();
+    size_t idet, p, h;
+    int *buf = malloc(sizeof(int) * (norb * 6 + 1));
+    uint64_t *key = malloc(sizeof(uint64_t) * keylen);
+    CandSet set;
+    cand_set_init(&set, keylen, 1024);
+
+    #pragma omp for schedule(dynamic, 4)
+    for (idet = 0; idet < ndet; ++idet) {
+        if (civec[idet] == 0) continue;
+        double tol = select_cutoff / fabs(civec[idet]);
+        uint64_t ncut_eri = sorted_cutoff(eri, eri_sorted, n4, tol);
+        uint64_t ncut_jk = sorted_cutoff(jk, jk_sorted, n4, tol);
+        select_from_det(focka, fockb, eri, jk, eri_sorted, jk_sorted, norb, neleca, nelecb,
+                        strs + idet * keylen, strs + idet * keylen + nset,
+                        tol, ncut_eri, ncut_jk, buf, key, &set);
+    }
+
+    // Remove the determinants of the CI space and merge the candidates of all
+    // threads
+    uint64_t nkept = 0;
+    for (h = 0; h <= set.mask; ++h) {
+        if (set.used[h] && str_index_lookup(&dets, set.keys + h * keylen) == HASH_EMPTY) {
+            for (p = 0; p < keylen; ++p) set.keys[nkept * keylen + p] = set.keys[h * keylen + p];
+            nkept++;
+        }
+    }
+    counts[tid + 1] = nkept;
+    #pragma omp barrier
+    #pragma omp single
+    {
+    counts[0] = 0;
+    for (p = 0; p < nthreads; ++p) counts[p + 1] += counts[p];
+    cands = malloc(sizeof(uint64_t) * (counts[nthreads] * keylen + 1));
+    }
+    memcpy(cands + counts[tid] * keylen, set.keys, sizeof(uint64_t) * nkept * keylen);
+    #pragma omp barrier
+    #pragma omp single
+    counts[MAX_THREADS] = counts[nthreads];
+
+    cand_set_del(&set);
+    free(buf);
+    free(key);
+
+    } // end omp
+
+    // Remove the candidates found by more than one thread
+    uint64_t ncands = counts[MAX_THREADS];
+    uint64_t nuniq = 0;
+    radix_sort_keys(cands, ncands, keylen);
+    for (p = 0; p < ncands; ++p) {
+        if (p > 0 && FCIbs_equal(cands + (p - 1) * keylen, cands + p * keylen, keylen)) continue;
+        if (nuniq < max_strs_add) {
+            for (q = 0; q < keylen; ++q) strs_add[nuniq * keylen + q] = cands[p * keylen + q];
+        }
+        nuniq++;
+    }
+
+    str_index_del(&dets);
+    free(cands);
+    free(focka);
+    free(fockb);
+
+    strs_add_size[0] = nuniq;
+
+}
+
 // Toggle bit at a specified position
 uint64_t *toggle_bit(uint64_t *str, int nset, int p) {
 
@@ -808,254 +1517,14 @@ void argunique(uint64_t *strs, uint64_t *sort_idx, uint64_t *nstrs_, int nset) {
 // Computes C' = S2 * C in the selected CI basis
 void contract_ss_c(int norb, int neleca, int nelecb, uint64_t *strs, double *civec, uint64_t ndet, double *ci1) {
 
-    int *ts = malloc(sizeof(int) * ndet);
-
-    #pragma omp parallel default(none) shared(norb, neleca, nelecb, strs, civec, ndet, ci1, ts)
-    {
-
-    size_t ip, jp, p, q;
-    int nset = (norb + 63) / 64;
- 
-    // Calculate excitation level for prescreening
-    ts[0] = 0;
-    uint64_t *str1a = strs;
-    uint64_t *str1b = strs + nset;
-    #pragma omp for schedule(static)
-    for (ip = 1; ip < ndet; ++ip) {
-        uint64_t *stria = strs + ip * 2 * nset;
-        uint64_t *strib = strs + ip * 2 * nset + nset;
-        ts[ip] = (n_excitations(stria, str1a, nset) + n_excitations(strib, str1b, nset));
-    }
-
-    // Loop over pairs of determinants
-    #pragma omp for schedule(static)
-    for (ip = 0; ip < ndet; ++ip) {
-        for (jp = 0; jp < ndet; ++jp) {
-            if (abs(ts[ip] - ts[jp]) < 3) {
-                uint64_t *stria = strs + ip * 2 * nset;
-                uint64_t *strib = strs + ip * 2 * nset + nset;
-                uint64_t *strja = strs + jp * 2 * nset;
-                uint64_t *strjb = strs + jp * 2 * nset + nset;
-                int n_excit_a = n_excitations(stria, strja, nset);
-                int n_excit_b = n_excitations(strib, strjb, nset);
-                // Diagonal term
-                if (ip == jp) {
-                    double apb = (double) (neleca + nelecb);
-                    double amb = (double) (neleca - nelecb);
-                    double prefactor = apb / 2.0 + amb * amb / 4.0;
-                    int *occsa = compute_occ_list(stria, nset, norb, neleca);
-                    int *occsb = compute_occ_list(strib, nset, norb, nelecb);
-                    for (p = 0; p < neleca; ++p) {
-                        int pa = occsa[p];
-                        for (q = 0; q < nelecb; ++q) {
-                            int qb = occsb[q];
-                            if (pa == qb) prefactor -= 1.0;
-                        }
-                    }
-                    ci1[ip] += prefactor * civec[ip];
-                    free(occsa);
-                    free(occsb);
-                }
-                // Double excitation
-                else if ((n_excit_a + n_excit_b) == 2) {
-                    int i, j, a, b;
-                    // alpha,beta->alpha,beta
-                    if (n_excit_a == n_excit_b) {
-                        int *ia = get_single_excitation(stria, strja, nset);
-                        int *jb = get_single_excitation(strib, strjb, nset);
-                        i = ia[0]; a = ia[1]; j = jb[0]; b = jb[1];
-                        if (i == b && j == a) {
-                            double sign = compute_cre_des_sign(a, i, stria, nset);
-                            sign *= compute_cre_des_sign(b, j, strib, nset);
-                            ci1[ip] -= sign * civec[jp];
-                        }
-                        free(ia);
-                        free(jb);
-                    }
-                }
-            } // end if over ts
-        } // end loop over jp
-    } // end loop over ip
-
-    } // end omp
-  
-    free(ts);
+    contract_connected(NULL, NULL, norb, neleca, nelecb, strs, civec, NULL, ndet, NULL, ci1);
 
 }
 
 // Computes C' = H * C and C'' = S2 * C simultaneously in the selected CI basis
 void contract_h_c_ss_c(double *h1, double *eri, int norb, int neleca, int nelecb, uint64_t *strs, double *civec, double *hdiag, uint64_t ndet, double *ci1, double *ci2) {
 
-    int *ts = malloc(sizeof(int) * ndet);
-
-    #pragma omp parallel default(none) shared(h1, eri, norb, neleca, nelecb, strs, civec, hdiag, ndet, ci1, ci2, ts)
-    {
-
-    size_t ip, jp, p, q;
-    int nset = (norb + 63) / 64;
- 
-    // Calculate excitation level for prescreening
-    ts[0] = 0;
-    uint64_t *str1a = strs;
-    uint64_t *str1b = strs + nset;
-    #pragma omp for schedule(static)
-    for (ip = 1; ip < ndet; ++ip) {
-        uint64_t *stria = strs + ip * 2 * nset;
-        uint64_t *strib = strs + ip * 2 * nset + nset;
-        ts[ip] = (n_excitations(stria, str1a, nset) + n_excitations(strib, str1b, nset));
-    }
-
-    // Loop over pairs of determinants
-    #pragma omp for schedule(static)
-    for (ip = 0; ip < ndet; ++ip) {
-        for (jp = 0; jp < ndet; ++jp) {
-            if (abs(ts[ip] - ts[jp]) < 3) {
-                uint64_t *stria = strs + ip * 2 * nset;
-                uint64_t *strib = strs + ip * 2 * nset + nset;
-                uint64_t *strja = strs + jp * 2 * nset;
-                uint64_t *strjb = strs + jp * 2 * nset + nset;
-                int n_excit_a = n_excitations(stria, strja, nset);
-                int n_excit_b = n_excitations(strib, strjb, nset);
-                // Diagonal term
-                if (ip == jp) {
-                    ci1[ip] += hdiag[ip] * civec[ip];
-                    // S^2
-                    double apb = (double) (neleca + nelecb);
-                    double amb = (double) (neleca - nelecb);
-                    double prefactor = apb / 2.0 + amb * amb / 4.0;
-                    int *occsa = compute_occ_list(stria, nset, norb, neleca);
-                    int *occsb = compute_occ_list(strib, nset, norb, nelecb);
-                    for (p = 0; p < neleca; ++p) {
-                        int pa = occsa[p];
-                        for (q = 0; q < nelecb; ++q) {
-                            int qb = occsb[q];
-                            if (pa == qb) prefactor -= 1.0;
-                        }
-                    }
-                    ci2[ip] += prefactor * civec[ip];
-                    free(occsa);
-                    free(occsb);
-                }
-                // Single excitation
-                else if ((n_excit_a + n_excit_b) == 1) {
-                    int *ia;
-                    // alpha->alpha
-                    if (n_excit_b == 0) {
-                        ia = get_single_excitation(stria, strja, nset);
-                        int i = ia[0];
-                        int a = ia[1];
-                        double sign = compute_cre_des_sign(a, i, stria, nset);
-                        int *occsa = compute_occ_list(stria, nset, norb, neleca);
-                        int *occsb = compute_occ_list(strib, nset, norb, nelecb);
-                        double fai = h1[a * norb + i];
-                        for (p = 0; p < neleca; ++p) {
-                            int k = occsa[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            int kiak = k * norb * norb * norb + i * norb * norb + a * norb + k;
-                            fai += eri[kkai] - eri[kiak];
-                        }
-                        for (p = 0; p < nelecb; ++p) {
-                            int k = occsb[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            fai += eri[kkai];
-                        }
-                        if (fabs(fai) > 1.0E-14) ci1[ip] += sign * fai * civec[jp];
-                        free(occsa);
-                        free(occsb);
-                    }
-                    // beta->beta
-                    else if (n_excit_a == 0) {
-                        ia = get_single_excitation(strib, strjb, nset);
-                        int i = ia[0];
-                        int a = ia[1];
-                        double sign = compute_cre_des_sign(a, i, strib, nset);
-                        int *occsa = compute_occ_list(stria, nset, norb, neleca);
-                        int *occsb = compute_occ_list(strib, nset, norb, nelecb);
-                        double fai = h1[a * norb + i];
-                        for (p = 0; p < nelecb; ++p) {
-                            int k = occsb[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            int kiak = k * norb * norb * norb + i * norb * norb + a * norb + k;
-                            fai += eri[kkai] - eri[kiak];
-                        }
-                        for (p = 0; p < neleca; ++p) {
-                            int k = occsa[p];
-                            int kkai = k * norb * norb * norb + k * norb * norb + a * norb + i;
-                            fai += eri[kkai];
-                        }
-                        if (fabs(fai) > 1.0E-14) ci1[ip] += sign * fai * civec[jp];
-                        free(occsa);
-                        free(occsb);
-                    }
-                   free(ia);
-                }
-                // Double excitation
-                else if ((n_excit_a + n_excit_b) == 2) {
-                    int i, j, a, b;
-                    // alpha,alpha->alpha,alpha
-                    if (n_excit_b == 0) {
-	                int *ijab = get_double_excitation(stria, strja, nset);
-                        i = ijab[0]; j = ijab[1]; a = ijab[2]; b = ijab[3];
-                        double v, sign;
-                        int ajbi = a * norb * norb * norb + j * norb * norb + b * norb + i;
-                        int aibj = a * norb * norb * norb + i * norb * norb + b * norb + j;
-                        if (a > j || i > b) {
-                            v = eri[ajbi] - eri[aibj];
-                            sign = compute_cre_des_sign(b, i, stria, nset);
-                            sign *= compute_cre_des_sign(a, j, stria, nset);
-                        } 
-                        else {
-                            v = eri[aibj] - eri[ajbi];
-                            sign = compute_cre_des_sign(b, j, stria, nset);
-                            sign *= compute_cre_des_sign(a, i, stria, nset);
-                        }
-                        if (fabs(v) > 1.0E-14) ci1[ip] += sign * v * civec[jp];
-                        free(ijab);
-                    }
-                    // beta,beta->beta,beta
-                    else if (n_excit_a == 0) {
-	                int *ijab = get_double_excitation(strib, strjb, nset);
-                        i = ijab[0]; j = ijab[1]; a = ijab[2]; b = ijab[3];
-                        double v, sign;
-                        int ajbi = a * norb * norb * norb + j * norb * norb + b * norb + i;
-                        int aibj = a * norb * norb * norb + i * norb * norb + b * norb + j;
-                        if (a > j || i > b) {
-                            v = eri[ajbi] - eri[aibj];
-                            sign = compute_cre_des_sign(b, i, strib, nset);
-                            sign *= compute_cre_des_sign(a, j, strib, nset);
-                        } 
-                        else {
-                            v = eri[aibj] - eri[ajbi];
-                            sign = compute_cre_des_sign(b, j, strib, nset);
-                            sign *= compute_cre_des_sign(a, i, strib, nset);
-                        }
-                        if (fabs(v) > 1.0E-14) ci1[ip] += sign * v * civec[jp];
-                        free(ijab);
-                    }
-                    // alpha,beta->alpha,beta
-                    else {
-                        int *ia = get_single_excitation(stria, strja, nset);
-                        int *jb = get_single_excitation(strib, strjb, nset);
-                        i = ia[0]; a = ia[1]; j = jb[0]; b = jb[1];
-                        double v = eri[a * norb * norb * norb + i * norb * norb + b * norb + j];
-                        double sign = compute_cre_des_sign(a, i, stria, nset);
-                        sign *= compute_cre_des_sign(b, j, strib, nset);
-                        if (fabs(v) > 1.0E-14) ci1[ip] += sign * v * civec[jp];
-                        // S^2
-                        if (i == b && j == a) {
-                            ci2[ip] -= sign * civec[jp];
-                        }
-                        free(ia);
-                        free(jb);
-                   }
-                }
-            } // end if over ts
-        } // end loop over jp
-    } // end loop over ip
-
-    } // end omp
-  
-    free(ts);
+    contract_connected(h1, eri, norb, neleca, nelecb, strs, civec, hdiag, ndet, ci1, ci2);
 
 }
 
@@ -1150,7 +1619,7 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                     ia = get_single_excitation(stria, strja, nset);
                     int i = ia[0];
                     int a = ia[1];
-                    double sign = compute_cre_des_sign(a, i, stria, nset);
+                    double sign = FCIbs_cre_des_sign(a, i, stria, nset);
                     int *occsa = compute_occ_list(stria, nset, norb, neleca);
                     int *occsb = compute_occ_list(strib, nset, norb, nelecb);
                     ci_sq = sign * civec[ip] * civec[jp];
@@ -1182,7 +1651,7 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                     ia = get_single_excitation(strib, strjb, nset);
                     int i = ia[0];
                     int a = ia[1];
-                    double sign = compute_cre_des_sign(a, i, strib, nset);
+                    double sign = FCIbs_cre_des_sign(a, i, strib, nset);
                     int *occsa = compute_occ_list(stria, nset, norb, neleca);
                     int *occsb = compute_occ_list(strib, nset, norb, nelecb);
                     ci_sq = sign * civec[ip] * civec[jp];
@@ -1224,8 +1693,8 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                     int abij = a * norb * norb * norb + b * norb * norb + i * norb + j;
                     int abji = a * norb * norb * norb + b * norb * norb + j * norb + i;
                     if (a > j || i > b) {
-                        sign = compute_cre_des_sign(b, i, stria, nset);
-                        sign *= compute_cre_des_sign(a, j, stria, nset);
+                        sign = FCIbs_cre_des_sign(b, i, stria, nset);
+                        sign *= FCIbs_cre_des_sign(a, j, stria, nset);
                         ci_sq = sign * civec[ip] * civec[jp];
                         rdm2aa_private[baij] += ci_sq;
                         rdm2aa_private[baji] -= ci_sq;
@@ -1233,8 +1702,8 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                         rdm2aa_private[abji] += ci_sq;
                     } 
                     else {
-                        sign = compute_cre_des_sign(b, j, stria, nset);
-                        sign *= compute_cre_des_sign(a, i, stria, nset);
+                        sign = FCIbs_cre_des_sign(b, j, stria, nset);
+                        sign *= FCIbs_cre_des_sign(a, i, stria, nset);
                         ci_sq = sign * civec[ip] * civec[jp];
                         rdm2aa_private[baij] -= ci_sq;
                         rdm2aa_private[baji] += ci_sq;
@@ -1253,8 +1722,8 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                     int abij = a * norb * norb * norb + b * norb * norb + i * norb + j;
                     int abji = a * norb * norb * norb + b * norb * norb + j * norb + i;
                     if (a > j || i > b) {
-                        sign = compute_cre_des_sign(b, i, strib, nset);
-                        sign *= compute_cre_des_sign(a, j, strib, nset);
+                        sign = FCIbs_cre_des_sign(b, i, strib, nset);
+                        sign *= FCIbs_cre_des_sign(a, j, strib, nset);
                         ci_sq = sign * civec[ip] * civec[jp];
                         rdm2bb_private[baij] += ci_sq;
                         rdm2bb_private[baji] -= ci_sq;
@@ -1262,8 +1731,8 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                         rdm2bb_private[abji] += ci_sq;
                     } 
                     else {
-                        sign = compute_cre_des_sign(b, j, strib, nset);
-                        sign *= compute_cre_des_sign(a, i, strib, nset);
+                        sign = FCIbs_cre_des_sign(b, j, strib, nset);
+                        sign *= FCIbs_cre_des_sign(a, i, strib, nset);
                         ci_sq = sign * civec[ip] * civec[jp];
                         rdm2bb_private[baij] -= ci_sq;
                         rdm2bb_private[baji] += ci_sq;
@@ -1277,8 +1746,8 @@ void compute_rdm12s(int norb, int neleca, int nelecb, uint64_t *strs, double *ci
                     int *ia = get_single_excitation(stria, strja, nset);
                     int *jb = get_single_excitation(strib, strjb, nset);
                     i = ia[0]; a = ia[1]; j = jb[0]; b = jb[1];
-                    double sign = compute_cre_des_sign(a, i, stria, nset);
-                    sign *= compute_cre_des_sign(b, j, strib, nset);
+                    double sign = FCIbs_cre_des_sign(a, i, stria, nset);
+                    sign *= FCIbs_cre_des_sign(b, j, strib, nset);
                     ci_sq = sign * civec[ip] * civec[jp];
                     int abij = a * norb * norb * norb + b * norb * norb + i * norb + j;
                     rdm2ab_private[abij] += ci_sq;
@@ -21,6 +21,7 @@ Extension to scipy.linalg module
 '''
 
 import sys
+import ctypes
 import warnings
 import tempfile
 from functools import reduce
@@ -53,6 +54,8 @@ PROJECT_OUT_CONV_EIGS = \
 
 FOLLOW_STATE = getattr(__config__, 'lib_linalg_helper_davidson_follow_state', False)
 
+libnp_helper = misc.load_library('libnp_helper')
+
 
 def safe_eigh(h, s, lindep=SAFE_EIGH_LINDEP):
     '''Solve generalized eigenvalue problem  h v = w s v.
@@ -391,9 +394,11 @@ def davidson1(aop, x0, precond, tol=1e-12, max_cycle=50, max_space=12,
         head, space = space, space+rnow
 
         if heff is None:  # Lazy initilize heff to determine the dtype
-            heff = numpy.empty((max_space+nroots,max_space+nroots), dtype=ax[0].dtype)
+            # at least double precision for single precision vectors
+            heff = numpy.empty((max_space+nroots,max_space+nroots),
+                               dtype=numpy.result_type(ax[0].dtype, numpy.double))
         else:
-            heff = numpy.asarray(heff, dtype=ax[0].dtype)
+            heff = numpy.asarray(heff, dtype=numpy.result_type(ax[0].dtype, numpy.double))
 
         elast = e
         vlast = v
@@ -521,6 +526,177 @@ def davidson1(aop, x0, precond, tol=1e-12, max_cycle=50, max_space=12,
 
     return conv, e, x0
 
+def davidson1_native(aop, x0, precond, tol=1e-12, max_cycle=50, max_space=12,
+                     lindep=DAVIDSON_LINDEP, max_memory=MAX_MEMORY,
+                     callback=None, nroots=1, pick=None, verbose=logger.WARN,
+                     tol_residual=None, **kwargs):
+    '''Davidson diagonalization for real symmetric matrices.  The arguments
+    and the returns are the same to :func:`davidson1`.
+
+    The trial vectors and the a*x vectors are held in two preallocated
+    arrays (arenas).  If the arenas do not fit in max_memory, they are
+    memory-mapped to a scratch file in lib.param.TMPDIR.  The subspace
+    orthogonalization (blocked Gram-Schmidt), the subspace Hamiltonian and
+    the rotations of the subspace are computed by the BLAS3 functions in
+    libnp_helper which stream the vectors block by block.  Temporary arrays
+    of the vector size are not created in the iterations.  The subspace is
+    restarted with the current eigenvectors and their a*x vectors when it
+    is full, so aop is called once for each new trial vector.
+
+    The keyword arguments dot, lessio and follow_state of :func:`davidson1`
+    are ignored.
+    '''
+    if isinstance(verbose, logger.Logger):
+        log = verbose
+    else:
+        log = logger.Logger(sys.stdout, verbose)
+
+    if tol_residual is None:
+        toloose = numpy.sqrt(tol)
+    else:
+        toloose = tol_residual
+    log.debug1('tol %g  toloose %g', tol, toloose)
+
+    if callable(x0):
+        x0 = x0()
+    if isinstance(x0, numpy.ndarray) and x0.ndim == 1:
+        x0 = [x0]
+    n = x0[0].size
+    max_space = max_space + nroots * 3
+    nbuf = max(len(x0), nroots)
+
+    # x0, ax0 and the trial vectors are held in memory
+    mem_now = max_memory - nbuf * 3 * n * 8e-6
+    xs = _subspace_arena(max_space, n, mem_now)
+    ax = _subspace_arena(max_space, n, mem_now - xs.nbytes*1e-6)
+    log.debug1('max_cycle %d  max_space %d  max_memory %d  incore %s',
+               max_cycle, max_space, max_memory,
+               not isinstance(ax, numpy.memmap))
+    xt = numpy.empty((nbuf,n))
+    for k, xi in enumerate(x0):
+        xt[k] = xi.ravel()
+    nvec = len(x0)
+    x0 = numpy.empty((nroots,n))
+    ax0 = numpy.empty((nroots,n))
+    heff = numpy.empty((max_space,max_space))
+
+    space = 0
+    e = numpy.zeros(0)
+    conv = [False] * nroots
+    dx_norm = [0] * nroots
+    for icyc in range(max_cycle):
+        nvec = _subspace_orth(xs, space, xt, nvec, lindep)
+        if nvec == 0:
+            log.debug('Linear dependency in trial subspace. |r| for each state %s',
+                      dx_norm)
+            conv = [conv[k] or (norm < toloose) for k,norm in enumerate(dx_norm)]
+            break
+
+        head, space = space, space+nvec
+        xs[head:space] = xt[:nvec]
+        axt = aop([xs[i] for i in range(head, space)])
+        for k in range(nvec):
+            ax[head+k] = axt[k].ravel()
+        axt = None
+
+        _subspace_dot(heff[:space,head:space], xs[:space], ax[head:space])
+        heff[head:space,head:space] = (heff[head:space,head:space] +
+                                       heff[head:space,head:space].T) * .5
+        heff[head:space,:head] = heff[:head,head:space].T
+
+        w, v = scipy.linalg.eigh(heff[:space,:space])
+        if callable(pick):
+            w, v, idx = pick(w, v, nroots, locals())
+        elast, e = e, w[:nroots]
+        v = numpy.asarray(v[:,:nroots], order='C')
+        nr = e.size
+        if elast.size != e.size:
+            de = e
+        else:
+            de = e - elast
+
+        _subspace_rotate(x0[:nr], v, xs[:space])
+        _subspace_rotate(ax0[:nr], v, ax[:space])
+        # residuals are saved in xt
+        conv = [False] * nroots
+        dx_norm = [0] * nroots
+        for k in range(nr):
+            xt[k] = x0[k]
+            xt[k] *= -e[k]
+            xt[k] += ax0[k]
+            dx_norm[k] = numpy.linalg.norm(xt[k])
+            conv[k] = abs(de[k]) < tol and dx_norm[k] < toloose
+        max_dx_norm = max(dx_norm)
+        ide = numpy.argmax(abs(de))
+        if all(conv):
+            log.debug('converge %d %d  |r|= %4.3g  e= %s  max|de|= %4.3g',
+                      icyc, space, max_dx_norm, e, de[ide])
+            break
+
+        nvec = 0
+        for k in range(nr):
+            if not conv[k] and dx_norm[k]**2 > lindep:
+                xt[nvec] = precond(xt[k], e[0], x0[k]).ravel()
+                xt[nvec] *= 1/numpy.linalg.norm(xt[nvec])
+                nvec += 1
+        log.debug('davidson %d %d  |r|= %4.3g  e= %s  max|de|= %4.3g  nnew= %d',
+                  icyc, space, max_dx_norm, e, de[ide], nvec)
+
+        if space + nvec > max_space:
+            # Restart with the current eigenvectors.  The subspace
+            # Hamiltonian is diagonal in this basis.
+            xs[:nr] = x0[:nr]
+            ax[:nr] = ax0[:nr]
+            heff[:nr,:nr] = numpy.diag(e)
+            space = nr
+
+        if callable(callback):
+            callback(locals())
+
+    return conv, e, [x0[k].copy() for k in range(e.size)]
+
+def _subspace_arena(nvec, n, max_memory):
+    '''Preallocated storage of nvec vectors.  It is memory-mapped to a
+    scratch file if the size is larger than max_memory (in MB).'''
+    if nvec * n * 8e-6 < max_memory:
+        return numpy.empty((nvec,n))
+    else:
+        with tempfile.NamedTemporaryFile(dir=parameters.TMPDIR) as f:
+            # the mapping remains valid after the file is closed and removed
+            return numpy.memmap(f, dtype=numpy.double, mode='w+',
+                                shape=(nvec,n))
+
+def _subspace_dot(c, a, b):
+    '''c[:m,:p] = a[:m] . b[:p].T'''
+    m, p = c.shape
+    buf = numpy.empty((m,p))
+    libnp_helper.NPdsubspace_dot(buf.ctypes.data_as(ctypes.c_void_p),
+                                 a.ctypes.data_as(ctypes.c_void_p),
+                                 b.ctypes.data_as(ctypes.c_void_p),
+                                 ctypes.c_int(m), ctypes.c_int(p),
+                                 ctypes.c_size_t(a.shape[1]))
+    c[:] = buf
+    return c
+
+def _subspace_rotate(y, v, x, alpha=1, beta=0):
+    '''y[:p] = alpha * v[:m,:p].T . x[:m] + beta * y[:p]'''
+    m, p = v.shape
+    libnp_helper.NPdsubspace_rotate(y.ctypes.data_as(ctypes.c_void_p),
+                                    v.ctypes.data_as(ctypes.c_void_p),
+                                    x.ctypes.data_as(ctypes.c_void_p),
+                                    ctypes.c_int(m), ctypes.c_int(p),
+                                    ctypes.c_size_t(x.shape[1]),
+                                    ctypes.c_double(alpha), ctypes.c_double(beta))
+    return y
+
+def _subspace_orth(xs, space, xt, nvec, lindep):
+    return libnp_helper.NPdsubspace_orth(xs.ctypes.data_as(ctypes.c_void_p),
+                                         ctypes.c_int(space),
+                                         xt.ctypes.data_as(ctypes.c_void_p),
+                                         ctypes.c_int(nvec),
+                                         ctypes.c_size_t(xt.shape[1]),
+                                         ctypes.c_double(lindep))
+
 
 def eigh(a, *args, **kwargs):
     nroots = kwargs.get('nroots', 1)
@@ -43,6 +43,26 @@ typedef struct {
 #define EXTRACT_CRE(I)  EXTRACT_A(I)
 #define EXTRACT_DES(I)  EXTRACT_I(I)
 
+/*
+ * Hash table (open addressing) to look up the address of a string in a
+ * set of strings
+ */
+typedef struct {
+        uint64_t str;
+        int addr;
+        int _padding;
+} _StrsHashEntry;
+
+typedef struct {
+        _StrsHashEntry *entries;
+        uint64_t mask;
+        int shift;
+} SCIStrsHash;
+
+void SCIstrs_hash_init(SCIStrsHash *table, uint64_t *strs, int nstrs);
+void SCIstrs_hash_del(SCIStrsHash *table);
+int SCIstrs_hash_addr(SCIStrsHash *table, uint64_t str);
+
 void FCIcompress_link(_LinkT *clink, int *link_index,
                       int norb, int nstr, int nlink);
 void FCIcompress_link_tril(_LinkTrilT *clink, int *link_index,
@@ -71,5 +91,7 @@ double FCIrdm2_a_t1ci(double *ci0, double *t1,
 double FCIrdm2_b_t1ci(double *ci0, double *t1,
                       int bcount, int stra_id, int strb_id,
                       int norb, int nstrb, int nlinka, _LinkT *clink_indexa);
+void FCIrdm_block_norm(double *norm1, double *norm2, double *ci,
+                       int na, int nb, int nlinka, _LinkT *clinka, int blksize);
 
 void FCIaxpy2d(double *out, double *in, size_t count, size_t no, size_t ni);
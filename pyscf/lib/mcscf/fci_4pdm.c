@@ -26,6 +26,7 @@
 #define MIN(X,Y)        ((X)<(Y)?(X):(Y))
 #define BLK     48
 #define BUFBASE 96
+#define CSUMTHR 1e-28
 
 double FCI_t1ci_sf(double *ci0, double *t1, int bcount,
                    int stra_id, int strb_id,
@@ -449,7 +450,7 @@ void FCIrdm4_drv(void (*kernel)(),
 {
         const size_t nnorb = norb * norb;
         const size_t n4 = nnorb * nnorb;
-        int ib, strk, bcount;
+        int i, ib, strk, bcount;
 
         _LinkT *clinka = malloc(sizeof(_LinkT) * nlinka * na);
         _LinkT *clinkb = malloc(sizeof(_LinkT) * nlinkb * nb);
@@ -460,14 +461,213 @@ void FCIrdm4_drv(void (*kernel)(),
         memset(rdm3, 0, sizeof(double) * n4 * nnorb);
         memset(rdm4, 0, sizeof(double) * n4 * n4);
 
+// Skip the blocks in which E^i_j E^k_l|bra> or E^i_j E^k_l|ket> vanishes
+        const int nblk = (nb + BUFBASE - 1) / BUFBASE;
+        double *norm1 = malloc(sizeof(double) * na * nblk);
+        double *bnorm = malloc(sizeof(double) * na * nblk * 2);
+        double *knorm = bnorm + na * nblk;
+        FCIrdm_block_norm(norm1, bnorm, bra, na, nb, nlinka, clinka, BUFBASE);
+        if (ket != bra) {
+                FCIrdm_block_norm(norm1, knorm, ket, na, nb, nlinka, clinka, BUFBASE);
+                for (i = 0; i < na * nblk; i++) {
+                        bnorm[i] = MIN(bnorm[i], knorm[i]);
+                }
+        }
+
         for (strk = 0; strk < na; strk++) {
                 for (ib = 0; ib < nb; ib += BUFBASE) {
+                        if (bnorm[strk*nblk+ib/BUFBASE] < CSUMTHR) {
+                                continue;
+                        }
                         bcount = MIN(BUFBASE, nb-ib);
                         (*kernel)(rdm1, rdm2, rdm3, rdm4,
                                   bra, ket, bcount, strk, ib,
                                   norb, na, nb, nlinka, nlinkb, clinka, clinkb);
                 }
         }
+        free(norm1);
+        free(bnorm);
+        free(clinka);
+        free(clinkb);
+}
+
+
+/*
+ * Slices of the 3-pdm and 4-pdm for the leading index p0 <= p < p1
+ *      rdm3[p-p0,q,r,s,t,u] = <p^+ q r^+ s t^+ u>
+ *      rdm4[p-p0,q,r,s,t,u,v,w] = <p^+ q r^+ s t^+ u v^+ w>
+ * The 3-pdm slice is complete.  The 4-pdm slice is only computed for
+ * r >= t >= v, the other elements are zero.  The rest of the 4-pdm slice can
+ * be obtained from the 3-pdm slice by permuting E^r_s E^t_u E^v_w (see
+ * _complete_dm4_slice_ in fci/rdm.py).  The slices can be generated one after
+ * another with bounded memory.  rdm4 can be NULL.
+ */
+static void rdm34_slice_kern(double *rdm3, double *rdm4, double *bra, double *ket,
+                             double *t2bra, double *t2ket, double *t1ket,
+                             double *tbra, int bcount, int stra_id, int strb_id,
+                             int norb, int na, int nb, int nlinka, int nlinkb,
+                             _LinkT *clink_indexa, _LinkT *clink_indexb,
+                             int p0, int p1)
+{
+        const int nnorb = norb * norb;
+        const int n3 = nnorb * norb;
+        const int n4 = nnorb * nnorb;
+        const int nslice = (p1 - p0) * n3;
+
+        FCI_t2ci_sf(bra, t2bra, bcount, stra_id, strb_id,
+                    norb, na, nb, nlinka, nlinkb, clink_indexa, clink_indexb);
+// t2bra is not used after the transposition to tbra.  It is shared with
+// t2ket if bra == ket
+        if (rdm4 != NULL) {
+                if (ket == bra) {
+                        t2ket = t2bra;
+                } else {
+                        FCI_t2ci_sf(ket, t2ket, bcount, stra_id, strb_id,
+                                    norb, na, nb, nlinka, nlinkb,
+                                    clink_indexa, clink_indexb);
+                }
+        }
+        FCI_t1ci_sf(ket, t1ket, bcount, stra_id, strb_id,
+                    norb, na, nb, nlinka, nlinkb, clink_indexa, clink_indexb);
+
+#pragma omp parallel \
+        shared(rdm3, rdm4, t2bra, t2ket, t1ket, tbra, bcount, norb, p0, p1)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D1 = 1;
+        int n, p, q, r, s, t, u, v, g, i0, i1, m, ncol;
+        double *pbra, *pt2, *pket, *buf;
+// <bra|E^p_q E^r_s = (E^s_r E^q_p|bra>)^+
+#pragma omp for schedule(static)
+        for (n = 0; n < bcount; n++) {
+                pbra = tbra + (size_t)n * nslice;
+                pt2 = t2bra + (size_t)n * n4;
+                for (p = p0; p < p1; p++) {
+                for (q = 0; q < norb; q++) {
+                for (r = 0; r < norb; r++) {
+                for (s = 0; s < norb; s++) {
+                        pbra[((p-p0)*norb+q)*nnorb+r*norb+s] =
+                                pt2[s*n3+r*nnorb+q*norb+p];
+                } } } }
+        }
+#pragma omp for schedule(dynamic, 1)
+        for (i0 = 0; i0 < nslice; i0 += BLK) {
+                i1 = MIN(i0 + BLK, nslice);
+                m = i1 - i0;
+                dgemm_(&TRANS_N, &TRANS_T, &nnorb, &m, &bcount,
+                       &D1, t1ket, &nnorb, tbra+i0, &nslice,
+                       &D1, rdm3+(size_t)i0*nnorb, &nnorb);
+        }
+
+        if (rdm4 != NULL) {
+// swap u, v of E^t_u E^v_w|ket> so that v <= t are the leading columns of
+// each t-block:  t2ket[:,t,v,u,w] = E^t_u E^v_w|ket>
+                buf = malloc(sizeof(double) * n4);
+#pragma omp for schedule(static)
+                for (n = 0; n < bcount; n++) {
+                        pket = t2ket + (size_t)n * n4;
+                        for (t = 0; t < norb; t++) {
+                        for (u = 0; u < norb; u++) {
+                        for (v = 0; v < norb; v++) {
+                                memcpy(buf+((t*norb+v)*norb+u)*norb,
+                                       pket+((t*norb+u)*norb+v)*norb,
+                                       sizeof(double) * norb);
+                        } } }
+                        memcpy(pket, buf, sizeof(double) * n4);
+                }
+                free(buf);
+// for each row group (p,q,r), the rows s and the columns t <= r, v <= t
+#pragma omp for schedule(dynamic, 1)
+                for (g = 0; g < (p1-p0)*nnorb; g++) {
+                        r = g % norb;
+                        for (t = 0; t <= r; t++) {
+                                ncol = (t + 1) * nnorb;
+                                dgemm_(&TRANS_N, &TRANS_T, &ncol, &norb, &bcount,
+                                       &D1, t2ket+t*n3, &n4, tbra+g*norb, &nslice,
+                                       &D1, rdm4+(size_t)g*norb*n4+t*n3, &n4);
+                        }
+                }
+        }
+}
+}
+
+void FCIrdm34_slice_drv(double *rdm3, double *rdm4, double *bra, double *ket,
+                        int norb, int na, int nb, int nlinka, int nlinkb,
+                        int *link_indexa, int *link_indexb, int p0, int p1)
+{
+        const size_t nnorb = norb * norb;
+        const size_t n4 = nnorb * nnorb;
+        const size_t nslice = (p1 - p0) * nnorb * norb;
+        const int nblk = (nb + BUFBASE - 1) / BUFBASE;
+        int i, ib, strk, bcount;
+        size_t n;
+        int t, u, v;
+        double *prdm4;
+
+        _LinkT *clinka = malloc(sizeof(_LinkT) * nlinka * na);
+        _LinkT *clinkb = malloc(sizeof(_LinkT) * nlinkb * nb);
+        FCIcompress_link(clinka, link_indexa, norb, na, nlinka);
+        FCIcompress_link(clinkb, link_indexb, norb, nb, nlinkb);
+        memset(rdm3, 0, sizeof(double) * nslice * nnorb);
+        if (rdm4 != NULL) {
+                memset(rdm4, 0, sizeof(double) * nslice * n4);
+        }
+
+// Skip the blocks in which E^i_j E^k_l|bra> or the ket intermediates vanish
+        double *norm1 = malloc(sizeof(double) * na * nblk);
+        double *bnorm = malloc(sizeof(double) * na * nblk * 2);
+        double *knorm = bnorm + na * nblk;
+        FCIrdm_block_norm(norm1, bnorm, bra, na, nb, nlinka, clinka, BUFBASE);
+        FCIrdm_block_norm(norm1, knorm, ket, na, nb, nlinka, clinka, BUFBASE);
+        if (rdm4 == NULL) {
+                memcpy(knorm, norm1, sizeof(double) * na * nblk);
+        }
+        for (i = 0; i < na * nblk; i++) {
+                bnorm[i] = MIN(bnorm[i], knorm[i]);
+        }
+
+        double *t2bra = malloc(sizeof(double) * BUFBASE * n4);
+        double *t2ket = NULL;
+        double *t1ket = malloc(sizeof(double) * BUFBASE * nnorb);
+        double *tbra = malloc(sizeof(double) * BUFBASE * nslice);
+        if (rdm4 != NULL && ket != bra) {
+                t2ket = malloc(sizeof(double) * BUFBASE * n4);
+        }
+
+        for (strk = 0; strk < na; strk++) {
+                for (ib = 0; ib < nb; ib += BUFBASE) {
+                        if (bnorm[strk*nblk+ib/BUFBASE] < CSUMTHR) {
+                                continue;
+                        }
+                        bcount = MIN(BUFBASE, nb-ib);
+                        rdm34_slice_kern(rdm3, rdm4, bra, ket,
+                                         t2bra, t2ket, t1ket, tbra,
+                                         bcount, strk, ib, norb, na, nb,
+                                         nlinka, nlinkb, clinka, clinkb, p0, p1);
+                }
+        }
+
+// the columns of rdm4 back to the order (t,u,v,w)
+        if (rdm4 != NULL) {
+                for (n = 0; n < nslice; n++) {
+                        prdm4 = rdm4 + n * n4;
+                        for (t = 0; t < norb; t++) {
+                        for (v = 0; v < norb; v++) {
+                        for (u = 0; u < norb; u++) {
+                                memcpy(t2bra+((t*norb+u)*norb+v)*norb,
+                                       prdm4+((t*norb+v)*norb+u)*norb,
+                                       sizeof(double) * norb);
+                        } } }
+                        memcpy(prdm4, t2bra, sizeof(double) * n4);
+                }
+        }
+        free(t2bra);
+        free(t2ket);
+        free(t1ket);
+        free(tbra);
+        free(norm1);
+        free(bnorm);
         free(clinka);
         free(clinkb);
 }
@@ -617,7 +817,7 @@ void FCIrdm3_drv(void (*kernel)(),
 {
         const size_t nnorb = norb * norb;
         const size_t n4 = nnorb * nnorb;
-        int ib, strk, bcount;
+        int i, ib, strk, bcount;
 
         _LinkT *clinka = malloc(sizeof(_LinkT) * nlinka * na);
         _LinkT *clinkb = malloc(sizeof(_LinkT) * nlinkb * nb);
@@ -627,14 +827,30 @@ void FCIrdm3_drv(void (*kernel)(),
         memset(rdm2, 0, sizeof(double) * n4);
         memset(rdm3, 0, sizeof(double) * n4 * nnorb);
 
+// Skip the blocks in which E^i_j E^k_l|bra> or E^i_j|ket> vanishes
+        const int nblk = (nb + BUFBASE - 1) / BUFBASE;
+        double *bnorm = malloc(sizeof(double) * na * nblk * 2);
+        double *knorm = bnorm + na * nblk;
+        FCIrdm_block_norm(knorm, bnorm, bra, na, nb, nlinka, clinka, BUFBASE);
+        if (ket != bra) {
+                FCIrdm_block_norm(knorm, NULL, ket, na, nb, nlinka, clinka, BUFBASE);
+        }
+        for (i = 0; i < na * nblk; i++) {
+                bnorm[i] = MIN(bnorm[i], knorm[i]);
+        }
+
         for (strk = 0; strk < na; strk++) {
                 for (ib = 0; ib < nb; ib += BUFBASE) {
+                        if (bnorm[strk*nblk+ib/BUFBASE] < CSUMTHR) {
+                                continue;
+                        }
                         bcount = MIN(BUFBASE, nb-ib);
                         (*kernel)(rdm1, rdm2, rdm3,
                                   bra, ket, bcount, strk, ib,
                                   norb, na, nb, nlinka, nlinkb, clinka, clinkb);
                 }
         }
+        free(bnorm);
         free(clinka);
         free(clinkb);
 }
@@ -0,0 +1,248 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * Bit operations on the occupation strings of determinants.
+ *
+ * A string of norb orbitals is stored in nset = (norb+63)/64 words.  The
+ * last word holds the orbitals 0-63, the second last word the orbitals
+ * 64-127, and so on (the layout of the HCI strings).  A single-word string
+ * is a plain uint64_t as used by the FCI and SCI string tools.
+ *
+ * The FCIbs_* functions dispatch on nset.  For nset = 1, 2 and 4 (up to 64,
+ * 128 and 256 orbitals) the word loops are fully unrolled by the compiler;
+ * other nset use the generic loops.  With GCC/Clang the popcount and
+ * trailing-zero count map to the POPCNT/TZCNT instructions when the target
+ * has them (e.g. -march=native in cmake.arch.inc).
+ */
+
+#ifndef HAVE_DEFINED_FCI_BITSTR_H
+#define HAVE_DEFINED_FCI_BITSTR_H
+
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define FCIBS_INLINE    static inline __attribute__((always_inline))
+#else
+#define FCIBS_INLINE    static inline
+#endif
+
+FCIBS_INLINE int FCIbs_popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+        return __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+/*
+ * Index of the lowest set bit.  x must not be 0.
+ */
+FCIBS_INLINE int FCIbs_tzcnt64(uint64_t x)
+{
+#if defined(__GNUC__)
+        return __builtin_ctzll(x);
+#else
+        return FCIbs_popcount64((x & -x) - 1);
+#endif
+}
+
+/*
+ * Generic implementations.  They are called with a constant nset by the
+ * dispatchers below so that the loops are unrolled.
+ */
+FCIBS_INLINE int _bs_popcount(uint64_t *str, int nset)
+{
+        int k, n = 0;
+        for (k = 0; k < nset; k++) {
+                n += FCIbs_popcount64(str[k]);
+        }
+        return n;
+}
+
+FCIBS_INLINE int _bs_n_excitations(uint64_t *str1, uint64_t *str2, int nset)
+{
+        int k, n = 0;
+        for (k = 0; k < nset; k++) {
+                n += FCIbs_popcount64(str1[k] ^ str2[k]);
+        }
+        return n / 2;
+}
+
+FCIBS_INLINE int _bs_equal(uint64_t *str1, uint64_t *str2, int nset)
+{
+        int k;
+        uint64_t d = 0;
+        for (k = 0; k < nset; k++) {
+                d |= str1[k] ^ str2[k];
+        }
+        return d == 0;
+}
+
+/*
+ * Number of the occupied orbitals lo <= p < hi
+ */
+FCIBS_INLINE int _bs_count_range(uint64_t *str, int nset, int lo, int hi)
+{
+        int wlo = lo / 64;
+        int whi = hi / 64;
+        uint64_t mlo = (1ULL << (lo % 64)) - 1;
+        uint64_t mhi = (1ULL << (hi % 64)) - 1;
+        int k, n;
+        if (wlo == whi) {
+                return FCIbs_popcount64(str[nset-1-wlo] & mhi & ~mlo);
+        }
+        n = FCIbs_popcount64(str[nset-1-wlo] & ~mlo);
+        for (k = wlo+1; k < whi; k++) {
+                n += FCIbs_popcount64(str[nset-1-k]);
+        }
+        return n + FCIbs_popcount64(str[nset-1-whi] & mhi);
+}
+
+/*
+ * Occupied orbitals in ascending order.  Returns the number of electrons.
+ */
+FCIBS_INLINE int _bs_occ_list(uint64_t *str, int *occ, int nset)
+{
+        int k, n = 0;
+        uint64_t x;
+        for (k = 0; k < nset; k++) {
+                x = str[nset-1-k];
+                while (x) {
+                        occ[n++] = FCIbs_tzcnt64(x) + k * 64;
+                        x &= x - 1;
+                }
+        }
+        return n;
+}
+
+/*
+ * Holes (orbitals occupied in str1 but not in str2) and particles (occupied
+ * in str2 but not in str1) in ascending order.  Returns the number of holes.
+ */
+FCIBS_INLINE int _bs_excitation(uint64_t *str1, uint64_t *str2, int nset,
+                                int *holes, int *particles)
+{
+        int k, nh = 0, np = 0;
+        uint64_t d, x;
+        for (k = 0; k < nset; k++) {
+                d = str1[nset-1-k] ^ str2[nset-1-k];
+                x = d & str1[nset-1-k];
+                while (x) {
+                        holes[nh++] = FCIbs_tzcnt64(x) + k * 64;
+                        x &= x - 1;
+                }
+                x = d & str2[nset-1-k];
+                while (x) {
+                        particles[np++] = FCIbs_tzcnt64(x) + k * 64;
+                        x &= x - 1;
+                }
+        }
+        return nh;
+}
+
+#define FCIBS_DISPATCH(fn, nset, ...) \
+        switch (nset) { \
+        case 1: return fn(__VA_ARGS__, 1); \
+        case 2: return fn(__VA_ARGS__, 2); \
+        case 4: return fn(__VA_ARGS__, 4); \
+        default: return fn(__VA_ARGS__, nset); }
+
+static inline int FCIbs_popcount(uint64_t *str, int nset)
+{
+        FCIBS_DISPATCH(_bs_popcount, nset, str);
+}
+
+/*
+ * Excitation level between two strings
+ */
+static inline int FCIbs_n_excitations(uint64_t *str1, uint64_t *str2, int nset)
+{
+        FCIBS_DISPATCH(_bs_n_excitations, nset, str1, str2);
+}
+
+static inline int FCIbs_equal(uint64_t *str1, uint64_t *str2, int nset)
+{
+        FCIBS_DISPATCH(_bs_equal, nset, str1, str2);
+}
+
+static inline int FCIbs_occ_list(uint64_t *str, int nset, int *occ)
+{
+        FCIBS_DISPATCH(_bs_occ_list, nset, str, occ);
+}
+
+static inline int FCIbs_test(uint64_t *str, int nset, int p)
+{
+        return (str[nset-1-p/64] >> (p % 64)) & 1;
+}
+
+static inline void FCIbs_flip(uint64_t *str, int nset, int p)
+{
+        str[nset-1-p/64] ^= 1ULL << (p % 64);
+}
+
+/*
+ * sign of  a_p^+ a_q |str>
+ */
+static inline int FCIbs_cre_des_sign(int p, int q, uint64_t *str, int nset)
+{
+        int lo = (p < q ? p : q) + 1;
+        int hi = (p < q ? q : p);
+        int n;
+        if (lo >= hi) {
+                return 1;
+        }
+        switch (nset) {
+        case 1: n = _bs_count_range(str, 1, lo, hi); break;
+        case 2: n = _bs_count_range(str, 2, lo, hi); break;
+        case 4: n = _bs_count_range(str, 4, lo, hi); break;
+        default: n = _bs_count_range(str, nset, lo, hi);
+        }
+        return (n % 2) ? -1 : 1;
+}
+
+/*
+ * Orbital indices ia = (i, a) of the single excitation str1 -> str2
+ */
+static inline void FCIbs_single_excitation(uint64_t *str1, uint64_t *str2,
+                                           int nset, int *ia)
+{
+        switch (nset) {
+        case 1: _bs_excitation(str1, str2, 1, ia, ia+1); break;
+        case 2: _bs_excitation(str1, str2, 2, ia, ia+1); break;
+        case 4: _bs_excitation(str1, str2, 4, ia, ia+1); break;
+        default: _bs_excitation(str1, str2, nset, ia, ia+1);
+        }
+}
+
+/*
+ * Orbital indices ijab = (i, j, a, b) of the double excitation str1 -> str2,
+ * i < j and a < b
+ */
+static inline void FCIbs_double_excitation(uint64_t *str1, uint64_t *str2,
+                                           int nset, int *ijab)
+{
+        switch (nset) {
+        case 1: _bs_excitation(str1, str2, 1, ijab, ijab+2); break;
+        case 2: _bs_excitation(str1, str2, 2, ijab, ijab+2); break;
+        case 4: _bs_excitation(str1, str2, 4, ijab, ijab+2); break;
+        default: _bs_excitation(str1, str2, nset, ijab, ijab+2);
+        }
+}
+
+#endif
@@ -26,8 +26,10 @@
 #include "vhf/fblas.h"
 #include "np_helper/np_helper.h"
 #include "fci.h"
+#include "fci_bitstr.h"
 // for (16e,16o) ~ 11 MB buffer = 120 * 12870 * 8
 #define STRB_BLKSIZE    112
+#define STRA_BLKSIZE    16
 
 /*
  * CPU timing of single thread can be estimated:
@@ -288,14 +290,154 @@ static void spread_bufa_t1(double *ci1, double *t1, int nrow_t1,
 }
 
 /*
- * bcount_for_spread_a is different for spin1 and spin0
+ * The t1 intermediates of the (beta,beta) and the (alpha,beta) parts of the
+ * 2e Hamiltonian for string stra_id
+ *      \sum_{kl,ij} eri[kl,ij] E^b_{kl} (2 E^a_{ij} + E^b_{ij}) |ci0>
+ * The (alpha,alpha) part, which spreads to other alpha strings, is not
+ * included.  The results are added to row stra_id of ci1 only.
+ * ci0a is the column panel ci0[:,strb_id:strb_id+bcount] (with leading
+ * dimension lda) to generate alpha excitations.
+ * ci0b is the array to generate beta excitations.  ci0b and ci1 are
+ * indexed with stra_id_b
  */
-static void ctr_rhf2e_kern(double *eri, double *ci0, double *ci1,
-                           double *ci1buf, double *t1buf,
-                           int bcount_for_spread_a, int ncol_ci1buf,
-                           int bcount, int stra_id, int strb_id,
-                           int norb, int na, int nb, int nlinka, int nlinkb,
-                           _LinkTrilT *clink_indexa, _LinkTrilT *clink_indexb)
+static void ctr_rhf2e_bb_kern(double *eri, double *ci0a, double *ci0b,
+                              double *ci1, double *t1buf,
+                              int bcount, int stra_id, int stra_id_b,
+                              int strb_id, int lda, int norb, int nb,
+                              int nlinka, int nlinkb,
+                              _LinkTrilT *clink_indexa, _LinkTrilT *clink_indexb)
+{
+        const char TRANS_N = 'N';
+        const double D0 = 0;
+        const double D1 = 1;
+        const int nnorb = norb * (norb+1)/2;
+        double *t1 = t1buf;
+        double *vt1 = t1buf + nnorb*bcount;
+        int i;
+
+        memset(t1, 0, sizeof(double)*nnorb*bcount);
+        FCIprog_a_t1(ci0a, t1, bcount, stra_id, 0,
+                     norb, lda, nlinka, clink_indexa);
+        for (i = 0; i < nnorb*bcount; i++) {
+                t1[i] *= 2;
+        }
+        FCIprog_b_t1(ci0b, t1, bcount, stra_id_b, strb_id,
+                     norb, nb, nlinkb, clink_indexb);
+
+        dgemm_(&TRANS_N, &TRANS_N, &bcount, &nnorb, &nnorb,
+               &D1, t1, &bcount, eri, &nnorb, &D0, vt1, &bcount);
+        FCIspread_b_t1(ci1, vt1, bcount, stra_id_b, strb_id,
+                       norb, nb, nlinkb, clink_indexb);
+}
+
+/*
+ * Row stra_id of the (alpha,alpha) part of the 2e Hamiltonian
+ *      h[J] = \sum_{kl,ij} eri[kl,ij] <stra_id|E^a_{kl} E^a_{ij}|J>
+ * The non-zero elements are saved in hval and hidx (up to nlinka**2).
+ * hrow is a work array of na doubles.  It should be zero on entry and it
+ * is zero on exit.
+ */
+static int aa_hrow(double *hval, int *hidx, double *hrow, double *eri,
+                   int stra_id, int norb, int nlinka, _LinkTrilT *clink_indexa)
+{
+        const size_t nnorb = norb * (norb+1)/2;
+        const _LinkTrilT *tab0 = clink_indexa + stra_id * nlinka;
+        const _LinkTrilT *tab1;
+        int j0, j1, ia, str1, str2, sign1, sign2;
+        int nnz = 0;
+        double *peri;
+
+        for (j0 = 0; j0 < nlinka; j0++) {
+                ia    = EXTRACT_IA  (tab0[j0]);
+                str1  = EXTRACT_ADDR(tab0[j0]);
+                sign1 = EXTRACT_SIGN(tab0[j0]);
+                if (sign1 == 0) {
+                        break;
+                }
+                peri = eri + ia * nnorb;
+                tab1 = clink_indexa + str1 * nlinka;
+                for (j1 = 0; j1 < nlinka; j1++) {
+                        ia    = EXTRACT_IA  (tab1[j1]);
+                        str2  = EXTRACT_ADDR(tab1[j1]);
+                        sign2 = EXTRACT_SIGN(tab1[j1]);
+                        if (sign2 == 0) {
+                                break;
+                        }
+                        // J can be recorded more than once if the sum happens
+                        // to be zero.  The duplicated entry gets 0 below.
+                        if (hrow[str2] == 0) {
+                                hidx[nnz] = str2;
+                                nnz++;
+                        }
+                        hrow[str2] += sign1 * sign2 * peri[ia];
+                }
+        }
+        for (j0 = 0; j0 < nnz; j0++) {
+                hval[j0] = hrow[hidx[j0]];
+                hrow[hidx[j0]] = 0;
+        }
+        return nnz;
+}
+
+/*
+ * ci1[:bcount] += \sum_J h[J] ci0[J,:bcount]
+ */
+static void aa_gather(double *ci1, double *ci0, double *hval, int *hidx,
+                      int nnz, int bcount, int lda)
+{
+        int n, k;
+        double v;
+        double *pci0;
+        for (n = 0; n < nnz; n++) {
+                v = hval[n];
+                pci0 = ci0 + hidx[n] * (size_t)lda;
+                for (k = 0; k < bcount; k++) {
+                        ci1[k] += v * pci0[k];
+                }
+        }
+}
+
+/*
+ * spread t1 into the transposed ci1 (for spin0 only)
+ *      ci1[strb_id+k,str1] += sign * t1[ia,k]
+ */
+static void spread_a_t1_transpose(double *ci1, double *t1, int nrow_t1,
+                                  int bcount, int stra_id, int strb_id,
+                                  int na, int nlinka, _LinkTrilT *clink_indexa)
+{
+        int j, k, ia, sign;
+        size_t str1;
+        const _LinkTrilT *tab = clink_indexa + stra_id * nlinka;
+        double *cp0, *cp1;
+
+        ci1 += strb_id * (size_t)na;
+        for (j = 0; j < nlinka; j++) {
+                ia   = EXTRACT_IA  (tab[j]);
+                str1 = EXTRACT_ADDR(tab[j]);
+                sign = EXTRACT_SIGN(tab[j]);
+                cp0 = t1 + ia*nrow_t1;
+                cp1 = ci1 + str1;
+                if (sign == 0) {
+                        break;
+                } else if (sign > 0) {
+                        for (k = 0; k < bcount; k++) {
+                                cp1[k*(size_t)na] += cp0[k];
+                        }
+                } else {
+                        for (k = 0; k < bcount; k++) {
+                                cp1[k*(size_t)na] -= cp0[k];
+                        }
+                }
+        }
+}
+
+/*
+ * bcount_for_spread_a excludes the diagonal element for the diagonal blocks
+ */
+static void ctr_rhf2e_spin0_kern(double *eri, double *ci0, double *ci1,
+                                 double *t1buf, int bcount_for_spread_a,
+                                 int bcount, int stra_id, int strb_id,
+                                 int norb, int na, int nlink, _LinkTrilT *clink)
 {
         const char TRANS_N = 'N';
         const double D0 = 0;
@@ -306,18 +448,16 @@ static void ctr_rhf2e_kern(double *eri, double *ci0, double *ci1,
 
         memset(t1, 0, sizeof(double)*nnorb*bcount);
         FCIprog_a_t1(ci0, t1, bcount, stra_id, strb_id,
-                     norb, nb, nlinka, clink_indexa);
+                     norb, na, nlink, clink);
         FCIprog_b_t1(ci0, t1, bcount, stra_id, strb_id,
-                     norb, nb, nlinkb, clink_indexb);
+                     norb, na, nlink, clink);
 
         dgemm_(&TRANS_N, &TRANS_N, &bcount, &nnorb, &nnorb,
                &D1, t1, &bcount, eri, &nnorb, &D0, vt1, &bcount);
         FCIspread_b_t1(ci1, vt1, bcount, stra_id, strb_id,
-                       norb, nb, nlinkb, clink_indexb);
-        //FCIspread_a_t1(ci1buf, vt1, bcount_for_spread_a, stra_id, 0,
-        //               norb, ncol_ci1buf, nlinka, clink_indexa);
-        spread_bufa_t1(ci1buf, vt1, bcount, bcount_for_spread_a, stra_id, 0,
-                       norb, ncol_ci1buf, nlinka, clink_indexa);
+                       norb, na, nlink, clink);
+        spread_a_t1_transpose(ci1, vt1, bcount, bcount_for_spread_a,
+                              stra_id, strb_id, na, nlink, clink);
 }
 
 void FCIaxpy2d(double *out, double *in, size_t count, size_t no, size_t ni)
@@ -338,6 +478,13 @@ void FCIaxpy2d(double *out, double *in, size_t count, size_t no, size_t ni)
  * FCIcontract_2e_spin0 only compute half of the contraction, due to the
  * symmetry between alpha and beta spin.  The right contracted ci vector
  * is (ci1+ci1.T)
+ *
+ * The lower triangular part of the (alpha,beta) tiles are contracted.  The
+ * contributions of tile (p,q) are written to the rows of blocks p and q
+ * (the alpha excitations are stored in the transposed place since only
+ * ci1+ci1.T is needed).  The tiles are scheduled in rounds (round robin
+ * pairing) so that the blocks of rows are not shared by two threads in
+ * the same round.  No thread-private ci1 buffer is required.
  */
 void FCIcontract_2e_spin0(double *eri, double *ci0, double *ci1,
                           int norb, int na, int nlink, int *link_index)
@@ -346,38 +493,72 @@ void FCIcontract_2e_spin0(double *eri, double *ci0, double *ci1,
         FCIcompress_link_tril(clink, link_index, na, nlink);
 
         memset(ci1, 0, sizeof(double)*na*na);
-        double *ci1bufs[MAX_THREADS];
 #pragma omp parallel default(none) \
-                shared(eri, ci0, ci1, norb, na, nlink, clink, ci1bufs)
+                shared(eri, ci0, ci1, norb, na, nlink, clink)
 {
-        int strk, ib;
-        size_t blen;
-        double *t1buf = malloc(sizeof(double) * (STRB_BLKSIZE*norb*(norb+1)+2));
-        double *ci1buf = malloc(sizeof(double) * (na*STRB_BLKSIZE+2));
-        ci1bufs[omp_get_thread_num()] = ci1buf;
-        for (ib = 0; ib < na; ib += STRB_BLKSIZE) {
-                blen = MIN(STRB_BLKSIZE, na-ib);
-                memset(ci1buf, 0, sizeof(double) * na*blen);
-#pragma omp for schedule(static, 112)
-/* strk starts from MAX(strk0, ib), because [0:ib,0:ib] have been evaluated */
-                for (strk = ib; strk < na; strk++) {
-                        ctr_rhf2e_kern(eri, ci0, ci1, ci1buf, t1buf,
-                                       MIN(STRB_BLKSIZE, strk-ib), blen,
-                                       MIN(STRB_BLKSIZE, strk+1-ib),
-                                       strk, ib, norb, na, na, nlink, nlink,
-                                       clink, clink);
+        // at least 2 blocks per thread for the rounds of tile pairs
+        int blksize = na / (omp_get_num_threads() * 2);
+        blksize = MAX(MIN(blksize, STRB_BLKSIZE), 16);
+        int nblk = (na + blksize - 1) / blksize;
+        // for odd nblk, the pairs of a dummy block are skipped
+        int nround = nblk + (nblk & 1) - 1;
+        int npair = (nblk + 1) / 2;
+        int round, ipair, p, q, ib, strk, stra1, blen;
+        double *t1buf = malloc(sizeof(double) * (blksize*norb*(norb+1)+2));
+
+        for (round = 0; round < nround; round++) {
+#pragma omp for schedule(dynamic)
+                for (ipair = 0; ipair < npair; ipair++) {
+                        if (ipair == 0) {
+                                p = nround;
+                                q = round;
+                        } else {
+                                p = (round + ipair) % nround;
+                                q = (round + nround - ipair) % nround;
+                        }
+                        if (p < q) {
+                                ib = p; p = q; q = ib;
+                        }
+                        if (p >= nblk) {
+                                continue;
+                        }
+                        ib = q * blksize;
+                        blen = MIN(blksize, na-ib);
+                        stra1 = MIN(p * blksize + blksize, na);
+                        for (strk = p * blksize; strk < stra1; strk++) {
+                                ctr_rhf2e_spin0_kern(eri, ci0, ci1, t1buf,
+                                                     blen, blen, strk, ib,
+                                                     norb, na, nlink, clink);
+                        }
+                }
+        }
+
+        // the diagonal tiles
+#pragma omp for schedule(dynamic)
+        for (p = 0; p < nblk; p++) {
+                ib = p * blksize;
+                stra1 = MIN(ib + blksize, na);
+                for (strk = ib; strk < stra1; strk++) {
+                        ctr_rhf2e_spin0_kern(eri, ci0, ci1, t1buf,
+                                             strk-ib, strk+1-ib, strk, ib,
+                                             norb, na, nlink, clink);
                 }
-                NPomp_dsum_reduce_inplace(ci1bufs, blen*na);
-#pragma omp master
-                FCIaxpy2d(ci1+ib, ci1buf, na, na, blen);
         }
-        free(ci1buf);
         free(t1buf);
 }
         free(clink);
 }
 
 
+/*
+ * Each thread owns blocks of STRA_BLKSIZE alpha strings (rows of ci1).  The
+ * (beta,beta) and (alpha,beta) parts of an owned row are computed by
+ * gathering the alpha excitations into t1.  The (alpha,alpha) part of an
+ * owned row is gathered from the elements of the (alpha,alpha) Hamiltonian
+ * (aa_hrow), which are generated once for the block of rows.  Threads only
+ * update their own rows of ci1.  No thread-private ci1 buffer and no
+ * reduction are needed.
+ */
 void FCIcontract_2e_spin1(double *eri, double *ci0, double *ci1,
                           int norb, int na, int nb, int nlinka, int nlinkb,
                           int *link_indexa, int *link_indexb)
@@ -388,37 +569,92 @@ void FCIcontract_2e_spin1(double *eri, double *ci0, double *ci1,
         FCIcompress_link_tril(clinkb, link_indexb, nb, nlinkb);
 
         memset(ci1, 0, sizeof(double)*na*nb);
-        double *ci1bufs[MAX_THREADS];
 #pragma omp parallel default(none) \
-        shared(eri, ci0, ci1, norb, na, nb, nlinka, nlinkb, \
-               clinka, clinkb, ci1bufs)
+        shared(eri, ci0, ci1, norb, na, nb, nlinka, nlinkb, clinka, clinkb)
 {
-        int strk, ib;
-        size_t blen;
+        int ia0, ia1, strk, ib, blen, n;
+        int hoff[STRA_BLKSIZE+1];
         double *t1buf = malloc(sizeof(double) * (STRB_BLKSIZE*norb*(norb+1)+2));
-        double *ci1buf = malloc(sizeof(double) * (na*STRB_BLKSIZE+2));
-        ci1bufs[omp_get_thread_num()] = ci1buf;
-        for (ib = 0; ib < nb; ib += STRB_BLKSIZE) {
-                blen = MIN(STRB_BLKSIZE, nb-ib);
-                memset(ci1buf, 0, sizeof(double) * na*blen);
-#pragma omp for schedule(static)
-                for (strk = 0; strk < na; strk++) {
-                        ctr_rhf2e_kern(eri, ci0, ci1, ci1buf, t1buf,
-                                       blen, blen, blen, strk, ib,
-                                       norb, na, nb, nlinka, nlinkb,
-                                       clinka, clinkb);
+        double *hrow = calloc(na, sizeof(double));
+        double *hval = malloc(sizeof(double) * STRA_BLKSIZE*nlinka*nlinka);
+        int *hidx = malloc(sizeof(int) * STRA_BLKSIZE*nlinka*nlinka);
+#pragma omp for schedule(dynamic)
+        for (ia0 = 0; ia0 < na; ia0 += STRA_BLKSIZE) {
+                ia1 = MIN(ia0+STRA_BLKSIZE, na);
+                hoff[0] = 0;
+                for (strk = ia0; strk < ia1; strk++) {
+                        n = strk - ia0;
+                        hoff[n+1] = hoff[n] + aa_hrow(hval+hoff[n], hidx+hoff[n],
+                                                      hrow, eri, strk,
+                                                      norb, nlinka, clinka);
+                }
+                for (ib = 0; ib < nb; ib += STRB_BLKSIZE) {
+                        blen = MIN(STRB_BLKSIZE, nb-ib);
+                        for (strk = ia0; strk < ia1; strk++) {
+                                n = strk - ia0;
+                                ctr_rhf2e_bb_kern(eri, ci0+ib, ci0, ci1, t1buf,
+                                                  blen, strk, strk, ib, nb,
+                                                  norb, nb, nlinka, nlinkb,
+                                                  clinka, clinkb);
+                                aa_gather(ci1+strk*(size_t)nb+ib, ci0+ib,
+                                          hval+hoff[n], hidx+hoff[n],
+                                          hoff[n+1]-hoff[n], blen, nb);
+                        }
                 }
-                NPomp_dsum_reduce_inplace(ci1bufs, blen*na);
-#pragma omp master
-                FCIaxpy2d(ci1+ib, ci1buf, na, nb, blen);
         }
-        free(ci1buf);
+        free(hidx);
+        free(hval);
+        free(hrow);
         free(t1buf);
 }
         free(clinka);
         free(clinkb);
 }
 
+/*
+ * FCIcontract_2e_spin1 for the distributed CI vector.  The alpha strings
+ * [stra0:stra1] are owned by the caller.  Only the beta strings
+ * [strb0:strb1] are contracted in each call.
+ *   ci0[stra0:stra1,:nb] and ci1[stra0:stra1,:nb] are the local rows of the
+ *      CI vectors.
+ *   ci0pan[:na,strb0:strb1] is the column panel of the entire ci0 (gathered
+ *      from all processes).
+ * Only the local rows of ci1 are updated.
+ * clinka and clinkb are the link tables compressed by FCIcompress_link_tril
+ */
+void FCIcontract_2e_spin1_rows(double *eri, double *ci0pan, double *ci0,
+                               double *ci1, int norb, int na, int nb,
+                               int nlinka, int nlinkb,
+                               int stra0, int stra1, int strb0, int strb1,
+                               _LinkTrilT *clinka, _LinkTrilT *clinkb)
+{
+        int blen = strb1 - strb0;
+#pragma omp parallel default(none) \
+        shared(eri, ci0pan, ci0, ci1, norb, na, nb, nlinka, nlinkb, \
+               stra0, stra1, strb0, blen, clinka, clinkb)
+{
+        const int nnorb = norb * (norb+1)/2;
+        int strk, nnz;
+        double *t1buf = malloc(sizeof(double) * (nnorb*blen*2+2));
+        double *hrow = calloc(na, sizeof(double));
+        double *hval = malloc(sizeof(double) * nlinka*nlinka);
+        int *hidx = malloc(sizeof(int) * nlinka*nlinka);
+#pragma omp for schedule(static)
+        for (strk = stra0; strk < stra1; strk++) {
+                ctr_rhf2e_bb_kern(eri, ci0pan, ci0, ci1, t1buf,
+                                  blen, strk, strk-stra0, strb0, blen, norb, nb,
+                                  nlinka, nlinkb, clinka, clinkb);
+                nnz = aa_hrow(hval, hidx, hrow, eri, strk, norb, nlinka, clinka);
+                aa_gather(ci1+(strk-stra0)*(size_t)nb+strb0, ci0pan,
+                          hval, hidx, nnz, blen, blen);
+        }
+        free(hidx);
+        free(hval);
+        free(hrow);
+        free(t1buf);
+}
+}
+
 
 /*
  * eri_ab is mixed integrals (alpha,alpha|beta,beta), |beta,beta) in small strides
@@ -567,18 +803,7 @@ void FCImake_hdiag(double *hdiag, double *h1e, double *jdiag, double *kdiag,
 
 static int first1(uint64_t r)
 {
-#ifdef HAVE_FFS
-        return ffsll(r) - 1;
-#else
-        int n = 0;
-        if (r >> (n + 32)) n += 32;
-        if (r >> (n + 16)) n += 16;
-        if (r >> (n +  8)) n +=  8;
-        if (r >> (n +  4)) n +=  4;
-        if (r >> (n +  2)) n +=  2;
-        if (r >> (n +  1)) n +=  1;
-        return n;
-#endif
+        return FCIbs_tzcnt64(r);
 }
 
 
@@ -0,0 +1,244 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+  
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+ 
+        http://www.apache.org/licenses/LICENSE-2.0
+ 
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * Single precision 2e contraction for the FCI solver.  The CI vectors, the
+ * t1 intermediates and the integrals are stored in float.  The structure is
+ * the same to FCIcontract_2e_spin1 in fci_contract.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "vhf/fblas.h"
+#include "fci.h"
+// the same size in bytes to the t1 buffer of fci_contract.c
+#define STRB_BLKSIZE    224
+#define STRA_BLKSIZE    16
+#define MIN(X,Y)        ((X)<(Y)?(X):(Y))
+
+static void prog_a_t1(float *ci0, float *t1, int bcount, int stra_id,
+                      int lda, int nlinka, _LinkTrilT *clink_indexa)
+{
+        int j, k, ia, sign;
+        size_t str1;
+        const _LinkTrilT *tab = clink_indexa + stra_id * nlinka;
+        float *pt1, *pci;
+
+        for (j = 0; j < nlinka; j++) {
+                ia   = EXTRACT_IA  (tab[j]);
+                str1 = EXTRACT_ADDR(tab[j]);
+                sign = EXTRACT_SIGN(tab[j]);
+                pt1 = t1 + ia*bcount;
+                pci = ci0 + str1*lda;
+                if (sign == 0) {
+                        break;
+                } else if (sign > 0) {
+                        for (k = 0; k < bcount; k++) {
+                                pt1[k] += pci[k];
+                        }
+                } else {
+                        for (k = 0; k < bcount; k++) {
+                                pt1[k] -= pci[k];
+                        }
+                }
+        }
+}
+
+static void prog_b_t1(float *ci0, float *t1, int bcount, int stra_id,
+                      int strb_id, int nb, int nlinkb, _LinkTrilT *clink_indexb)
+{
+        int j, ia, str0, str1, sign;
+        const _LinkTrilT *tab = clink_indexb + strb_id * nlinkb;
+        float *pci = ci0 + stra_id*(size_t)nb;
+
+        for (str0 = 0; str0 < bcount; str0++) {
+                for (j = 0; j < nlinkb; j++) {
+                        ia   = EXTRACT_IA  (tab[j]);
+                        str1 = EXTRACT_ADDR(tab[j]);
+                        sign = EXTRACT_SIGN(tab[j]);
+                        if (sign == 0) {
+                                break;
+                        } else {
+                                t1[ia*bcount+str0] += sign * pci[str1];
+                        }
+                }
+                tab += nlinkb;
+        }
+}
+
+static void spread_b_t1(float *ci1, float *t1, int bcount, int stra_id,
+                        int strb_id, int nb, int nlinkb, _LinkTrilT *clink_indexb)
+{
+        int j, ia, str0, str1, sign;
+        const _LinkTrilT *tab = clink_indexb + strb_id * nlinkb;
+        float *pci = ci1 + stra_id * (size_t)nb;
+
+        for (str0 = 0; str0 < bcount; str0++) {
+                for (j = 0; j < nlinkb; j++) {
+                        ia   = EXTRACT_IA  (tab[j]);
+                        str1 = EXTRACT_ADDR(tab[j]);
+                        sign = EXTRACT_SIGN(tab[j]);
+                        if (sign == 0) {
+                                break;
+                        } else {
+                                pci[str1] += sign * t1[ia*bcount+str0];
+                        }
+                }
+                tab += nlinkb;
+        }
+}
+
+/*
+ * (beta,beta) and (alpha,beta) parts for row stra_id, see ctr_rhf2e_bb_kern
+ * in fci_contract.c
+ */
+static void ctr_bb_kern(float *eri, float *ci0, float *ci1, float *t1buf,
+                        int bcount, int stra_id, int strb_id,
+                        int norb, int nb, int nlinka, int nlinkb,
+                        _LinkTrilT *clink_indexa, _LinkTrilT *clink_indexb)
+{
+        const char TRANS_N = 'N';
+        const float D0 = 0;
+        const float D1 = 1;
+        const int nnorb = norb * (norb+1)/2;
+        float *t1 = t1buf;
+        float *vt1 = t1buf + nnorb*bcount;
+        int i;
+
+        memset(t1, 0, sizeof(float)*nnorb*bcount);
+        prog_a_t1(ci0+strb_id, t1, bcount, stra_id, nb, nlinka, clink_indexa);
+        for (i = 0; i < nnorb*bcount; i++) {
+                t1[i] *= 2;
+        }
+        prog_b_t1(ci0, t1, bcount, stra_id, strb_id, nb, nlinkb, clink_indexb);
+
+        sgemm_(&TRANS_N, &TRANS_N, &bcount, &nnorb, &nnorb,
+               &D1, t1, &bcount, eri, &nnorb, &D0, vt1, &bcount);
+        spread_b_t1(ci1, vt1, bcount, stra_id, strb_id, nb, nlinkb, clink_indexb);
+}
+
+/*
+ * Row stra_id of the (alpha,alpha) Hamiltonian, see aa_hrow in
+ * fci_contract.c.  The elements are accumulated in double precision.
+ */
+static int aa_hrow(float *hval, int *hidx, double *hrow, float *eri,
+                   int stra_id, int norb, int nlinka, _LinkTrilT *clink_indexa)
+{
+        const size_t nnorb = norb * (norb+1)/2;
+        const _LinkTrilT *tab0 = clink_indexa + stra_id * nlinka;
+        const _LinkTrilT *tab1;
+        int j0, j1, ia, str1, str2, sign1, sign2;
+        int nnz = 0;
+        float *peri;
+
+        for (j0 = 0; j0 < nlinka; j0++) {
+                ia    = EXTRACT_IA  (tab0[j0]);
+                str1  = EXTRACT_ADDR(tab0[j0]);
+                sign1 = EXTRACT_SIGN(tab0[j0]);
+                if (sign1 == 0) {
+                        break;
+                }
+                peri = eri + ia * nnorb;
+                tab1 = clink_indexa + str1 * nlinka;
+                for (j1 = 0; j1 < nlinka; j1++) {
+                        ia    = EXTRACT_IA  (tab1[j1]);
+                        str2  = EXTRACT_ADDR(tab1[j1]);
+                        sign2 = EXTRACT_SIGN(tab1[j1]);
+                        if (sign2 == 0) {
+                                break;
+                        }
+                        if (hrow[str2] == 0) {
+                                hidx[nnz] = str2;
+                                nnz++;
+                        }
+                        hrow[str2] += sign1 * sign2 * peri[ia];
+                }
+        }
+        for (j0 = 0; j0 < nnz; j0++) {
+                hval[j0] = hrow[hidx[j0]];
+                hrow[hidx[j0]] = 0;
+        }
+        return nnz;
+}
+
+static void aa_gather(float *ci1, float *ci0, float *hval, int *hidx,
+                      int nnz, int bcount, int lda)
+{
+        int n, k;
+        float v;
+        float *pci0;
+        for (n = 0; n < nnz; n++) {
+                v = hval[n];
+                pci0 = ci0 + hidx[n] * (size_t)lda;
+                for (k = 0; k < bcount; k++) {
+                        ci1[k] += v * pci0[k];
+                }
+        }
+}
+
+/*
+ * Single precision version of FCIcontract_2e_spin1.  eri is the 4-fold
+ * symmetric 2e Hamiltonian in float.
+ */
+void FCIcontract_2e_spin1_f32(float *eri, float *ci0, float *ci1,
+                              int norb, int na, int nb, int nlinka, int nlinkb,
+                              int *link_indexa, int *link_indexb)
+{
+        _LinkTrilT *clinka = malloc(sizeof(_LinkTrilT) * nlinka * na);
+        _LinkTrilT *clinkb = malloc(sizeof(_LinkTrilT) * nlinkb * nb);
+        FCIcompress_link_tril(clinka, link_indexa, na, nlinka);
+        FCIcompress_link_tril(clinkb, link_indexb, nb, nlinkb);
+
+        memset(ci1, 0, sizeof(float)*na*nb);
+#pragma omp parallel default(none) \
+        shared(eri, ci0, ci1, norb, na, nb, nlinka, nlinkb, clinka, clinkb)
+{
+        int ia0, ia1, strk, ib, blen, n;
+        int hoff[STRA_BLKSIZE+1];
+        float *t1buf = malloc(sizeof(float) * (STRB_BLKSIZE*norb*(norb+1)+2));
+        double *hrow = calloc(na, sizeof(double));
+        float *hval = malloc(sizeof(float) * STRA_BLKSIZE*nlinka*nlinka);
+        int *hidx = malloc(sizeof(int) * STRA_BLKSIZE*nlinka*nlinka);
+#pragma omp for schedule(dynamic)
+        for (ia0 = 0; ia0 < na; ia0 += STRA_BLKSIZE) {
+                ia1 = MIN(ia0+STRA_BLKSIZE, na);
+                hoff[0] = 0;
+                for (strk = ia0; strk < ia1; strk++) {
+                        n = strk - ia0;
+                        hoff[n+1] = hoff[n] + aa_hrow(hval+hoff[n], hidx+hoff[n],
+                                                      hrow, eri, strk,
+                                                      norb, nlinka, clinka);
+                }
+                for (ib = 0; ib < nb; ib += STRB_BLKSIZE) {
+                        blen = MIN(STRB_BLKSIZE, nb-ib);
+                        for (strk = ia0; strk < ia1; strk++) {
+                                n = strk - ia0;
+                                ctr_bb_kern(eri, ci0, ci1, t1buf, blen, strk, ib,
+                                            norb, nb, nlinka, nlinkb,
+                                            clinka, clinkb);
+                                aa_gather(ci1+strk*(size_t)nb+ib, ci0+ib,
+                                          hval+hoff[n], hidx+hoff[n],
+                                          hoff[n+1]-hoff[n], blen, nb);
+                        }
+                }
+        }
+        free(hidx);
+        free(hval);
+        free(hrow);
+        free(t1buf);
+}
+        free(clinka);
+        free(clinkb);
+}
@@ -21,8 +21,8 @@
 //#include <omp.h>
 #include "config.h"
 #include "vhf/fblas.h"
+#include "np_helper/np_helper.h"
 #include "fci.h"
-#define MIN(X,Y)        ((X)<(Y)?(X):(Y))
 #define CSUMTHR         1e-28
 #define BUFBASE         96
 #define SQRT2           1.4142135623730950488
@@ -194,6 +194,91 @@ static void _transpose_jikl(double *dm2, int norb)
         free(tmp);
 }
 
+/*
+ * Screening of the CI blocks [stra_id,strb_id:strb_id+blksize] for the RDM
+ * drivers.  norm1[stra_id,ib] is an upper bound of the sum of the squared
+ * CI coefficients which contribute to E^i_j|ci> in block ib.  norm2 is the
+ * bound for E^i_j E^k_l|ci> (norm2 >= norm1).  Beta excitations stay on the
+ * row stra_id and are bounded by the norm of the row.  norm2 can be NULL.
+ */
+void FCIrdm_block_norm(double *norm1, double *norm2, double *ci,
+                       int na, int nb, int nlinka, _LinkT *clinka, int blksize)
+{
+        const int nblk = (nb + blksize - 1) / blksize;
+        double *cnorm = malloc(sizeof(double) * na * nblk);
+        double *rnorm = malloc(sizeof(double) * na);
+
+#pragma omp parallel \
+        shared(norm1, norm2, ci, na, nb, nlinka, clinka, blksize, cnorm, rnorm)
+{
+        int stra, ib, blk, j, k, str1;
+        double s, r;
+        double *pci;
+        _LinkT *tab;
+#pragma omp for schedule(static)
+        for (stra = 0; stra < na; stra++) {
+                pci = ci + (size_t)stra * nb;
+                r = 0;
+                for (blk = 0, ib = 0; ib < nb; blk++, ib += blksize) {
+                        s = 0;
+                        for (k = ib; k < MIN(ib+blksize, nb); k++) {
+                                s += pci[k] * pci[k];
+                        }
+                        cnorm[stra*nblk+blk] = s;
+                        r += s;
+                }
+                rnorm[stra] = r;
+        }
+
+#pragma omp for schedule(static)
+        for (stra = 0; stra < na; stra++) {
+                tab = clinka + stra * nlinka;
+                for (blk = 0; blk < nblk; blk++) {
+                        norm1[stra*nblk+blk] = rnorm[stra];
+                }
+                for (j = 0; j < nlinka; j++) {
+                        if (EXTRACT_SIGN(tab[j]) == 0) {
+                                break;
+                        }
+                        str1 = EXTRACT_ADDR(tab[j]);
+                        for (blk = 0; blk < nblk; blk++) {
+                                norm1[stra*nblk+blk] += cnorm[str1*nblk+blk];
+                        }
+                }
+        }
+
+        if (norm2 != NULL) {
+// E^i_j E^k_l|ci>: beta excitations from E^i_j|ci> on the whole row
+#pragma omp for schedule(static)
+                for (stra = 0; stra < na; stra++) {
+                        r = 0;
+                        for (blk = 0; blk < nblk; blk++) {
+                                r += norm1[stra*nblk+blk];
+                        }
+                        rnorm[stra] = r;
+                }
+#pragma omp for schedule(static)
+                for (stra = 0; stra < na; stra++) {
+                        tab = clinka + stra * nlinka;
+                        for (blk = 0; blk < nblk; blk++) {
+                                norm2[stra*nblk+blk] = rnorm[stra];
+                        }
+                        for (j = 0; j < nlinka; j++) {
+                                if (EXTRACT_SIGN(tab[j]) == 0) {
+                                        break;
+                                }
+                                str1 = EXTRACT_ADDR(tab[j]);
+                                for (blk = 0; blk < nblk; blk++) {
+                                        norm2[stra*nblk+blk] += norm1[str1*nblk+blk];
+                                }
+                        }
+                }
+        }
+}
+        free(cnorm);
+        free(rnorm);
+}
+
 /*
  * Note! The returned rdm2 from FCI*kern* function corresponds to
  *      [(p^+ q on <bra|) r^+ s] = [p q^+ r^+ s]
@@ -217,7 +302,8 @@ void FCIrdm12_drv(void (*dm12kernel)(),
                   int *link_indexa, int *link_indexb, int symm)
 {
         const int nnorb = norb * norb;
-        int strk, i, j, k, l, ib, blen;
+        const int nblk = (nb + BUFBASE - 1) / BUFBASE;
+        int i, j, k, l;
         double *pdm1, *pdm2;
         memset(rdm1, 0, sizeof(double) * nnorb);
         memset(rdm2, 0, sizeof(double) * nnorb*nnorb);
@@ -227,34 +313,56 @@ void FCIrdm12_drv(void (*dm12kernel)(),
         FCIcompress_link(clinka, link_indexa, norb, na, nlinka);
         FCIcompress_link(clinkb, link_indexb, norb, nb, nlinkb);
 
-#pragma omp parallel default(none) \
+// Skip the blocks in which E^i_j|bra> or E^i_j|ket> vanishes
+        double *bnorm = malloc(sizeof(double) * na * nblk * 2);
+        double *knorm = bnorm + na * nblk;
+        FCIrdm_block_norm(bnorm, NULL, bra, na, nb, nlinka, clinka, BUFBASE);
+        if (ket != bra) {
+                FCIrdm_block_norm(knorm, NULL, ket, na, nb, nlinka, clinka, BUFBASE);
+                for (i = 0; i < na * nblk; i++) {
+                        bnorm[i] = MIN(bnorm[i], knorm[i]);
+                }
+        }
+
+        double *pdm1s[MAX_THREADS];
+        double *pdm2s[MAX_THREADS];
+#pragma omp parallel \
         shared(dm12kernel, bra, ket, norb, na, nb, nlinka, \
-               nlinkb, clinka, clinkb, rdm1, rdm2, symm), \
-        private(strk, i, ib, blen, pdm1, pdm2)
+               nlinkb, clinka, clinkb, rdm1, rdm2, symm, bnorm, \
+               pdm1s, pdm2s)
 {
-        pdm1 = calloc(nnorb+2, sizeof(double));
-        pdm2 = calloc(nnorb*nnorb+2, sizeof(double));
+        int strk, ib, blen;
+        int thread_id = omp_get_thread_num();
+        double *pdm1, *pdm2;
+        if (thread_id == 0) {
+                pdm1 = rdm1;
+                pdm2 = rdm2;
+        } else {
+                pdm1 = calloc(nnorb+2, sizeof(double));
+                pdm2 = calloc(nnorb*nnorb+2, sizeof(double));
+        }
+        pdm1s[thread_id] = pdm1;
+        pdm2s[thread_id] = pdm2;
 #pragma omp for schedule(dynamic, 40)
         for (strk = 0; strk < na; strk++) {
                 for (ib = 0; ib < nb; ib += BUFBASE) {
+                        if (bnorm[strk*nblk+ib/BUFBASE] < CSUMTHR) {
+                                continue;
+                        }
                         blen = MIN(BUFBASE, nb-ib);
                         (*dm12kernel)(pdm1, pdm2, bra, ket, blen, strk, ib,
                                       norb, na, nb, nlinka, nlinkb,
                                       clinka, clinkb, symm);
                 }
         }
-#pragma omp critical
-{
-        for (i = 0; i < nnorb; i++) {
-                rdm1[i] += pdm1[i];
+        NPomp_dsum_reduce_inplace(pdm1s, nnorb);
+        NPomp_dsum_reduce_inplace(pdm2s, (size_t)nnorb*nnorb);
+        if (thread_id != 0) {
+                free(pdm1);
+                free(pdm2);
         }
-        for (i = 0; i < nnorb*nnorb; i++) {
-                rdm2[i] += pdm2[i];
-        }
-}
-        free(pdm1);
-        free(pdm2);
 }
+        free(bnorm);
         free(clinka);
         free(clinkb);
         switch (symm) {
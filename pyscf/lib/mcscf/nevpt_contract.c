@@ -26,6 +26,7 @@
 #define MIN(X,Y)        ((X)<(Y)?(X):(Y))
 #define BLK     48
 #define BUFBASE 96
+#define CSUMTHR 1e-28
 
 double FCI_t1ci_sf(double *ci0, double *t1, int bcount,
                    int stra_id, int strb_id,
@@ -253,6 +254,7 @@ void NEVPTcontract(void (*kernel)(),
 {
         const size_t nnorb = norb * norb;
         const size_t n4 = nnorb * nnorb;
+        const int nblk = (nb + BUFBASE - 1) / BUFBASE;
         int i, j, k, ib, strk, bcount;
         double *pdm2 = malloc(sizeof(double) * n4);
         double *cp1, *cp0;
@@ -264,8 +266,16 @@ void NEVPTcontract(void (*kernel)(),
         memset(pdm2, 0, sizeof(double) * n4);
         memset(rdm3, 0, sizeof(double) * n4 * nnorb);
 
+// Every term of NEVPTkern_sf carries E^i_j E^k_l|ci0> of the block
+        double *norm1 = malloc(sizeof(double) * na * nblk);
+        double *norm2 = malloc(sizeof(double) * na * nblk);
+        FCIrdm_block_norm(norm1, norm2, ci0, na, nb, nlinka, clinka, BUFBASE);
+
         for (strk = 0; strk < na; strk++) {
                 for (ib = 0; ib < nb; ib += BUFBASE) {
+                        if (norm2[strk*nblk+ib/BUFBASE] < CSUMTHR) {
+                                continue;
+                        }
                         bcount = MIN(BUFBASE, nb-ib);
                         NEVPTkern_sf(kernel, pdm2, rdm3,
                                      eri, ci0, bcount, strk, ib,
@@ -274,6 +284,8 @@ void NEVPTcontract(void (*kernel)(),
         }
         free(clinka);
         free(clinkb);
+        free(norm1);
+        free(norm2);
 
         for (i = 0; i < norb; i++) {
         for (j = 0; j < norb; j++) {
@@ -49,6 +49,59 @@ int SCIstr2addr(uint64_t str, uint64_t *strsbook, int nstrs)
         return addr;
 }
 
+/*
+ * The table size is a power of 2 and at least twice of nstrs.  The slot of
+ * a string is given by the Fibonacci hashing of the string.
+ */
+void SCIstrs_hash_init(SCIStrsHash *table, uint64_t *strs, int nstrs)
+{
+        int bits = 4;
+        while ((1ULL << bits) < nstrs * 2ULL) {
+                bits++;
+        }
+        size_t size = 1ULL << bits;
+        uint64_t mask = size - 1;
+        int shift = 64 - bits;
+        _StrsHashEntry *entries = malloc(sizeof(_StrsHashEntry) * size);
+        uint64_t i;
+        int n;
+        for (i = 0; i < size; i++) {
+                entries[i].addr = -1;
+        }
+        for (n = 0; n < nstrs; n++) {
+                i = (strs[n] * 0x9e3779b97f4a7c15ULL) >> shift;
+                while (entries[i].addr >= 0) {
+                        i = (i + 1) & mask;
+                }
+                entries[i].str = strs[n];
+                entries[i].addr = n;
+        }
+        table->entries = entries;
+        table->mask = mask;
+        table->shift = shift;
+}
+
+void SCIstrs_hash_del(SCIStrsHash *table)
+{
+        free(table->entries);
+}
+
+/*
+ * Return the address of str in the string set.  -1 if str is not found.
+ */
+int SCIstrs_hash_addr(SCIStrsHash *table, uint64_t str)
+{
+        _StrsHashEntry *entries = table->entries;
+        uint64_t i = (str * 0x9e3779b97f4a7c15ULL) >> table->shift;
+        while (entries[i].addr >= 0) {
+                if (entries[i].str == str) {
+                        return entries[i].addr;
+                }
+                i = (i + 1) & table->mask;
+        }
+        return -1;
+}
+
 static void make_occ_vir(int *occ, int *vir, uint64_t str1, int norb)
 {
         int i, io, iv;
@@ -74,6 +127,8 @@ void SCIcre_des_linkstr(int *link_index, int norb, int nstrs, int nocc,
         int str_id, i, a, k, ai, addr;
         uint64_t str0, str1;
         int *tab;
+        SCIStrsHash table;
+        SCIstrs_hash_init(&table, strs, nstrs);
 
         for (str_id = 0; str_id < ninter; str_id++) {
                 str1 = strs[str_id];
@@ -89,7 +144,7 @@ void SCIcre_des_linkstr(int *link_index, int norb, int nstrs, int nocc,
                         for (a = 0; a < nvir; a++) {
                         for (i = 0; i < nocc; i++) {
                                 str0 = (str1^(1ULL<<occ[i])) | (1ULL<<vir[a]);
-                                addr = SCIstr2addr(str0, strs, nstrs);
+                                addr = SCIstrs_hash_addr(&table, str0);
                                 if (addr >= 0) {
                                         if (vir[a] > occ[i]) {
                                                 ai = vir[a]*(vir[a]+1)/2+occ[i];
@@ -113,7 +168,7 @@ void SCIcre_des_linkstr(int *link_index, int norb, int nstrs, int nocc,
                         for (a = 0; a < nvir; a++) {
                         for (i = 0; i < nocc; i++) {
                                 str0 = (str1^(1ULL<<occ[i])) | (1ULL<<vir[a]);
-                                addr = SCIstr2addr(str0, strs, nstrs);
+                                addr = SCIstrs_hash_addr(&table, str0);
                                 if (addr >= 0) {
                                         tab[k*4+0] = vir[a];
                                         tab[k*4+1] = occ[i];
@@ -124,6 +179,7 @@ void SCIcre_des_linkstr(int *link_index, int norb, int nstrs, int nocc,
                         } }
                 }
         }
+        SCIstrs_hash_del(&table);
 }
 
 void SCIdes_des_linkstr(int *link_index, int norb, int nocc, int nstrs, int ninter,
@@ -137,6 +193,8 @@ void SCIdes_des_linkstr(int *link_index, int norb, int nocc, int nstrs, int nint
         int nvir = norb - nocc + 2;
         int nlink = nvir * nvir;
         int *tab;
+        SCIStrsHash table;
+        SCIstrs_hash_init(&table, strs, nstrs);
         for (str_id = 0; str_id < ninter; str_id++) {
                 str1 = inter[str_id];
                 make_occ_vir(occ, vir, str1, norb);
@@ -146,7 +204,7 @@ void SCIdes_des_linkstr(int *link_index, int norb, int nocc, int nstrs, int nint
                         for (k = 0, i = 1; i < nvir; i++) {
                         for (j = 0; j < i; j++) {
                                 str0 = str1 | (1ULL<<vir[i]) | (1ULL<<vir[j]);
-                                addr = SCIstr2addr(str0, strs, nstrs);
+                                addr = SCIstrs_hash_addr(&table, str0);
                                 if (addr >= 0) {
                                         sign = FCIcre_sign(vir[i], str1);
                                         sign*= FCIdes_sign(vir[j], str0);
@@ -161,7 +219,7 @@ void SCIdes_des_linkstr(int *link_index, int norb, int nocc, int nstrs, int nint
                         for (k = 0, i = 1; i < nvir; i++) {
                         for (j = 0; j < i; j++) {
                                 str0 = str1 | (1ULL<<vir[i]) | (1ULL<<vir[j]);
-                                addr = SCIstr2addr(str0, strs, nstrs);
+                                addr = SCIstrs_hash_addr(&table, str0);
                                 if (addr >= 0) {
                                         sign = FCIcre_sign(vir[i], str1);
                                         sign*= FCIdes_sign(vir[j], str0);
@@ -179,6 +237,7 @@ void SCIdes_des_linkstr(int *link_index, int norb, int nocc, int nstrs, int nint
                         } }
                 }
         }
+        SCIstrs_hash_del(&table);
 }
 
 int SCIdes_uniq_strs(uint64_t *uniq_strs, uint64_t *strs,
@@ -209,13 +268,15 @@ void SCIdes_linkstr(int *link_index, int norb, int nocc, int nstrs, int ninter,
         int nvir = norb - nocc + 1;
         int nlink = nvir;
         int *tab;
+        SCIStrsHash table;
+        SCIstrs_hash_init(&table, strs, nstrs);
         for (str_id = 0; str_id < ninter; str_id++) {
                 str1 = inter[str_id];
                 tab = link_index + str_id * nlink * 4;
                 for (k = 0, i = 0; i < norb; i++) {
                         if (!(str1 & (1ULL<<i))) {
                                 str0 = str1 | (1ULL<<i);
-                                addr = SCIstr2addr(str0, strs, nstrs);
+                                addr = SCIstrs_hash_addr(&table, str0);
                                 if (addr >= 0) {
                                         tab[k*4+0] = 0;
                                         tab[k*4+1] = i;
@@ -226,6 +287,7 @@ void SCIdes_linkstr(int *link_index, int norb, int nocc, int nstrs, int ninter,
                         }
                 }
         }
+        SCIstrs_hash_del(&table);
 }
 
 int SCIcre_uniq_strs(uint64_t *uniq_strs, uint64_t *strs,
@@ -255,13 +317,15 @@ void SCIcre_linkstr(int *link_index, int norb, int nocc, int nstrs, int ninter,
         uint64_t str0, str1;
         int nlink = nocc + 1;
         int *tab;
+        SCIStrsHash table;
+        SCIstrs_hash_init(&table, strs, nstrs);
         for (str_id = 0; str_id < ninter; str_id++) {
                 str1 = inter[str_id];
                 tab = link_index + str_id * nlink * 4;
                 for (k = 0, i = 0; i < norb; i++) {
                         if (str1 & (1ULL<<i)) {
                                 str0 = str1 ^ (1ULL<<i);
-                                addr = SCIstr2addr(str0, strs, nstrs);
+                                addr = SCIstrs_hash_addr(&table, str0);
                                 if (addr >= 0) {
                                         tab[k*4+0] = i;
                                         tab[k*4+1] = 0;
@@ -272,6 +336,7 @@ void SCIcre_linkstr(int *link_index, int norb, int nocc, int nstrs, int ninter,
                         }
                 }
         }
+        SCIstrs_hash_del(&table);
 }
 
 int SCIselect_strs(uint64_t *inter, uint64_t *strs,
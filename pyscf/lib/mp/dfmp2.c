@@ -0,0 +1,258 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * RI-MP2 energy for a block of occupied pairs
+ *
+ *      (ia|jb) = sum_P L[P,ia] L[P,jb]
+ *
+ * The integrals of one i and all j of the block are generated by one DGEMM.
+ * The amplitudes and the energy are evaluated in the same pass, so nothing
+ * larger than nvir*nj*nvir is held for each thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "vhf/fblas.h"
+#include "np_helper/np_helper.h"
+
+/*
+ * For i in [i0:i0+ni], j in [j0:j0+nj]
+ *
+ *      g[i,a,j,b] = (ia|jb) = sum_P Lia[P,i*nva+a] Ljb[P,j*nvb+b]
+ *      t[i,a,j,b] = g[i,a,j,b] / (e_i + e_j - e_a - e_b)
+ *      e[0] += sum t[i,a,j,b] g[i,a,j,b]
+ *      e[1] += sum (t[i,a,j,b] - t[i,b,j,a]) g[i,a,j,b]     if exchange
+ *
+ * Lia: (naux,ni*nva) the columns of the i block, leading dimension lda
+ * Ljb: (naux,nj*nvb) the columns of the j block, leading dimension ldb
+ * eo_i, eo_j, ev_a, ev_b: orbital energies of i, j, a, b
+ * exchange: i and j (a and b) are the orbitals of the same spin.  nva == nvb
+ * tril: only the pairs i0+i >= j0+j are evaluated.  The pairs i0+i > j0+j
+ *      are counted twice.  i and j should be the same orbitals.
+ *
+ * If gamma is not NULL, the intermediates of the amplitudes
+ *      T[i,a,j,b] = fos * t[i,a,j,b] + fss * (t[i,a,j,b] - t[i,b,j,a])
+ * are accumulated (tril should be 0)
+ *
+ *      gamma[P,i*nva+a] += sum_jb T[i,a,j,b] Ljb[P,j*nvb+b]  (leading dim lda)
+ *      dm1occ[j,k] += sum_iab t[i,a,j,b] T[i,a,k,b]         (nj,nj), leading dim ldo
+ *      dm1vir[b,c] += sum_iaj t[i,a,j,b] T[i,a,j,c]         (nvb,nvb)
+ *
+ * dm1occ is the diagonal block of the j block.  The blocks between two
+ * different j blocks are computed by MP2_df_dm1occ.
+ */
+void MP2_df_energy(double *e, double *Lia, double *Ljb, int lda, int ldb,
+                   double *eo_i, double *eo_j, double *ev_a, double *ev_b,
+                   int i0, int ni, int j0, int nj, int nva, int nvb, int naux,
+                   int exchange, int tril,
+                   double *gamma, double *dm1occ, int ldo, double *dm1vir,
+                   double fos, double fss)
+{
+        const size_t nbuf = (size_t)nva * nj * nvb;
+#pragma omp parallel \
+        shared(e, Lia, Ljb, lda, ldb, eo_i, eo_j, ev_a, ev_b, i0, ni, j0, nj, \
+               nva, nvb, naux, exchange, tril, gamma, dm1occ, ldo, dm1vir, \
+               fos, fss)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D0 = 0;
+        const double D1 = 1;
+        int i, j, k, a, b, njj, njb, naj;
+        double eij, eija, d, t, tx, g, fac;
+        double e0 = 0;
+        double e1 = 0;
+        double *buf = malloc(sizeof(double) * nbuf);
+        double *tbuf = NULL;
+        double *doo = NULL;
+        double *dvv = NULL;
+        double *pbuf, *pt;
+        if (gamma != NULL) {
+                tbuf = malloc(sizeof(double) * nbuf);
+                doo = calloc((size_t)nj*nj + (size_t)nvb*nvb, sizeof(double));
+                dvv = doo + nj * nj;
+        }
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < ni; i++) {
+                if (tril) {
+                        njj = MIN(nj, i0 + i + 1 - j0);
+                        if (njj <= 0) {
+                                continue;
+                        }
+                } else {
+                        njj = nj;
+                }
+                njb = njj * nvb;
+                // buf[a,j,b] = (ia|jb)
+                dgemm_(&TRANS_N, &TRANS_T, &njb, &nva, &naux,
+                       &D1, Ljb, &ldb, Lia+i*nva, &lda, &D0, buf, &njb);
+
+                for (a = 0; a < nva; a++) {
+                for (j = 0; j < njj; j++) {
+                        eij = eo_i[i] + eo_j[j];
+                        eija = eij - ev_a[a];
+                        if (tril && i0+i > j0+j) {
+                                fac = 2;
+                        } else {
+                                fac = 1;
+                        }
+                        pbuf = buf + (size_t)a * njb + j * nvb;
+                        for (b = 0; b < nvb; b++) {
+                                d = eija - ev_b[b];
+                                g = pbuf[b];
+                                t = g / d;
+                                e0 += fac * t * g;
+                                if (exchange) {
+                                        // t[i,b,j,a]
+                                        tx = buf[(size_t)b*njb+j*nvb+a] / d;
+                                        e1 += fac * (t - tx) * g;
+                                        if (tbuf != NULL) {
+                                                tbuf[(size_t)a*njb+j*nvb+b] = fos * t + fss * (t - tx);
+                                        }
+                                } else if (tbuf != NULL) {
+                                        tbuf[(size_t)a*njb+j*nvb+b] = fos * t;
+                                }
+                        }
+                } }
+
+                if (gamma == NULL) {
+                        continue;
+                }
+                // buf <- t
+                for (a = 0; a < nva; a++) {
+                for (j = 0; j < njj; j++) {
+                        eija = eo_i[i] + eo_j[j] - ev_a[a];
+                        pbuf = buf + (size_t)a * njb + j * nvb;
+                        for (b = 0; b < nvb; b++) {
+                                pbuf[b] /= eija - ev_b[b];
+                        }
+                } }
+                // gamma[P,i*nva+a] += sum_jb T[a,jb] Ljb[P,jb]
+                dgemm_(&TRANS_T, &TRANS_N, &nva, &naux, &njb,
+                       &D1, tbuf, &njb, Ljb, &ldb, &D1, gamma+i*nva, &lda);
+                // dvv[b,c] += sum_aj t[aj,b] T[aj,c]
+                naj = nva * njj;
+                dgemm_(&TRANS_N, &TRANS_T, &nvb, &nvb, &naj,
+                       &D1, tbuf, &nvb, buf, &nvb, &D1, dvv, &nvb);
+                // doo[j,k] += sum_ab t[a,j,b] T[a,k,b]
+                for (a = 0; a < nva; a++) {
+                        pbuf = buf + (size_t)a * njb;
+                        pt = tbuf + (size_t)a * njb;
+                        dgemm_(&TRANS_T, &TRANS_N, &njj, &njj, &nvb,
+                               &D1, pt, &nvb, pbuf, &nvb, &D1, doo, &njj);
+                }
+        }
+        free(buf);
+#pragma omp critical
+{
+        e[0] += e0;
+        e[1] += e1;
+        if (gamma != NULL) {
+                for (j = 0; j < nj; j++) {
+                for (k = 0; k < nj; k++) {
+                        dm1occ[j*ldo+k] += doo[j*nj+k];
+                } }
+                for (i = 0; i < nvb*nvb; i++) {
+                        dm1vir[i] += dvv[i];
+                }
+        }
+}
+        if (gamma != NULL) {
+                free(tbuf);
+                free(doo);
+        }
+}
+}
+
+/*
+ * The off-diagonal block of dm1occ between two blocks of j and k
+ *
+ *      dm1occ[j,k] += sum_iab t[i,a,j,b] T[i,a,k,b]
+ *
+ * for i in [0:ni], j in [0:nj] and k in [0:nk].  t and T are defined as in
+ * MP2_df_energy.  Ljb, Lkb are the columns of the j and k blocks,
+ * eo_j, eo_k their orbital energies.  dm1occ: (nj,nk), leading dimension ldo
+ */
+void MP2_df_dm1occ(double *dm1occ, int ldo,
+                   double *Lia, double *Ljb, double *Lkb, int lda, int ldb,
+                   double *eo_i, double *eo_j, double *eo_k,
+                   double *ev_a, double *ev_b,
+                   int ni, int nj, int nk, int nva, int nvb, int naux,
+                   int exchange, double fos, double fss)
+{
+#pragma omp parallel \
+        shared(dm1occ, ldo, Lia, Ljb, Lkb, lda, ldb, eo_i, eo_j, eo_k, \
+               ev_a, ev_b, ni, nj, nk, nva, nvb, naux, exchange, fos, fss)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D0 = 0;
+        const double D1 = 1;
+        const int njb = nj * nvb;
+        const int nkb = nk * nvb;
+        int i, j, k, a, b;
+        double eija, t, tx;
+        double *bufj = malloc(sizeof(double) * nva * (njb + nkb*2));
+        double *bufk = bufj + (size_t)nva * njb;
+        double *tbuf = bufk + (size_t)nva * nkb;
+        double *doo = calloc((size_t)nj*nk, sizeof(double));
+        double *pbuf, *pt;
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < ni; i++) {
+                // bufj[a,j,b] = (ia|jb), bufk[a,k,b] = (ia|kb)
+                dgemm_(&TRANS_N, &TRANS_T, &njb, &nva, &naux,
+                       &D1, Ljb, &ldb, Lia+i*nva, &lda, &D0, bufj, &njb);
+                dgemm_(&TRANS_N, &TRANS_T, &nkb, &nva, &naux,
+                       &D1, Lkb, &ldb, Lia+i*nva, &lda, &D0, bufk, &nkb);
+                for (a = 0; a < nva; a++) {
+                for (j = 0; j < nj; j++) {
+                        eija = eo_i[i] + eo_j[j] - ev_a[a];
+                        pbuf = bufj + (size_t)a * njb + j * nvb;
+                        for (b = 0; b < nvb; b++) {
+                                pbuf[b] /= eija - ev_b[b];
+                        }
+                } }
+                for (a = 0; a < nva; a++) {
+                for (k = 0; k < nk; k++) {
+                        eija = eo_i[i] + eo_k[k] - ev_a[a];
+                        pbuf = bufk + (size_t)a * nkb + k * nvb;
+                        pt = tbuf + (size_t)a * nkb + k * nvb;
+                        for (b = 0; b < nvb; b++) {
+                                t = pbuf[b] / (eija - ev_b[b]);
+                                if (exchange) {
+                                        tx = bufk[(size_t)b*nkb+k*nvb+a] / (eija - ev_b[b]);
+                                        pt[b] = fos * t + fss * (t - tx);
+                                } else {
+                                        pt[b] = fos * t;
+                                }
+                        }
+                } }
+                // doo[j,k] += sum_ab t[a,j,b] T[a,k,b]
+                for (a = 0; a < nva; a++) {
+                        dgemm_(&TRANS_T, &TRANS_N, &nk, &nj, &nvb,
+                               &D1, tbuf+(size_t)a*nkb, &nvb,
+                               bufj+(size_t)a*njb, &nvb, &D1, doo, &nk);
+                }
+        }
+        free(bufj);
+#pragma omp critical
+        for (j = 0; j < nj; j++) {
+        for (k = 0; k < nk; k++) {
+                dm1occ[j*ldo+k] += doo[j*nk+k];
+        } }
+        free(doo);
+}
+}
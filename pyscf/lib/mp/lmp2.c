@@ -0,0 +1,86 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * Amplitude equation of local MP2 in the pair domains
+ */
+
+#include <stdlib.h>
+#include "config.h"
+#include "vhf/fblas.h"
+#include "np_helper/np_helper.h"
+
+/*
+ * R_ij = K_ij + (e_a + e_b - f_ii - f_jj) T_ij
+ *      - sum_{k!=i} f_ik S_{ij,kj} T_kj S_{kj,ij}
+ *      - sum_{k!=j} f_kj S_{ij,ik} T_ik S_{ik,ij}
+ *
+ * The virtual orbitals of the pair p = (i,j) are the semi-canonical
+ * orbitals of its domain, dims[p] of them.  T, R and K of pair p are the
+ * (dims[p],dims[p]) matrices at t_loc[p].  Their orbital energies are
+ * eps[e_loc[p]:].  fpair[p] = f_ii + f_jj.
+ *
+ * The Fock couplings of pair p are c in [c_loc[p]:c_loc[p+1]]:
+ *      c_pair[c]: the coupled pair q, which is (k,j) or (i,k)
+ *      c_trans[c]: whether T_q is stored as the transpose of T_kj or T_ik
+ *      c_f[c]: f_ik or f_kj
+ *      S+s_loc[c]: the overlap S_{p,q} of the domains, (dims[p],dims[q])
+ */
+void LMP2_residual(double *R, double *T, double *K, double *eps,
+                   double *fpair, int *dims, size_t *t_loc, int *e_loc,
+                   int *c_loc, int *c_pair, int *c_trans, double *c_f,
+                   double *S, size_t *s_loc, int npair, int max_dim)
+{
+#pragma omp parallel default(none) \
+        shared(R, T, K, eps, fpair, dims, t_loc, e_loc, c_loc, c_pair, \
+               c_trans, c_f, S, s_loc, npair, max_dim)
+{
+        const char TRANS_N = 'N';
+        const char TRANS_T = 'T';
+        const double D0 = 0;
+        const double D1 = 1;
+        double *buf = malloc(sizeof(double) * max_dim * max_dim);
+        int p, q, c, a, b, n, m;
+        double *pR, *pT, *pK, *pe, *pS;
+        double fac;
+#pragma omp for schedule(dynamic)
+        for (p = 0; p < npair; p++) {
+                n = dims[p];
+                pR = R + t_loc[p];
+                pT = T + t_loc[p];
+                pK = K + t_loc[p];
+                pe = eps + e_loc[p];
+                for (a = 0; a < n; a++) {
+                for (b = 0; b < n; b++) {
+                        pR[a*n+b] = pK[a*n+b]
+                                  + (pe[a] + pe[b] - fpair[p]) * pT[a*n+b];
+                } }
+
+                for (c = c_loc[p]; c < c_loc[p+1]; c++) {
+                        q = c_pair[c];
+                        m = dims[q];
+                        pS = S + s_loc[c];
+                        fac = -c_f[c];
+                        // buf[a,d] = sum_c S[a,c] T_q[c,d]
+                        dgemm_(c_trans[c] ? &TRANS_T : &TRANS_N, &TRANS_N,
+                               &m, &n, &m, &D1, T+t_loc[q], &m, pS, &m,
+                               &D0, buf, &m);
+                        // R[a,b] -= f * sum_d buf[a,d] S[b,d]
+                        dgemm_(&TRANS_T, &TRANS_N, &n, &n, &m,
+                               &fac, pS, &m, buf, &m, &D1, pR, &n);
+                }
+        }
+        free(buf);
+}
+}
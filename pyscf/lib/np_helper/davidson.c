@@ -0,0 +1,235 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * Subspace operations of the Davidson diagonalization.  The subspace
+ * vectors are the rows of a C-contiguous array (nvec,n).  The array can be
+ * a memory-mapped file.  Every function streams the columns of the vectors
+ * block by block.  The column blocks are distributed over threads.
+ *
+ * The row stride n is passed to BLAS as the leading dimension.  If n does
+ * not fit in int, the column blocks are first copied to contiguous buffers.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "config.h"
+#include "vhf/fblas.h"
+
+#define MIN(X,Y)        ((X) < (Y) ? (X) : (Y))
+// 8 vectors of COLBLK columns are 256 KB
+#define COLBLK          4096
+
+/*
+ * out[:nrow,:k] = x[:nrow,i0:i0+k], the row stride of x is n
+ */
+static void pack_cols(double *out, double *x, int nrow, size_t n,
+                      size_t i0, int k)
+{
+        int i;
+        for (i = 0; i < nrow; i++) {
+                memcpy(out+(size_t)i*k, x+i*n+i0, sizeof(double) * k);
+        }
+}
+
+static void unpack_cols(double *x, double *in, int nrow, size_t n,
+                        size_t i0, int k)
+{
+        int i;
+        for (i = 0; i < nrow; i++) {
+                memcpy(x+i*n+i0, in+(size_t)i*k, sizeof(double) * k);
+        }
+}
+
+/*
+ * c[m,p] = a[:m,:n] . b[:p,:n].T
+ */
+void NPdsubspace_dot(double *c, double *a, double *b,
+                     int m, int p, size_t n)
+{
+        memset(c, 0, sizeof(double) * m * p);
+        if (m == 0 || p == 0) {
+                return;
+        }
+#pragma omp parallel default(none) shared(c, a, b, m, p, n)
+{
+        const char TRANS_T = 'T';
+        const char TRANS_N = 'N';
+        const double D1 = 1;
+        const int packed = (n > INT_MAX);
+        int ld = packed ? COLBLK : n;
+        int i, k;
+        size_t i0;
+        double *cbuf = calloc(m * p, sizeof(double));
+        double *abuf = NULL;
+        double *bbuf = NULL;
+        double *pa, *pb;
+        if (packed) {
+                abuf = malloc(sizeof(double) * (m + p) * COLBLK);
+                bbuf = abuf + (size_t)m * COLBLK;
+        }
+#pragma omp for schedule(static)
+        for (i0 = 0; i0 < n; i0 += COLBLK) {
+                k = MIN(COLBLK, n-i0);
+                if (packed) {
+                        pack_cols(abuf, a, m, n, i0, k);
+                        pack_cols(bbuf, b, p, n, i0, k);
+                        pa = abuf;
+                        pb = bbuf;
+                        ld = k;
+                } else {
+                        pa = a + i0;
+                        pb = b + i0;
+                }
+                // column-major c.T[p,m] = b[:p,i0:i0+k] . a[:m,i0:i0+k].T
+                dgemm_(&TRANS_T, &TRANS_N, &p, &m, &k,
+                       &D1, pb, &ld, pa, &ld, &D1, cbuf, &p);
+        }
+#pragma omp critical
+        for (i = 0; i < m*p; i++) {
+                c[i] += cbuf[i];
+        }
+        free(cbuf);
+        if (packed) {
+                free(abuf);
+        }
+}
+}
+
+/*
+ * y[:p,:n] = alpha * v[m,p].T . x[:m,:n] + beta * y[:p,:n]
+ * y should not overlap with x.
+ */
+void NPdsubspace_rotate(double *y, double *v, double *x,
+                        int m, int p, size_t n, double alpha, double beta)
+{
+        if (p == 0) {
+                return;
+        }
+#pragma omp parallel default(none) shared(y, v, x, m, p, n, alpha, beta)
+{
+        const char TRANS_T = 'T';
+        const char TRANS_N = 'N';
+        const int packed = (n > INT_MAX);
+        int ld = packed ? COLBLK : n;
+        int i, j, k;
+        size_t i0;
+        double *xbuf = NULL;
+        double *ybuf = NULL;
+        if (packed) {
+                xbuf = malloc(sizeof(double) * (m + p) * COLBLK);
+                ybuf = xbuf + (size_t)m * COLBLK;
+        }
+#pragma omp for schedule(static)
+        for (i0 = 0; i0 < n; i0 += COLBLK) {
+                k = MIN(COLBLK, n-i0);
+                if (m == 0) {
+                        // y = beta * y
+                        if (beta == 0) {
+                                for (i = 0; i < p; i++) {
+                                        memset(y+i*n+i0, 0, sizeof(double)*k);
+                                }
+                        } else if (beta != 1) {
+                                for (i = 0; i < p; i++) {
+                                        for (j = 0; j < k; j++) {
+                                                y[i*n+i0+j] *= beta;
+                                        }
+                                }
+                        }
+                } else if (packed) {
+                        ld = k;
+                        pack_cols(xbuf, x, m, n, i0, k);
+                        if (beta != 0) {
+                                pack_cols(ybuf, y, p, n, i0, k);
+                        }
+                        dgemm_(&TRANS_N, &TRANS_T, &k, &p, &m,
+                               &alpha, xbuf, &ld, v, &p, &beta, ybuf, &ld);
+                        unpack_cols(y, ybuf, p, n, i0, k);
+                } else {
+                        // column-major y.T[k,p] = x.T[k,m] . v[m,p]
+                        dgemm_(&TRANS_N, &TRANS_T, &k, &p, &m,
+                               &alpha, x+i0, &ld, v, &p, &beta, y+i0, &ld);
+                }
+        }
+        if (packed) {
+                free(xbuf);
+        }
+}
+}
+
+static double vec_dot(double *x, double *y, size_t n)
+{
+        double s = 0;
+        size_t i;
+#pragma omp parallel for default(none) shared(x, y, n) \
+        schedule(static) reduction(+:s)
+        for (i = 0; i < n; i++) {
+                s += x[i] * y[i];
+        }
+        return s;
+}
+
+static void vec_axpy(double a, double *x, double *y, size_t n)
+{
+        size_t i;
+#pragma omp parallel for default(none) shared(a, x, y, n) schedule(static)
+        for (i = 0; i < n; i++) {
+                y[i] += a * x[i];
+        }
+}
+
+/*
+ * Orthonormalize the trial vectors xt[:nvec] against the orthonormal
+ * subspace xs[:space] (blocked classical Gram-Schmidt, applied twice) then
+ * among themselves (modified Gram-Schmidt).  The vectors whose squared norm
+ * after the projection is smaller than lindep are discarded.  The remaining
+ * vectors are moved to the front of xt.  The number of the remaining
+ * vectors is returned.
+ */
+int NPdsubspace_orth(double *xs, int space, double *xt, int nvec, size_t n,
+                     double lindep)
+{
+        int i, j, pass;
+        int kept = 0;
+        size_t k;
+        double norm;
+        double *s;
+
+        if (space > 0 && nvec > 0) {
+                s = malloc(sizeof(double) * space * nvec);
+                for (pass = 0; pass < 2; pass++) {
+                        NPdsubspace_dot(s, xs, xt, space, nvec, n);
+                        NPdsubspace_rotate(xt, s, xs, space, nvec, n, -1., 1.);
+                }
+                free(s);
+        }
+
+        for (i = 0; i < nvec; i++) {
+                for (j = 0; j < kept; j++) {
+                        norm = vec_dot(xt+j*n, xt+i*n, n);
+                        vec_axpy(-norm, xt+j*n, xt+i*n, n);
+                }
+                norm = vec_dot(xt+i*n, xt+i*n, n);
+                if (norm > lindep) {
+                        norm = 1 / sqrt(norm);
+                        for (k = 0; k < n; k++) {
+                                xt[kept*n+k] = xt[i*n+k] * norm;
+                        }
+                        kept++;
+                }
+        }
+        return kept;
+}
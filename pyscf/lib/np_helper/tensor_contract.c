@@ -0,0 +1,154 @@
+/* Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+ *
+ * Tiled contraction of two strided tensors
+ *
+ *      c[i,j] = alpha * sum_p a[i,p] * b[p,j] + beta * c[i,j]
+ *
+ * where i, j, p are compound indices of the tensor axes.  The address of an
+ * element is given by offset tables, e.g.  a[i,p] = a[a_moff[i]+a_koff[p]].
+ * Tiles of a and b are gathered into a per-thread work space, multiplied
+ * with DGEMM, and the tile of c is scattered to the destination.  Thus
+ * transposed operands and outputs need no full-size temporary arrays.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "vhf/fblas.h"
+#include "np_helper/np_helper.h"
+
+static int contiguous(size_t *off, int n)
+{
+        int i;
+        for (i = 1; i < n; i++) {
+                if (off[i] != off[0] + i) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/*
+ * arena: work space of (mtile*ktile + ktile*ntile + mtile*ntile) doubles for
+ * each thread
+ */
+void NPdtensor_contract(double *c, double *a, double *b,
+                        int m, int n, int k,
+                        size_t *a_moff, size_t *a_koff,
+                        size_t *b_koff, size_t *b_noff,
+                        size_t *c_moff, size_t *c_noff,
+                        double alpha, double beta,
+                        int mtile, int ntile, int ktile, double *arena)
+{
+        const int nmtile = (m + mtile - 1) / mtile;
+        const int nntile = (n + ntile - 1) / ntile;
+        const size_t bufsize = (size_t)mtile * ktile + (size_t)ktile * ntile
+                             + (size_t)mtile * ntile;
+
+#pragma omp parallel \
+        shared(c, a, b, m, n, k, a_moff, a_koff, b_koff, b_noff, \
+               c_moff, c_noff, alpha, beta, mtile, ntile, ktile, arena)
+{
+        const char TRANS_N = 'N';
+        const double D0 = 0;
+        const double D1 = 1;
+        double *abuf = arena + bufsize * omp_get_thread_num();
+        double *bbuf = abuf + (size_t)mtile * ktile;
+        double *cbuf = bbuf + (size_t)ktile * ntile;
+        int it, i0, j0, p0, dm, dn, dk, i, j, p;
+        size_t *poff;
+        double *pa, *pb, *pc, *pbuf;
+#pragma omp for schedule(dynamic)
+        for (it = 0; it < nmtile*nntile; it++) {
+                i0 = it / nntile * mtile;
+                j0 = it % nntile * ntile;
+                dm = MIN(mtile, m - i0);
+                dn = MIN(ntile, n - j0);
+                if (k == 0) {
+                        memset(cbuf, 0, sizeof(double) * dm*dn);
+                }
+                for (p0 = 0; p0 < k; p0 += ktile) {
+                        dk = MIN(ktile, k - p0);
+                        poff = a_koff + p0;
+                        if (contiguous(poff, dk)) {
+                                for (i = 0; i < dm; i++) {
+                                        memcpy(abuf + i * dk, a + a_moff[i0+i] + poff[0],
+                                               sizeof(double) * dk);
+                                }
+                        } else {
+                                for (i = 0; i < dm; i++) {
+                                        pa = a + a_moff[i0+i];
+                                        pbuf = abuf + i * dk;
+                                        for (p = 0; p < dk; p++) {
+                                                pbuf[p] = pa[poff[p]];
+                                        }
+                                }
+                        }
+                        poff = b_noff + j0;
+                        if (contiguous(poff, dn)) {
+                                for (p = 0; p < dk; p++) {
+                                        memcpy(bbuf + p * dn, b + b_koff[p0+p] + poff[0],
+                                               sizeof(double) * dn);
+                                }
+                        } else {
+                                for (p = 0; p < dk; p++) {
+                                        pb = b + b_koff[p0+p];
+                                        pbuf = bbuf + p * dn;
+                                        for (j = 0; j < dn; j++) {
+                                                pbuf[j] = pb[poff[j]];
+                                        }
+                                }
+                        }
+                        dgemm_(&TRANS_N, &TRANS_N, &dn, &dm, &dk,
+                               &D1, bbuf, &dn, abuf, &dk,
+                               (p0 == 0) ? &D0 : &D1, cbuf, &dn);
+                }
+
+                poff = c_noff + j0;
+                if (contiguous(poff, dn)) {
+                        for (i = 0; i < dm; i++) {
+                                pc = c + c_moff[i0+i] + poff[0];
+                                pbuf = cbuf + i * dn;
+                                if (beta == 0) {
+                                        for (j = 0; j < dn; j++) {
+                                                pc[j] = alpha * pbuf[j];
+                                        }
+                                } else {
+                                        for (j = 0; j < dn; j++) {
+                                                pc[j] = alpha * pbuf[j] + beta * pc[j];
+                                        }
+                                }
+                        }
+                } else if (beta == 0) {
+                        for (i = 0; i < dm; i++) {
+                                pc = c + c_moff[i0+i];
+                                pbuf = cbuf + i * dn;
+                                for (j = 0; j < dn; j++) {
+                                        pc[poff[j]] = alpha * pbuf[j];
+                                }
+                        }
+                } else {
+                        for (i = 0; i < dm; i++) {
+                                pc = c + c_moff[i0+i];
+                                pbuf = cbuf + i * dn;
+                                for (j = 0; j < dn; j++) {
+                                        pc[poff[j]] = alpha * pbuf[j] + beta * pc[poff[j]];
+                                }
+                        }
+                }
+        }
+}
+}
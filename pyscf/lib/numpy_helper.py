@@ -24,6 +24,7 @@ import string
 import ctypes
 import math
 import re
+import threading
 import numpy
 import scipy.linalg
 from pyscf.lib import misc
@@ -759,6 +760,131 @@ def _zgemm(trans_a, trans_b, m, n, k, a, b, c, alpha=1, beta=0,
                        (ctypes.c_double*2)(beta.real, beta.imag))
     return c
 
+# Tile sizes (m, n, k) of the tiled contraction
+CONTRACT_TILES = (128, 128, 256)
+_contract_tls = threading.local()
+
+def contract(subscripts, a, b, alpha=1, beta=0, out=None):
+    '''out = alpha * einsum(subscripts, a, b) + beta * out
+
+    Unlike einsum, the transposes of a, b and out are not applied on
+    full-size temporary arrays.  The indices are grouped as
+    out[m,n] = a[m,k] b[k,n].  If a, b and out can be viewed as matrices
+    without copying, DGEMM is called on the views.  Otherwise, tiles of a and
+    b are gathered into a per-thread work space (kept between the calls),
+    multiplied, and the result is scattered to out.  out can be a
+    non-contiguous view, e.g. t2new[:,:,p0:p1].
+
+    Every index must appear in exactly two of the three subscripts.  Other
+    contractions and complex arrays are handed to einsum.
+
+    Examples:
+
+    >>> t2new = numpy.zeros((nocc,nocc,nvir,nvir))
+    >>> contract('kica,ckjb->ijab', theta, w, beta=1, out=t2new[:,:,p0:p1])
+    '''
+    idx_a, idx_bc = subscripts.replace(' ','').split(',')
+    idx_b, idx_c = idx_bc.split('->')
+    a = numpy.asarray(a)
+    b = numpy.asarray(b)
+    dims = dict(zip(idx_a, a.shape))
+    dims.update(zip(idx_b, b.shape))
+    if out is None:
+        out = numpy.empty([dims[i] for i in idx_c], numpy.result_type(a, b))
+        beta = 0
+
+    m_idx = [i for i in idx_c if i in idx_a]
+    n_idx = [i for i in idx_c if i in idx_b]
+    k_idx = [i for i in idx_a if i in idx_b]
+    m = int(numpy.prod([dims[i] for i in m_idx]))
+    n = int(numpy.prod([dims[i] for i in n_idx]))
+    k = int(numpy.prod([dims[i] for i in k_idx]))
+    if (a.dtype != numpy.double or b.dtype != numpy.double or
+        out.dtype != numpy.double or
+        len(set(idx_a+idx_b+idx_c)) != len(m_idx) + len(n_idx) + len(k_idx) or
+        len(idx_a) != len(m_idx) + len(k_idx) or
+        len(idx_b) != len(k_idx) + len(n_idx) or
+        len(idx_c) != len(m_idx) + len(n_idx) or
+        any(x < 0 for x in a.strides + b.strides + out.strides) or
+        m * n * max(k, 1) < 65536):
+        ab = einsum(subscripts, a, b)
+        if alpha != 1:
+            ab *= alpha
+        if beta == 0:
+            out[:] = ab
+        else:
+            if beta != 1:
+                out *= beta
+            out += ab
+        return out
+
+    at = a.transpose([idx_a.index(i) for i in m_idx+k_idx])
+    bt = b.transpose([idx_b.index(i) for i in k_idx+n_idx])
+    ct = out.transpose([idx_c.index(i) for i in m_idx+n_idx])
+
+    a2 = _matrix_view(at, m, k)
+    b2 = _matrix_view(bt, k, n)
+    c2 = _matrix_view(ct, m, n)
+    if a2 is not None and b2 is not None and c2 is not None:
+        if c2.flags.c_contiguous:
+            ddot(a2, b2, alpha, c2, beta)
+            return out
+        elif c2.flags.f_contiguous:
+            ddot(b2.T, a2.T, alpha, c2.T, beta)
+            return out
+
+    mtile, ntile, ktile = CONTRACT_TILES
+    mtile = min(mtile, m)
+    ntile = min(ntile, n)
+    ktile = max(1, min(ktile, k))
+    bufsize = (mtile*ktile + ktile*ntile + mtile*ntile) * misc.num_threads()
+    arena = getattr(_contract_tls, 'arena', None)
+    if arena is None or arena.size < bufsize:
+        arena = _contract_tls.arena = numpy.empty(bufsize)
+
+    a_moff, a_koff = _strided_offsets(at, len(m_idx))
+    b_koff, b_noff = _strided_offsets(bt, len(k_idx))
+    c_moff, c_noff = _strided_offsets(ct, len(m_idx))
+    _np_helper.NPdtensor_contract(
+        out.ctypes.data_as(ctypes.c_void_p),
+        a.ctypes.data_as(ctypes.c_void_p), b.ctypes.data_as(ctypes.c_void_p),
+        ctypes.c_int(m), ctypes.c_int(n), ctypes.c_int(k),
+        a_moff.ctypes.data_as(ctypes.c_void_p),
+        a_koff.ctypes.data_as(ctypes.c_void_p),
+        b_koff.ctypes.data_as(ctypes.c_void_p),
+        b_noff.ctypes.data_as(ctypes.c_void_p),
+        c_moff.ctypes.data_as(ctypes.c_void_p),
+        c_noff.ctypes.data_as(ctypes.c_void_p),
+        ctypes.c_double(alpha), ctypes.c_double(beta),
+        ctypes.c_int(mtile), ctypes.c_int(ntile), ctypes.c_int(ktile),
+        arena.ctypes.data_as(ctypes.c_void_p))
+    return out
+
+def _matrix_view(a, m, n):
+    '''(m,n) matrix view of a if it can be made without copying'''
+    v = a.view()
+    try:
+        v.shape = (m, n)
+    except AttributeError:
+        return None
+    if v.flags.c_contiguous or v.flags.f_contiguous:
+        return v
+    else:
+        return None
+
+def _strided_offsets(a, nrow):
+    '''Element offsets of the compound row index (the first nrow axes) and
+    the compound column index (the remaining axes) of a'''
+    offs = []
+    for shape, strides in ((a.shape[:nrow], a.strides[:nrow]),
+                           (a.shape[nrow:], a.strides[nrow:])):
+        off = numpy.zeros(1, dtype=numpy.uint64)
+        for d, s in zip(shape, strides):
+            off = (off[:,None] + numpy.arange(d, dtype=numpy.uint64) *
+                   numpy.uint64(s//a.itemsize)).ravel()
+        offs.append(off)
+    return offs
+
 def asarray(a, dtype=None, order=None):
     '''Convert a list of N-dim arrays to a (N+1) dim array.  It is equivalent to
     numpy.asarray function.
@@ -75,6 +75,59 @@ class KnownValues(unittest.TestCase):
         self.assertAlmostEqual(abs(a.dot(x) - b).max(), 0, 6)
         self.assertAlmostEqual(abs(x - numpy.linalg.solve(a,b)).max(), 0, 6)
 
+    def test_async_io(self):
+        a, b, adiag, arest, x0 = make_ab(16)
+        lib.diis.INCORE_SIZE, bak = 4, lib.diis.INCORE_SIZE
+        ftmp = tempfile.NamedTemporaryFile()
+        ad0 = lib.diis.DIIS(filename=ftmp.name, async_io=True)
+        ad1 = lib.diis.DIIS(async_io=False)
+        ad1.space = ad0.space = 4
+        x = x1 = x0
+        for i in range(7):
+            x = ad0.update((b - arest.dot(x)) / adiag)
+            x1 = ad1.update((b - arest.dot(x1)) / adiag)
+            self.assertAlmostEqual(abs(x - x1).max(), 0, 12)
+            # Vectors larger than INCORE_SIZE are not held in memory
+            self.assertEqual(len(ad0._pending) + len(ad0._writing), 0)
+        ad0.flush()
+
+        # restore the ordering of vectors and the error matrix from the file
+        ad = lib.diis.DIIS(async_io=True)
+        ad.space = 4
+        ad.restore(ftmp.name, inplace=False)
+        self.assertEqual(ad._head, ad0._head)
+        self.assertEqual(ad._bookkeep, ad0._bookkeep)
+        self.assertAlmostEqual(abs(ad._H - ad0._H).max(), 0, 12)
+        x = ad.extrapolate()
+        self.assertAlmostEqual(abs(x - ad0.extrapolate()).max(), 0, 12)
+        for i in range(20):
+            x = ad.update((b - arest.dot(x)) / adiag)
+        ad.flush()
+        lib.diis.INCORE_SIZE = bak
+        self.assertAlmostEqual(abs(x - numpy.linalg.solve(a,b)).max(), 0, 6)
+
+    def test_async_io_incore(self):
+        a, b, adiag, arest, x0 = make_ab(16)
+        ftmp = tempfile.NamedTemporaryFile()
+        ad0 = lib.diis.DIIS(filename=ftmp.name, async_io=True)
+        ad1 = lib.diis.DIIS(async_io=False)
+        ad1.space = ad0.space = 4
+        x = x1 = x0
+        for i in range(7):
+            x = ad0.update((b - arest.dot(x)) / adiag)
+            x1 = ad1.update((b - arest.dot(x1)) / adiag)
+            self.assertAlmostEqual(abs(x - x1).max(), 0, 12)
+            # The queued vectors are copies of the input vectors
+            for key, vec in ad0._writing.items():
+                self.assertFalse(numpy.may_share_memory(vec, ad0._buffer[key]))
+        ad0.flush()
+
+        ad = lib.diis.restore(ftmp.name)
+        ad.space = 4
+        for key in ad1._buffer:
+            self.assertAlmostEqual(abs(ad._get(key) - ad1._buffer[key]).max(), 0, 12)
+        self.assertAlmostEqual(abs(ad.extrapolate() - ad1.extrapolate()).max(), 0, 12)
+
     def test_extrapolate(self):
         a, b, adiag, arest, x = make_ab(16)
         ad = lib.diis.DIIS()
@@ -19,6 +19,7 @@ import unittest
 import numpy
 import scipy.linalg
 import tempfile
+from pyscf import lib
 from pyscf import gto
 from pyscf import scf
 from pyscf import fci
@@ -38,6 +39,36 @@ class KnowValues(unittest.TestCase):
         e = myfci.kernel()[0]
         self.assertAlmostEqual(e, -11.579978414933732+mol.energy_nuc(), 9)
 
+    def test_davidson1_native(self):
+        numpy.random.seed(12)
+        n = 500
+        a = numpy.random.random((n,n)) * .1
+        a = a + a.T + numpy.diag(numpy.arange(n)*.1)
+        aop = lambda xs: [a.dot(x) for x in xs]
+        precond = lambda dx, e, x0: dx/(a.diagonal()-e+1e-4)
+        x0 = [numpy.eye(n)[i] for i in range(3)]
+        eref = scipy.linalg.eigh(a)[0][:3]
+        # in memory and memory-mapped subspace
+        for max_memory in (2000, .001):
+            conv, e, c = lib.davidson1_native(aop, x0, precond, nroots=3,
+                                              max_space=8, max_memory=max_memory)
+            self.assertTrue(all(conv))
+            self.assertAlmostEqual(abs(e - eref).max(), 0, 9)
+            c = numpy.asarray(c)
+            self.assertAlmostEqual(abs(c.dot(c.T) - numpy.eye(3)).max(), 0, 9)
+
+    def test_subspace_rotate(self):
+        numpy.random.seed(3)
+        v = numpy.random.random((5,3))
+        x = numpy.random.random((5,7))
+        y0 = numpy.random.random((3,7))
+        for m, alpha, beta in ((5, 1, 0), (5, .5, 2), (0, 1, 0), (0, 1, 1),
+                               (0, .5, 2)):
+            ref = alpha * v[:m].T.dot(x[:m]) + beta * y0
+            y = lib.linalg_helper._subspace_rotate(y0.copy(), v[:m].copy(),
+                                                   x[:m].copy(), alpha, beta)
+            self.assertAlmostEqual(abs(y - ref).max(), 0, 12)
+
 if __name__ == "__main__":
     print("Full Tests for linalg_helper")
     unittest.main()
@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+# Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+import numpy
+from pyscf import lib
+
+class KnownValues(unittest.TestCase):
+    def test_contract(self):
+        numpy.random.seed(1)
+        a = numpy.random.random((8,9,10,11))
+        b = numpy.random.random((10,9,12,11))
+
+        ref = numpy.einsum('ikla,lkjb->ijab', a, b)
+        out = lib.contract('ikla,lkjb->ijab', a, b)
+        self.assertAlmostEqual(abs(out-ref).max(), 0, 11)
+
+        c = numpy.random.random((8,12,11,20))
+        ref = c.copy()
+        ref[:,:,:,3:14] = 2*c[:,:,:,3:14] - .5*numpy.einsum('ikla,lkjb->ijab', a, b)
+        lib.contract('ikla,lkjb->ijab', a, b, -.5, 2, out=c[:,:,:,3:14])
+        self.assertAlmostEqual(abs(c-ref).max(), 0, 11)
+
+        c = numpy.random.random((11,8,12,11))
+        ref = c + numpy.einsum('ikla,lkjb->bija', a, b)
+        lib.contract('ikla,lkjb->bija', a, b, 1, 1, out=c)
+        self.assertAlmostEqual(abs(c-ref).max(), 0, 11)
+
+        ref = numpy.einsum('ij,jk->ki', a[0,0], b[0,0].T)
+        out = lib.contract('ij,jk->ki', a[0,0], b[0,0].T)
+        self.assertAlmostEqual(abs(out-ref).max(), 0, 12)
+
+if __name__ == "__main__":
+    unittest.main()
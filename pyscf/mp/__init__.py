@@ -59,7 +59,7 @@ def UMP2(mf, frozen=0, mo_coeff=None, mo_occ=None):
         mf = scf.addons.convert_to_uhf(mf)
 
     if hasattr(mf, 'with_df') and mf.with_df:
-        raise NotImplementedError('DF-UMP2')
+        return dfmp2.DFUMP2(mf, frozen, mo_coeff, mo_occ)
     else:
         return ump2.UMP2(mf, frozen, mo_coeff, mo_occ)
 
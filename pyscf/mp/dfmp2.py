@@ -15,20 +15,28 @@
 
 '''
 density fitting MP2,  3-center integrals incore.
+
+The integrals (ia|jb) of a block of occupied pairs (i,j) are generated from
+the 3-index tensor L[P,ia] by DGEMM in C (MP2_df_energy in lib/mp/dfmp2.c).
+The energy is evaluated in the same pass.  The same-spin and opposite-spin
+components are kept in the attributes e_corr_ss and e_corr_os.
 '''
 
 import time
+import ctypes
 import numpy
 from pyscf import lib
 from pyscf.lib import logger
 from pyscf.ao2mo import _ao2mo
 from pyscf import df
 from pyscf.mp import mp2
+from pyscf.mp import ump2
 #from pyscf.mp.mp2 import make_rdm1, make_rdm2, make_rdm1_ao
 from pyscf import __config__
 
 WITH_T2 = getattr(__config__, 'mp_dfmp2_with_t2', True)
 
+libmp = lib.load_library('libmp')
 
 def kernel(mp, mo_energy=None, mo_coeff=None, eris=None, with_t2=WITH_T2,
            verbose=logger.NOTE):
@@ -41,23 +49,184 @@ def kernel(mp, mo_energy=None, mo_coeff=None, eris=None, with_t2=WITH_T2,
         assert(mp.frozen is 0 or mp.frozen is None)
 
     nocc = mp.nocc
-    nvir = mp.nmo - nocc
-    eia = mo_energy[:nocc,None] - mo_energy[None,nocc:]
+    Lov = _make_Lov(mp, mo_coeff, nocc)
+    e = _pair_energy(mp, Lov, Lov, mo_energy, mo_energy, nocc, nocc,
+                     exchange=True)[0]
+    mp.e_corr_os, mp.e_corr_ss = e
+    logger.info(mp, 'E_corr(same-spin) = %.15g  E_corr(opposite-spin) = %.15g',
+                mp.e_corr_ss, mp.e_corr_os)
+    return e[0] + e[1], None
+
+def _gamma_intermediates(mp, mo_energy=None, mo_coeff=None):
+    '''Intermediates of the DF-MP2 (relaxed) density for nuclear gradients.
 
-    t2 = None
-    emp2 = 0
+    Returns:
+        doo, dvv : the occupied-occupied and virtual-virtual blocks of the
+            unrelaxed one-particle density, in the same convention as
+            :func:`mp2._gamma1_intermediates`
+        Gamma : the 3-index two-particle density
+            Gamma[P,ia] = sum_jb (2 t_ij^ab - t_ij^ba) L[P,jb]
+        Lov : the 3-index integrals L[P,ia]
+    '''
+    if mo_energy is None or mo_coeff is None:
+        mo_coeff = mp2._mo_without_core(mp, mp.mo_coeff)
+        mo_energy = mp2._mo_energy_without_core(mp, mp.mo_energy)
+    nocc = mp.nocc
+    Lov = _make_Lov(mp, mo_coeff, nocc)
+    e, gamma, doo, dvv = _pair_energy(mp, Lov, Lov, mo_energy, mo_energy,
+                                      nocc, nocc, exchange=True,
+                                      with_gamma=True)
+    return -doo, dvv.T, gamma, Lov
+
+def _make_Lov(mp, mo_coeff, nocc):
+    '''L[P,ia] of all auxiliary functions, (naux,nocc*nvir)
+
+    The whole tensor is held in memory.  The pair energies need all
+    auxiliary functions for each (ia|jb), so the auxiliary index is not
+    streamed.  The gradient intermediates hold gamma[P,ia] of the same size
+    in addition.
+    '''
+    nvir = mo_coeff.shape[1] - nocc
+    naux = mp.with_df.get_naoaux()
+    mem_now = lib.current_memory()[0]
+    if naux*nocc*nvir*8e-6 > mp.max_memory - mem_now:
+        logger.warn(mp, 'DF-MP2 needs %.0f MB for the 3-index tensor in core. '
+                    'max_memory %d MB is not enough',
+                    naux*nocc*nvir*8e-6, mp.max_memory)
+    Lov = numpy.empty((naux,nocc*nvir))
+    p1 = 0
     for istep, qov in enumerate(mp.loop_ao2mo(mo_coeff, nocc)):
         logger.debug(mp, 'Load cderi step %d', istep)
-        for i in range(nocc):
-            buf = numpy.dot(qov[:,i*nvir:(i+1)*nvir].T,
-                            qov).reshape(nvir,nocc,nvir)
-            gi = numpy.array(buf, copy=False)
-            gi = gi.reshape(nvir,nocc,nvir).transpose(1,0,2)
-            t2i = gi/lib.direct_sum('jb+a->jba', eia, eia[i])
-            emp2 += numpy.einsum('jab,jab', t2i, gi) * 2
-            emp2 -= numpy.einsum('jab,jba', t2i, gi)
+        p0, p1 = p1, p1 + qov.shape[0]
+        Lov[p0:p1] = qov
+    return Lov
+
+def _pair_energy(mp, Lia, Ljb, mo_energy_i, mo_energy_j, nocci, noccj,
+                 exchange=False, with_gamma=False, fos=1, fss=1):
+    '''Sum over the occupied pairs (i,j) of the RI-MP2 amplitudes
+    t_ij^ab = (ia|jb)/(e_i+e_j-e_a-e_b).
+
+    Returns:
+        e : [sum t_ij^ab (ia|jb), sum (t_ij^ab - t_ij^ba) (ia|jb)].  The
+            second is computed if exchange is True, i.e. i and j (a and b)
+            are the orbitals of the same spin.
+        gamma, dm1occ, dm1vir : if with_gamma,
+            gamma[P,ia] = sum_jb T_ij^ab L[P,jb]
+            dm1occ[j,k] = sum_iab t_ij^ab T_ik^ab
+            dm1vir[b,c] = sum_ija t_ij^ab T_ij^ac
+            with T = fos * t + fss * (t - t.transpose(0,1,3,2))
+
+    The pairs are evaluated in blocks of j bounded by max_memory.  dm1occ
+    is symmetric.  Its blocks between two different j blocks are
+    accumulated by MP2_df_dm1occ, which generates the amplitudes of both
+    blocks again.
+    '''
+    nvira = Lia.shape[1] // nocci
+    nvirb = Ljb.shape[1] // noccj
+    naux = Lia.shape[0]
+    # The pairs (i,j) and (j,i) give the same energy
+    tril = exchange and not with_gamma and Lia is Ljb
+    Lia = numpy.asarray(Lia, order='C')
+    Ljb = numpy.asarray(Ljb, order='C')
+    eo_i = numpy.asarray(mo_energy_i[:nocci], dtype=numpy.double, order='C')
+    ev_a = numpy.asarray(mo_energy_i[nocci:], dtype=numpy.double, order='C')
+    eo_j = numpy.asarray(mo_energy_j[:noccj], dtype=numpy.double, order='C')
+    ev_b = numpy.asarray(mo_energy_j[noccj:], dtype=numpy.double, order='C')
 
-    return emp2, t2
+    e = numpy.zeros(2)
+    mem_now = lib.current_memory()[0]
+    max_memory = max(0, mp.max_memory*.9-mem_now)
+    if with_gamma:
+        gamma = numpy.zeros_like(Lia)
+        dm1occ = numpy.zeros((noccj,noccj))
+        dm1vir = numpy.zeros((nvirb,nvirb))
+        # MP2_df_dm1occ holds three buffers of the pair block for each thread
+        occblk = int(max_memory*1e6/8 / (nvira*nvirb*3*lib.num_threads()))
+    else:
+        gamma = dm1occ = dm1vir = None
+        occblk = int(max_memory*1e6/8 / (nvira*nvirb*lib.num_threads()))
+    occblk = min(noccj, max(1, occblk))
+    logger.debug1(mp, 'occ pair block %d', occblk)
+
+    def null_or_ptr(x, offset=0):
+        if x is None:
+            return lib.c_null_ptr()
+        return x[:,offset:].ctypes.data_as(ctypes.c_void_p)
+
+    def dm1occ_ptr(j0, k0):
+        if dm1occ is None:
+            return lib.c_null_ptr()
+        return dm1occ[j0,k0:].ctypes.data_as(ctypes.c_void_p)
+
+    for i0, i1 in lib.prange(0, nocci, occblk):
+        if tril:
+            jblocks = lib.prange(0, i1, occblk)
+        else:
+            jblocks = lib.prange(0, noccj, occblk)
+        for j0, j1 in jblocks:
+            libmp.MP2_df_energy(
+                e.ctypes.data_as(ctypes.c_void_p),
+                Lia[:,i0*nvira:].ctypes.data_as(ctypes.c_void_p),
+                Ljb[:,j0*nvirb:].ctypes.data_as(ctypes.c_void_p),
+                ctypes.c_int(Lia.shape[1]), ctypes.c_int(Ljb.shape[1]),
+                eo_i[i0:].ctypes.data_as(ctypes.c_void_p),
+                eo_j[j0:].ctypes.data_as(ctypes.c_void_p),
+                ev_a.ctypes.data_as(ctypes.c_void_p),
+                ev_b.ctypes.data_as(ctypes.c_void_p),
+                ctypes.c_int(i0), ctypes.c_int(i1-i0),
+                ctypes.c_int(j0), ctypes.c_int(j1-j0),
+                ctypes.c_int(nvira), ctypes.c_int(nvirb), ctypes.c_int(naux),
+                ctypes.c_int(exchange), ctypes.c_int(tril),
+                null_or_ptr(gamma, i0*nvira),
+                dm1occ_ptr(j0, j0), ctypes.c_int(noccj), null_or_ptr(dm1vir),
+                ctypes.c_double(fos), ctypes.c_double(fss))
+
+            if not with_gamma:
+                continue
+            # dm1occ between two blocks of j.  It is symmetric, only the
+            # blocks k0 > j0 are computed.
+            for k0, k1 in lib.prange(j1, noccj, occblk):
+                libmp.MP2_df_dm1occ(
+                    dm1occ_ptr(j0, k0), ctypes.c_int(noccj),
+                    Lia[:,i0*nvira:].ctypes.data_as(ctypes.c_void_p),
+                    Ljb[:,j0*nvirb:].ctypes.data_as(ctypes.c_void_p),
+                    Ljb[:,k0*nvirb:].ctypes.data_as(ctypes.c_void_p),
+                    ctypes.c_int(Lia.shape[1]), ctypes.c_int(Ljb.shape[1]),
+                    eo_i[i0:].ctypes.data_as(ctypes.c_void_p),
+                    eo_j[j0:].ctypes.data_as(ctypes.c_void_p),
+                    eo_j[k0:].ctypes.data_as(ctypes.c_void_p),
+                    ev_a.ctypes.data_as(ctypes.c_void_p),
+                    ev_b.ctypes.data_as(ctypes.c_void_p),
+                    ctypes.c_int(i1-i0), ctypes.c_int(j1-j0),
+                    ctypes.c_int(k1-k0),
+                    ctypes.c_int(nvira), ctypes.c_int(nvirb), ctypes.c_int(naux),
+                    ctypes.c_int(exchange),
+                    ctypes.c_double(fos), ctypes.c_double(fss))
+
+    if with_gamma:
+        # dm1occ[k,j] = dm1occ[j,k]
+        for j0, j1 in lib.prange(0, noccj, occblk):
+            dm1occ[j1:,j0:j1] = dm1occ[j0:j1,j1:].T
+        return e, gamma, dm1occ, dm1vir
+    else:
+        return e, None, None, None
+
+def loop_ao2mo(mp, mo_coeff, nocc):
+    mo = numpy.asarray(mo_coeff, order='F')
+    nmo = mo.shape[1]
+    ijslice = (0, nocc, nocc, nmo)
+    Lov = None
+    with_df = mp.with_df
+
+    nvir = nmo - nocc
+    naux = with_df.get_naoaux()
+    mem_now = lib.current_memory()[0]
+    max_memory = max(2000, mp.max_memory*.9-mem_now)
+    blksize = int(min(naux, max(with_df.blockdim,
+                                (max_memory*1e6/8-nocc*nvir**2*2)/(nocc*nvir))))
+    for eri1 in with_df.loop(blksize=blksize):
+        Lov = _ao2mo.nr_e2(eri1, mo, ijslice, aosym='s2', out=Lov)
+        yield Lov
 
 
 class DFMP2(mp2.MP2):
@@ -68,28 +237,15 @@ class DFMP2(mp2.MP2):
         else:
             self.with_df = df.DF(mf.mol)
             self.with_df.auxbasis = df.make_auxbasis(mf.mol, mp2fit=True)
-        self._keys.update(['with_df'])
+        self.e_corr_os = None
+        self.e_corr_ss = None
+        self._keys.update(['with_df', 'e_corr_os', 'e_corr_ss'])
 
     @lib.with_doc(mp2.MP2.kernel.__doc__)
     def kernel(self, mo_energy=None, mo_coeff=None, eris=None, with_t2=WITH_T2):
         return mp2.MP2.kernel(self, mo_energy, mo_coeff, eris, with_t2, kernel)
 
-    def loop_ao2mo(self, mo_coeff, nocc):
-        mo = numpy.asarray(mo_coeff, order='F')
-        nmo = mo.shape[1]
-        ijslice = (0, nocc, nocc, nmo)
-        Lov = None
-        with_df = self.with_df
-
-        nvir = nmo - nocc
-        naux = with_df.get_naoaux()
-        mem_now = lib.current_memory()[0]
-        max_memory = max(2000, self.max_memory*.9-mem_now)
-        blksize = int(min(naux, max(with_df.blockdim,
-                                    (max_memory*1e6/8-nocc*nvir**2*2)/(nocc*nvir))))
-        for eri1 in with_df.loop(blksize=blksize):
-            Lov = _ao2mo.nr_e2(eri1, mo, ijslice, aosym='s2', out=Lov)
-            yield Lov
+    loop_ao2mo = loop_ao2mo
 
 #    def make_rdm1(self, t2=None):
 #        if t2 is None: t2 = self.t2
@@ -99,6 +255,89 @@ class DFMP2(mp2.MP2):
 #        if t2 is None: t2 = self.t2
 #        return make_rdm2(self, t2, self.verbose)
 
+
+
+def _ukernel(mp, mo_energy=None, mo_coeff=None, eris=None, with_t2=WITH_T2,
+             verbose=logger.NOTE):
+    if mo_energy is None or mo_coeff is None:
+        moidx = mp.get_frozen_mask()
+        mo_coeff = (mp.mo_coeff[0][:,moidx[0]], mp.mo_coeff[1][:,moidx[1]])
+        mo_energy = (mp.mo_energy[0][moidx[0]], mp.mo_energy[1][moidx[1]])
+    else:
+        assert(mp.frozen is 0 or mp.frozen is None)
+
+    nocca, noccb = mp.get_nocc()
+    Lova = _make_Lov(mp, mo_coeff[0], nocca)
+    Lovb = _make_Lov(mp, mo_coeff[1], noccb)
+    e_aa = _pair_energy(mp, Lova, Lova, mo_energy[0], mo_energy[0],
+                        nocca, nocca, exchange=True)[0][1] * .5
+    e_bb = _pair_energy(mp, Lovb, Lovb, mo_energy[1], mo_energy[1],
+                        noccb, noccb, exchange=True)[0][1] * .5
+    e_ab = _pair_energy(mp, Lova, Lovb, mo_energy[0], mo_energy[1],
+                        nocca, noccb)[0][0]
+    mp.e_corr_ss = e_aa + e_bb
+    mp.e_corr_os = e_ab
+    logger.info(mp, 'E_corr(same-spin) = %.15g  E_corr(opposite-spin) = %.15g',
+                mp.e_corr_ss, mp.e_corr_os)
+    return mp.e_corr_ss + mp.e_corr_os, None
+
+def _ugamma_intermediates(mp, mo_energy=None, mo_coeff=None):
+    '''Intermediates of the DF-UMP2 (relaxed) density for nuclear gradients.
+
+    Returns:
+        (dooa, doob), (dvva, dvvb) : the occupied-occupied and
+            virtual-virtual blocks of the unrelaxed one-particle density, in
+            the same convention as :func:`ump2._gamma1_intermediates`
+        (Gamma_a, Gamma_b) : the 3-index two-particle density
+            Gamma_a[P,ia] = sum_jb t_ij^ab L[P,jb] + sum_JB t_iJ^aB L[P,JB]
+            with the antisymmetrized same-spin amplitudes
+        (Lova, Lovb) : the 3-index integrals L[P,ia]
+    '''
+    if mo_energy is None or mo_coeff is None:
+        moidx = mp.get_frozen_mask()
+        mo_coeff = (mp.mo_coeff[0][:,moidx[0]], mp.mo_coeff[1][:,moidx[1]])
+        mo_energy = (mp.mo_energy[0][moidx[0]], mp.mo_energy[1][moidx[1]])
+    nocca, noccb = mp.get_nocc()
+    Lova = _make_Lov(mp, mo_coeff[0], nocca)
+    Lovb = _make_Lov(mp, mo_coeff[1], noccb)
+    # same-spin: T = t - t.transpose(0,1,3,2)
+    e, gamma_a, dooa, dvva = _pair_energy(mp, Lova, Lova, mo_energy[0], mo_energy[0],
+                                          nocca, nocca, True, True, 0, 1)
+    e, gamma_b, doob, dvvb = _pair_energy(mp, Lovb, Lovb, mo_energy[1], mo_energy[1],
+                                          noccb, noccb, True, True, 0, 1)
+    # opposite-spin, the intermediates of j are generated.  The two
+    # orders of the spins give the alpha and beta parts.
+    e, gamma_ab, doo, dvv = _pair_energy(mp, Lova, Lovb, mo_energy[0], mo_energy[1],
+                                         nocca, noccb, False, True, 1, 0)
+    gamma_a += gamma_ab
+    doob += doo
+    dvvb += dvv
+    e, gamma_ba, doo, dvv = _pair_energy(mp, Lovb, Lova, mo_energy[1], mo_energy[0],
+                                         noccb, nocca, False, True, 1, 0)
+    gamma_b += gamma_ba
+    dooa += doo
+    dvva += dvv
+    return ((-dooa, -doob), (dvva.T, dvvb.T), (gamma_a, gamma_b), (Lova, Lovb))
+
+
+class DFUMP2(ump2.UMP2):
+    def __init__(self, mf, frozen=0, mo_coeff=None, mo_occ=None):
+        ump2.UMP2.__init__(self, mf, frozen, mo_coeff, mo_occ)
+        if hasattr(mf, 'with_df') and mf.with_df:
+            self.with_df = mf.with_df
+        else:
+            self.with_df = df.DF(mf.mol)
+            self.with_df.auxbasis = df.make_auxbasis(mf.mol, mp2fit=True)
+        self.e_corr_os = None
+        self.e_corr_ss = None
+        self._keys.update(['with_df', 'e_corr_os', 'e_corr_ss'])
+
+    @lib.with_doc(mp2.MP2.kernel.__doc__)
+    def kernel(self, mo_energy=None, mo_coeff=None, eris=None, with_t2=WITH_T2):
+        return mp2.MP2.kernel(self, mo_energy, mo_coeff, eris, with_t2, _ukernel)
+
+    loop_ao2mo = loop_ao2mo
+
 del(WITH_T2)
 
 
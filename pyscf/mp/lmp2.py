@@ -0,0 +1,427 @@
+#!/usr/bin/env python
+# Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+'''
+Local DF-MP2 in the pair domains of localized orbitals (prototype)
+
+This module is a prototype of the pair-domain approximation for MP2.  It
+truncates the pairs and the virtual spaces of the amplitudes, but the
+integrals are still generated in the full basis.  The cost is O(N^3) and the
+memory is O(naux*nocc*nao), as for DF-MP2 (see below).  It is not a linear
+scaling method, and there is no local CCSD counterpart.
+
+The occupied orbitals are localized (Boys by default).  The domain of an
+occupied orbital i is the set of atoms on which the Mulliken population of
+orbital i is larger than 10*threshold.  The virtual space of the pair (i,j)
+is spanned by the projected atomic orbitals (PAOs) of the atoms in the
+domains of i or j.  The pairs are classified as
+
+* strong pairs: the domains of i and j share atoms, or the dipole estimate
+  of the pair energy is larger than threshold.  The amplitudes are solved in
+  the pair domain, including the couplings through the off-diagonal
+  occupied Fock matrix.
+* distant pairs: the dipole estimate of the pair energy is used.
+
+The attribute threshold is the only parameter to control the accuracy.  For
+long molecules, the number of strong pairs and the size of the pair domains
+approach constants per occupied orbital, so the amplitude equation (the C
+kernel LMP2_residual in lib/mp/lmp2.c) scales linearly.  The distant pairs
+are screened by an upper bound of the dipole estimate which depends on the
+centroid distance.  The setup steps work with the full system:
+
+* the PAO coefficients are an (nao,nao) matrix.
+* the DF half-transformed integrals (P|i mu), (naux,nocc,nao), are held in
+  core, and each pair contracts the full AO index with its domain orbitals.
+* the overlaps between the pair domains are computed in the full AO basis.
+
+These steps dominate the cost for long molecules.  Restricting them to the
+AO and auxiliary functions of the domains (local density fitting) is not
+implemented.  examples/2-benchmark/lmp2_hchain.py times the steps for a
+series of hydrogen chains.
+
+Ref:
+    Pulay, Saebo, Theor. Chim. Acta 69, 357 (1986)
+    Neese, Wennmohs, Hansen, J. Chem. Phys. 130, 114108 (2009)
+'''
+
+import time
+import ctypes
+from functools import reduce
+import numpy
+from pyscf import lib
+from pyscf.lib import logger
+from pyscf.ao2mo import _ao2mo
+from pyscf.mp import mp2
+from pyscf.mp import dfmp2
+from pyscf import __config__
+
+THRESHOLD = getattr(__config__, 'mp_lmp2_threshold', 1e-4)
+LOCALIZER = getattr(__config__, 'mp_lmp2_localizer', 'boys')
+CONV_TOL = getattr(__config__, 'mp_lmp2_conv_tol', 1e-7)
+MAX_CYCLE = getattr(__config__, 'mp_lmp2_max_cycle', 50)
+# Linear dependency of the PAOs in a domain
+LINDEP = getattr(__config__, 'mp_lmp2_lindep', 1e-6)
+# The Fock couplings below this value are not included
+FOCK_TOL = getattr(__config__, 'mp_lmp2_fock_tol', 1e-8)
+# The distant pairs of which the upper bound of the dipole estimate is
+# smaller than DISTANT_NEGLECT*threshold are neglected
+DISTANT_NEGLECT = getattr(__config__, 'mp_lmp2_distant_neglect', 1e-3)
+
+libmp = dfmp2.libmp
+
+def kernel(mp, mo_energy=None, mo_coeff=None, eris=None, with_t2=False,
+           verbose=logger.NOTE):
+    log = logger.new_logger(mp, verbose)
+    time0 = (time.clock(), time.time())
+    if mo_energy is None or mo_coeff is None:
+        mo_coeff = mp2._mo_without_core(mp, mp.mo_coeff)
+        mo_energy = mp2._mo_energy_without_core(mp, mp.mo_energy)
+    else:
+        assert(mp.frozen is 0 or mp.frozen is None)
+
+    nocc = mp.nocc
+    s, fock, rints, aoslice = _ao_data(mp)
+    orbo = mp.localize(mo_coeff[:,:nocc])
+    foo = reduce(numpy.dot, (orbo.T, fock, orbo))
+    time1 = log.timer('localization', *time0)
+
+    # PAOs: the occupied orbitals (including the frozen ones) projected out
+    occ_all = mp.mo_coeff[:,mp.mo_occ>0]
+    pao = numpy.eye(s.shape[0]) - reduce(numpy.dot, (occ_all, occ_all.T, s))
+
+    domains = orbital_domains(orbo, s, aoslice, mp.threshold*10)
+    dom_cache = {}
+    def get_domain(atoms):
+        key = tuple(sorted(atoms))
+        if key not in dom_cache:
+            dom_cache[key] = _domain_basis(pao, s, fock, aoslice, key)
+        return dom_cache[key]
+
+    strong, e_distant = classify_pairs(mp, orbo, foo, domains, get_domain,
+                                       rints, log)
+    mp.pairs = strong
+    mp.e_corr_distant = e_distant
+    time1 = log.timer('pair classification', *time1)
+
+    Lhalf = _make_Lhalf(mp, orbo)
+    time1 = log.timer('DF half transformation', *time1)
+
+    e_strong = _solve_amplitudes(mp, strong, foo, domains, get_domain,
+                                 Lhalf, s, log)
+    log.timer('LMP2', *time0)
+    return e_strong + e_distant, None
+
+def orbital_domains(orbo, s, aoslice, cutoff):
+    '''The atoms where the (absolute) Mulliken population of the orbital is
+    larger than cutoff'''
+    pop = orbo * numpy.dot(s, orbo)
+    domains = []
+    for i in range(orbo.shape[1]):
+        qi = abs(numpy.array([pop[p0:p1,i].sum() for p0, p1 in aoslice[:,2:]]))
+        atoms = numpy.where(qi > cutoff)[0]
+        if atoms.size == 0:
+            atoms = [numpy.argmax(qi)]
+        domains.append(set(atoms))
+    return domains
+
+def _domain_basis(pao, s, fock, aoslice, atoms):
+    '''Orthonormal semi-canonical virtual orbitals of the PAOs of atoms'''
+    idx = numpy.hstack([numpy.arange(aoslice[a,2], aoslice[a,3]) for a in atoms])
+    c = pao[:,idx]
+    e, v = numpy.linalg.eigh(reduce(numpy.dot, (c.T, s, c)))
+    mask = e > LINDEP
+    c = numpy.dot(c, v[:,mask] / numpy.sqrt(e[mask]))
+    eps, u = numpy.linalg.eigh(reduce(numpy.dot, (c.T, fock, c)))
+    return numpy.dot(c, u), eps
+
+def classify_pairs(mp, orbo, foo, domains, get_domain, rints, log):
+    '''Returns the strong pairs [(i,j), i >= j] and the dipole estimate of
+    the energy of the distant pairs.
+
+    The pairs of which the domains overlap are strong.  For the other pairs,
+    the dipole estimate
+
+        e_ij = -4/R^6 sum_ab (mu_ia.mu_jb - 3 (mu_ia.n) (mu_jb.n))^2
+                             / (e_a + e_b - f_ii - f_jj)
+
+    is computed with the transition dipoles mu_ia between orbital i and the
+    virtual orbitals of the domain of i.  R and n are the distance and the
+    direction between the centroids of i and j.
+
+    Since |mu_ia.mu_jb - 3 (mu_ia.n) (mu_jb.n)| <= 4 |mu_ia| |mu_jb|,
+
+        |e_ij| <= 64/R^6 |mu_i|^2 |mu_j|^2 / (min(e_a) + min(e_b) - f_ii - f_jj)
+
+    This bound is evaluated for all pairs at once.  The pairs of which the
+    bound is smaller than DISTANT_NEGLECT*threshold are neglected; e_ij is
+    only evaluated for the other pairs.
+    '''
+    nocc = orbo.shape[1]
+    centroids = numpy.einsum('xpq,pi,qi->ix', rints, orbo, orbo)
+    mu = []
+    vir_e = []
+    for i in range(nocc):
+        qi, ei = get_domain(domains[i])
+        mu.append(numpy.einsum('xpq,p,qa->xa', rints, orbo[:,i], qi))
+        vir_e.append(ei)
+
+    natm = max(max(d) for d in domains) + 1
+    dom_mask = numpy.zeros((nocc,natm), dtype=bool)
+    for i in range(nocc):
+        dom_mask[i,list(domains[i])] = True
+    overlap = numpy.dot(dom_mask.astype(int), dom_mask.T.astype(int)) > 0
+
+    mu2 = numpy.array([numpy.einsum('xa,xa', m, m) for m in mu])
+    gap = numpy.array([e.min() for e in vir_e]) - foo.diagonal()
+    dmin = gap[:,None] + gap
+    dist = lib.norm(centroids[:,None] - centroids, axis=2)
+    with numpy.errstate(divide='ignore', invalid='ignore'):
+        bound = 64 * numpy.outer(mu2, mu2) / (dist**6 * dmin)
+    bound[dmin <= 0] = numpy.inf
+    bound[overlap] = numpy.inf
+
+    strong = []
+    e_distant = 0
+    ndistant = 0
+    neglect = mp.threshold * DISTANT_NEGLECT
+    tril = numpy.tril(numpy.ones((nocc,nocc), dtype=bool))
+    for i, j in zip(*numpy.where(tril & overlap)):
+        strong.append((i,j))
+    idx_i, idx_j = numpy.where(tril & ~overlap & (bound >= neglect))
+    for i, j in zip(idx_i, idx_j):
+        r = (centroids[i] - centroids[j]) / dist[i,j]
+        dip = (numpy.dot(mu[i].T, mu[j]) -
+               3 * numpy.einsum('x,xa,y,yb->ab', r, mu[i], r, mu[j]))
+        d = (vir_e[i][:,None] + vir_e[j] - foo[i,i] - foo[j,j])
+        eij = -4 / dist[i,j]**6 * numpy.einsum('ab,ab', dip**2, 1/d)
+        if abs(eij) > mp.threshold:
+            strong.append((i,j))
+        else:
+            e_distant += eij
+            ndistant += 1
+    strong.sort(key=lambda ij: (ij[0], ij[1]))
+    strong = [(int(i), int(j)) for i, j in strong]
+
+    neglected = tril & ~overlap & (bound < neglect)
+    log.info('LMP2 strong pairs %d, distant pairs %d, E(distant) = %.12g',
+             len(strong), ndistant, e_distant)
+    log.info('LMP2 neglected pairs %d, |E(neglected)| < %.3g',
+             numpy.count_nonzero(neglected), bound[neglected].sum())
+    return strong, e_distant
+
+def _make_Lhalf(mp, orbo):
+    '''(P|i mu), (naux,nocc,nao)'''
+    with_df = mp.with_df
+    nao, nocc = orbo.shape
+    naux = with_df.get_naoaux()
+    mo = numpy.asarray(numpy.hstack((orbo, numpy.eye(nao))), order='F')
+    ijslice = (0, nocc, nocc, nocc+nao)
+    Lhalf = numpy.empty((naux,nocc*nao))
+    p1 = 0
+    for eri1 in with_df.loop():
+        p0, p1 = p1, p1 + eri1.shape[0]
+        Lhalf[p0:p1] = _ao2mo.nr_e2(eri1, mo, ijslice, aosym='s2')
+    return Lhalf.reshape(naux,nocc,nao)
+
+def _solve_amplitudes(mp, pairs, foo, domains, get_domain, Lhalf, s, log):
+    '''Solve the LMP2 amplitudes of the strong pairs.  Returns the
+    correlation energy of the pairs.'''
+    npair = len(pairs)
+    pair_id = dict((p, k) for k, p in enumerate(pairs))
+    bases = [get_domain(domains[i] | domains[j]) for i, j in pairs]
+    dims = numpy.array([e.size for q, e in bases], dtype=numpy.int32)
+    t_loc = numpy.append(0, numpy.cumsum(dims**2)).astype(numpy.uint64)
+    e_loc = numpy.append(0, numpy.cumsum(dims)).astype(numpy.int32)
+    eps = numpy.hstack([e for q, e in bases])
+    fpair = numpy.array([foo[i,i] + foo[j,j] for i, j in pairs])
+    log.info('LMP2 average pair domain size %.1f, max %d',
+             dims.mean(), dims.max())
+
+    K = numpy.empty(int(t_loc[-1]))
+    denom = numpy.empty_like(K)
+    for k, (i, j) in enumerate(pairs):
+        q, e = bases[k]
+        kij = numpy.dot(numpy.dot(Lhalf[:,i], q).T, numpy.dot(Lhalf[:,j], q))
+        K[t_loc[k]:t_loc[k+1]] = kij.ravel()
+        denom[t_loc[k]:t_loc[k+1]] = (e[:,None] + e - fpair[k]).ravel()
+
+    # Fock couplings, T_kj for R_ij through f_ik and T_ik through f_kj
+    sq = [numpy.dot(s, q) for q, e in bases]
+    nocc = foo.shape[0]
+    c_loc = [0]
+    c_pair = []
+    c_trans = []
+    c_f = []
+    ovlp = []
+    for k, (i, j) in enumerate(pairs):
+        for l in range(nocc):
+            if l != i and abs(foo[i,l]) > FOCK_TOL:
+                q = pair_id.get((max(l,j), min(l,j)))
+                if q is not None:
+                    c_pair.append(q)
+                    c_trans.append(l < j)
+                    c_f.append(foo[i,l])
+                    ovlp.append(numpy.dot(bases[k][0].T, sq[q]).ravel())
+            if l != j and abs(foo[l,j]) > FOCK_TOL:
+                q = pair_id.get((max(i,l), min(i,l)))
+                if q is not None:
+                    c_pair.append(q)
+                    c_trans.append(i < l)
+                    c_f.append(foo[l,j])
+                    ovlp.append(numpy.dot(bases[k][0].T, sq[q]).ravel())
+        c_loc.append(len(c_pair))
+    c_loc = numpy.asarray(c_loc, dtype=numpy.int32)
+    c_pair = numpy.asarray(c_pair, dtype=numpy.int32)
+    c_trans = numpy.asarray(c_trans, dtype=numpy.int32)
+    c_f = numpy.asarray(c_f, dtype=numpy.double)
+    s_loc = numpy.append(0, numpy.cumsum([x.size for x in ovlp])).astype(numpy.uint64)
+    if ovlp:
+        ovlp = numpy.hstack(ovlp)
+    else:
+        ovlp = numpy.zeros(1)
+    log.debug('LMP2 Fock couplings %d', c_pair.size)
+
+    def residual(t):
+        r = numpy.empty_like(t)
+        libmp.LMP2_residual(r.ctypes.data_as(ctypes.c_void_p),
+                            t.ctypes.data_as(ctypes.c_void_p),
+                            K.ctypes.data_as(ctypes.c_void_p),
+                            eps.ctypes.data_as(ctypes.c_void_p),
+                            fpair.ctypes.data_as(ctypes.c_void_p),
+                            dims.ctypes.data_as(ctypes.c_void_p),
+                            t_loc.ctypes.data_as(ctypes.c_void_p),
+                            e_loc.ctypes.data_as(ctypes.c_void_p),
+                            c_loc.ctypes.data_as(ctypes.c_void_p),
+                            c_pair.ctypes.data_as(ctypes.c_void_p),
+                            c_trans.ctypes.data_as(ctypes.c_void_p),
+                            c_f.ctypes.data_as(ctypes.c_void_p),
+                            ovlp.ctypes.data_as(ctypes.c_void_p),
+                            s_loc.ctypes.data_as(ctypes.c_void_p),
+                            ctypes.c_int(npair), ctypes.c_int(dims.max()))
+        return r
+
+    def energy(t):
+        e = 0
+        for k, (i, j) in enumerate(pairs):
+            n = dims[k]
+            tij = t[t_loc[k]:t_loc[k+1]].reshape(n,n)
+            kij = K[t_loc[k]:t_loc[k+1]].reshape(n,n)
+            eij = numpy.einsum('ab,ab', kij, tij*2 - tij.T)
+            if i == j:
+                e += eij
+            else:
+                e += eij * 2
+        return e
+
+    t = -K / denom
+    eold = 0
+    e = energy(t)
+    log.info('LMP2 init E_corr(strong pairs) = %.15g', e)
+    adiis = lib.diis.DIIS(mp)
+    for cycle in range(mp.max_cycle):
+        r = residual(t)
+        norm_r = numpy.linalg.norm(r)
+        t = adiis.update(t - r / denom)
+        eold, e = e, energy(t)
+        log.info('cycle = %d  E_corr(strong pairs) = %.15g  dE = %.9g  |r| = %.6g',
+                 cycle+1, e, e - eold, norm_r)
+        if abs(e - eold) < mp.conv_tol and norm_r < numpy.sqrt(mp.conv_tol):
+            break
+    else:
+        log.warn('LMP2 amplitudes not converged')
+    return e
+
+def _ao_data(mp):
+    '''AO overlap, AO Fock matrix, dipole integrals and the AO offsets of
+    the atoms'''
+    mol = mp.mol
+    s = mp._scf.get_ovlp()
+    mo = mp.mo_coeff
+    sc = numpy.dot(s, mo)
+    fock = numpy.dot(sc * mp.mo_energy, sc.T)
+    rints = mol.intor_symmetric('int1e_r', comp=3)
+    return s, fock, rints, mol.aoslice_by_atom()
+
+
+class LMP2(dfmp2.DFMP2):
+    '''Local DF-MP2 in the pair domains (prototype, O(N^3) integral steps)
+
+    Attributes:
+        threshold : float
+            The dipole estimate of the pair energy below which the pairs are
+            treated as distant pairs.  10*threshold is the Mulliken
+            population cutoff of the orbital domains.  Default is 1e-4.
+        localizer : str or callable
+            'boys', 'pm', 'er', None (the orbitals are not localized) or a
+            function localizer(mol, orbo) which returns localized orbitals.
+
+    Saved results:
+        pairs : list
+            The strong pairs (i,j), i >= j
+        e_corr_distant : float
+            The dipole estimate of the energy of the distant pairs
+    '''
+    def __init__(self, mf, frozen=0, mo_coeff=None, mo_occ=None):
+        dfmp2.DFMP2.__init__(self, mf, frozen, mo_coeff, mo_occ)
+        self.threshold = THRESHOLD
+        self.localizer = LOCALIZER
+        self.conv_tol = CONV_TOL
+        self.max_cycle = MAX_CYCLE
+        self.pairs = None
+        self.e_corr_distant = None
+        self._keys.update(['threshold', 'localizer', 'conv_tol', 'max_cycle',
+                           'pairs', 'e_corr_distant'])
+
+    def dump_flags(self):
+        dfmp2.DFMP2.dump_flags(self)
+        log = logger.Logger(self.stdout, self.verbose)
+        log.info('threshold = %g', self.threshold)
+        log.info('localizer = %s', self.localizer)
+        log.info('conv_tol = %g', self.conv_tol)
+        log.info('max_cycle = %d', self.max_cycle)
+        return self
+
+    def localize(self, orbo):
+        from pyscf import lo
+        if self.localizer is None:
+            return orbo
+        elif callable(self.localizer):
+            return self.localizer(self.mol, orbo)
+        name = self.localizer.lower()
+        if name == 'boys':
+            return lo.Boys(self.mol, orbo).kernel()
+        elif name in ('pm', 'pipek'):
+            return lo.PM(self.mol, orbo).kernel()
+        elif name in ('er', 'edmiston'):
+            return lo.ER(self.mol, orbo).kernel()
+        else:
+            raise KeyError('Unknown localizer %s' % self.localizer)
+
+    @lib.with_doc(mp2.MP2.kernel.__doc__)
+    def kernel(self, mo_energy=None, mo_coeff=None, eris=None, with_t2=False):
+        return mp2.MP2.kernel(self, mo_energy, mo_coeff, eris, with_t2, kernel)
+
+
+if __name__ == '__main__':
+    from pyscf import gto, scf
+    mol = gto.M(atom=[['H', (0, 0, i*1.8)] for i in range(20)],
+                basis='cc-pvdz', unit='bohr', verbose=4)
+    mf = scf.RHF(mol).density_fit().run()
+    e_ref = dfmp2.DFMP2(mf).kernel()[0]
+    for thresh in (1e-3, 1e-4, 1e-5):
+        pt = LMP2(mf)
+        pt.threshold = thresh
+        e = pt.kernel()[0]
+        print(thresh, len(pt.pairs), e, e - e_ref)
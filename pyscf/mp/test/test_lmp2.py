@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+# Copyright 2014-2018 The PySCF Developers. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+import numpy
+from pyscf import gto
+from pyscf import scf
+from pyscf.mp import dfmp2, lmp2
+
+mol = gto.Mole()
+mol.verbose = 7
+mol.output = '/dev/null'
+mol.atom = [
+    [8 , (0. , 0.     , 0.)],
+    [1 , (0. , -0.757 , 0.587)],
+    [1 , (0. , 0.757  , 0.587)]]
+mol.basis = 'cc-pvdz'
+mol.build()
+mf = scf.RHF(mol).density_fit('weigend')
+mf.conv_tol = 1e-12
+mf.kernel()
+
+def tearDownModule():
+    global mol, mf
+    mol.stdout.close()
+    del mol, mf
+
+
+class KnownValues(unittest.TestCase):
+    def test_full_domains(self):
+        e_ref = dfmp2.DFMP2(mf).kernel()[0]
+        pt = lmp2.LMP2(mf)
+        pt.threshold = 1e-9
+        pt.conv_tol = 1e-10
+        e = pt.kernel()[0]
+        self.assertEqual(len(pt.pairs), 15)
+        self.assertAlmostEqual(e, e_ref, 7)
+
+        pt.frozen = 1
+        pt.localizer = 'pm'
+        e = pt.kernel()[0]
+        self.assertAlmostEqual(e, dfmp2.DFMP2(mf, frozen=1).kernel()[0], 7)
+
+    def test_hydrogen_chain(self):
+        hchain = gto.M(atom=[['H', (0, 0, i*1.8)] for i in range(16)],
+                       basis='6-31g', unit='bohr', verbose=0)
+        mf1 = scf.RHF(hchain).density_fit().run()
+        e_ref = dfmp2.DFMP2(mf1).kernel()[0]
+        pt = lmp2.LMP2(mf1)
+        e = pt.kernel()[0]
+        self.assertTrue(len(pt.pairs) < 8*9//2)
+        self.assertAlmostEqual(e/e_ref, 1, 2)
+
+        pt.threshold = 1e-6
+        e1 = pt.kernel()[0]
+        self.assertTrue(abs(e1-e_ref) < abs(e-e_ref))
+
+
+if __name__ == "__main__":
+    print("Full Tests for local MP2")
+    unittest.main()
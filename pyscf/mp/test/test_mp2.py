@@ -167,6 +167,37 @@ class KnownValues(unittest.TestCase):
         e = pt.kernel()[0]
         self.assertAlmostEqual(e, -0.14708846352674113, 9)
 
+    def test_dfmp2_spin_components(self):
+        pt = mp.dfmp2.DFMP2(mf.density_fit('weigend'))
+        e = pt.kernel()[0]
+        self.assertAlmostEqual(e, -0.20425449198334983, 9)
+        self.assertAlmostEqual(pt.e_corr_os + pt.e_corr_ss, e, 12)
+
+        upt = mp.dfmp2.DFUMP2(scf.addons.convert_to_uhf(mf))
+        upt.with_df = pt.with_df
+        self.assertAlmostEqual(upt.kernel()[0], e, 9)
+        self.assertAlmostEqual(upt.e_corr_os, pt.e_corr_os, 9)
+        self.assertAlmostEqual(upt.e_corr_ss, pt.e_corr_ss, 9)
+
+        doo, dvv, gamma, Lov = mp.dfmp2._gamma_intermediates(pt)
+        nocc = pt.nocc
+        nvir = pt.nmo - nocc
+        eia = mf.mo_energy[:nocc,None] - mf.mo_energy[nocc:]
+        g = numpy.dot(Lov.T, Lov).reshape(nocc,nvir,nocc,nvir)
+        t2 = g.transpose(0,2,1,3) / lib.direct_sum('ia+jb->ijab', eia, eia)
+        ref = mp.mp2._gamma1_intermediates(pt, t2)
+        self.assertAlmostEqual(abs(doo - ref[0]).max(), 0, 12)
+        self.assertAlmostEqual(abs(dvv - ref[1]).max(), 0, 12)
+        t2 = t2 * 2 - t2.transpose(0,1,3,2)
+        ref = lib.einsum('ijab,Pjb->Pia', t2, Lov.reshape(-1,nocc,nvir))
+        self.assertAlmostEqual(abs(gamma - ref.reshape(gamma.shape)).max(), 0, 12)
+
+        # One occupied orbital in each pair block
+        pt.max_memory = 1
+        doo1, dvv1, gamma1 = mp.dfmp2._gamma_intermediates(pt)[:3]
+        self.assertAlmostEqual(abs(doo1 - doo).max(), 0, 12)
+        self.assertAlmostEqual(abs(dvv1 - dvv).max(), 0, 12)
+        self.assertAlmostEqual(abs(gamma1 - gamma).max(), 0, 12)
 
     def test_mp2_frozen(self):
         pt = mp.mp2.MP2(mf)
@@ -258,7 +289,7 @@ class KnownValues(unittest.TestCase):
         self.assertTrue(isinstance(mp.MP2(mf0), mp.mp2.RMP2))
         self.assertTrue(isinstance(mp.MP2(mf1), mp.ump2.UMP2))
         self.assertTrue(isinstance(mp.MP2(mf0.density_fit()), mp.dfmp2.DFMP2))
-        #self.assertTrue(isinstance(mp.MP2(mf1.density_fit()), mp.dfmp2.DFUMP2))
+        self.assertTrue(isinstance(mp.MP2(mf1.density_fit()), mp.dfmp2.DFUMP2))
         self.assertTrue(isinstance(mp.MP2(mf0.newton()), mp.mp2.RMP2))
         self.assertTrue(isinstance(mp.MP2(mf1.newton()), mp.ump2.UMP2))
 
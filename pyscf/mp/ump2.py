@@ -18,6 +18,7 @@ UMP2 with spatial integals
 '''
 
 import time
+import copy
 import numpy
 from pyscf import lib
 from pyscf import gto
@@ -317,6 +318,16 @@ class UMP2(mp2.MP2):
     make_rdm1 = make_rdm1
     make_rdm2 = make_rdm2
 
+    def density_fit(self, auxbasis=None, with_df=None):
+        from pyscf.mp import dfmp2
+        mymp = dfmp2.DFUMP2(self._scf, self.frozen, self.mo_coeff, self.mo_occ)
+        if with_df is not None:
+            mymp.with_df = with_df
+        if mymp.with_df.auxbasis != auxbasis:
+            mymp.with_df = copy.copy(mymp.with_df)
+            mymp.with_df.auxbasis = auxbasis
+        return mymp
+
     def nuc_grad_method(self):
         from pyscf.grad import ump2
         return ump2.Gradients(self)
@@ -1,6 +1,7 @@
 import sys
 import time
 import copy
+import ctypes
 import numpy
 from pyscf import lib
 from pyscf.gto import ATOM_OF, NPRIM_OF, PTR_EXP, PTR_COEFF
@@ -34,6 +35,15 @@ RHOG_HIGH_DERIV = getattr(__config__, 'pbc_df_fft_multi_grids_rhog_high_deriv',
 WITH_J = getattr(__config__, 'pbc_df_fft_multi_grids_with_j', True)
 J_IN_XC = getattr(__config__, 'pbc_df_fft_multi_grids_j_in_xc', False)
 
+# Collocate the Gamma point density in C.  Each primitive pair is placed on
+# the coarsest level of NLEVELS meshes that resolves it.  The cutoff energies
+# of two adjacent levels differ by KE_RATIO.
+NATIVE = getattr(__config__, 'pbc_df_fft_multi_grids_native', True)
+NLEVELS = getattr(__config__, 'pbc_df_fft_multi_grids_nlevels', 4)
+KE_RATIO = getattr(__config__, 'pbc_df_fft_multi_grids_ke_ratio', 3.)
+
+libdft = lib.load_library('libdft')
+
 def get_nuc(mydf, kpts=None):
     cell = mydf.cell
     if kpts is None:
@@ -185,6 +195,11 @@ def _eval_rhoG(mydf, dm_kpts, hermi=1, kpts=numpy.zeros((1,3)), deriv=0):
     dm_kpts = lib.asarray(dm_kpts, order='C')
     dms = _format_dms(dm_kpts, kpts)
     nset, nkpts, nao = dms.shape[:3]
+    is_hermi = abs(dms - dms.transpose(0,1,3,2).conj()).max() < 1e-9
+
+    if (deriv == 0 and is_hermi and gamma_point(kpts) and
+        getattr(mydf, 'native', NATIVE) and _native_supported(cell)):
+        return _eval_rhoG_native(mydf, dms[:,0].real)
 
     tasks = getattr(mydf, 'tasks', None)
     if tasks is None:
@@ -192,7 +207,7 @@ def _eval_rhoG(mydf, dm_kpts, hermi=1, kpts=numpy.zeros((1,3)), deriv=0):
         log.debug('Multigrid ntasks %s', len(tasks))
 
     assert(deriv <= 2)
-    if abs(dms - dms.transpose(0,1,3,2).conj()).max() < 1e-9:
+    if is_hermi:
         def dot_bra(bra, aodm):
             rho  = numpy.einsum('pi,pi->p', bra.real, aodm.real)
             if aodm.dtype == numpy.complex:
@@ -303,6 +318,72 @@ def _eval_rhoG(mydf, dm_kpts, hermi=1, kpts=numpy.zeros((1,3)), deriv=0):
     return rhoG.reshape(nset,rhodim,ngrids0)
 
 
+def _native_supported(cell):
+    return cell.dimension == 3
+
+def _native_levels(mydf):
+    levels = getattr(mydf, 'levels', None)
+    if levels is None:
+        mydf.levels = levels = multi_grids_levels(mydf.cell)
+    return levels
+
+def _native_drv(drv, mydf, out, inp, nset, meshes, ke_cutoffs):
+    cell = mydf.cell
+    nlevels = len(meshes)
+    a = numpy.asarray(cell.lattice_vectors(), order='C')
+    b = numpy.asarray(numpy.linalg.inv(a.T), order='C')
+    ao_loc = numpy.asarray(cell.ao_loc_nr(cart=True), dtype=numpy.int32)
+    log_prec = numpy.log(cell.precision * EXTRA_PREC)
+    npairs = numpy.zeros(nlevels, dtype=numpy.int32)
+    drv(out.ctypes.data_as(ctypes.c_void_p),
+        inp.ctypes.data_as(ctypes.c_void_p),
+        ctypes.c_int(nset), ctypes.c_int(1), ctypes.c_int(nlevels),
+        meshes.ctypes.data_as(ctypes.c_void_p),
+        ke_cutoffs.ctypes.data_as(ctypes.c_void_p),
+        npairs.ctypes.data_as(ctypes.c_void_p),
+        ctypes.c_double(log_prec), ctypes.c_int(cell.dimension),
+        a.ctypes.data_as(ctypes.c_void_p), b.ctypes.data_as(ctypes.c_void_p),
+        (ctypes.c_int*2)(0, cell.nbas), ao_loc.ctypes.data_as(ctypes.c_void_p),
+        cell._atm.ctypes.data_as(ctypes.c_void_p), ctypes.c_int(cell.natm),
+        cell._bas.ctypes.data_as(ctypes.c_void_p), ctypes.c_int(cell.nbas),
+        cell._env.ctypes.data_as(ctypes.c_void_p))
+    return npairs
+
+def _eval_rhoG_native(mydf, dms):
+    '''Gamma point density of hermitian density matrices.  The density of
+    each level is collocated in C then merged on cell.mesh in reciprocal space.
+    '''
+    log = lib.logger.Logger(mydf.stdout, mydf.verbose)
+    cell = mydf.cell
+    nset = dms.shape[0]
+    if not cell.cart:
+        c2s = cell.cart2sph_coeff()
+        dms = lib.einsum('pi,nij,qj->npq', c2s, dms, c2s)
+    dms = numpy.asarray(dms, order='C')
+
+    meshes, ke_cutoffs = _native_levels(mydf)
+    ngrids = numpy.prod(meshes, axis=1)
+    rho = numpy.zeros((nset,ngrids.sum()))
+    npairs = _native_drv(libdft.NUMINT_rho_multigrid, mydf, rho, dms, nset,
+                         meshes, ke_cutoffs)
+
+    nx, ny, nz = cell.mesh
+    rhoG = numpy.zeros((nset,nx,ny,nz), dtype=numpy.complex128)
+    p1 = 0
+    for mesh, ngrids0, n in zip(meshes, ngrids, npairs):
+        log.debug('mesh %s, ngrids %s, pGTO pairs %d', mesh, ngrids0, n)
+        p0, p1 = p1, p1 + ngrids0
+        if n == 0:
+            continue
+        gx = numpy.fft.fftfreq(mesh[0], 1./mesh[0]).astype(int)
+        gy = numpy.fft.fftfreq(mesh[1], 1./mesh[1]).astype(int)
+        gz = numpy.fft.fftfreq(mesh[2], 1./mesh[2]).astype(int)
+        rho_freq = tools.fft(rho[:,p0:p1], mesh) * cell.vol/ngrids0
+        for i in range(nset):
+            rhoG[i,gx[:,None,None],gy[:,None],gz] += rho_freq[i].reshape(mesh)
+    return rhoG.reshape(nset,1,-1)
+
+
 def _get_j_pass2(mydf, vG, kpts=numpy.zeros((1,3))):
     log = lib.logger.Logger(mydf.stdout, mydf.verbose)
     cell = mydf.cell
@@ -312,6 +393,11 @@ def _get_j_pass2(mydf, vG, kpts=numpy.zeros((1,3))):
     vG = vG.reshape(-1,nx,ny,nz)
     nset = vG.shape[0]
 
+    if (gamma_point(kpts) and getattr(mydf, 'native', NATIVE) and
+        _native_supported(cell)):
+        vj = _get_j_pass2_native(mydf, vG)
+        return vj.reshape(nset,nkpts,nao,nao)
+
     tasks = getattr(mydf, 'tasks', None)
     if tasks is None:
         mydf.tasks = tasks = multi_grids_tasks(cell, log)
@@ -366,6 +452,37 @@ def _get_j_pass2(mydf, vG, kpts=numpy.zeros((1,3))):
     return vj_kpts
 
 
+def _get_j_pass2_native(mydf, vG):
+    '''Gamma point Coulomb matrices.  The potential is transformed to the
+    real space of each level and integrated with the GTO pairs in C.
+    '''
+    log = lib.logger.Logger(mydf.stdout, mydf.verbose)
+    cell = mydf.cell
+    nx, ny, nz = cell.mesh
+    vG = vG.reshape(-1,nx,ny,nz)
+    nset = vG.shape[0]
+
+    meshes, ke_cutoffs = _native_levels(mydf)
+    vR = []
+    for mesh in meshes:
+        gx = numpy.fft.fftfreq(mesh[0], 1./mesh[0]).astype(int)
+        gy = numpy.fft.fftfreq(mesh[1], 1./mesh[1]).astype(int)
+        gz = numpy.fft.fftfreq(mesh[2], 1./mesh[2]).astype(int)
+        sub_vG = vG[:,gx[:,None,None],gy[:,None],gz].reshape(nset,-1)
+        vR.append(tools.ifft(sub_vG, mesh).real.reshape(nset,-1))
+    vR = numpy.asarray(numpy.hstack(vR), order='C')
+
+    nao = cell.nao_nr(cart=True)
+    vj = numpy.zeros((nset,nao,nao))
+    npairs = _native_drv(libdft.NUMINT_vmat_multigrid, mydf, vj, vR, nset,
+                         meshes, ke_cutoffs)
+    log.debug('pGTO pairs of each level %s', npairs)
+    if not cell.cart:
+        c2s = cell.cart2sph_coeff()
+        vj = lib.einsum('pi,npq,qj->nij', c2s, vj, c2s)
+    return vj
+
+
 def rks_j_xc(mydf, dm_kpts, xc_code, hermi=1, kpts=numpy.zeros((1,3)),
              kpts_band=None, with_j=WITH_J, j_in_xc=J_IN_XC):
     log = lib.logger.Logger(mydf.stdout, mydf.verbose)
@@ -498,7 +615,12 @@ def rks_j_xc(mydf, dm_kpts, xc_code, hermi=1, kpts=numpy.zeros((1,3)),
         veff = numpy.zeros((nset,nkpts,nao,nao), dtype=numpy.complex128)
         vj = numpy.zeros((nset,nkpts,nao,nao), dtype=numpy.complex128)
 
-    for grids_high, grids_low in mydf.tasks:
+    tasks = getattr(mydf, 'tasks', None)
+    if tasks is None:
+        mydf.tasks = tasks = multi_grids_tasks(cell, log)
+        log.debug('Multigrid ntasks %s', len(tasks))
+
+    for grids_high, grids_low in tasks:
         cell_high = grids_high.cell
         mesh = grids_high.mesh
         coords_idx = grids_high.coords_idx
@@ -719,7 +841,12 @@ def uks_j_xc(mydf, dm_kpts, xc_code, hermi=1, kpts=numpy.zeros((1,3)),
         veff = numpy.zeros((2,nkpts,nao,nao), dtype=numpy.complex128)
         vj = numpy.zeros((2,nkpts,nao,nao), dtype=numpy.complex128)
 
-    for grids_high, grids_low in mydf.tasks:
+    tasks = getattr(mydf, 'tasks', None)
+    if tasks is None:
+        mydf.tasks = tasks = multi_grids_tasks(cell, log)
+        log.debug('Multigrid ntasks %s', len(tasks))
+
+    for grids_high, grids_low in tasks:
         cell_high = grids_high.cell
         mesh = grids_high.mesh
         coords_idx = grids_high.coords_idx
@@ -935,6 +1062,25 @@ def multi_grids_tasks(cell, verbose=None):
             break
     return tasks
 
+def multi_grids_levels(cell, nlevels=NLEVELS, ke_ratio=KE_RATIO):
+    '''Meshes and the associated kinetic energy cutoffs of the multigrid
+    levels, from the coarsest level to the finest level (cell.mesh).
+    '''
+    a = cell.lattice_vectors()
+    meshes = [numpy.asarray(cell.mesh)]
+    ke_cutoff = tools.mesh_to_cutoff(a, cell.mesh).min()
+    for i in range(1, nlevels):
+        mesh = tools.cutoff_to_mesh(a, ke_cutoff / ke_ratio**i)
+        if TO_EVEN_GRIDS:
+            mesh = (mesh+1)//2 * 2
+        mesh = numpy.min([mesh, meshes[-1]], axis=0)
+        if numpy.all(mesh == meshes[-1]):
+            break
+        meshes.append(mesh)
+    meshes = numpy.asarray(meshes[::-1], dtype=numpy.int32)
+    ke_cutoffs = numpy.asarray([tools.mesh_to_cutoff(a, m).min() for m in meshes])
+    return meshes, ke_cutoffs
+
 def _primitive_gto_cutoff(cell):
     '''Cutoff raidus, above which each shell decays to a value less than the
     required precsion'''
@@ -963,10 +1109,13 @@ class MultiGridFFTDF(fft.FFTDF):
     def __init__(self, cell, kpts=numpy.zeros((1,3))):
         fft.FFTDF.__init__(self, cell, kpts)
         self.tasks = None
-        self._keys = self._keys.union(['tasks'])
+        self.levels = None
+        self.native = NATIVE
+        self._keys = self._keys.union(['tasks', 'levels', 'native'])
 
     def build(self):
         self.tasks = multi_grids_tasks(self.cell)
+        self.levels = multi_grids_levels(self.cell)
 
     get_pp = get_pp
     get_nuc = get_nuc
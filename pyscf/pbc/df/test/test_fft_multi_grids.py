@@ -64,6 +64,41 @@ class KnownValues(unittest.TestCase):
         self.assertAlmostEqual(abs(ref-v).max(), 0, 8)
         self.assertAlmostEqual(lib.finger(v), 0.21963596743261393, 8)
 
+    def test_get_j_gamma_native(self):
+        dm0 = dm[0].real
+        mydf = df.FFTDF(cell)
+        ref = fft_jk.get_j_kpts(mydf, dm0)
+        mydf = fft_multi_grids.MultiGridFFTDF(cell)
+        v = mydf.get_j_kpts(dm0)
+        self.assertTrue(len(mydf.levels[0]) > 1)
+        self.assertAlmostEqual(abs(ref-v).max(), 0, 7)
+
+        rhoG = fft_multi_grids._eval_rhoG(mydf, dm0)
+        mydf.native = False
+        ref = fft_multi_grids._eval_rhoG(mydf, dm0)
+        self.assertAlmostEqual(abs(ref-rhoG).max(), 0, 7)
+
+        ref = mydf.get_j_kpts(dm0)
+        self.assertAlmostEqual(abs(ref-v).max(), 0, 7)
+
+    def test_get_j_gamma_native_nonorth(self):
+        cell1 = gto.M(
+            a = [[4., 0., 0.], [.8, 3.8, 0.], [-.5, .6, 4.1]],
+            atom = '''C     0.      0.      0.
+                      C     0.8917  0.8917  0.8917 ''',
+            basis = 'gth-dzvp',
+            pseudo = 'gth-pade',
+            verbose = 0,
+        )
+        numpy.random.seed(2)
+        dm1 = numpy.random.random((2,cell1.nao_nr(),cell1.nao_nr()))
+        dm1 = dm1 + dm1.transpose(0,2,1)
+        mydf = df.FFTDF(cell1)
+        ref = fft_jk.get_j_kpts(mydf, dm1)
+        mydf = fft_multi_grids.MultiGridFFTDF(cell1)
+        v = mydf.get_j_kpts(dm1)
+        self.assertAlmostEqual(abs(ref-v).max(), 0, 7)
+
     def test_rks_lda(self):
         mydf = df.FFTDF(cell)
         mydf.grids.build()